@@ -54,6 +54,7 @@
 #include <sys/stat.h>
 #include <sys/resource.h>
 #include <sys/dmu_traverse.h>
+#include <sys/ddt.h>
 #include <sys/zio_checksum.h>
 #include <sys/zio_compress.h>
 #undef ZFS_MAXNAMELEN
@@ -860,6 +861,32 @@ dump_bplist(objset_t *mos, uint64_t object, char *name)
 	mutex_destroy(&bpl.bpl_lock);
 }
 
+static void
+dump_ddt(spa_t *spa)
+{
+	ddt_stat_t dds;
+	char asize[6], saved[6];
+	int error;
+
+	if ((error = ddt_get_stats(spa, &dds)) != 0) {
+		(void) printf("\n    Dedup table: error %d\n", error);
+		return;
+	}
+	if (dds.dds_entries == 0)
+		return;
+
+	nicenum(dds.dds_asize, asize);
+	nicenum(dds.dds_ref_asize - dds.dds_asize, saved);
+	(void) printf("\n    Dedup table: %llu entries, %llu references, "
+	    "%s allocated, %s saved\n",
+	    (u_longlong_t)dds.dds_entries, (u_longlong_t)dds.dds_refs,
+	    asize, saved);
+	(void) printf("\tdedup ratio (referenced/allocated): %.2fx\t"
+	    "duplicate references: %.2f%%\n",
+	    (double)dds.dds_ref_asize / dds.dds_asize,
+	    100.0 * (dds.dds_refs - dds.dds_entries) / dds.dds_refs);
+}
+
 /*ARGSUSED*/
 static void
 dump_znode(objset_t *os, uint64_t object, void *data, size_t size)
@@ -1431,25 +1458,70 @@ typedef struct zdb_cb {
 	traverse_blk_cache_t *zcb_cache;
 	int		zcb_readfails;
 	int		zcb_haderrors;
+	avl_tree_t	zcb_dedup;	/* deduplicated blocks seen so far */
 } zdb_cb_t;
 
+typedef struct zdb_dedup {
+	avl_node_t	zd_node;
+	dva_t		zd_dva;
+} zdb_dedup_t;
+
+static int
+zdb_dedup_compare(const void *x1, const void *x2)
+{
+	const dva_t *dva1 = &((zdb_dedup_t *)x1)->zd_dva;
+	const dva_t *dva2 = &((zdb_dedup_t *)x2)->zd_dva;
+
+	if (DVA_GET_VDEV(dva1) < DVA_GET_VDEV(dva2))
+		return (-1);
+	if (DVA_GET_VDEV(dva1) > DVA_GET_VDEV(dva2))
+		return (1);
+	if (DVA_GET_OFFSET(dva1) < DVA_GET_OFFSET(dva2))
+		return (-1);
+	if (DVA_GET_OFFSET(dva1) > DVA_GET_OFFSET(dva2))
+		return (1);
+	return (0);
+}
+
+/*
+ * Deduplicated blocks are referenced by more than one block pointer,
+ * but are only allocated once.  Returns B_TRUE if we've seen this one.
+ */
+static boolean_t
+zdb_dedup_seen(zdb_cb_t *zcb, blkptr_t *bp)
+{
+	zdb_dedup_t *zd, search;
+	avl_index_t where;
+
+	search.zd_dva = *BP_IDENTITY(bp);
+	if (avl_find(&zcb->zcb_dedup, &search, &where) != NULL)
+		return (B_TRUE);
+
+	zd = umem_alloc(sizeof (zdb_dedup_t), UMEM_NOFAIL);
+	zd->zd_dva = search.zd_dva;
+	avl_insert(&zcb->zcb_dedup, zd, where);
+	return (B_FALSE);
+}
+
 static void
 zdb_count_block(spa_t *spa, zdb_cb_t *zcb, blkptr_t *bp, int type)
 {
 	int i, error;
+	boolean_t dup = (BP_GET_DEDUP(bp) && zdb_dedup_seen(zcb, bp));
 
 	for (i = 0; i < 4; i++) {
 		int l = (i < 2) ? BP_GET_LEVEL(bp) : ZB_TOTAL;
 		int t = (i & 1) ? type : DMU_OT_TOTAL;
 		zdb_blkstats_t *zb = &zcb->zcb_type[l][t];
 
-		zb->zb_asize += BP_GET_ASIZE(bp);
+		if (!dup)
+			zb->zb_asize += BP_GET_ASIZE(bp);
 		zb->zb_lsize += BP_GET_LSIZE(bp);
 		zb->zb_psize += BP_GET_PSIZE(bp);
 		zb->zb_count++;
 	}
 
-	if (dump_opt['L'])
+	if (dump_opt['L'] || dup)
 		return;
 
 	error = zdb_space_map_claim(spa, bp, &zcb->zcb_cache->bc_bookmark);
@@ -1534,8 +1606,12 @@ dump_block_stats(spa_t *spa)
 	int leaks = 0;
 	int advance = zdb_advance;
 	int c, e, flags;
+	zdb_dedup_t *zd;
+	void *cookie = NULL;
 
 	zcb.zcb_cache = &dummy_cache;
+	avl_create(&zcb.zcb_dedup, zdb_dedup_compare, sizeof (zdb_dedup_t),
+	    offsetof(zdb_dedup_t, zd_node));
 
 	if (dump_opt['c'])
 		advance |= ADVANCE_DATA;
@@ -1597,6 +1673,48 @@ dump_block_stats(spa_t *spa)
 
 	traverse_fini(th);
 
+	/*
+	 * Destroyed datasets that are still being freed aren't reachable
+	 * from the pool, but the part not yet freed is still allocated.
+	 * Their resume points are in post-order, so traverse them that way.
+	 */
+	if (spa->spa_dsl_pool->dp_free_pending_obj != 0) {
+		objset_t *mos = spa->spa_meta_objset;
+		uint64_t fpobj = spa->spa_dsl_pool->dp_free_pending_obj;
+		dsl_free_pending_phys_t fp;
+		zap_cursor_t zc;
+		zap_attribute_t za;
+		zbookmark_t zbm, *zbp;
+
+		th = traverse_init(spa, zdb_blkptr_cb, &zcb,
+		    (advance & ADVANCE_DATA) | ADVANCE_POST, flags);
+		th->th_noread = zdb_noread;
+
+		for (zap_cursor_init(&zc, mos, fpobj);
+		    zap_cursor_retrieve(&zc, &za) == 0;
+		    zap_cursor_advance(&zc)) {
+			VERIFY(0 == zap_lookup(mos, fpobj, za.za_name,
+			    sizeof (uint64_t), sizeof (fp) / sizeof (uint64_t),
+			    &fp));
+			zbp = NULL;
+			if (fp.fp_level != ZB_NO_LEVEL) {
+				zbm.zb_objset = fp.fp_dsobj;
+				zbm.zb_object = fp.fp_object;
+				zbm.zb_level = fp.fp_level;
+				zbm.zb_blkid = fp.fp_blkid;
+				zbp = &zbm;
+			}
+			traverse_add_destroyed_objset(th, fp.fp_mintxg,
+			    fp.fp_dsobj, &fp.fp_bp, zbp);
+		}
+		zap_cursor_fini(&zc);
+
+		while (traverse_more(th) == EAGAIN)
+			continue;
+
+		traverse_fini(th);
+	}
+
 	if (zcb.zcb_haderrors) {
 		(void) printf("\nError counts:\n\n");
 		(void) printf("\t%5s  %s\n", "errno", "count");
@@ -1608,6 +1726,10 @@ dump_block_stats(spa_t *spa)
 		}
 	}
 
+	while ((zd = avl_destroy_nodes(&zcb.zcb_dedup, &cookie)) != NULL)
+		umem_free(zd, sizeof (zdb_dedup_t));
+	avl_destroy(&zcb.zcb_dedup);
+
 	/*
 	 * Report any leaked segments.
 	 */
@@ -1753,6 +1875,7 @@ dump_zpool(spa_t *spa)
 		if (dump_opt['d'] >= 3) {
 			dump_bplist(dp->dp_meta_objset,
 			    spa->spa_sync_bplist_obj, "Deferred frees");
+			dump_ddt(spa);
 			dump_dtl(spa->spa_root_vdev, 0);
 			dump_metaslabs(spa);
 		}
@@ -220,9 +220,9 @@ get_usage(zfs_help_t idx)
 	case HELP_PROMOTE:
 		return (gettext("\tpromote <clone-filesystem>\n"));
 	case HELP_RECEIVE:
-		return (gettext("\treceive [-vnF] <filesystem|volume|"
+		return (gettext("\treceive [-vnFs] <filesystem|volume|"
 		"snapshot>\n"
-		"\treceive [-vnF] -d <filesystem>\n"));
+		"\treceive [-vnFs] -d <filesystem>\n"));
 	case HELP_RENAME:
 		return (gettext("\trename <filesystem|volume|snapshot> "
 		    "<filesystem|volume|snapshot>\n"
@@ -231,7 +231,8 @@ get_usage(zfs_help_t idx)
 	case HELP_ROLLBACK:
 		return (gettext("\trollback [-rRf] <snapshot>\n"));
 	case HELP_SEND:
-		return (gettext("\tsend [-i snapshot] <snapshot>\n"));
+		return (gettext("\tsend [-cD] [-i snapshot] <snapshot>\n"
+		    "\tsend -t <token> [-i snapshot] <snapshot>\n"));
 	case HELP_SET:
 		return (gettext("\tset <property=value> "
 		    "<filesystem|volume> ...\n"));
@@ -2174,7 +2175,13 @@ zfs_do_snapshot(int argc, char **argv)
 }
 
 /*
- * zfs send [-i <@snap>] <fs@snap>
+ * zfs send [-cD] [-i <@snap>] <fs@snap>
+ * zfs send -t <token> [-i <@snap>] <fs@snap>
+ *
+ *	-c	Send compressed blocks without decompressing them.
+ *	-D	Send blocks repeated in the stream by reference.
+ *	-t	Send the rest of an interrupted resumable receive, given
+ *		its receive_resume_token.
  *
  * Send a backup stream to stdout.
  */
@@ -2184,16 +2191,28 @@ zfs_do_send(int argc, char **argv)
 	char *fromname = NULL;
 	char *cp;
 	zfs_handle_t *zhp;
+	boolean_t compressed = B_FALSE;
+	boolean_t dedup = B_FALSE;
+	char *resumetok = NULL;
 	int c, err;
 
 	/* check options */
-	while ((c = getopt(argc, argv, ":i:")) != -1) {
+	while ((c = getopt(argc, argv, ":cDi:t:")) != -1) {
 		switch (c) {
+		case 'c':
+			compressed = B_TRUE;
+			break;
+		case 'D':
+			dedup = B_TRUE;
+			break;
 		case 'i':
 			if (fromname)
 				usage(B_FALSE);
 			fromname = optarg;
 			break;
+		case 't':
+			resumetok = optarg;
+			break;
 		case ':':
 			(void) fprintf(stderr, gettext("missing argument for "
 			    "'%c' option\n"), optopt);
@@ -2219,6 +2238,13 @@ zfs_do_send(int argc, char **argv)
 		usage(B_FALSE);
 	}
 
+	/* a resumed send takes its stream options from the token */
+	if (resumetok && (compressed || dedup)) {
+		(void) fprintf(stderr, gettext("-c and -D can not be used "
+		    "with -t\n"));
+		usage(B_FALSE);
+	}
+
 	if (isatty(STDOUT_FILENO)) {
 		(void) fprintf(stderr,
 		    gettext("Error: Stream can not be written to a terminal.\n"
@@ -2249,14 +2275,18 @@ zfs_do_send(int argc, char **argv)
 		}
 	}
 
-	err = zfs_send(zhp, fromname, STDOUT_FILENO);
+	err = zfs_send(zhp, fromname, compressed, dedup, resumetok,
+	    STDOUT_FILENO);
 	zfs_close(zhp);
 
 	return (err != 0);
 }
 
 /*
- * zfs receive <fs@snap>
+ * zfs receive [-vnFs] <fs@snap>
+ *
+ *	-s	If interrupted, keep what was received so far, so that the
+ *		rest can be sent with 'zfs send -t'.
  *
  * Restore a backup stream from stdin.
  */
@@ -2268,9 +2298,10 @@ zfs_do_receive(int argc, char **argv)
 	boolean_t dryrun = B_FALSE;
 	boolean_t verbose = B_FALSE;
 	boolean_t force = B_FALSE;
+	boolean_t resumable = B_FALSE;
 
 	/* check options */
-	while ((c = getopt(argc, argv, ":dnvF")) != -1) {
+	while ((c = getopt(argc, argv, ":dnvFs")) != -1) {
 		switch (c) {
 		case 'd':
 			isprefix = B_TRUE;
@@ -2284,6 +2315,9 @@ zfs_do_receive(int argc, char **argv)
 		case 'F':
 			force = B_TRUE;
 			break;
+		case 's':
+			resumable = B_TRUE;
+			break;
 		case ':':
 			(void) fprintf(stderr, gettext("missing argument for "
 			    "'%c' option\n"), optopt);
@@ -2318,7 +2352,7 @@ zfs_do_receive(int argc, char **argv)
 	}
 
 	err = zfs_receive(g_zfs, argv[0], isprefix, verbose, dryrun, force,
-	    STDIN_FILENO);
+	    resumable, STDIN_FILENO);
 
 	return (err != 0);
 }
@@ -0,0 +1,671 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2008 Sun Microsystems, Inc.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+#pragma ident	"%Z%%M%	%I%	%E% SMI"
+
+/*
+ * znbd serves a volume over the NBD protocol on a Unix domain socket,
+ * using the userland volume engine in libzpool, or with -b drives the
+ * engine directly for a fixed time and reports IOPS and latency.
+ *
+ * The pool is opened from the cached configuration like zdb does, so
+ * it must not be imported by the kernel at the same time.  Only the
+ * fixed newstyle handshake with NBD_OPT_EXPORT_NAME is supported; the
+ * export name is ignored.  Connections are served one at a time, each
+ * with as many requests in flight as the engine's queue allows.  Reads
+ * are sent straight from the ARC with UZVOL_LOAN unless -c asks for
+ * them to be copied, which is mostly useful for comparing the two.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/zfs_context.h>
+#include <sys/spa.h>
+#include <sys/dmu.h>
+#include <sys/zvol.h>
+#include <sys/fs/zfs.h>
+#include <sys/byteorder.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+const char cmdname[] = "znbd";
+
+#define	NBD_INIT_MAGIC		0x4e42444d41474943ULL	/* "NBDMAGIC" */
+#define	NBD_OPTS_MAGIC		0x49484156454f5054ULL	/* "IHAVEOPT" */
+#define	NBD_REP_MAGIC		0x0003e889045565a9ULL
+#define	NBD_REQUEST_MAGIC	0x25609513
+#define	NBD_REPLY_MAGIC		0x67446698
+
+#define	NBD_FLAG_FIXED_NEWSTYLE	0x1	/* handshake flags */
+#define	NBD_FLAG_NO_ZEROES	0x2
+
+#define	NBD_OPT_EXPORT_NAME	1
+#define	NBD_OPT_ABORT		2
+#define	NBD_REP_ACK		1
+#define	NBD_REP_ERR_UNSUP	0x80000001
+
+#define	NBD_FLAG_HAS_FLAGS	0x1	/* transmission flags */
+#define	NBD_FLAG_READ_ONLY	0x2
+#define	NBD_FLAG_SEND_FLUSH	0x4
+#define	NBD_FLAG_SEND_FUA	0x8
+
+#define	NBD_CMD_READ		0
+#define	NBD_CMD_WRITE		1
+#define	NBD_CMD_DISC		2
+#define	NBD_CMD_FLUSH		3
+#define	NBD_CMD_FLAG_FUA	0x1
+
+#define	NBD_EPERM		1	/* NBD uses Linux errno values */
+#define	NBD_EIO			5
+#define	NBD_ENOMEM		12
+#define	NBD_EINVAL		22
+#define	NBD_ENOSPC		28
+
+#define	ZNBD_MAXOPTLEN		4096
+#define	ZNBD_MAXIOLEN		(32 << 20)
+
+extern int uzvol_queue_depth;
+
+typedef struct znbd_stat {
+	uint64_t	zs_ops;
+	uint64_t	zs_bytes;
+	hrtime_t	zs_time;	/* total latency */
+	hrtime_t	zs_max;		/* worst latency */
+} znbd_stat_t;
+
+static kmutex_t znbd_stat_lock;
+static znbd_stat_t znbd_stats[UZVOL_FLUSH + 1];
+static const char *znbd_stat_names[UZVOL_FLUSH + 1] = {
+	"read", "write", "flush"
+};
+
+typedef struct znbd_conn {
+	int		zc_fd;
+	kmutex_t	zc_lock;	/* orders replies; protects below */
+	kcondvar_t	zc_cv;		/* wait for zc_inflight to drain */
+	int		zc_inflight;	/* requests not yet replied to */
+	int		zc_error;	/* a reply couldn't be sent */
+} znbd_conn_t;
+
+typedef struct znbd_req {
+	uzvol_req_t	zr_req;
+	znbd_conn_t	*zr_conn;	/* NULL for -b */
+	uint8_t		zr_handle[8];	/* opaque, echoed in the reply */
+	hrtime_t	zr_start;
+} znbd_req_t;
+
+static int verbose;
+static int copyreads;
+
+static void
+usage(void)
+{
+	(void) fprintf(stderr,
+	    "Usage: %s [-cv] [-t threads] [-q depth] [-C size] "
+	    "volume socket\n"
+	    "       %s [-cv] [-t threads] [-q depth] [-C size] -b seconds "
+	    "[-s iosize] [-w write%%] volume\n", cmdname, cmdname);
+	(void) fprintf(stderr, "	-t threads to run requests\n");
+	(void) fprintf(stderr, "	-q requests in flight per thread\n");
+	(void) fprintf(stderr, "	-C create the volume with this size\n");
+	(void) fprintf(stderr, "	-b benchmark for this many seconds\n");
+	(void) fprintf(stderr, "	-s benchmark I/O size (default 4k)\n");
+	(void) fprintf(stderr, "	-w percentage of benchmark writes\n");
+	(void) fprintf(stderr, "	-c copy reads, do not lend them\n");
+	(void) fprintf(stderr, "	-v print statistics\n");
+	exit(1);
+}
+
+static void
+fatal(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	(void) fprintf(stderr, "%s: ", cmdname);
+	(void) vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	(void) fprintf(stderr, "\n");
+
+	exit(1);
+}
+
+static uint64_t
+znbd_parse_size(const char *str)
+{
+	char *end;
+	uint64_t val = strtoull(str, &end, 0);
+
+	switch (*end) {
+	case 'g': case 'G':
+		val <<= 10;
+		/* FALLTHROUGH */
+	case 'm': case 'M':
+		val <<= 10;
+		/* FALLTHROUGH */
+	case 'k': case 'K':
+		val <<= 10;
+		end++;
+		break;
+	}
+	if (*end != '\0' || val == 0)
+		fatal("bad size '%s'", str);
+	return (val);
+}
+
+static int
+znbd_read(int fd, void *buf, size_t len)
+{
+	char *p = buf;
+	ssize_t n;
+
+	while (len != 0) {
+		n = read(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return (n == 0 ? ECONNRESET : errno);
+		p += n;
+		len -= n;
+	}
+	return (0);
+}
+
+static int
+znbd_write(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t n;
+
+	while (len != 0) {
+		n = write(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return (errno);
+		p += n;
+		len -= n;
+	}
+	return (0);
+}
+
+static uint32_t
+znbd_errno(int error)
+{
+	switch (error) {
+	case 0:
+		return (0);
+	case EROFS:
+	case EPERM:
+		return (NBD_EPERM);
+	case EINVAL:
+		return (NBD_EINVAL);
+	case ENOSPC:
+		return (NBD_ENOSPC);
+	case ENOMEM:
+		return (NBD_ENOMEM);
+	default:
+		return (NBD_EIO);
+	}
+}
+
+static void
+znbd_stat_update(uzvol_req_t *req, hrtime_t start)
+{
+	znbd_stat_t *zs = &znbd_stats[req->uzr_op];
+	hrtime_t delta = gethrtime() - start;
+
+	mutex_enter(&znbd_stat_lock);
+	zs->zs_ops++;
+	zs->zs_bytes += req->uzr_length;
+	zs->zs_time += delta;
+	if (delta > zs->zs_max)
+		zs->zs_max = delta;
+	mutex_exit(&znbd_stat_lock);
+}
+
+static void
+znbd_stat_print(hrtime_t elapsed)
+{
+	znbd_stat_t *zs;
+	int op;
+
+	elapsed = MAX(elapsed, 1);
+	mutex_enter(&znbd_stat_lock);
+	for (op = 0; op <= UZVOL_FLUSH; op++) {
+		zs = &znbd_stats[op];
+		if (zs->zs_ops == 0)
+			continue;
+		(void) printf("%-6s %10llu ops %8llu ops/s %8llu KB/s "
+		    "%8llu us avg %8llu us max\n", znbd_stat_names[op],
+		    (u_longlong_t)zs->zs_ops,
+		    (u_longlong_t)(zs->zs_ops * NANOSEC / elapsed),
+		    (u_longlong_t)(zs->zs_bytes * (NANOSEC >> 10) / elapsed),
+		    (u_longlong_t)(zs->zs_time / zs->zs_ops / 1000),
+		    (u_longlong_t)(zs->zs_max / 1000));
+	}
+	bzero(znbd_stats, sizeof (znbd_stats));
+	mutex_exit(&znbd_stat_lock);
+}
+
+static void
+znbd_req_free(znbd_req_t *zr)
+{
+	uzvol_loan_rele(&zr->zr_req);
+	if (zr->zr_req.uzr_length != 0 && zr->zr_req.uzr_data != NULL)
+		umem_free(zr->zr_req.uzr_data, zr->zr_req.uzr_length);
+	umem_free(zr, sizeof (znbd_req_t));
+}
+
+/*
+ * Request completion, on the engine's taskq: send the reply (and the
+ * data, for a successful read) in one piece under zc_lock.  If that
+ * fails the client can't make sense of anything more we send, so shut
+ * the connection down, which also ends znbd_serve()'s read loop.
+ */
+static void
+znbd_done(uzvol_req_t *req)
+{
+	znbd_req_t *zr = req->uzr_private;
+	znbd_conn_t *zc = zr->zr_conn;
+	dmu_loan_t *dl = req->uzr_loan;
+	uint8_t reply[16];
+	uint32_t val;
+	int i, error;
+
+	znbd_stat_update(req, zr->zr_start);
+
+	val = BE_32(NBD_REPLY_MAGIC);
+	bcopy(&val, reply, 4);
+	val = BE_32(znbd_errno(req->uzr_error));
+	bcopy(&val, reply + 4, 4);
+	bcopy(zr->zr_handle, reply + 8, 8);
+
+	mutex_enter(&zc->zc_lock);
+	error = zc->zc_error;
+	if (error == 0)
+		error = znbd_write(zc->zc_fd, reply, sizeof (reply));
+	if (error == 0 && req->uzr_op == UZVOL_READ && req->uzr_error == 0) {
+		if (dl == NULL) {
+			error = znbd_write(zc->zc_fd, req->uzr_data,
+			    req->uzr_length);
+		} else {
+			for (i = 0; error == 0 && i < dl->dl_numbufs; i++)
+				error = znbd_write(zc->zc_fd,
+				    dl->dl_segs[i].dls_data,
+				    dl->dl_segs[i].dls_len);
+		}
+	}
+	if (error != 0 && zc->zc_error == 0) {
+		zc->zc_error = error;
+		(void) shutdown(zc->zc_fd, SHUT_RDWR);
+	}
+	zc->zc_inflight--;
+	cv_broadcast(&zc->zc_cv);
+	mutex_exit(&zc->zc_lock);
+
+	znbd_req_free(zr);
+}
+
+/*
+ * Fixed newstyle handshake.  Returns 0 once the client has asked for
+ * the export.
+ */
+static int
+znbd_handshake(int fd, uzvol_t *zv)
+{
+	uint8_t buf[ZNBD_MAXOPTLEN];
+	uint64_t val64;
+	uint32_t cflags, opt, len, val32;
+	uint16_t val16;
+	int error;
+
+	val64 = BE_64(NBD_INIT_MAGIC);
+	bcopy(&val64, buf, 8);
+	val64 = BE_64(NBD_OPTS_MAGIC);
+	bcopy(&val64, buf + 8, 8);
+	val16 = BE_16(NBD_FLAG_FIXED_NEWSTYLE | NBD_FLAG_NO_ZEROES);
+	bcopy(&val16, buf + 16, 2);
+	if ((error = znbd_write(fd, buf, 18)) != 0 ||
+	    (error = znbd_read(fd, &cflags, 4)) != 0)
+		return (error);
+	cflags = BE_32(cflags);
+	if (cflags & ~(NBD_FLAG_FIXED_NEWSTYLE | NBD_FLAG_NO_ZEROES))
+		return (ENOTSUP);
+
+	for (;;) {
+		if ((error = znbd_read(fd, buf, 16)) != 0)
+			return (error);
+		bcopy(buf, &val64, 8);
+		bcopy(buf + 8, &opt, 4);
+		bcopy(buf + 12, &len, 4);
+		opt = BE_32(opt);
+		len = BE_32(len);
+		if (BE_64(val64) != NBD_OPTS_MAGIC || len > sizeof (buf))
+			return (EPROTO);
+		if ((error = znbd_read(fd, buf, len)) != 0)
+			return (error);
+
+		if (opt == NBD_OPT_EXPORT_NAME) {
+			val64 = BE_64(uzvol_size(zv));
+			bcopy(&val64, buf, 8);
+			val16 = NBD_FLAG_HAS_FLAGS | NBD_FLAG_SEND_FLUSH |
+			    NBD_FLAG_SEND_FUA;
+			if (uzvol_readonly(zv))
+				val16 |= NBD_FLAG_READ_ONLY;
+			val16 = BE_16(val16);
+			bcopy(&val16, buf + 8, 2);
+			len = 10;
+			if (!(cflags & NBD_FLAG_NO_ZEROES)) {
+				bzero(buf + len, 124);
+				len += 124;
+			}
+			return (znbd_write(fd, buf, len));
+		}
+
+		/* anything else gets an option reply */
+		val64 = BE_64(NBD_REP_MAGIC);
+		bcopy(&val64, buf, 8);
+		val32 = BE_32(opt);
+		bcopy(&val32, buf + 8, 4);
+		val32 = BE_32(opt == NBD_OPT_ABORT ?
+		    NBD_REP_ACK : NBD_REP_ERR_UNSUP);
+		bcopy(&val32, buf + 12, 4);
+		bzero(buf + 16, 4);
+		if ((error = znbd_write(fd, buf, 20)) != 0)
+			return (error);
+		if (opt == NBD_OPT_ABORT)
+			return (ECONNRESET);
+	}
+}
+
+/*
+ * Read requests off the connection and queue them to the engine until
+ * the client disconnects, then wait for the replies to go out.
+ */
+static void
+znbd_serve(int fd, uzvol_t *zv)
+{
+	znbd_conn_t zc;
+	znbd_req_t *zr;
+	uzvol_req_t *req;
+	uint8_t hdr[28];
+	uint32_t magic, len;
+	uint16_t flags, type;
+	uint64_t off;
+	hrtime_t start = gethrtime();
+	int error;
+
+	if ((error = znbd_handshake(fd, zv)) != 0) {
+		if (verbose)
+			(void) fprintf(stderr, "%s: handshake failed: %s\n",
+			    cmdname, strerror(error));
+		return;
+	}
+
+	zc.zc_fd = fd;
+	zc.zc_inflight = 0;
+	zc.zc_error = 0;
+	mutex_init(&zc.zc_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&zc.zc_cv, NULL, CV_DEFAULT, NULL);
+
+	while (znbd_read(fd, hdr, sizeof (hdr)) == 0) {
+		bcopy(hdr, &magic, 4);
+		bcopy(hdr + 4, &flags, 2);
+		bcopy(hdr + 6, &type, 2);
+		bcopy(hdr + 16, &off, 8);
+		bcopy(hdr + 24, &len, 4);
+		flags = BE_16(flags);
+		type = BE_16(type);
+		off = BE_64(off);
+		len = BE_32(len);
+
+		if (BE_32(magic) != NBD_REQUEST_MAGIC ||
+		    type == NBD_CMD_DISC)
+			break;
+		if ((type == NBD_CMD_READ || type == NBD_CMD_WRITE) &&
+		    len > ZNBD_MAXIOLEN)
+			break;	/* can't skip the data of a huge write */
+
+		zr = umem_zalloc(sizeof (znbd_req_t), UMEM_NOFAIL);
+		zr->zr_conn = &zc;
+		bcopy(hdr + 8, zr->zr_handle, 8);
+		req = &zr->zr_req;
+		req->uzr_offset = off;
+		req->uzr_done = znbd_done;
+		req->uzr_private = zr;
+
+		switch (type) {
+		case NBD_CMD_READ:
+		case NBD_CMD_WRITE:
+			req->uzr_op = (type == NBD_CMD_READ) ?
+			    UZVOL_READ : UZVOL_WRITE;
+			req->uzr_length = len;
+			if (type == NBD_CMD_READ && !copyreads &&
+			    len <= DMU_MAX_ACCESS / 2)
+				req->uzr_flags |= UZVOL_LOAN;
+			else if (len != 0)
+				req->uzr_data = umem_alloc(len, UMEM_NOFAIL);
+			if (flags & NBD_CMD_FLAG_FUA)
+				req->uzr_flags |= UZVOL_FUA;
+			break;
+		case NBD_CMD_FLUSH:
+			req->uzr_op = UZVOL_FLUSH;
+			break;
+		default:
+			req->uzr_op = UZVOL_FLUSH;
+			req->uzr_error = EINVAL;
+			break;
+		}
+
+		if (req->uzr_op == UZVOL_WRITE && len != 0 &&
+		    znbd_read(fd, req->uzr_data, len) != 0) {
+			znbd_req_free(zr);
+			break;
+		}
+
+		mutex_enter(&zc.zc_lock);
+		zc.zc_inflight++;
+		mutex_exit(&zc.zc_lock);
+
+		zr->zr_start = gethrtime();
+		if (req->uzr_error != 0)
+			znbd_done(req);
+		else
+			uzvol_submit(zv, req);
+	}
+
+	mutex_enter(&zc.zc_lock);
+	while (zc.zc_inflight != 0)
+		cv_wait(&zc.zc_cv, &zc.zc_lock);
+	mutex_exit(&zc.zc_lock);
+	cv_destroy(&zc.zc_cv);
+	mutex_destroy(&zc.zc_lock);
+
+	if (zc.zc_error != 0 && verbose)
+		(void) fprintf(stderr, "%s: reply failed: %s\n", cmdname,
+		    strerror(zc.zc_error));
+	if (verbose)
+		znbd_stat_print(gethrtime() - start);
+}
+
+static void
+znbd_bench_done(uzvol_req_t *req)
+{
+	znbd_req_t *zr = req->uzr_private;
+
+	if (req->uzr_error != 0)
+		fatal("%s at %llu failed: %s", znbd_stat_names[req->uzr_op],
+		    (u_longlong_t)req->uzr_offset, strerror(req->uzr_error));
+	znbd_stat_update(req, zr->zr_start);
+	znbd_req_free(zr);
+}
+
+/*
+ * Keep the engine's queue full of random, iosize aligned reads and
+ * writes for the given time.
+ */
+static void
+znbd_bench(uzvol_t *zv, int seconds, uint64_t iosize, int writepct)
+{
+	uint64_t nblocks = uzvol_size(zv) / iosize;
+	hrtime_t start, stop;
+	znbd_req_t *zr;
+	uzvol_req_t *req;
+
+	if (nblocks == 0)
+		fatal("I/O size %llu is larger than the volume",
+		    (u_longlong_t)iosize);
+	if (writepct != 0 && uzvol_readonly(zv))
+		fatal("volume is read-only");
+
+	srand48(gethrtime());
+	start = gethrtime();
+	stop = start + (hrtime_t)seconds * NANOSEC;
+	while (gethrtime() < stop) {
+		zr = umem_zalloc(sizeof (znbd_req_t), UMEM_NOFAIL);
+		req = &zr->zr_req;
+		req->uzr_op = (lrand48() % 100 < writepct) ?
+		    UZVOL_WRITE : UZVOL_READ;
+		req->uzr_offset = (((uint64_t)lrand48() << 31) ^ lrand48()) %
+		    nblocks * iosize;
+		req->uzr_length = iosize;
+		if (req->uzr_op == UZVOL_READ && !copyreads &&
+		    iosize <= DMU_MAX_ACCESS / 2) {
+			req->uzr_flags |= UZVOL_LOAN;
+		} else {
+			req->uzr_data = umem_alloc(iosize, UMEM_NOFAIL);
+			if (req->uzr_op == UZVOL_WRITE)
+				(void) memset(req->uzr_data,
+				    (int)req->uzr_offset, iosize);
+		}
+		req->uzr_done = znbd_bench_done;
+		req->uzr_private = zr;
+		zr->zr_start = gethrtime();
+		uzvol_submit(zv, req);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	struct sockaddr_un sun;
+	uzvol_t *zv;
+	char *volume, *path = NULL;
+	uint64_t volsize = 0, iosize = 4096;
+	int nthreads = 8, seconds = 0, writepct = 0;
+	int c, fd, cfd, error;
+	hrtime_t start;
+
+	while ((c = getopt(argc, argv, "cvt:q:C:b:s:w:")) != -1) {
+		switch (c) {
+		case 'c':
+			copyreads = 1;
+			break;
+		case 'v':
+			verbose++;
+			break;
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		case 'q':
+			uzvol_queue_depth = atoi(optarg);
+			break;
+		case 'C':
+			volsize = znbd_parse_size(optarg);
+			break;
+		case 'b':
+			seconds = atoi(optarg);
+			break;
+		case 's':
+			iosize = znbd_parse_size(optarg);
+			break;
+		case 'w':
+			writepct = atoi(optarg);
+			break;
+		default:
+			usage();
+			break;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc != (seconds ? 1 : 2) || nthreads < 1 ||
+	    uzvol_queue_depth < 1 || writepct < 0 || writepct > 100)
+		usage();
+	volume = argv[0];
+	if (seconds == 0)
+		path = argv[1];
+
+	(void) signal(SIGPIPE, SIG_IGN);
+	mutex_init(&znbd_stat_lock, NULL, MUTEX_DEFAULT, NULL);
+	kernel_init(FREAD | FWRITE);
+
+	if (volsize != 0 && (error = uzvol_create(volume, volsize,
+	    zfs_prop_default_numeric(ZFS_PROP_VOLBLOCKSIZE))) != 0)
+		fatal("can't create %s: %s", volume, strerror(error));
+	if ((error = uzvol_open(volume, nthreads, &zv)) != 0)
+		fatal("can't open %s: %s", volume, strerror(error));
+
+	if (seconds != 0) {
+		start = gethrtime();
+		znbd_bench(zv, seconds, iosize, writepct);
+		uzvol_close(zv);
+		znbd_stat_print(gethrtime() - start);
+		kernel_fini();
+		return (0);
+	}
+
+	if (strlen(path) >= sizeof (sun.sun_path))
+		fatal("socket path too long: %s", path);
+	bzero(&sun, sizeof (sun));
+	sun.sun_family = AF_UNIX;
+	(void) strcpy(sun.sun_path, path);
+	(void) unlink(path);
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+	    bind(fd, (struct sockaddr *)&sun, sizeof (sun)) != 0 ||
+	    listen(fd, 1) != 0)
+		fatal("can't listen on %s: %s", path, strerror(errno));
+
+	if (verbose)
+		(void) printf("serving %s (%llu bytes) on %s\n", volume,
+		    (u_longlong_t)uzvol_size(zv), path);
+
+	for (;;) {
+		if ((cfd = accept(fd, NULL, NULL)) < 0) {
+			if (errno == EINTR)
+				continue;
+			fatal("accept: %s", strerror(errno));
+		}
+		znbd_serve(cfd, zv);
+		(void) close(cfd);
+	}
+
+	/* NOTREACHED */
+	return (0);
+}
@@ -213,7 +213,7 @@ get_usage(zpool_help_t idx) {
 		    "\timport [-p property=value] [-d dir] [-D] [-f] \n"
 		    "\t    [-o opts] [-R root ] <pool | id> [newpool]\n"));
 	case HELP_IOSTAT:
-		return (gettext("\tiostat [-v] [pool] ... [interval "
+		return (gettext("\tiostat [-lv] [pool] ... [interval "
 		    "[count]]\n"));
 	case HELP_LIST:
 		return (gettext("\tlist [-H] [-o field[,...]] [pool] ...\n"));
@@ -1706,6 +1706,7 @@ error:
 typedef struct iostat_cbdata {
 	zpool_list_t *cb_list;
 	int cb_verbose;
+	int cb_latency;
 	int cb_iteration;
 	int cb_namewidth;
 } iostat_cbdata_t;
@@ -1876,6 +1877,250 @@ print_iostat(zpool_handle_t *zhp, void *data)
 	return (0);
 }
 
+/*
+ * Names for the rows of spa_lat_stat_t's sl_stage, in zio_stage_t order.
+ */
+static const char *latency_stage_name[ZIO_LAT_STAGES] = {
+	"open", "wait_ready", "compress", "checksum_gen", "ddt_write",
+	"gang_pipeline", "gang_header", "gang_rewrite", "gang_free",
+	"gang_claim", "dva_allocate", "dva_free", "dva_claim",
+	"gang_checksum", "ready", "vdev_start", "vdev_done", "vdev_assess",
+	"wait_done", "checksum_verify", "gang_read", "decompress", "done"
+};
+
+static void
+print_latency_header(iostat_cbdata_t *cb)
+{
+	(void) printf("%*s      read latency        write latency\n",
+	    cb->cb_namewidth, "");
+	(void) printf("%-*s    ops    p50    p99    ops    p50    p99\n",
+	    cb->cb_namewidth, "pool");
+	print_iostat_separator(cb);
+}
+
+/*
+ * Display a latency in microseconds.
+ */
+static void
+print_one_latency(uint64_t us)
+{
+	char buf[64];
+
+	if (us < 1000)
+		(void) snprintf(buf, sizeof (buf), "%lluu", (u_longlong_t)us);
+	else if (us < 1000000)
+		(void) snprintf(buf, sizeof (buf), "%llum",
+		    (u_longlong_t)(us / 1000));
+	else
+		(void) snprintf(buf, sizeof (buf), "%llus",
+		    (u_longlong_t)(us / 1000000));
+	(void) printf("  %5s", buf);
+}
+
+/*
+ * Return the upper bound, in microseconds, of the histogram bucket holding
+ * the given percentile of the 'total' I/Os counted between 'old' and 'new'.
+ */
+static uint64_t
+latency_percentile(const uint64_t *old, const uint64_t *new, uint64_t total,
+    int pct)
+{
+	uint64_t want = (total * pct + 99) / 100;
+	uint64_t seen = 0;
+	int b;
+
+	for (b = 0; b < ZIO_LAT_BUCKETS - 1; b++) {
+		seen += new[b] - old[b];
+		if (seen >= want)
+			break;
+	}
+
+	return (1ULL << (b + 1));
+}
+
+/*
+ * Print the read and write operation rates and median and 99th percentile
+ * latencies for one pair of histograms.  Rows without any I/O are skipped.
+ */
+static void
+print_latency_row(iostat_cbdata_t *cb, const char *name, int depth,
+    const uint64_t *oldr, const uint64_t *newr,
+    const uint64_t *oldw, const uint64_t *neww, double scale)
+{
+	uint64_t nr = 0, nw = 0;
+	int b;
+
+	for (b = 0; b < ZIO_LAT_BUCKETS; b++) {
+		nr += newr[b] - oldr[b];
+		nw += neww[b] - oldw[b];
+	}
+
+	if (nr == 0 && nw == 0)
+		return;
+
+	if (strlen(name) + depth > cb->cb_namewidth)
+		(void) printf("%*s%s", depth, "", name);
+	else
+		(void) printf("%*s%s%*s", depth, "", name,
+		    (int)(cb->cb_namewidth - strlen(name) - depth), "");
+
+	print_one_stat((uint64_t)(scale * nr));
+	if (nr == 0) {
+		(void) printf("      -      -");
+	} else {
+		print_one_latency(latency_percentile(oldr, newr, nr, 50));
+		print_one_latency(latency_percentile(oldr, newr, nr, 99));
+	}
+
+	print_one_stat((uint64_t)(scale * nw));
+	if (nw == 0) {
+		(void) printf("      -      -");
+	} else {
+		print_one_latency(latency_percentile(oldw, neww, nw, 50));
+		print_one_latency(latency_percentile(oldw, neww, nw, 99));
+	}
+
+	(void) printf("\n");
+}
+
+/*
+ * Print the queue and disk latencies of every leaf vdev below 'newnv'.
+ */
+static void
+print_vdev_latency(zpool_handle_t *zhp, nvlist_t *oldnv, nvlist_t *newnv,
+    iostat_cbdata_t *cb, double scale, int depth)
+{
+	static vdev_lat_stat_t zerovl;
+	nvlist_t **oldchild, **newchild;
+	uint_t c, children;
+	vdev_lat_stat_t *oldvl, *newvl;
+	char *vname;
+
+	if (nvlist_lookup_uint64_array(newnv, ZPOOL_CONFIG_VDEV_LATENCY,
+	    (uint64_t **)&newvl, &c) == 0) {
+		if (oldnv == NULL || nvlist_lookup_uint64_array(oldnv,
+		    ZPOOL_CONFIG_VDEV_LATENCY, (uint64_t **)&oldvl, &c) != 0)
+			oldvl = &zerovl;
+
+		vname = zpool_vdev_name(g_zfs, zhp, newnv);
+		(void) printf("%*s%s\n", depth, "", vname);
+		free(vname);
+
+		print_latency_row(cb, "queue", depth + 2,
+		    oldvl->vl_queue[ZIO_TYPE_READ],
+		    newvl->vl_queue[ZIO_TYPE_READ],
+		    oldvl->vl_queue[ZIO_TYPE_WRITE],
+		    newvl->vl_queue[ZIO_TYPE_WRITE], scale);
+		print_latency_row(cb, "disk", depth + 2,
+		    oldvl->vl_disk[ZIO_TYPE_READ],
+		    newvl->vl_disk[ZIO_TYPE_READ],
+		    oldvl->vl_disk[ZIO_TYPE_WRITE],
+		    newvl->vl_disk[ZIO_TYPE_WRITE], scale);
+		return;
+	}
+
+	if (nvlist_lookup_nvlist_array(newnv, ZPOOL_CONFIG_CHILDREN,
+	    &newchild, &children) != 0)
+		return;
+
+	if (oldnv && nvlist_lookup_nvlist_array(oldnv, ZPOOL_CONFIG_CHILDREN,
+	    &oldchild, &c) != 0)
+		return;
+
+	for (c = 0; c < children; c++)
+		print_vdev_latency(zhp, oldnv ? oldchild[c] : NULL,
+		    newchild[c], cb, scale, depth);
+}
+
+/*
+ * Callback to print out the latency histograms for the given pool: the
+ * time each zio pipeline stage took, the total time of each zio by
+ * priority and, with -v, the time spent queued and on the disk by each
+ * leaf vdev.  The kernel only reports these while zio_latency_stats is set.
+ */
+int
+print_latency(zpool_handle_t *zhp, void *data)
+{
+	static spa_lat_stat_t zerosl;
+	iostat_cbdata_t *cb = data;
+	nvlist_t *oldconfig, *newconfig;
+	nvlist_t *oldnvroot, *newnvroot;
+	vdev_stat_t *oldvs, *newvs;
+	vdev_stat_t zerovs = { 0 };
+	spa_lat_stat_t *oldsl, *newsl;
+	uint64_t tdelta;
+	double scale;
+	char name[32];
+	uint_t c;
+	int i;
+
+	newconfig = zpool_get_config(zhp, &oldconfig);
+
+	if (cb->cb_iteration == 1)
+		oldconfig = NULL;
+
+	verify(nvlist_lookup_nvlist(newconfig, ZPOOL_CONFIG_VDEV_TREE,
+	    &newnvroot) == 0);
+
+	if (oldconfig == NULL)
+		oldnvroot = NULL;
+	else
+		verify(nvlist_lookup_nvlist(oldconfig, ZPOOL_CONFIG_VDEV_TREE,
+		    &oldnvroot) == 0);
+
+	if (nvlist_lookup_uint64_array(newnvroot, ZPOOL_CONFIG_POOL_LATENCY,
+	    (uint64_t **)&newsl, &c) != 0) {
+		(void) printf("%-*s  %s\n", cb->cb_namewidth,
+		    zpool_get_name(zhp),
+		    gettext("latency statistics are not enabled"));
+		return (0);
+	}
+
+	verify(nvlist_lookup_uint64_array(newnvroot, ZPOOL_CONFIG_STATS,
+	    (uint64_t **)&newvs, &c) == 0);
+
+	if (oldnvroot == NULL || nvlist_lookup_uint64_array(oldnvroot,
+	    ZPOOL_CONFIG_POOL_LATENCY, (uint64_t **)&oldsl, &c) != 0) {
+		oldsl = &zerosl;
+		oldvs = &zerovs;
+	} else {
+		verify(nvlist_lookup_uint64_array(oldnvroot,
+		    ZPOOL_CONFIG_STATS, (uint64_t **)&oldvs, &c) == 0);
+	}
+
+	tdelta = newvs->vs_timestamp - oldvs->vs_timestamp;
+
+	if (tdelta == 0)
+		scale = 1.0;
+	else
+		scale = (double)NANOSEC / tdelta;
+
+	(void) printf("%s\n", zpool_get_name(zhp));
+
+	for (i = 0; i < ZIO_LAT_STAGES; i++)
+		print_latency_row(cb, latency_stage_name[i], 2,
+		    oldsl->sl_stage[ZIO_TYPE_READ][i],
+		    newsl->sl_stage[ZIO_TYPE_READ][i],
+		    oldsl->sl_stage[ZIO_TYPE_WRITE][i],
+		    newsl->sl_stage[ZIO_TYPE_WRITE][i], scale);
+
+	for (i = 0; i < ZIO_LAT_PRIORITIES; i++) {
+		(void) snprintf(name, sizeof (name), "priority %d", i);
+		print_latency_row(cb, name, 2,
+		    oldsl->sl_total[ZIO_TYPE_READ][i],
+		    newsl->sl_total[ZIO_TYPE_READ][i],
+		    oldsl->sl_total[ZIO_TYPE_WRITE][i],
+		    newsl->sl_total[ZIO_TYPE_WRITE][i], scale);
+	}
+
+	if (cb->cb_verbose)
+		print_vdev_latency(zhp, oldnvroot, newnvroot, cb, scale, 2);
+
+	print_iostat_separator(cb);
+
+	return (0);
+}
+
 static int
 get_columns(void)
 {
@@ -1919,8 +2164,9 @@ get_namewidth(zpool_handle_t *zhp, void *data)
 }
 
 /*
- * zpool iostat [-v] [pool] ... [interval [count]]
+ * zpool iostat [-lv] [pool] ... [interval [count]]
  *
+ *	-l	Display zio latency histograms instead of throughput
  *	-v	Display statistics for individual vdevs
  *
  * This command can be tricky because we want to be able to deal with pool
@@ -1938,12 +2184,16 @@ zpool_do_iostat(int argc, char **argv)
 	unsigned long interval = 0, count = 0;
 	zpool_list_t *list;
 	boolean_t verbose = B_FALSE;
+	boolean_t latency = B_FALSE;
 	iostat_cbdata_t cb;
 	int columns;
 
 	/* check options */
-	while ((c = getopt(argc, argv, "v")) != -1) {
+	while ((c = getopt(argc, argv, "lv")) != -1) {
 		switch (c) {
+		case 'l':
+			latency = B_TRUE;
+			break;
 		case 'v':
 			verbose = B_TRUE;
 			break;
@@ -2037,6 +2287,7 @@ zpool_do_iostat(int argc, char **argv)
 	 */
 	cb.cb_list = list;
 	cb.cb_verbose = verbose;
+	cb.cb_latency = latency;
 	cb.cb_iteration = 0;
 	cb.cb_namewidth = 0;
 
@@ -2068,25 +2319,34 @@ zpool_do_iostat(int argc, char **argv)
 
 		if (cb.cb_namewidth < 10)
 			cb.cb_namewidth = 10;
+		if (latency && cb.cb_namewidth < 20)
+			cb.cb_namewidth = 20;
 		if (cb.cb_namewidth > columns - 42)
 			cb.cb_namewidth = columns - 42;
 
 		/*
-		 * If it's the first time, or verbose mode, print the header.
+		 * If it's the first time, or verbose or latency mode, print the
+		 * header.
 		 */
-		if (++cb.cb_iteration == 1 || verbose)
-			print_iostat_header(&cb);
+		if (++cb.cb_iteration == 1 || verbose || latency) {
+			if (latency)
+				print_latency_header(&cb);
+			else
+				print_iostat_header(&cb);
+		}
 
-		(void) pool_list_iter(list, B_FALSE, print_iostat, &cb);
+		(void) pool_list_iter(list, B_FALSE,
+		    latency ? print_latency : print_iostat, &cb);
 
 		/*
-		 * If there's more than one pool, and we're not in verbose mode
-		 * (which prints a separator for us), then print a separator.
+		 * If there's more than one pool, and we're not in verbose or
+		 * latency mode (which print a separator for us), then print a
+		 * separator.
 		 */
-		if (npools > 1 && !verbose)
+		if (npools > 1 && !verbose && !latency)
 			print_iostat_separator(&cb);
 
-		if (verbose)
+		if (verbose || latency)
 			(void) printf("\n");
 
 		/*
@@ -3534,6 +3794,8 @@ zpool_do_upgrade(int argc, char **argv)
 		(void) printf(gettext(" 6   pool properties\n"));
 		(void) printf(gettext(" 7   Separate intent log devices\n"));
 		(void) printf(gettext(" 8   Delegated administration\n"));
+		(void) printf(gettext(" 9   Background dataset destroy\n"));
+		(void) printf(gettext(" 10  Deduplication\n"));
 		(void) printf(gettext("For more information on a particular "
 		    "version, including supported releases, see:\n\n"));
 		(void) printf("http://www.opensolaris.org/os/community/zfs/"
@@ -82,6 +82,11 @@
 #include <sys/dmu.h>
 #include <sys/txg.h>
 #include <sys/zap.h>
+#include <sys/zap_impl.h>
+#include <sys/dbuf.h>
+#include <sys/zfs_dircache.h>
+#include <sys/zvol.h>
+#include <sys/zfs_rlock.h>
 #include <sys/dmu_traverse.h>
 #include <sys/dmu_objset.h>
 #include <sys/poll.h>
@@ -98,6 +103,7 @@
 #include <sys/zil.h>
 #include <sys/vdev_impl.h>
 #include <sys/spa_impl.h>
+#include <sys/zfs_ioctl.h>
 #include <sys/dsl_prop.h>
 #include <sys/refcount.h>
 #include <stdio.h>
@@ -131,6 +137,7 @@ static int zopt_verbose = 0;
 static int zopt_init = 1;
 static char *zopt_dir = "/tmp";
 static uint64_t zopt_time = 300;	/* 5 minutes */
+static uint64_t zopt_bench = 0;		/* -b seconds */
 static int zopt_maxfaults;
 #ifdef __APPLE__
 static uint64_t zopt_seed = 0;
@@ -164,6 +171,19 @@ ztest_func_t ztest_dmu_write_parallel;
 ztest_func_t ztest_dmu_object_alloc_free;
 ztest_func_t ztest_zap;
 ztest_func_t ztest_zap_parallel;
+ztest_func_t ztest_hash;
+ztest_func_t ztest_mzap;
+ztest_func_t ztest_fzap;
+ztest_func_t ztest_zap_many;
+ztest_func_t ztest_dircache;
+ztest_func_t ztest_dbuf_hold;
+ztest_func_t ztest_uzvol;
+ztest_func_t ztest_dnode_hold;
+ztest_func_t ztest_dmu_read_loan;
+ztest_func_t ztest_dmu_partial_free;
+ztest_func_t ztest_compress_probe;
+ztest_func_t ztest_latency;
+ztest_func_t ztest_inject_delay;
 ztest_func_t ztest_traverse;
 ztest_func_t ztest_dsl_prop_get_set;
 ztest_func_t ztest_dmu_objset_create_destroy;
@@ -200,6 +220,19 @@ ztest_info_t ztest_info[] = {
 	{ ztest_dmu_object_alloc_free,		&zopt_always	},
 	{ ztest_zap,				&zopt_always	},
 	{ ztest_zap_parallel,			&zopt_always	},
+	{ ztest_hash,				&zopt_sometimes	},
+	{ ztest_mzap,				&zopt_sometimes	},
+	{ ztest_fzap,				&zopt_sometimes	},
+	{ ztest_zap_many,			&zopt_sometimes	},
+	{ ztest_dircache,			&zopt_sometimes	},
+	{ ztest_dbuf_hold,			&zopt_sometimes	},
+	{ ztest_uzvol,				&zopt_sometimes	},
+	{ ztest_dnode_hold,			&zopt_sometimes	},
+	{ ztest_dmu_read_loan,			&zopt_sometimes	},
+	{ ztest_dmu_partial_free,		&zopt_sometimes	},
+	{ ztest_compress_probe,			&zopt_sometimes	},
+	{ ztest_latency,			&zopt_sometimes	},
+	{ ztest_inject_delay,			&zopt_sometimes	},
 	{ ztest_traverse,			&zopt_often	},
 	{ ztest_dsl_prop_get_set,		&zopt_sometimes	},
 	{ ztest_dmu_objset_create_destroy,	&zopt_sometimes	},
@@ -229,6 +262,45 @@ ztest_info_t ztest_info[] = {
 	{ ztest_zap_parallel,
 		"ztest_zap_parallel",
 		&zopt_always},
+	{ ztest_hash,
+		"ztest_hash",
+		&zopt_sometimes},
+	{ ztest_mzap,
+		"ztest_mzap",
+		&zopt_sometimes},
+	{ ztest_fzap,
+		"ztest_fzap",
+		&zopt_sometimes},
+	{ ztest_zap_many,
+		"ztest_zap_many",
+		&zopt_sometimes},
+	{ ztest_dircache,
+		"ztest_dircache",
+		&zopt_sometimes},
+	{ ztest_dbuf_hold,
+		"ztest_dbuf_hold",
+		&zopt_sometimes},
+	{ ztest_uzvol,
+		"ztest_uzvol",
+		&zopt_sometimes},
+	{ ztest_dnode_hold,
+		"ztest_dnode_hold",
+		&zopt_sometimes},
+	{ ztest_dmu_read_loan,
+		"ztest_dmu_read_loan",
+		&zopt_sometimes},
+	{ ztest_dmu_partial_free,
+		"ztest_dmu_partial_free",
+		&zopt_sometimes},
+	{ ztest_compress_probe,
+		"ztest_compress_probe",
+		&zopt_sometimes},
+	{ ztest_latency,
+		"ztest_latency",
+		&zopt_sometimes},
+	{ ztest_inject_delay,
+		"ztest_inject_delay",
+		&zopt_sometimes},
 	{ ztest_traverse,
 		"ztest_traverse",
 		&zopt_often},
@@ -308,6 +380,11 @@ static int ztest_dump_core = 1;
 
 extern uint64_t zio_gang_bang;
 extern uint16_t zio_zil_fail_shift;
+extern int zap_leaf_index_min_lookups;
+extern int vdev_file_aio;
+extern int zio_cpu_taskq_threads;
+extern int zio_compress_probe;
+extern int vdev_mirror_load_balance;
 
 #define	ZTEST_DIROBJ		1
 #define	ZTEST_MICROZAP_OBJ	2
@@ -452,6 +529,7 @@ usage(boolean_t requested)
 	    "\t[-T time] total run time (default: %llu sec)\n"
 	    "\t[-P passtime] time per pass (default: %llu sec)\n"
 	    "\t[-z zil failure rate (default: fail every 2^%llu allocs)]\n"
+	    "\t[-b seconds] run the I/O benchmarks, then exit\n"
 #ifdef __APPLE__
 	    "\t[-S random seed (default: randomly chosen)]\n"
 	    "\t[-D] wait in child process for GDB to attach.  (After attaching say 'set ztest_forever=0')\n"
@@ -519,9 +597,9 @@ process_options(int argc, char **argv)
 
 	while ((opt = getopt(argc, argv,
 #ifdef __APPLE__	    
-		"v:s:a:m:r:R:d:t:g:i:k:p:f:VET:P:z:h:S:D")) != EOF) {
+		"v:s:a:m:r:R:d:t:g:i:k:p:f:VET:P:z:b:h:S:D")) != EOF) {
 #else
-	    "v:s:a:m:r:R:d:t:g:i:k:p:f:VET:P:z:h")) != EOF) {
+	    "v:s:a:m:r:R:d:t:g:i:k:p:f:VET:P:z:b:h")) != EOF) {
 #endif
 		value = 0;
 		switch (opt) {
@@ -539,6 +617,7 @@ process_options(int argc, char **argv)
 		case 'T':
 		case 'P':
 		case 'z':
+		case 'b':
 #ifdef __APPLE__
 		case 'S':
 #endif
@@ -599,6 +678,9 @@ process_options(int argc, char **argv)
 		case 'z':
 			zio_zil_fail_shift = MIN(value, 16);
 			break;
+		case 'b':
+			zopt_bench = value;
+			break;
 #ifdef __APPLE__
 	    case 'S':
 			zopt_seed = value;
@@ -2610,408 +2692,1709 @@ ztest_zap_parallel(ztest_args_t *za)
 	}
 }
 
-void
-ztest_dsl_prop_get_set(ztest_args_t *za)
-{
-	objset_t *os = za->za_os;
-	int i, inherit;
-	uint64_t value;
-	const char *prop, *valname;
-	char setpoint[MAXPATHLEN];
-	char osname[MAXNAMELEN];
-	int error;
-
-	(void) rw_rdlock(&ztest_shared->zs_name_lock);
-
-	dmu_objset_name(os, osname);
-
-	for (i = 0; i < 2; i++) {
-		if (i == 0) {
-			prop = "checksum";
-			value = ztest_random_checksum();
-			inherit = (value == ZIO_CHECKSUM_INHERIT);
-		} else {
-			prop = "compression";
-			value = ztest_random_compress();
-			inherit = (value == ZIO_COMPRESS_INHERIT);
-		}
-
-		error = dsl_prop_set(osname, prop, sizeof (value),
-		    !inherit, &value);
-
-		if (error == ENOSPC) {
-			ztest_record_enospc("dsl_prop_set");
-			break;
-		}
-
-		ASSERT3U(error, ==, 0);
-
-		VERIFY3U(dsl_prop_get(osname, prop, sizeof (value),
-		    1, &value, setpoint), ==, 0);
+#define	ZTEST_HASH_NAMES	1024
 
-		if (i == 0)
-			valname = zio_checksum_table[value].ci_name;
-		else
-			valname = zio_compress_table[value].ci_name;
+/*
+ * The ZAP and dbuf hashes as they were computed before they were sped
+ * up, one byte at a time through the CRC64 table.
+ */
+static uint64_t
+ztest_zap_hash_bytewise(uint64_t salt, const char *name)
+{
+	const uint8_t *cp;
+	uint64_t crc = salt;
 
-		if (zopt_verbose >= 6) {
-			(void) printf("%s %s = %s for '%s'\n",
-			    osname, prop, valname, setpoint);
-		}
-	}
+	for (cp = (const uint8_t *)name; *cp != '\0'; cp++)
+		crc = (crc >> 8) ^ zfs_crc64_table[(crc ^ *cp) & 0xFFULL];
 
-	(void) rw_unlock(&ztest_shared->zs_name_lock);
+	return (crc & ~((1ULL << (64 - ZAP_HASHBITS)) - 1));
 }
 
-static void
-ztest_error_setup(vdev_t *vd, int mode, int mask, uint64_t arg)
+static uint64_t
+ztest_dbuf_hash_crc(void *os, uint64_t obj, uint8_t lvl, uint64_t blkid)
 {
-	int c;
-
-	for (c = 0; c < vd->vdev_children; c++)
-		ztest_error_setup(vd->vdev_child[c], mode, mask, arg);
-
-	if (vd->vdev_path != NULL) {
-		vd->vdev_fault_mode = mode;
-		vd->vdev_fault_mask = mask;
-		vd->vdev_fault_arg = arg;
-	}
+	uintptr_t osv = (uintptr_t)os;
+	uint64_t crc = -1ULL;
+
+	crc = (crc >> 8) ^ zfs_crc64_table[(crc ^ (lvl)) & 0xFFULL];
+	crc = (crc >> 8) ^ zfs_crc64_table[(crc ^ (osv >> 6)) & 0xFFULL];
+	crc = (crc >> 8) ^ zfs_crc64_table[(crc ^ (obj >> 0)) & 0xFFULL];
+	crc = (crc >> 8) ^ zfs_crc64_table[(crc ^ (obj >> 8)) & 0xFFULL];
+	crc = (crc >> 8) ^ zfs_crc64_table[(crc ^ (blkid >> 0)) & 0xFFULL];
+	crc = (crc >> 8) ^ zfs_crc64_table[(crc ^ (blkid >> 8)) & 0xFFULL];
+	crc ^= (osv>>14) ^ (obj>>16) ^ (blkid>>16);
+
+	return (crc);
 }
 
 /*
- * Inject random faults into the on-disk data.
+ * Verify that zap_hash() still computes exactly the CRC64 it always
+ * has -- it's part of the on-disk format -- and time it and dbuf_hash()
+ * against the byte-at-a-time versions.
  */
 void
-ztest_fault_inject(ztest_args_t *za)
+ztest_hash(ztest_args_t *za)
 {
-	int fd;
-	uint64_t offset;
-	uint64_t leaves = MAX(zopt_mirrors, 1) * zopt_raidz;
-	uint64_t bad = 0x1990c0ffeedecade;
-	uint64_t top, leaf;
-	char path0[MAXPATHLEN];
-	char pathrand[MAXPATHLEN];
-	size_t fsize;
-	spa_t *spa = dmu_objset_spa(za->za_os);
-	int bshift = SPA_MAXBLOCKSHIFT + 2;	/* don't scrog all labels */
-	int iters = 1000;
-	vdev_t *vd0;
-	uint64_t guid0 = 0;
+	char *names;
+	uint64_t *objs;
+	zap_t zap;
+	uint64_t seed, sum, i, j, len;
+	hrtime_t start, zap_new, zap_old, dbuf_new, dbuf_old;
+
+	names = umem_alloc(ZTEST_HASH_NAMES * ZAP_MAXNAMELEN, UMEM_NOFAIL);
+	objs = umem_alloc(ZTEST_HASH_NAMES * sizeof (uint64_t), UMEM_NOFAIL);
+
+	bzero(&zap, sizeof (zap));
+	zap.zap_salt = ztest_random(-1ULL) | 1;
+
+	seed = ztest_random(-1ULL) | 1;
+	for (i = 0; i < ZTEST_HASH_NAMES; i++) {
+		char *name = names + i * ZAP_MAXNAMELEN;
+
+		len = ztest_random(ZAP_MAXNAMELEN);
+		for (j = 0; j < len; j++) {
+			seed ^= seed << 13;
+			seed ^= seed >> 7;
+			seed ^= seed << 17;
+			name[j] = (char)(seed % 255 + 1);
+		}
+		name[len] = '\0';
+		objs[i] = seed;
+	}
 
-	/*
-	 * We can't inject faults when we have no fault tolerance.
-	 */
-	if (zopt_maxfaults == 0)
-		return;
+	for (i = 0; i < ZTEST_HASH_NAMES; i++) {
+		char *name = names + i * ZAP_MAXNAMELEN;
 
-	ASSERT(leaves >= 2);
+		if (zap_hash(&zap, name) !=
+		    ztest_zap_hash_bytewise(zap.zap_salt, name))
+			fatal(0, "zap_hash(%llx, <%llu bytes>) mismatch",
+			    (u_longlong_t)zap.zap_salt,
+			    (u_longlong_t)strlen(name));
+	}
 
-	/*
-	 * Pick a random top-level vdev.
-	 */
-	spa_config_enter(spa, RW_READER, FTAG);
-	top = ztest_random(spa->spa_root_vdev->vdev_children);
-	spa_config_exit(spa, FTAG);
+	sum = 0;
+	start = gethrtime();
+	for (i = 0; i < ZTEST_HASH_NAMES; i++)
+		sum += zap_hash(&zap, names + i * ZAP_MAXNAMELEN);
+	zap_new = gethrtime() - start;
+
+	start = gethrtime();
+	for (i = 0; i < ZTEST_HASH_NAMES; i++)
+		sum += ztest_zap_hash_bytewise(zap.zap_salt,
+		    names + i * ZAP_MAXNAMELEN);
+	zap_old = gethrtime() - start;
+
+	start = gethrtime();
+	for (i = 0; i < ZTEST_HASH_NAMES; i++)
+		sum += dbuf_hash(za->za_os, objs[i] >> 40, i & 3, objs[i]);
+	dbuf_new = gethrtime() - start;
+
+	start = gethrtime();
+	for (i = 0; i < ZTEST_HASH_NAMES; i++)
+		sum += ztest_dbuf_hash_crc(za->za_os, objs[i] >> 40, i & 3,
+		    objs[i]);
+	dbuf_old = gethrtime() - start;
 
-	/*
-	 * Pick a random leaf.
-	 */
-	leaf = ztest_random(leaves);
+	if (zopt_verbose >= 3) {
+		(void) printf("hash: zap %lluns/name (bytewise %lluns), "
+		    "dbuf %lluns (crc %lluns) [%llx]\n",
+		    (u_longlong_t)(zap_new / ZTEST_HASH_NAMES),
+		    (u_longlong_t)(zap_old / ZTEST_HASH_NAMES),
+		    (u_longlong_t)(dbuf_new / ZTEST_HASH_NAMES),
+		    (u_longlong_t)(dbuf_old / ZTEST_HASH_NAMES),
+		    (u_longlong_t)sum);
+	}
 
-	/*
-	 * Generate paths to the first two leaves in this top-level vdev,
-	 * and to the random leaf we selected.  We'll induce transient
-	 * I/O errors and random online/offline activity on leaf 0,
-	 * and we'll write random garbage to the randomly chosen leaf.
-	 */
-	(void) snprintf(path0, sizeof (path0),
-	    ztest_dev_template, zopt_dir, zopt_pool, top * leaves + 0);
-	(void) snprintf(pathrand, sizeof (pathrand),
-	    ztest_dev_template, zopt_dir, zopt_pool, top * leaves + leaf);
+	umem_free(objs, ZTEST_HASH_NAMES * sizeof (uint64_t));
+	umem_free(names, ZTEST_HASH_NAMES * ZAP_MAXNAMELEN);
+}
 
-	dprintf("damaging %s and %s\n", path0, pathrand);
+/*
+ * Fill a micro-zap with up to (nearly) as many entries as it can hold,
+ * then verify and time lookups and a cursor walk over it.
+ */
+void
+ztest_mzap(ztest_args_t *za)
+{
+	objset_t *os = za->za_os;
+	uint64_t object, value, count, i, n;
+	dmu_tx_t *tx;
+	zap_cursor_t zc;
+	zap_attribute_t zattr;
+	char name[MZAP_NAME_LEN];
+	hrtime_t start, lookup, walk;
+	int error;
 
-	spa_config_enter(spa, RW_READER, FTAG);
+	n = ztest_random(MZAP_MAX_BLKSZ / MZAP_ENT_LEN - 2) + 1;
 
-	/*
-	 * If we can tolerate two or more faults, make vd0 fail randomly.
-	 */
-	vd0 = vdev_lookup_by_path(spa->spa_root_vdev, path0);
-	if (vd0 != NULL && zopt_maxfaults >= 2) {
-		guid0 = vd0->vdev_guid;
-		ztest_error_setup(vd0, VDEV_FAULT_COUNT,
-		    (1U << ZIO_TYPE_READ) | (1U << ZIO_TYPE_WRITE), 100);
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_zap(tx, DMU_NEW_OBJECT, TRUE, NULL);
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error) {
+		ztest_record_enospc("create mzap test obj");
+		dmu_tx_abort(tx);
+		return;
 	}
+	object = zap_create(os, DMU_OT_ZAP_OTHER, DMU_OT_NONE, 0, tx);
+	for (i = 0; i < n; i++) {
+		(void) sprintf(name, "mzap_%llu", (u_longlong_t)i);
+		VERIFY(zap_add(os, object, name, sizeof (uint64_t), 1,
+		    &i, tx) == 0);
+	}
+	dmu_tx_commit(tx);
 
-	spa_config_exit(spa, FTAG);
+	VERIFY(zap_count(os, object, &count) == 0);
+	ASSERT3U(count, ==, n);
 
-	/*
-	 * If we can tolerate two or more faults, randomly online/offline vd0.
-	 */
-	if (zopt_maxfaults >= 2 && guid0 != 0) {
-		if (ztest_random(10) < 6)
-			(void) vdev_offline(spa, guid0, B_TRUE);
-		else
-			(void) vdev_online(spa, guid0, B_FALSE, NULL);
+	start = gethrtime();
+	for (i = 0; i < n; i++) {
+		(void) sprintf(name, "mzap_%llu", (u_longlong_t)i);
+		VERIFY(zap_lookup(os, object, name, sizeof (uint64_t), 1,
+		    &value) == 0);
+		ASSERT3U(value, ==, i);
 	}
+	lookup = gethrtime() - start;
+
+	count = 0;
+	start = gethrtime();
+	for (zap_cursor_init(&zc, os, object);
+	    zap_cursor_retrieve(&zc, &zattr) == 0;
+	    zap_cursor_advance(&zc))
+		count++;
+	zap_cursor_fini(&zc);
+	walk = gethrtime() - start;
+	ASSERT3U(count, ==, n);
 
-	/*
-	 * We have at least single-fault tolerance, so inject data corruption.
-	 */
-	fd = open(pathrand, O_RDWR);
+	if (zopt_verbose >= 3) {
+		(void) printf("mzap: %llu entries, lookup %lluns, "
+		    "walk %lluns/entry\n", (u_longlong_t)n,
+		    (u_longlong_t)(lookup / n), (u_longlong_t)(walk / n));
+	}
 
-	if (fd == -1)	/* we hit a gap in the device namespace */
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_free(tx, object, 0, DMU_OBJECT_END);
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error) {
+		ztest_record_enospc("destroy mzap test obj");
+		dmu_tx_abort(tx);
 		return;
+	}
+	VERIFY(zap_destroy(os, object, tx) == 0);
+	dmu_tx_commit(tx);
+}
 
-	fsize = lseek(fd, 0, SEEK_END);
+/*
+ * Look up every entry of a fat zap enough times that its leaves get
+ * their in-core index, then remove some entries and check that the
+ * lookups see the change.
+ */
+void
+ztest_fzap(ztest_args_t *za)
+{
+	objset_t *os = za->za_os;
+	uint64_t object, value, i, n, pass;
+	uint64_t upgrade[2] = { 0, 0 };
+	dmu_tx_t *tx;
+	char name[MZAP_NAME_LEN];
+	hrtime_t start, first = 0, last = 0;
+	int error;
 
-	while (--iters != 0) {
-		offset = ztest_random(fsize / (leaves << bshift)) *
-		    (leaves << bshift) + (leaf << bshift) +
-		    (ztest_random(1ULL << (bshift - 1)) & -8ULL);
+	n = ztest_random(1000) + 1;
 
-		if (offset >= fsize)
-			continue;
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_zap(tx, DMU_NEW_OBJECT, TRUE, NULL);
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error) {
+		ztest_record_enospc("create fzap test obj");
+		dmu_tx_abort(tx);
+		return;
+	}
+	object = zap_create(os, DMU_OT_ZAP_OTHER, DMU_OT_NONE, 0, tx);
+	/* an entry with more than one integer forces a fat zap */
+	VERIFY(zap_add(os, object, "fzap_upgrade", sizeof (uint64_t), 2,
+	    upgrade, tx) == 0);
+	for (i = 0; i < n; i++) {
+		(void) sprintf(name, "fzap_%llu", (u_longlong_t)i);
+		VERIFY(zap_add(os, object, name, sizeof (uint64_t), 1,
+		    &i, tx) == 0);
+	}
+	dmu_tx_commit(tx);
 
-		if (zopt_verbose >= 6)
-			(void) printf("injecting bad word into %s,"
-			    " offset 0x%llx\n", pathrand, (u_longlong_t)offset);
+	for (pass = 0; pass <= zap_leaf_index_min_lookups; pass++) {
+		start = gethrtime();
+		for (i = 0; i < n; i++) {
+			(void) sprintf(name, "fzap_%llu", (u_longlong_t)i);
+			VERIFY(zap_lookup(os, object, name, sizeof (uint64_t),
+			    1, &value) == 0);
+			ASSERT3U(value, ==, i);
+		}
+		if (pass == 0)
+			first = gethrtime() - start;
+		else
+			last = gethrtime() - start;
+	}
 
-		if (pwrite(fd, &bad, sizeof (bad), offset) != sizeof (bad))
-			fatal(1, "can't inject bad word at 0x%llx in %s",
-			    offset, pathrand);
+	if (zopt_verbose >= 3) {
+		(void) printf("fzap: %llu entries, lookup %lluns first pass, "
+		    "%lluns indexed\n", (u_longlong_t)n,
+		    (u_longlong_t)(first / n), (u_longlong_t)(last / n));
 	}
 
-	(void) close(fd);
-}
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_zap(tx, object, FALSE, NULL);
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error) {
+		ztest_record_enospc("remove fzap test entries");
+		dmu_tx_abort(tx);
+	} else {
+		for (i = 0; i < n; i += 3) {
+			(void) sprintf(name, "fzap_%llu", (u_longlong_t)i);
+			VERIFY(zap_remove(os, object, name, tx) == 0);
+		}
+		dmu_tx_commit(tx);
 
-/*
- * Scrub the pool.
- */
-void
-ztest_scrub(ztest_args_t *za)
-{
-	spa_t *spa = dmu_objset_spa(za->za_os);
+		for (i = 0; i < n; i++) {
+			(void) sprintf(name, "fzap_%llu", (u_longlong_t)i);
+			error = zap_lookup(os, object, name, sizeof (uint64_t),
+			    1, &value);
+			if (i % 3 == 0) {
+				if (error != ENOENT)
+					fatal(0, "fzap: removed '%s' found, "
+					    "error %d", name, error);
+			} else {
+				if (error != 0 || value != i)
+					fatal(0, "fzap: '%s' = %llu, error %d",
+					    name, (u_longlong_t)value, error);
+			}
+		}
+	}
 
-	mutex_enter(&spa_namespace_lock);
-	(void) spa_scrub(spa, POOL_SCRUB_EVERYTHING, B_FALSE);
-	mutex_exit(&spa_namespace_lock);
-	(void) poll(NULL, 0, 1000); /* wait a second, then force a restart */
-	mutex_enter(&spa_namespace_lock);
-	(void) spa_scrub(spa, POOL_SCRUB_EVERYTHING, B_FALSE);
-	mutex_exit(&spa_namespace_lock);
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_free(tx, object, 0, DMU_OBJECT_END);
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error) {
+		ztest_record_enospc("destroy fzap test obj");
+		dmu_tx_abort(tx);
+		return;
+	}
+	VERIFY(zap_destroy(os, object, tx) == 0);
+	dmu_tx_commit(tx);
 }
 
 /*
- * Rename the pool to a different name and then rename it back.
+ * Add, update and remove a batch of names with the zap_*_many()
+ * interfaces, in either a micro or (with long names) a fat zap, and
+ * check the result with plain lookups.
  */
 void
-ztest_spa_rename(ztest_args_t *za)
+ztest_zap_many(ztest_args_t *za)
 {
-	char *oldname, *newname;
+	objset_t *os = za->za_os;
+	uint64_t object, value, i, n, nrem;
+	uint64_t *vals;
+	const char **names;
+	char *namebuf;
+	dmu_tx_t *tx;
+	int longnames = ztest_random(2);
 	int error;
-	spa_t *spa;
-
-	(void) rw_wrlock(&ztest_shared->zs_name_lock);
 
-	oldname = za->za_pool;
-	newname = umem_alloc(strlen(oldname) + 5, UMEM_NOFAIL);
-	(void) strcpy(newname, oldname);
-	(void) strcat(newname, "_tmp");
+	n = ztest_random(500) + 2;
+	namebuf = umem_alloc(n * MAXNAMELEN, UMEM_NOFAIL);
+	names = umem_alloc(n * sizeof (char *), UMEM_NOFAIL);
+	vals = umem_alloc(n * sizeof (uint64_t), UMEM_NOFAIL);
+	for (i = 0; i < n; i++) {
+		names[i] = namebuf + i * MAXNAMELEN;
+		(void) sprintf(namebuf + i * MAXNAMELEN, "%s_%llu",
+		    longnames ? "zap_many_name_long_enough_for_a_fat_zap_"
+		    "rather_than_a_micro_one" : "zap_many", (u_longlong_t)i);
+		vals[i] = i;
+	}
 
-	/*
-	 * Do the rename
-	 */
-	error = spa_rename(oldname, newname);
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_zap_many(tx, DMU_NEW_OBJECT, TRUE, n);
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error) {
+		ztest_record_enospc("zap_add_many");
+		dmu_tx_abort(tx);
+		goto out;
+	}
+	object = zap_create(os, DMU_OT_ZAP_OTHER, DMU_OT_NONE, 0, tx);
+	error = zap_add_many(os, object, n, names, sizeof (uint64_t), 1,
+	    vals, tx);
 	if (error)
-		fatal(0, "spa_rename('%s', '%s') = %d", oldname,
-		    newname, error);
+		fatal(0, "zap_add_many(%llu) = %d", (u_longlong_t)n, error);
+	/* adding them again must fail without harm */
+	error = zap_add_many(os, object, n, names, sizeof (uint64_t), 1,
+	    vals, tx);
+	if (error != EEXIST)
+		fatal(0, "zap_add_many(existing) = %d", error);
+	dmu_tx_commit(tx);
 
-	/*
-	 * Try to open it under the old name, which shouldn't exist
-	 */
-	error = spa_open(oldname, &spa, FTAG);
+	for (i = 0; i < n; i++)
+		vals[i] = i * 3;
+
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_zap_many(tx, object, TRUE, n);
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error) {
+		ztest_record_enospc("zap_update_many");
+		dmu_tx_abort(tx);
+		goto destroy;
+	}
+	VERIFY(zap_update_many(os, object, n, names, sizeof (uint64_t), 1,
+	    vals, tx) == 0);
+	dmu_tx_commit(tx);
+
+	/* remove the first half, twice over; the second pass finds none */
+	nrem = n / 2;
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_zap_many(tx, object, FALSE, nrem);
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error) {
+		ztest_record_enospc("zap_remove_many");
+		dmu_tx_abort(tx);
+		goto destroy;
+	}
+	VERIFY(zap_remove_many(os, object, nrem, names, tx) == 0);
+	error = zap_remove_many(os, object, nrem, names, tx);
 	if (error != ENOENT)
-		fatal(0, "spa_open('%s') = %d", oldname, error);
+		fatal(0, "zap_remove_many(removed) = %d", error);
+	dmu_tx_commit(tx);
 
-	/*
-	 * Open it under the new name and make sure it's still the same spa_t.
-	 */
-	error = spa_open(newname, &spa, FTAG);
-	if (error != 0)
-		fatal(0, "spa_open('%s') = %d", newname, error);
+	VERIFY(zap_count(os, object, &value) == 0);
+	ASSERT3U(value, ==, n - nrem);
+	for (i = 0; i < n; i++) {
+		error = zap_lookup(os, object, names[i], sizeof (uint64_t), 1,
+		    &value);
+		if (i < nrem ? error != ENOENT : (error != 0 || value != i * 3))
+			fatal(0, "zap_many: '%s' = %llu, error %d",
+			    names[i], (u_longlong_t)value, error);
+	}
 
-	ASSERT(spa == dmu_objset_spa(za->za_os));
-	spa_close(spa, FTAG);
+destroy:
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_free(tx, object, 0, DMU_OBJECT_END);
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error) {
+		ztest_record_enospc("destroy zap_many test obj");
+		dmu_tx_abort(tx);
+	} else {
+		VERIFY(zap_destroy(os, object, tx) == 0);
+		dmu_tx_commit(tx);
+	}
+out:
+	umem_free(vals, n * sizeof (uint64_t));
+	umem_free(names, n * sizeof (char *));
+	umem_free(namebuf, n * MAXNAMELEN);
+}
 
-	/*
-	 * Rename it back to the original
-	 */
-	error = spa_rename(newname, oldname);
-	if (error)
-		fatal(0, "spa_rename('%s', '%s') = %d", newname,
-		    oldname, error);
+#define	ZTEST_DIRCACHE_NAMES	(2 * ZFS_DIRCACHE_NENTS)
+
+/*
+ * Check the directory lookup cache's positive, negative and
+ * invalidation results against a model, and time its lookups.
+ */
+/* ARGSUSED */
+void
+ztest_dircache(ztest_args_t *za)
+{
+	zfs_dircache_t *dc = NULL;
+	uint64_t zoid, i, n, lookups = 0;
+	char name[MAXNAMELEN];
+	hrtime_t start, elapsed;
+	int error, rounds;
 
 	/*
-	 * Make sure it can still be opened
+	 * Names 0..n-1 are entered with object i + 1, or as missing when
+	 * i is odd.  Slots are shared, so a miss (ESRCH) is always a
+	 * legal answer, but a hit must match what was entered last.
 	 */
-	error = spa_open(oldname, &spa, FTAG);
-	if (error != 0)
-		fatal(0, "spa_open('%s') = %d", oldname, error);
+	n = ZTEST_DIRCACHE_NAMES;
+	for (i = 0; i < n; i++) {
+		(void) sprintf(name, "dircache_%llu", (u_longlong_t)i);
+		zfs_dircache_enter(&dc, name, (i & 1) ? 0 : i + 1);
+	}
+	if (dc == NULL)
+		return;		/* over zfs_dircache_max */
+
+	start = gethrtime();
+	for (rounds = 0; rounds < 100; rounds++) {
+		for (i = 0; i < n; i++, lookups++) {
+			(void) sprintf(name, "dircache_%llu", (u_longlong_t)i);
+			error = zfs_dircache_lookup(dc, name, &zoid);
+			if (error == ESRCH)
+				continue;
+			if ((i & 1) ? error != ENOENT :
+			    (error != 0 || zoid != i + 1))
+				fatal(0, "dircache: '%s' = %llu, error %d",
+				    name, (u_longlong_t)zoid, error);
+		}
+	}
+	elapsed = gethrtime() - start;
+
+	/* removed names must miss, whatever they were */
+	for (i = 0; i < n; i += 3) {
+		(void) sprintf(name, "dircache_%llu", (u_longlong_t)i);
+		zfs_dircache_remove(dc, name);
+		error = zfs_dircache_lookup(dc, name, &zoid);
+		if (error != ESRCH)
+			fatal(0, "dircache: removed '%s' error %d",
+			    name, error);
+	}
 
-	ASSERT(spa == dmu_objset_spa(za->za_os));
-	spa_close(spa, FTAG);
+	/* names too long to cache are never cached */
+	(void) memset(name, 'x', ZFS_DIRCACHE_NAMELEN);
+	name[ZFS_DIRCACHE_NAMELEN] = '\0';
+	zfs_dircache_enter(&dc, name, 1);
+	if (zfs_dircache_lookup(dc, name, &zoid) != ESRCH)
+		fatal(0, "dircache: long name was cached");
 
-	umem_free(newname, strlen(newname) + 1);
+	if (zopt_verbose >= 3) {
+		(void) printf("dircache: %llu lookups/sec\n",
+		    (u_longlong_t)(lookups * NANOSEC / MAX(elapsed, 1)));
+	}
 
-	(void) rw_unlock(&ztest_shared->zs_name_lock);
+	zfs_dircache_destroy(&dc);
 }
 
+#define	ZTEST_DBUF_THREADS	4
+#define	ZTEST_DBUF_BLOCKS	64
+#define	ZTEST_DBUF_BLOCKSIZE	(1 << 12)
+
+typedef struct ztest_dbuf_arg {
+	objset_t	*zd_os;
+	uint64_t	zd_object;
+	uint64_t	zd_holds;
+	uint64_t	zd_seed;
+} ztest_dbuf_arg_t;
+
+static void *
+ztest_dbuf_hold_thread(void *arg)
+{
+	ztest_dbuf_arg_t *zd = arg;
+	dmu_buf_t *db;
+	uint64_t i, blk;
+
+	for (i = 0; i < zd->zd_holds; i++) {
+		/* a cheap LCG keeps every thread on its own block sequence */
+		zd->zd_seed = zd->zd_seed * 6364136223846793005ULL + 1;
+		blk = (zd->zd_seed >> 33) % ZTEST_DBUF_BLOCKS;
+		VERIFY(dmu_buf_hold(zd->zd_os, zd->zd_object,
+		    blk * ZTEST_DBUF_BLOCKSIZE, FTAG, &db) == 0);
+		if (db->db_object != zd->zd_object ||
+		    db->db_offset != blk * ZTEST_DBUF_BLOCKSIZE)
+			fatal(0, "dbuf_hold: got <%llu, %llu>, "
+			    "wanted <%llu, %llu>",
+			    (u_longlong_t)db->db_object,
+			    (u_longlong_t)db->db_offset,
+			    (u_longlong_t)zd->zd_object,
+			    (u_longlong_t)(blk * ZTEST_DBUF_BLOCKSIZE));
+		dmu_buf_rele(db, FTAG);
+	}
+	return (NULL);
+}
 
 /*
- * Completely obliterate one disk.
+ * Hold and release the cached blocks of one object from several
+ * threads at once, which is all dbuf_find() lookups, and time it.
+ * Concurrent ztest threads evicting their own dbufs exercise the
+ * deferred freeing behind the lookups.
  */
-static void
-ztest_obliterate_one_disk(uint64_t vdev)
+void
+ztest_dbuf_hold(ztest_args_t *za)
 {
-	int fd;
-	char dev_name[MAXPATHLEN], copy_name[MAXPATHLEN];
-	size_t fsize;
+	objset_t *os = za->za_os;
+	ztest_dbuf_arg_t zd[ZTEST_DBUF_THREADS];
+	thread_t tid[ZTEST_DBUF_THREADS];
+	uint64_t object, blk, holds;
+	dmu_tx_t *tx;
+	hrtime_t start, elapsed;
+	int t, error;
 
-	if (zopt_maxfaults < 2)
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_write(tx, DMU_NEW_OBJECT, 0,
+	    ZTEST_DBUF_BLOCKS * ZTEST_DBUF_BLOCKSIZE);
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error) {
+		ztest_record_enospc("create dbuf test obj");
+		dmu_tx_abort(tx);
 		return;
+	}
+	object = dmu_object_alloc(os, DMU_OT_UINT64_OTHER,
+	    ZTEST_DBUF_BLOCKSIZE, DMU_OT_NONE, 0, tx);
+	for (blk = 0; blk < ZTEST_DBUF_BLOCKS; blk++)
+		dmu_write(os, object, blk * ZTEST_DBUF_BLOCKSIZE,
+		    sizeof (uint64_t), &blk, tx);
+	dmu_tx_commit(tx);
 
-	(void) sprintf(dev_name, ztest_dev_template, zopt_dir, zopt_pool, vdev);
-	(void) snprintf(copy_name, MAXPATHLEN, "%s.old", dev_name);
-
-	fd = open(dev_name, O_RDWR);
+	holds = 10000 + ztest_random(10000);
+	start = gethrtime();
+	for (t = 0; t < ZTEST_DBUF_THREADS; t++) {
+		zd[t].zd_os = os;
+		zd[t].zd_object = object;
+		zd[t].zd_holds = holds;
+		zd[t].zd_seed = ztest_random(-1ULL);
+		error = thr_create(0, 0, ztest_dbuf_hold_thread, &zd[t],
+		    THR_BOUND, &tid[t]);
+		if (error)
+			fatal(0, "dbuf_hold: can't create thread %d: "
+			    "error %d", t, error);
+	}
+	for (t = 0; t < ZTEST_DBUF_THREADS; t++) {
+		error = thr_join(tid[t], NULL, NULL);
+		if (error)
+			fatal(0, "dbuf_hold: thr_join(%d) = %d", t, error);
+	}
+	elapsed = gethrtime() - start;
 
-	if (fd == -1)
-		fatal(1, "can't open %s", dev_name);
+	if (zopt_verbose >= 3) {
+		(void) printf("dbuf_hold: %d threads, %llu holds/sec\n",
+		    ZTEST_DBUF_THREADS, (u_longlong_t)(ZTEST_DBUF_THREADS *
+		    holds * NANOSEC / MAX(elapsed, 1)));
+	}
 
-	/*
-	 * Determine the size.
-	 */
-	fsize = lseek(fd, 0, SEEK_END);
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_free(tx, object, 0, DMU_OBJECT_END);
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error) {
+		ztest_record_enospc("free dbuf test obj");
+		dmu_tx_abort(tx);
+		return;
+	}
+	VERIFY(dmu_object_free(os, object, tx) == 0);
+	dmu_tx_commit(tx);
+}
 
-	(void) close(fd);
+#define	ZTEST_UZVOL_BLOCKS	64
+#define	ZTEST_UZVOL_BLOCKSIZE	8192
 
-	/*
-	 * Rename the old device to dev_name.old (useful for debugging).
-	 */
-	VERIFY(rename(dev_name, copy_name) == 0);
+typedef struct ztest_uzvol_arg {
+	kmutex_t	zu_lock;
+	kcondvar_t	zu_cv;
+	int		zu_pending;
+	int		zu_error;
+} ztest_uzvol_arg_t;
 
-	/*
-	 * Create a new one.
-	 */
-	VERIFY((fd = open(dev_name, O_RDWR | O_CREAT | O_TRUNC, 0666)) >= 0);
-	VERIFY(ftruncate(fd, fsize) == 0);
-	(void) close(fd);
+static void
+ztest_uzvol_done(uzvol_req_t *req)
+{
+	ztest_uzvol_arg_t *zu = req->uzr_private;
+
+	mutex_enter(&zu->zu_lock);
+	if (req->uzr_error != 0 && zu->zu_error == 0)
+		zu->zu_error = req->uzr_error;
+	zu->zu_pending--;
+	cv_broadcast(&zu->zu_cv);
+	mutex_exit(&zu->zu_lock);
 }
 
-static void
-ztest_replace_one_disk(spa_t *spa, uint64_t vdev)
+/*
+ * Write every block of a fresh volume through the userland volume
+ * engine, some with FUA, flush, then read it all back from a reopened
+ * volume, which replays whatever the intent log still holds.
+ */
+void
+ztest_uzvol(ztest_args_t *za)
 {
-	char dev_name[MAXPATHLEN];
-	nvlist_t *file, *root;
+	ztest_uzvol_arg_t zu;
+	uzvol_req_t req[ZTEST_UZVOL_BLOCKS];
+	uzvol_t *zv;
+	char name[100];
+	char *buf;
+	uint64_t blk, *wp;
+	uint64_t size = ZTEST_UZVOL_BLOCKS * ZTEST_UZVOL_BLOCKSIZE;
+	hrtime_t start, elapsed;
 	int error;
-	uint64_t guid;
-	uint64_t ashift = ztest_get_ashift();
-	vdev_t *vd;
 
-	(void) sprintf(dev_name, ztest_dev_template, zopt_dir, zopt_pool, vdev);
+	(void) rw_rdlock(&ztest_shared->zs_name_lock);
+	(void) snprintf(name, 100, "%s/uzvol_%llu", za->za_pool,
+	    (u_longlong_t)za->za_instance);
 
-	/*
-	 * Build the nvlist describing dev_name.
-	 */
-	VERIFY(nvlist_alloc(&file, NV_UNIQUE_NAME, 0) == 0);
-	VERIFY(nvlist_add_string(file, ZPOOL_CONFIG_TYPE, VDEV_TYPE_FILE) == 0);
-	VERIFY(nvlist_add_string(file, ZPOOL_CONFIG_PATH, dev_name) == 0);
-	VERIFY(nvlist_add_uint64(file, ZPOOL_CONFIG_ASHIFT, ashift) == 0);
+	/* a previous run may have left it behind */
+	(void) dmu_objset_destroy(name);
 
-	VERIFY(nvlist_alloc(&root, NV_UNIQUE_NAME, 0) == 0);
-	VERIFY(nvlist_add_string(root, ZPOOL_CONFIG_TYPE, VDEV_TYPE_ROOT) == 0);
-	VERIFY(nvlist_add_nvlist_array(root, ZPOOL_CONFIG_CHILDREN,
-	    &file, 1) == 0);
+	error = uzvol_create(name, size, ZTEST_UZVOL_BLOCKSIZE);
+	if (error) {
+		(void) rw_unlock(&ztest_shared->zs_name_lock);
+		if (error == ENOSPC) {
+			ztest_record_enospc("uzvol_create");
+			return;
+		}
+		fatal(0, "uzvol_create(%s) = %d", name, error);
+	}
+	error = uzvol_open(name, 4, &zv);
+	if (error)
+		fatal(0, "uzvol_open(%s) = %d", name, error);
+
+	buf = umem_alloc(size, UMEM_NOFAIL);
+	for (wp = (uint64_t *)buf; (char *)wp < buf + size; wp++)
+		*wp = ztest_random(-1ULL);
+
+	mutex_init(&zu.zu_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&zu.zu_cv, NULL, CV_DEFAULT, NULL);
+	zu.zu_pending = ZTEST_UZVOL_BLOCKS;
+	zu.zu_error = 0;
+
+	start = gethrtime();
+	for (blk = 0; blk < ZTEST_UZVOL_BLOCKS; blk++) {
+		bzero(&req[blk], sizeof (uzvol_req_t));
+		req[blk].uzr_op = UZVOL_WRITE;
+		req[blk].uzr_flags = ztest_random(4) ? 0 : UZVOL_FUA;
+		req[blk].uzr_offset = blk * ZTEST_UZVOL_BLOCKSIZE;
+		req[blk].uzr_length = ZTEST_UZVOL_BLOCKSIZE;
+		req[blk].uzr_data = buf + blk * ZTEST_UZVOL_BLOCKSIZE;
+		req[blk].uzr_done = ztest_uzvol_done;
+		req[blk].uzr_private = &zu;
+		uzvol_submit(zv, &req[blk]);
+	}
+	mutex_enter(&zu.zu_lock);
+	while (zu.zu_pending != 0)
+		cv_wait(&zu.zu_cv, &zu.zu_lock);
+	mutex_exit(&zu.zu_lock);
+	elapsed = gethrtime() - start;
+
+	if (zu.zu_error == ENOSPC) {
+		ztest_record_enospc("uzvol write");
+	} else if (zu.zu_error) {
+		fatal(0, "uzvol write = %d", zu.zu_error);
+	} else {
+		bzero(&req[0], sizeof (uzvol_req_t));
+		req[0].uzr_op = UZVOL_FLUSH;
+		VERIFY(uzvol_io(zv, &req[0]) == 0);
 
-	spa_config_enter(spa, RW_READER, FTAG);
-	if ((vd = vdev_lookup_by_path(spa->spa_root_vdev, dev_name)) == NULL)
-		guid = 0;
-	else
-		guid = vd->vdev_guid;
-	spa_config_exit(spa, FTAG);
-	error = spa_vdev_attach(spa, guid, root, B_TRUE);
-	if (error != 0 &&
-	    error != EBUSY &&
-	    error != ENOTSUP &&
-	    error != ENODEV &&
-	    error != EDOM)
-		fatal(0, "spa_vdev_attach(in-place) = %d", error);
+		uzvol_close(zv);
+		error = uzvol_open(name, 1, &zv);
+		if (error)
+			fatal(0, "uzvol_open(%s) = %d", name, error);
+
+		bzero(&req[0], sizeof (uzvol_req_t));
+		req[0].uzr_op = UZVOL_READ;
+		req[0].uzr_length = size;
+		req[0].uzr_data = umem_alloc(size, UMEM_NOFAIL);
+		VERIFY(uzvol_io(zv, &req[0]) == 0);
+		if (bcmp(req[0].uzr_data, buf, size) != 0)
+			fatal(0, "uzvol %s: data mismatch", name);
+		umem_free(req[0].uzr_data, size);
+
+		if (zopt_verbose >= 3) {
+			(void) printf("uzvol: %d writes, %llu writes/sec\n",
+			    ZTEST_UZVOL_BLOCKS, (u_longlong_t)
+			    (ZTEST_UZVOL_BLOCKS * NANOSEC / MAX(elapsed, 1)));
+		}
+	}
 
-	nvlist_free(file);
-	nvlist_free(root);
+	uzvol_close(zv);
+	cv_destroy(&zu.zu_cv);
+	mutex_destroy(&zu.zu_lock);
+	umem_free(buf, size);
+
+	error = dmu_objset_destroy(name);
+	if (error && error != EBUSY)
+		fatal(0, "dmu_objset_destroy(%s) = %d", name, error);
+	(void) rw_unlock(&ztest_shared->zs_name_lock);
 }
 
-/* fake getexecname() by just saving Arg0, which is supposed to be the
-   full path to the executable. */
-char *getexecname_fake=0;
+#define	ZTEST_DNODE_MAXTHREADS	8
+#define	ZTEST_DNODE_OBJECTS	32
 
-static void
-ztest_verify_blocks(char *pool)
-{
-	int status;
-	char zdb[MAXPATHLEN + MAXNAMELEN + 20];
-	char zbuf[1024];
-	char *bin;
-	char *ztest;
-	char *isa;
-	int isalen;
-	FILE *fp;
-	
-#ifdef __APPLE__
-	/* Assume zdb is always located at /usr/sbin/zdb */
-	/* snprintf(zdb, 15, "%s", "/usr/bin/ztest"); */
-	(void) realpath(getexecname_fake, zdb);
+typedef struct ztest_dnode_arg {
+	objset_t	*zn_os;
+	uint64_t	*zn_objects;
+	uint64_t	zn_holds;
+	uint64_t	zn_seed;
+} ztest_dnode_arg_t;
 
-	ztest = strstr(zdb, "/ztest");
-#ifdef ZDB_STATIC
-	strcpy(ztest, "/" __STRING(ZDB_STATIC));
-#else
-	strcpy(ztest, "/zdb");
-#endif
-	if (access(zdb, F_OK) != 0) {
-		/* zdb not found in same path as ztest. */
-		printf("Failed to find zdb as '%s'\n", zdb);
-#ifdef ZDB_STATIC
-		strcpy(zdb,"/usr/sbin/" __STRING(ZDB_STATIC));
-#else
-		strcpy(zdb,"/usr/sbin/zdb");
-#endif
+static void *
+ztest_dnode_hold_thread(void *arg)
+{
+	ztest_dnode_arg_t *zn = arg;
+	dmu_buf_t *db;
+	uint64_t i, object;
+
+	for (i = 0; i < zn->zn_holds; i++) {
+		zn->zn_seed = zn->zn_seed * 6364136223846793005ULL + 1;
+		object = zn->zn_objects[(zn->zn_seed >> 33) %
+		    ZTEST_DNODE_OBJECTS];
+		VERIFY(dmu_bonus_hold(zn->zn_os, object, FTAG, &db) == 0);
+		if (db->db_object != object)
+			fatal(0, "dnode_hold: got %llu, wanted %llu",
+			    (u_longlong_t)db->db_object, (u_longlong_t)object);
+		dmu_buf_rele(db, FTAG);
 	}
-	bin = strdup(zdb);
-	(void) sprintf(zdb, "%s -bc%s%s -U -O %s %s",
-	    bin,
-	    zopt_verbose >= 3 ? "s" : "",
-	    zopt_verbose >= 4 ? "v" : "",
-	    ztest_random(2) == 0 ? "pre" : "post", pool);
-	#else
-	(void) realpath(getexecname(), zdb);
-
-	/* zdb lives in /usr/sbin, while ztest lives in /usr/bin */
-	bin = strstr(zdb, "/usr/bin/");
-	ztest = strstr(bin, "/ztest");
-	isa = bin + 8;
-	isalen = ztest - isa;
-	isa = strdup(isa);
-	/* LINTED */
-	(void) sprintf(bin, "/usr/sbin%.*s/zdb -bc%s%s -U -O %s %s",
-	    isalen,
-	    isa,
-	    zopt_verbose >= 3 ? "s" : "",
-	    zopt_verbose >= 4 ? "v" : "",
-	    ztest_random(2) == 0 ? "pre" : "post", pool);
-	free(isa);
-	#endif
+
+	return (NULL);
+}
+
+/*
+ * Hold the bonus buffers of a set of objects, as the ZPL does for its
+ * cached znodes, then look their dnodes up from a growing number of
+ * threads, which all goes through the dnode hold fast path, and report
+ * the rate for each thread count.
+ */
+void
+ztest_dnode_hold(ztest_args_t *za)
+{
+	objset_t *os = za->za_os;
+	ztest_dnode_arg_t zn[ZTEST_DNODE_MAXTHREADS];
+	thread_t tid[ZTEST_DNODE_MAXTHREADS];
+	uint64_t objects[ZTEST_DNODE_OBJECTS];
+	dmu_buf_t *bonus[ZTEST_DNODE_OBJECTS];
+	uint64_t holds;
+	dmu_tx_t *tx;
+	hrtime_t start, elapsed;
+	int i, t, nthreads, error;
+
+	tx = dmu_tx_create(os);
+	for (i = 0; i < ZTEST_DNODE_OBJECTS; i++)
+		dmu_tx_hold_bonus(tx, DMU_NEW_OBJECT);
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error) {
+		ztest_record_enospc("create dnode test objs");
+		dmu_tx_abort(tx);
+		return;
+	}
+	for (i = 0; i < ZTEST_DNODE_OBJECTS; i++) {
+		objects[i] = dmu_object_alloc(os, DMU_OT_UINT64_OTHER, 0,
+		    DMU_OT_UINT64_OTHER, sizeof (uint64_t), tx);
+		VERIFY(dmu_bonus_hold(os, objects[i], FTAG, &bonus[i]) == 0);
+	}
+	dmu_tx_commit(tx);
+
+	holds = 10000 + ztest_random(10000);
+	for (nthreads = 1; nthreads <= ZTEST_DNODE_MAXTHREADS;
+	    nthreads <<= 1) {
+		start = gethrtime();
+		for (t = 0; t < nthreads; t++) {
+			zn[t].zn_os = os;
+			zn[t].zn_objects = objects;
+			zn[t].zn_holds = holds;
+			zn[t].zn_seed = ztest_random(-1ULL);
+			error = thr_create(0, 0, ztest_dnode_hold_thread,
+			    &zn[t], THR_BOUND, &tid[t]);
+			if (error)
+				fatal(0, "dnode_hold: can't create thread %d: "
+				    "error %d", t, error);
+		}
+		for (t = 0; t < nthreads; t++) {
+			error = thr_join(tid[t], NULL, NULL);
+			if (error)
+				fatal(0, "dnode_hold: thr_join(%d) = %d",
+				    t, error);
+		}
+		elapsed = gethrtime() - start;
+
+		if (zopt_verbose >= 3) {
+			(void) printf("dnode_hold: %d threads, "
+			    "%llu holds/sec\n", nthreads,
+			    (u_longlong_t)(nthreads * holds * NANOSEC /
+			    MAX(elapsed, 1)));
+		}
+	}
+
+	for (i = 0; i < ZTEST_DNODE_OBJECTS; i++)
+		dmu_buf_rele(bonus[i], FTAG);
+
+	tx = dmu_tx_create(os);
+	for (i = 0; i < ZTEST_DNODE_OBJECTS; i++)
+		dmu_tx_hold_free(tx, objects[i], 0, DMU_OBJECT_END);
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error) {
+		ztest_record_enospc("free dnode test objs");
+		dmu_tx_abort(tx);
+		return;
+	}
+	for (i = 0; i < ZTEST_DNODE_OBJECTS; i++)
+		VERIFY(dmu_object_free(os, objects[i], tx) == 0);
+	dmu_tx_commit(tx);
+}
+
+#define	ZTEST_LOAN_BLOCKSIZE	SPA_MAXBLOCKSIZE
+#define	ZTEST_LOAN_SIZE		(8 * ZTEST_LOAN_BLOCKSIZE)
+#define	ZTEST_LOAN_PASSES	64
+
+/*
+ * Check that a loaned read sees the same bytes as dmu_read(), then
+ * read a cached object over and over both ways and compare the rates.
+ */
+void
+ztest_dmu_read_loan(ztest_args_t *za)
+{
+	objset_t *os = za->za_os;
+	dmu_loan_t *dl;
+	dmu_tx_t *tx;
+	uint64_t object, off, *wp;
+	char *buf, *copy;
+	hrtime_t start, copytime, loantime;
+	int i, pass, error;
+
+	buf = umem_alloc(ZTEST_LOAN_SIZE, UMEM_NOFAIL);
+	copy = umem_alloc(ZTEST_LOAN_SIZE, UMEM_NOFAIL);
+	for (wp = (uint64_t *)buf; (char *)wp < buf + ZTEST_LOAN_SIZE; wp++)
+		*wp = ztest_random(-1ULL);
+
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_write(tx, DMU_NEW_OBJECT, 0, ZTEST_LOAN_SIZE);
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error) {
+		ztest_record_enospc("create loan test obj");
+		dmu_tx_abort(tx);
+		umem_free(buf, ZTEST_LOAN_SIZE);
+		umem_free(copy, ZTEST_LOAN_SIZE);
+		return;
+	}
+	object = dmu_object_alloc(os, DMU_OT_UINT64_OTHER,
+	    ZTEST_LOAN_BLOCKSIZE, DMU_OT_NONE, 0, tx);
+	dmu_write(os, object, 0, ZTEST_LOAN_SIZE, buf, tx);
+	dmu_tx_commit(tx);
+
+	/* an unaligned loan, with a second reference handed out */
+	off = ztest_random(ZTEST_LOAN_BLOCKSIZE);
+	VERIFY(dmu_read_loan(os, object, off, ZTEST_LOAN_SIZE - off,
+	    &dl) == 0);
+	dmu_loan_hold(dl);
+	VERIFY(dl->dl_offset == off);
+	VERIFY(dl->dl_length == ZTEST_LOAN_SIZE - off);
+	for (i = 0; i < dl->dl_numbufs; i++) {
+		if (bcmp(dl->dl_segs[i].dls_data, buf + off,
+		    dl->dl_segs[i].dls_len) != 0)
+			fatal(0, "dmu_read_loan: segment %d differs", i);
+		off += dl->dl_segs[i].dls_len;
+	}
+	VERIFY(off == ZTEST_LOAN_SIZE);
+	dmu_loan_rele(dl);
+	dmu_loan_rele(dl);
+
+	start = gethrtime();
+	for (pass = 0; pass < ZTEST_LOAN_PASSES; pass++)
+		VERIFY(dmu_read(os, object, 0, ZTEST_LOAN_SIZE, copy) == 0);
+	copytime = gethrtime() - start;
+
+	start = gethrtime();
+	for (pass = 0; pass < ZTEST_LOAN_PASSES; pass++) {
+		VERIFY(dmu_read_loan(os, object, 0, ZTEST_LOAN_SIZE,
+		    &dl) == 0);
+		dmu_loan_rele(dl);
+	}
+	loantime = gethrtime() - start;
+
+	if (bcmp(copy, buf, ZTEST_LOAN_SIZE) != 0)
+		fatal(0, "dmu_read: data mismatch");
+
+	if (zopt_verbose >= 3) {
+		(void) printf("dmu_read_loan: copy %llu MB/s, loan %llu MB/s\n",
+		    (u_longlong_t)((uint64_t)ZTEST_LOAN_PASSES *
+		    ZTEST_LOAN_SIZE * (NANOSEC >> 20) / MAX(copytime, 1)),
+		    (u_longlong_t)((uint64_t)ZTEST_LOAN_PASSES *
+		    ZTEST_LOAN_SIZE * (NANOSEC >> 20) / MAX(loantime, 1)));
+	}
+
+	umem_free(buf, ZTEST_LOAN_SIZE);
+	umem_free(copy, ZTEST_LOAN_SIZE);
+
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_free(tx, object, 0, DMU_OBJECT_END);
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error) {
+		ztest_record_enospc("free loan test obj");
+		dmu_tx_abort(tx);
+		return;
+	}
+	VERIFY(dmu_object_free(os, object, tx) == 0);
+	dmu_tx_commit(tx);
+}
+
+#define	ZTEST_PARTIAL_BLOCKS	3
+#define	ZTEST_PARTIAL_CHUNK	4096
+
+/*
+ * Drop the partial fill of an uncached block in the txg that made it:
+ * write the head of block 0 and free the block, and write the head of
+ * block 1 and leave it to be merged.  Then write the head of block 2
+ * and free the whole object in the same txg.
+ */
+void
+ztest_dmu_partial_free(ztest_args_t *za)
+{
+	objset_t *os = za->za_os;
+	dmu_tx_t *tx;
+	uint64_t object, bsize, off, want, *wp;
+	char *buf;
+	int b, i, error;
+
+	bsize = SPA_MAXBLOCKSIZE;
+	buf = umem_alloc(bsize, UMEM_NOFAIL);
+	wp = (uint64_t *)buf;
+
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_write(tx, DMU_NEW_OBJECT, 0, ZTEST_PARTIAL_BLOCKS * bsize);
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error) {
+		ztest_record_enospc("create partial fill test obj");
+		dmu_tx_abort(tx);
+		umem_free(buf, bsize);
+		return;
+	}
+	object = dmu_object_alloc(os, DMU_OT_UINT64_OTHER, bsize,
+	    DMU_OT_NONE, 0, tx);
+	for (b = 0; b < ZTEST_PARTIAL_BLOCKS; b++) {
+		off = b * bsize;
+		for (i = 0; i < bsize / 8; i++)
+			wp[i] = off + i * 8;
+		dmu_write(os, object, off, bsize, buf, tx);
+	}
+	dmu_tx_commit(tx);
+	txg_wait_synced(dmu_objset_pool(os), 0);
+
+	/* get the blocks out of the cache so that the writes defer */
+	arc_flush();
+
+	for (i = 0; i < ZTEST_PARTIAL_CHUNK / 8; i++)
+		wp[i] = -1ULL;
+
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_write(tx, object, 0, bsize + ZTEST_PARTIAL_CHUNK);
+	dmu_tx_hold_free(tx, object, 0, bsize);
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error) {
+		ztest_record_enospc("partial fill then free");
+		dmu_tx_abort(tx);
+		goto out;
+	}
+	dmu_write(os, object, 0, ZTEST_PARTIAL_CHUNK, buf, tx);
+	dmu_write(os, object, bsize, ZTEST_PARTIAL_CHUNK, buf, tx);
+	VERIFY(dmu_free_range(os, object, 0, bsize, tx) == 0);
+	dmu_tx_commit(tx);
+	txg_wait_synced(dmu_objset_pool(os), 0);
+
+	for (b = 0; b < 2; b++) {
+		off = b * bsize;
+		VERIFY(dmu_read(os, object, off, bsize, buf) == 0);
+		for (i = 0; i < bsize / 8; i++) {
+			if (b == 0)
+				want = 0;
+			else if (i < ZTEST_PARTIAL_CHUNK / 8)
+				want = -1ULL;
+			else
+				want = off + i * 8;
+			if (wp[i] != want)
+				fatal(0, "partial fill block %d word %d = %llx",
+				    b, i, (u_longlong_t)wp[i]);
+		}
+	}
+
+	arc_flush();
+
+	for (i = 0; i < ZTEST_PARTIAL_CHUNK / 8; i++)
+		wp[i] = -1ULL;
+out:
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_write(tx, object, 2 * bsize, ZTEST_PARTIAL_CHUNK);
+	dmu_tx_hold_free(tx, object, 0, DMU_OBJECT_END);
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error) {
+		ztest_record_enospc("free partial fill test obj");
+		dmu_tx_abort(tx);
+		umem_free(buf, bsize);
+		return;
+	}
+	dmu_write(os, object, 2 * bsize, ZTEST_PARTIAL_CHUNK, buf, tx);
+	VERIFY(dmu_object_free(os, object, tx) == 0);
+	dmu_tx_commit(tx);
+
+	umem_free(buf, bsize);
+}
+
+#define	ZTEST_PROBE_PASSES	16
+
+/*
+ * Compress a block of random bytes and a block drawn from a 16-symbol
+ * alphabet with gzip, with and without the early-abort probe.  The
+ * probe must reject the first without changing the result for the
+ * second, which lzjb can't shrink but gzip can.
+ */
+/* ARGSUSED */
+void
+ztest_compress_probe(ztest_args_t *za)
+{
+	uint64_t size = SPA_MAXBLOCKSIZE;
+	uint64_t csize[2], cbufsize, skipped, saved;
+	void *cbuf;
+	uchar_t *buf;
+	hrtime_t start, elapsed[2];
+	int i, probe, pass, ret[2];
+
+	buf = umem_alloc(size, UMEM_NOFAIL);
+
+	for (i = 0; i < size; i++)
+		buf[i] = ztest_random(256);
+	for (probe = 0; probe < 2; probe++) {
+		zio_compress_probe = probe;
+		start = gethrtime();
+		for (pass = 0; pass < ZTEST_PROBE_PASSES; pass++) {
+			if (zio_compress_data(ZIO_COMPRESS_GZIP_6, buf, size,
+			    &cbuf, &csize[probe], &cbufsize))
+				fatal(0, "random block compressed");
+		}
+		elapsed[probe] = gethrtime() - start;
+	}
+	zio_compress_probe = 1;
+
+	for (i = 0; i < size; i++)
+		buf[i] = 'a' + ztest_random(16);
+	for (probe = 0; probe < 2; probe++) {
+		zio_compress_probe = probe;
+		ret[probe] = zio_compress_data(ZIO_COMPRESS_GZIP_6, buf, size,
+		    &cbuf, &csize[probe], &cbufsize);
+		if (ret[probe])
+			zio_buf_free(cbuf, cbufsize);
+	}
+	zio_compress_probe = 1;
+	VERIFY(ret[0] == 1 && ret[1] == 1);
+	VERIFY(csize[0] == csize[1]);
+
+	umem_free(buf, size);
+
+	if (zopt_verbose >= 3) {
+		zio_compress_get_stats(&skipped, &saved);
+		(void) printf("compress probe: random gzip-6 block %llu us, "
+		    "probed %llu us; %lluK skipped, %lluK saved so far\n",
+		    (u_longlong_t)(elapsed[0] / ZTEST_PROBE_PASSES / 1000),
+		    (u_longlong_t)(elapsed[1] / ZTEST_PROBE_PASSES / 1000),
+		    (u_longlong_t)(skipped >> 10), (u_longlong_t)(saved >> 10));
+	}
+}
+
+#define	ZTEST_LAT_SIZE		(1ULL << 20)
+
+static uint64_t
+ztest_latency_count(uint64_t *buckets)
+{
+	uint64_t count = 0;
+	int b;
+
+	for (b = 0; b < ZIO_LAT_BUCKETS; b++)
+		count += buckets[b];
+	return (count);
+}
+
+static uint64_t
+ztest_latency_disk_writes(vdev_t *vd)
+{
+	uint64_t count = 0;
+	int c;
+
+	for (c = 0; c < vd->vdev_children; c++)
+		count += ztest_latency_disk_writes(vd->vdev_child[c]);
+	if (vd->vdev_ops->vdev_op_leaf)
+		count += ztest_latency_count(
+		    vd->vdev_lat.vl_disk[ZIO_TYPE_WRITE]);
+	return (count);
+}
+
+/*
+ * Turn on the zio latency histograms, write and sync a megabyte, and make
+ * sure the write shows up in the pool's end-to-end histogram and in the
+ * disk histograms of its leaf vdevs.  The histograms stay on for the rest
+ * of the run so that every other test takes the timestamping paths too.
+ */
+void
+ztest_latency(ztest_args_t *za)
+{
+	objset_t *os = za->za_os;
+	spa_t *spa = dmu_objset_spa(os);
+	spa_lat_stat_t *sl = spa->spa_lat;
+	dmu_tx_t *tx;
+	uint64_t object, total[2], disk[2], p, *buckets;
+	char *buf;
+	int b, error;
+
+	zio_latency_stats = 1;
+
+	/* random, so that compression can't turn the writes into holes */
+	buf = umem_alloc(ZTEST_LAT_SIZE, UMEM_NOFAIL);
+	for (p = 0; p < ZTEST_LAT_SIZE / sizeof (uint64_t); p++)
+		((uint64_t *)buf)[p] = ztest_random(-1ULL);
+
+	for (total[0] = 0, p = 0; p < ZIO_LAT_PRIORITIES; p++)
+		total[0] += ztest_latency_count(sl->sl_total[ZIO_TYPE_WRITE][p]);
+	spa_config_enter(spa, RW_READER, FTAG);
+	disk[0] = ztest_latency_disk_writes(spa->spa_root_vdev);
+	spa_config_exit(spa, FTAG);
+
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_write(tx, DMU_NEW_OBJECT, 0, ZTEST_LAT_SIZE);
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error) {
+		ztest_record_enospc("create latency test obj");
+		dmu_tx_abort(tx);
+		umem_free(buf, ZTEST_LAT_SIZE);
+		return;
+	}
+	object = dmu_object_alloc(os, DMU_OT_UINT64_OTHER, 0, DMU_OT_NONE,
+	    0, tx);
+	dmu_write(os, object, 0, ZTEST_LAT_SIZE, buf, tx);
+	dmu_tx_commit(tx);
+	txg_wait_synced(dmu_objset_pool(os), 0);
+
+	for (total[1] = 0, p = 0; p < ZIO_LAT_PRIORITIES; p++)
+		total[1] += ztest_latency_count(sl->sl_total[ZIO_TYPE_WRITE][p]);
+	spa_config_enter(spa, RW_READER, FTAG);
+	disk[1] = ztest_latency_disk_writes(spa->spa_root_vdev);
+	spa_config_exit(spa, FTAG);
+
+	if (total[1] <= total[0])
+		fatal(0, "no writes in the pool latency histogram");
+	if (disk[1] <= disk[0])
+		fatal(0, "no writes in the vdev disk latency histograms");
+
+	if (zopt_verbose >= 3) {
+		(void) printf("zio latency: %llu writes, %llu disk writes; "
+		    "write stage counts:",
+		    (u_longlong_t)(total[1] - total[0]),
+		    (u_longlong_t)(disk[1] - disk[0]));
+		for (b = 0; b < ZIO_LAT_STAGES; b++) {
+			buckets = sl->sl_stage[ZIO_TYPE_WRITE][b];
+			(void) printf(" %llu",
+			    (u_longlong_t)ztest_latency_count(buckets));
+		}
+		(void) printf("\n");
+	}
+
+	umem_free(buf, ZTEST_LAT_SIZE);
+
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_free(tx, object, 0, DMU_OBJECT_END);
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error) {
+		ztest_record_enospc("free latency test obj");
+		dmu_tx_abort(tx);
+		return;
+	}
+	VERIFY(dmu_object_free(os, object, tx) == 0);
+	dmu_tx_commit(tx);
+}
+
+#define	ZTEST_DELAY_READS	4
+#define	ZTEST_DELAY_IOSIZE	(64 << 10)
+#define	ZTEST_DELAY_NS		(20 * (NANOSEC / MILLISEC))
+#define	ZTEST_DELAY_BANDWIDTH	(4 << 20)
+
+static vdev_t *
+ztest_random_healthy_leaf(vdev_t *vd)
+{
+	vdev_t *leaf;
+	int c, start;
+
+	if (vd->vdev_ops->vdev_op_leaf)
+		return (vdev_is_dead(vd) || vd->vdev_psize <
+		    VDEV_LABEL_START_SIZE + VDEV_LABEL_END_SIZE ? NULL : vd);
+
+	if (vd->vdev_children == 0)
+		return (NULL);
+	start = ztest_random(vd->vdev_children);
+	for (c = 0; c < vd->vdev_children; c++) {
+		leaf = ztest_random_healthy_leaf(
+		    vd->vdev_child[(start + c) % vd->vdev_children]);
+		if (leaf != NULL)
+			return (leaf);
+	}
+	return (NULL);
+}
+
+/*
+ * Read ZTEST_DELAY_READS blocks, one at a time, from the front label
+ * region of the leaf with the given guid and return how long the slowest
+ * took, or the total.
+ */
+static hrtime_t
+ztest_inject_delay_reads(spa_t *spa, uint64_t guid, char *buf,
+    boolean_t total)
+{
+	vdev_t *vd;
+	hrtime_t start, delta, result = 0;
+	int i;
+
+	spa_config_enter(spa, RW_READER, FTAG);
+	if ((vd = vdev_lookup_by_guid(spa->spa_root_vdev, guid)) == NULL) {
+		spa_config_exit(spa, FTAG);
+		return (-1);
+	}
+	for (i = 0; i < ZTEST_DELAY_READS; i++) {
+		start = gethrtime();
+		(void) zio_wait(zio_read_phys(NULL, vd,
+		    i * ZTEST_DELAY_IOSIZE, ZTEST_DELAY_IOSIZE, buf,
+		    ZIO_CHECKSUM_OFF, NULL, NULL, ZIO_PRIORITY_SYNC_READ,
+		    ZIO_FLAG_CANFAIL | ZIO_FLAG_DONT_CACHE |
+		    ZIO_FLAG_DONT_RETRY));
+		delta = gethrtime() - start;
+		result = total ? result + delta : MAX(result, delta);
+	}
+	spa_config_exit(spa, FTAG);
+
+	return (result);
+}
+
+/*
+ * Give a random leaf an injected latency, then a bandwidth limit, and
+ * check that reads from it slow down by at least that much.
+ */
+void
+ztest_inject_delay(ztest_args_t *za)
+{
+	spa_t *spa = dmu_objset_spa(za->za_os);
+	zinject_record_t record;
+	vdev_t *vd;
+	uint64_t guid;
+	hrtime_t slowest, total;
+	char *buf;
+	int id;
+
+	spa_config_enter(spa, RW_READER, FTAG);
+	vd = ztest_random_healthy_leaf(spa->spa_root_vdev);
+	guid = (vd == NULL) ? 0 : vd->vdev_guid;
+	spa_config_exit(spa, FTAG);
+	if (guid == 0)
+		return;
+
+	buf = umem_alloc(ZTEST_DELAY_IOSIZE, UMEM_NOFAIL);
+
+	bzero(&record, sizeof (record));
+	record.zi_cmd = ZINJECT_CMD_DELAY_IO;
+	record.zi_guid = guid;
+	record.zi_timer = ZTEST_DELAY_NS;
+	record.zi_dist = ZINJECT_DIST_FIXED;
+	VERIFY(zio_inject_fault(za->za_pool, 0, &id, &record) == 0);
+	slowest = ztest_inject_delay_reads(spa, guid, buf, B_FALSE);
+	VERIFY(zio_clear_fault(id) == 0);
+	if (slowest != -1 && slowest < ZTEST_DELAY_NS)
+		fatal(0, "injected delay: read took %llu ns, wanted %llu",
+		    (u_longlong_t)slowest, (u_longlong_t)ZTEST_DELAY_NS);
+
+	bzero(&record, sizeof (record));
+	record.zi_cmd = ZINJECT_CMD_BANDWIDTH;
+	record.zi_guid = guid;
+	record.zi_bandwidth = ZTEST_DELAY_BANDWIDTH;
+	VERIFY(zio_inject_fault(za->za_pool, 0, &id, &record) == 0);
+	total = ztest_inject_delay_reads(spa, guid, buf, B_TRUE);
+	VERIFY(zio_clear_fault(id) == 0);
+	if (total != -1 && total < (hrtime_t)ZTEST_DELAY_READS *
+	    ZTEST_DELAY_IOSIZE * NANOSEC / ZTEST_DELAY_BANDWIDTH)
+		fatal(0, "injected bandwidth: %d reads took %llu ns",
+		    ZTEST_DELAY_READS, (u_longlong_t)total);
+
+	if (zopt_verbose >= 3 && slowest != -1 && total != -1)
+		(void) printf("inject delay: slowest read %llu us with %llu us "
+		    "added, %dK in %llu us at %dK/s\n",
+		    (u_longlong_t)(slowest / 1000),
+		    (u_longlong_t)(ZTEST_DELAY_NS / 1000),
+		    (ZTEST_DELAY_READS * ZTEST_DELAY_IOSIZE) >> 10,
+		    (u_longlong_t)(total / 1000), ZTEST_DELAY_BANDWIDTH >> 10);
+
+	umem_free(buf, ZTEST_DELAY_IOSIZE);
+}
+
+void
+ztest_dsl_prop_get_set(ztest_args_t *za)
+{
+	objset_t *os = za->za_os;
+	int i, inherit;
+	uint64_t value;
+	const char *prop, *valname;
+	char setpoint[MAXPATHLEN];
+	char osname[MAXNAMELEN];
+	int error;
+
+	(void) rw_rdlock(&ztest_shared->zs_name_lock);
+
+	dmu_objset_name(os, osname);
+
+	for (i = 0; i < 2; i++) {
+		if (i == 0) {
+			prop = "checksum";
+			value = ztest_random_checksum();
+			inherit = (value == ZIO_CHECKSUM_INHERIT);
+		} else {
+			prop = "compression";
+			value = ztest_random_compress();
+			inherit = (value == ZIO_COMPRESS_INHERIT);
+		}
+
+		error = dsl_prop_set(osname, prop, sizeof (value),
+		    !inherit, &value);
+
+		if (error == ENOSPC) {
+			ztest_record_enospc("dsl_prop_set");
+			break;
+		}
+
+		ASSERT3U(error, ==, 0);
+
+		VERIFY3U(dsl_prop_get(osname, prop, sizeof (value),
+		    1, &value, setpoint), ==, 0);
+
+		if (i == 0)
+			valname = zio_checksum_table[value].ci_name;
+		else
+			valname = zio_compress_table[value].ci_name;
+
+		if (zopt_verbose >= 6) {
+			(void) printf("%s %s = %s for '%s'\n",
+			    osname, prop, valname, setpoint);
+		}
+	}
+
+	(void) rw_unlock(&ztest_shared->zs_name_lock);
+}
+
+static void
+ztest_error_setup(vdev_t *vd, int mode, int mask, uint64_t arg)
+{
+	int c;
+
+	for (c = 0; c < vd->vdev_children; c++)
+		ztest_error_setup(vd->vdev_child[c], mode, mask, arg);
+
+	if (vd->vdev_path != NULL) {
+		vd->vdev_fault_mode = mode;
+		vd->vdev_fault_mask = mask;
+		vd->vdev_fault_arg = arg;
+	}
+}
+
+/*
+ * Inject random faults into the on-disk data.
+ */
+void
+ztest_fault_inject(ztest_args_t *za)
+{
+	int fd;
+	uint64_t offset;
+	uint64_t leaves = MAX(zopt_mirrors, 1) * zopt_raidz;
+	uint64_t bad = 0x1990c0ffeedecade;
+	uint64_t top, leaf;
+	char path0[MAXPATHLEN];
+	char pathrand[MAXPATHLEN];
+	size_t fsize;
+	spa_t *spa = dmu_objset_spa(za->za_os);
+	int bshift = SPA_MAXBLOCKSHIFT + 2;	/* don't scrog all labels */
+	int iters = 1000;
+	vdev_t *vd0;
+	uint64_t guid0 = 0;
+
+	/*
+	 * We can't inject faults when we have no fault tolerance.
+	 */
+	if (zopt_maxfaults == 0)
+		return;
+
+	ASSERT(leaves >= 2);
+
+	/*
+	 * Pick a random top-level vdev.
+	 */
+	spa_config_enter(spa, RW_READER, FTAG);
+	top = ztest_random(spa->spa_root_vdev->vdev_children);
+	spa_config_exit(spa, FTAG);
+
+	/*
+	 * Pick a random leaf.
+	 */
+	leaf = ztest_random(leaves);
+
+	/*
+	 * Generate paths to the first two leaves in this top-level vdev,
+	 * and to the random leaf we selected.  We'll induce transient
+	 * I/O errors and random online/offline activity on leaf 0,
+	 * and we'll write random garbage to the randomly chosen leaf.
+	 */
+	(void) snprintf(path0, sizeof (path0),
+	    ztest_dev_template, zopt_dir, zopt_pool, top * leaves + 0);
+	(void) snprintf(pathrand, sizeof (pathrand),
+	    ztest_dev_template, zopt_dir, zopt_pool, top * leaves + leaf);
+
+	dprintf("damaging %s and %s\n", path0, pathrand);
+
+	spa_config_enter(spa, RW_READER, FTAG);
+
+	/*
+	 * If we can tolerate two or more faults, make vd0 fail randomly.
+	 */
+	vd0 = vdev_lookup_by_path(spa->spa_root_vdev, path0);
+	if (vd0 != NULL && zopt_maxfaults >= 2) {
+		guid0 = vd0->vdev_guid;
+		ztest_error_setup(vd0, VDEV_FAULT_COUNT,
+		    (1U << ZIO_TYPE_READ) | (1U << ZIO_TYPE_WRITE), 100);
+	}
+
+	spa_config_exit(spa, FTAG);
+
+	/*
+	 * If we can tolerate two or more faults, randomly online/offline vd0.
+	 */
+	if (zopt_maxfaults >= 2 && guid0 != 0) {
+		if (ztest_random(10) < 6)
+			(void) vdev_offline(spa, guid0, B_TRUE);
+		else
+			(void) vdev_online(spa, guid0, B_FALSE, NULL);
+	}
+
+	/*
+	 * We have at least single-fault tolerance, so inject data corruption.
+	 */
+	fd = open(pathrand, O_RDWR);
+
+	if (fd == -1)	/* we hit a gap in the device namespace */
+		return;
+
+	fsize = lseek(fd, 0, SEEK_END);
+
+	while (--iters != 0) {
+		offset = ztest_random(fsize / (leaves << bshift)) *
+		    (leaves << bshift) + (leaf << bshift) +
+		    (ztest_random(1ULL << (bshift - 1)) & -8ULL);
+
+		if (offset >= fsize)
+			continue;
+
+		if (zopt_verbose >= 6)
+			(void) printf("injecting bad word into %s,"
+			    " offset 0x%llx\n", pathrand, (u_longlong_t)offset);
+
+		if (pwrite(fd, &bad, sizeof (bad), offset) != sizeof (bad))
+			fatal(1, "can't inject bad word at 0x%llx in %s",
+			    offset, pathrand);
+	}
+
+	(void) close(fd);
+}
+
+/*
+ * Scrub the pool.
+ */
+void
+ztest_scrub(ztest_args_t *za)
+{
+	spa_t *spa = dmu_objset_spa(za->za_os);
+
+	mutex_enter(&spa_namespace_lock);
+	(void) spa_scrub(spa, POOL_SCRUB_EVERYTHING, B_FALSE);
+	mutex_exit(&spa_namespace_lock);
+	(void) poll(NULL, 0, 1000); /* wait a second, then force a restart */
+	mutex_enter(&spa_namespace_lock);
+	(void) spa_scrub(spa, POOL_SCRUB_EVERYTHING, B_FALSE);
+	mutex_exit(&spa_namespace_lock);
+}
+
+/*
+ * Rename the pool to a different name and then rename it back.
+ */
+void
+ztest_spa_rename(ztest_args_t *za)
+{
+	char *oldname, *newname;
+	int error;
+	spa_t *spa;
+
+	(void) rw_wrlock(&ztest_shared->zs_name_lock);
+
+	oldname = za->za_pool;
+	newname = umem_alloc(strlen(oldname) + 5, UMEM_NOFAIL);
+	(void) strcpy(newname, oldname);
+	(void) strcat(newname, "_tmp");
+
+	/*
+	 * Do the rename
+	 */
+	error = spa_rename(oldname, newname);
+	if (error)
+		fatal(0, "spa_rename('%s', '%s') = %d", oldname,
+		    newname, error);
+
+	/*
+	 * Try to open it under the old name, which shouldn't exist
+	 */
+	error = spa_open(oldname, &spa, FTAG);
+	if (error != ENOENT)
+		fatal(0, "spa_open('%s') = %d", oldname, error);
+
+	/*
+	 * Open it under the new name and make sure it's still the same spa_t.
+	 */
+	error = spa_open(newname, &spa, FTAG);
+	if (error != 0)
+		fatal(0, "spa_open('%s') = %d", newname, error);
+
+	ASSERT(spa == dmu_objset_spa(za->za_os));
+	spa_close(spa, FTAG);
+
+	/*
+	 * Rename it back to the original
+	 */
+	error = spa_rename(newname, oldname);
+	if (error)
+		fatal(0, "spa_rename('%s', '%s') = %d", newname,
+		    oldname, error);
+
+	/*
+	 * Make sure it can still be opened
+	 */
+	error = spa_open(oldname, &spa, FTAG);
+	if (error != 0)
+		fatal(0, "spa_open('%s') = %d", oldname, error);
+
+	ASSERT(spa == dmu_objset_spa(za->za_os));
+	spa_close(spa, FTAG);
+
+	umem_free(newname, strlen(newname) + 1);
+
+	(void) rw_unlock(&ztest_shared->zs_name_lock);
+}
+
+
+/*
+ * Completely obliterate one disk.
+ */
+static void
+ztest_obliterate_one_disk(uint64_t vdev)
+{
+	int fd;
+	char dev_name[MAXPATHLEN], copy_name[MAXPATHLEN];
+	size_t fsize;
+
+	if (zopt_maxfaults < 2)
+		return;
+
+	(void) sprintf(dev_name, ztest_dev_template, zopt_dir, zopt_pool, vdev);
+	(void) snprintf(copy_name, MAXPATHLEN, "%s.old", dev_name);
+
+	fd = open(dev_name, O_RDWR);
+
+	if (fd == -1)
+		fatal(1, "can't open %s", dev_name);
+
+	/*
+	 * Determine the size.
+	 */
+	fsize = lseek(fd, 0, SEEK_END);
+
+	(void) close(fd);
+
+	/*
+	 * Rename the old device to dev_name.old (useful for debugging).
+	 */
+	VERIFY(rename(dev_name, copy_name) == 0);
+
+	/*
+	 * Create a new one.
+	 */
+	VERIFY((fd = open(dev_name, O_RDWR | O_CREAT | O_TRUNC, 0666)) >= 0);
+	VERIFY(ftruncate(fd, fsize) == 0);
+	(void) close(fd);
+}
+
+static void
+ztest_replace_one_disk(spa_t *spa, uint64_t vdev)
+{
+	char dev_name[MAXPATHLEN];
+	nvlist_t *file, *root;
+	int error;
+	uint64_t guid;
+	uint64_t ashift = ztest_get_ashift();
+	vdev_t *vd;
+
+	(void) sprintf(dev_name, ztest_dev_template, zopt_dir, zopt_pool, vdev);
+
+	/*
+	 * Build the nvlist describing dev_name.
+	 */
+	VERIFY(nvlist_alloc(&file, NV_UNIQUE_NAME, 0) == 0);
+	VERIFY(nvlist_add_string(file, ZPOOL_CONFIG_TYPE, VDEV_TYPE_FILE) == 0);
+	VERIFY(nvlist_add_string(file, ZPOOL_CONFIG_PATH, dev_name) == 0);
+	VERIFY(nvlist_add_uint64(file, ZPOOL_CONFIG_ASHIFT, ashift) == 0);
+
+	VERIFY(nvlist_alloc(&root, NV_UNIQUE_NAME, 0) == 0);
+	VERIFY(nvlist_add_string(root, ZPOOL_CONFIG_TYPE, VDEV_TYPE_ROOT) == 0);
+	VERIFY(nvlist_add_nvlist_array(root, ZPOOL_CONFIG_CHILDREN,
+	    &file, 1) == 0);
+
+	spa_config_enter(spa, RW_READER, FTAG);
+	if ((vd = vdev_lookup_by_path(spa->spa_root_vdev, dev_name)) == NULL)
+		guid = 0;
+	else
+		guid = vd->vdev_guid;
+	spa_config_exit(spa, FTAG);
+	error = spa_vdev_attach(spa, guid, root, B_TRUE);
+	if (error != 0 &&
+	    error != EBUSY &&
+	    error != ENOTSUP &&
+	    error != ENODEV &&
+	    error != EDOM)
+		fatal(0, "spa_vdev_attach(in-place) = %d", error);
+
+	nvlist_free(file);
+	nvlist_free(root);
+}
+
+/* fake getexecname() by just saving Arg0, which is supposed to be the
+   full path to the executable. */
+char *getexecname_fake=0;
+
+static void
+ztest_verify_blocks(char *pool)
+{
+	int status;
+	char zdb[MAXPATHLEN + MAXNAMELEN + 20];
+	char zbuf[1024];
+	char *bin;
+	char *ztest;
+	char *isa;
+	int isalen;
+	FILE *fp;
+	
+#ifdef __APPLE__
+	/* Assume zdb is always located at /usr/sbin/zdb */
+	/* snprintf(zdb, 15, "%s", "/usr/bin/ztest"); */
+	(void) realpath(getexecname_fake, zdb);
+
+	ztest = strstr(zdb, "/ztest");
+#ifdef ZDB_STATIC
+	strcpy(ztest, "/" __STRING(ZDB_STATIC));
+#else
+	strcpy(ztest, "/zdb");
+#endif
+	if (access(zdb, F_OK) != 0) {
+		/* zdb not found in same path as ztest. */
+		printf("Failed to find zdb as '%s'\n", zdb);
+#ifdef ZDB_STATIC
+		strcpy(zdb,"/usr/sbin/" __STRING(ZDB_STATIC));
+#else
+		strcpy(zdb,"/usr/sbin/zdb");
+#endif
+	}
+	bin = strdup(zdb);
+	(void) sprintf(zdb, "%s -bc%s%s -U -O %s %s",
+	    bin,
+	    zopt_verbose >= 3 ? "s" : "",
+	    zopt_verbose >= 4 ? "v" : "",
+	    ztest_random(2) == 0 ? "pre" : "post", pool);
+	#else
+	(void) realpath(getexecname(), zdb);
+
+	/* zdb lives in /usr/sbin, while ztest lives in /usr/bin */
+	bin = strstr(zdb, "/usr/bin/");
+	ztest = strstr(bin, "/ztest");
+	isa = bin + 8;
+	isalen = ztest - isa;
+	isa = strdup(isa);
+	/* LINTED */
+	(void) sprintf(bin, "/usr/sbin%.*s/zdb -bc%s%s -U -O %s %s",
+	    isalen,
+	    isa,
+	    zopt_verbose >= 3 ? "s" : "",
+	    zopt_verbose >= 4 ? "v" : "",
+	    ztest_random(2) == 0 ? "pre" : "post", pool);
+	free(isa);
+	#endif
 
 #ifdef __APPLE__
 	if (zdb_forever) {
@@ -3020,439 +4403,1208 @@ ztest_verify_blocks(char *pool)
 #endif
 
 	if (zopt_verbose >= 5)
-	  (void) printf("Executing '%s'\n", zdb);
-	  /*		(void) printf("Executing %s\n", strstr(zdb, "zdb ")); */
+	  (void) printf("Executing '%s'\n", zdb);
+	  /*		(void) printf("Executing %s\n", strstr(zdb, "zdb ")); */
+
+	fp = popen(zdb, "r");
+
+	while (fgets(zbuf, sizeof (zbuf), fp) != NULL)
+		if (zopt_verbose >= 3)
+			(void) printf("%s", zbuf);
+
+	status = pclose(fp);
+
+	if (status == 0)
+		return;
+
+	ztest_dump_core = 0;
+	if (WIFEXITED(status))
+		fatal(0, "'%s' exit code %d", zdb, WEXITSTATUS(status));
+	else
+		fatal(0, "'%s' died with signal %d", zdb, WTERMSIG(status));
+}
+
+static void
+ztest_walk_pool_directory(char *header)
+{
+	spa_t *spa = NULL;
+
+	if (zopt_verbose >= 6)
+		(void) printf("%s\n", header);
+
+	mutex_enter(&spa_namespace_lock);
+	while ((spa = spa_next(spa)) != NULL)
+		if (zopt_verbose >= 6)
+			(void) printf("\t%s\n", spa_name(spa));
+	mutex_exit(&spa_namespace_lock);
+}
+
+static void
+ztest_spa_import_export(char *oldname, char *newname)
+{
+	nvlist_t *config;
+	uint64_t pool_guid;
+	spa_t *spa;
+	int error;
+
+	if (zopt_verbose >= 4) {
+		(void) printf("import/export: old = %s, new = %s\n",
+		    oldname, newname);
+	}
+
+	/*
+	 * Clean up from previous runs.
+	 */
+	(void) spa_destroy(newname);
+
+	/*
+	 * Get the pool's configuration and guid.
+	 */
+	error = spa_open(oldname, &spa, FTAG);
+	if (error)
+		fatal(0, "spa_open('%s') = %d", oldname, error);
+
+	pool_guid = spa_guid(spa);
+	spa_close(spa, FTAG);
+
+	ztest_walk_pool_directory("pools before export");
+
+	/*
+	 * Export it.
+	 */
+	error = spa_export(oldname, &config);
+	if (error)
+		fatal(0, "spa_export('%s') = %d", oldname, error);
+
+	ztest_walk_pool_directory("pools after export");
+
+	/*
+	 * Import it under the new name.
+	 */
+	error = spa_import(newname, config, NULL);
+	if (error)
+		fatal(0, "spa_import('%s') = %d", newname, error);
+
+	ztest_walk_pool_directory("pools after import");
+
+	/*
+	 * Try to import it again -- should fail with EEXIST.
+	 */
+	error = spa_import(newname, config, NULL);
+	if (error != EEXIST)
+		fatal(0, "spa_import('%s') twice", newname);
+
+	/*
+	 * Try to import it under a different name -- should fail with EEXIST.
+	 */
+	error = spa_import(oldname, config, NULL);
+	if (error != EEXIST)
+		fatal(0, "spa_import('%s') under multiple names", newname);
+
+	/*
+	 * Verify that the pool is no longer visible under the old name.
+	 */
+	error = spa_open(oldname, &spa, FTAG);
+	if (error != ENOENT)
+		fatal(0, "spa_open('%s') = %d", newname, error);
+
+	/*
+	 * Verify that we can open and close the pool using the new name.
+	 */
+	error = spa_open(newname, &spa, FTAG);
+	if (error)
+		fatal(0, "spa_open('%s') = %d", newname, error);
+	ASSERT(pool_guid == spa_guid(spa));
+	spa_close(spa, FTAG);
+
+	nvlist_free(config);
+}
+
+static void *
+ztest_thread(void *arg)
+{
+	ztest_args_t *za = arg;
+	ztest_shared_t *zs = ztest_shared;
+	hrtime_t now, functime;
+	ztest_info_t *zi;
+	int f;
+
+	while ((now = gethrtime()) < za->za_stop) {
+		/*
+		 * See if it's time to force a crash.
+		 */
+		if (now > za->za_kill) {
+			dmu_tx_t *tx;
+			uint64_t txg;
+
+			mutex_enter(&spa_namespace_lock);
+			tx = dmu_tx_create(za->za_os);
+			VERIFY(0 == dmu_tx_assign(tx, TXG_NOWAIT));
+			txg = dmu_tx_get_txg(tx);
+			dmu_tx_commit(tx);
+			zs->zs_txg = txg;
+			if (zopt_verbose >= 3)
+				(void) printf(
+				    "killing process after txg %lld\n",
+				    (u_longlong_t)txg);
+			txg_wait_synced(dmu_objset_pool(za->za_os), txg);
+			zs->zs_alloc = spa_get_alloc(dmu_objset_spa(za->za_os));
+			zs->zs_space = spa_get_space(dmu_objset_spa(za->za_os));
+			(void) kill(getpid(), SIGKILL);
+		}
+
+		/*
+		 * Pick a random function.
+		 */
+		f = ztest_random(ZTEST_FUNCS);
+		zi = &zs->zs_info[f];
+
+		/*
+		 * Decide whether to call it, based on the requested frequency.
+		 */
+		if (zi->zi_call_target == 0 ||
+		    (double)zi->zi_call_total / zi->zi_call_target >
+		    (double)(now - zs->zs_start_time) / (zopt_time * NANOSEC))
+			continue;
+
+		atomic_add_64(&zi->zi_calls, 1);
+		atomic_add_64(&zi->zi_call_total, 1);
+
+		za->za_diroff = (za->za_instance * ZTEST_FUNCS + f) *
+		    ZTEST_DIRSIZE;
+		za->za_diroff_shared = (1ULL << 63);
+
+		ztest_dmu_write_parallel(za);
+
+		zi->zi_func(za);
+
+		functime = gethrtime() - now;
+
+		atomic_add_64(&zi->zi_call_time, functime);
+
+		if (zopt_verbose >= 4) {
+#ifdef __APPLE__
+			(void) printf("%6.2f sec in %s\n",
+				(double)functime / NANOSEC, zi->zi_name);
+#else
+			Dl_info dli;
+			(void) dladdr((void *)zi->zi_func, &dli);
+			(void) printf("%6.2f sec in %s\n",
+			    (double)functime / NANOSEC, dli.dli_sname);
+#endif
+		}
+
+		/*
+		 * If we're getting ENOSPC with some regularity, stop.
+		 */
+		if (zs->zs_enospc_count > 10)
+			break;
+	}
+
+	return (NULL);
+}
+
+/*
+ * Kick off threads to run tests on all datasets in parallel.
+ */
+static void
+ztest_run(char *pool)
+{
+	int t, d, error;
+	ztest_shared_t *zs = ztest_shared;
+	ztest_args_t *za;
+	spa_t *spa;
+	char name[100];
+
+	(void) _mutex_init(&zs->zs_vdev_lock, USYNC_THREAD, NULL);
+	(void) rwlock_init(&zs->zs_name_lock, USYNC_THREAD, NULL);
+
+	for (t = 0; t < ZTEST_SYNC_LOCKS; t++)
+		(void) _mutex_init(&zs->zs_sync_lock[t], USYNC_THREAD, NULL);
+
+	/*
+	 * Destroy one disk before we even start.
+	 * It's mirrored, so everything should work just fine.
+	 * This makes us exercise fault handling very early in spa_load().
+	 */
+	ztest_obliterate_one_disk(0);
+
+	/*
+	 * Verify that the sum of the sizes of all blocks in the pool
+	 * equals the SPA's allocated space total.
+	 */
+	ztest_verify_blocks(pool);
+
+	/*
+	 * Kick off a replacement of the disk we just obliterated.
+	 */
+	kernel_init(FREAD | FWRITE);
+	error = spa_open(pool, &spa, FTAG);
+	if (error)
+		fatal(0, "spa_open(%s) = %d", pool, error);
+	ztest_replace_one_disk(spa, 0);
+	if (zopt_verbose >= 5)
+		show_pool_stats(spa);
+	spa_close(spa, FTAG);
+	kernel_fini();
 
-	fp = popen(zdb, "r");
+	kernel_init(FREAD | FWRITE);
 
-	while (fgets(zbuf, sizeof (zbuf), fp) != NULL)
+	/*
+	 * Verify that we can export the pool and reimport it under a
+	 * different name.
+	 */
+	if (ztest_random(2) == 0) {
+		(void) snprintf(name, 100, "%s_import", pool);
+		ztest_spa_import_export(pool, name);
+		ztest_spa_import_export(name, pool);
+	}
+
+	/*
+	 * Verify that we can loop over all pools.
+	 */
+	mutex_enter(&spa_namespace_lock);
+	for (spa = spa_next(NULL); spa != NULL; spa = spa_next(spa)) {
+		if (zopt_verbose > 3) {
+			(void) printf("spa_next: found %s\n", spa_name(spa));
+		}
+	}
+	mutex_exit(&spa_namespace_lock);
+
+	/*
+	 * Open our pool.
+	 */
+	error = spa_open(pool, &spa, FTAG);
+	if (error)
+		fatal(0, "spa_open() = %d", error);
+
+	/*
+	 * Verify that we can safely inquire about about any object,
+	 * whether it's allocated or not.  To make it interesting,
+	 * we probe a 5-wide window around each power of two.
+	 * This hits all edge cases, including zero and the max.
+	 */
+	for (t = 0; t < 64; t++) {
+		for (d = -5; d <= 5; d++) {
+			error = dmu_object_info(spa->spa_meta_objset,
+			    (1ULL << t) + d, NULL);
+			ASSERT(error == 0 || error == ENOENT ||
+			    error == EINVAL);
+		}
+	}
+
+	/*
+	 * Now kick off all the tests that run in parallel.
+	 */
+	zs->zs_enospc_count = 0;
+
+	za = umem_zalloc(zopt_threads * sizeof (ztest_args_t), UMEM_NOFAIL);
+
+	if (zopt_verbose >= 4)
+		(void) printf("starting main threads...\n");
+
+	za[0].za_start = gethrtime();
+	za[0].za_stop = za[0].za_start + zopt_passtime * NANOSEC;
+	za[0].za_stop = MIN(za[0].za_stop, zs->zs_stop_time);
+	za[0].za_kill = za[0].za_stop;
+	if (ztest_random(100) < zopt_killrate)
+		za[0].za_kill -= ztest_random(zopt_passtime * NANOSEC);
+
+	for (t = 0; t < zopt_threads; t++) {
+		d = t % zopt_datasets;
+		if (t < zopt_datasets) {
+			ztest_replay_t zr;
+			int test_future = FALSE;
+			(void) rw_rdlock(&ztest_shared->zs_name_lock);
+			(void) snprintf(name, 100, "%s/%s_%d", pool, pool, d);
+			error = dmu_objset_create(name, DMU_OST_OTHER, NULL,
+			    ztest_create_cb, NULL);
+			if (error == EEXIST) {
+				test_future = TRUE;
+			} else if (error != 0) {
+				if (error == ENOSPC) {
+					zs->zs_enospc_count++;
+					(void) rw_unlock(
+					    &ztest_shared->zs_name_lock);
+					break;
+				}
+				fatal(0, "dmu_objset_create(%s) = %d",
+				    name, error);
+			}
+			error = dmu_objset_open(name, DMU_OST_OTHER,
+			    DS_MODE_STANDARD, &za[d].za_os);
+			if (error)
+				fatal(0, "dmu_objset_open('%s') = %d",
+				    name, error);
+			(void) rw_unlock(&ztest_shared->zs_name_lock);
+			if (test_future && ztest_shared->zs_txg > 0)
+				ztest_dmu_check_future_leak(za[d].za_os,
+				    ztest_shared->zs_txg);
+			zr.zr_os = za[d].za_os;
+			zil_replay(zr.zr_os, &zr, &zr.zr_assign,
+			    ztest_replay_vector);
+			za[d].za_zilog = zil_open(za[d].za_os, NULL);
+		}
+		za[t].za_pool = spa_strdup(pool);
+		za[t].za_os = za[d].za_os;
+		za[t].za_zilog = za[d].za_zilog;
+		za[t].za_instance = t;
+		za[t].za_random = ztest_random(-1ULL);
+		za[t].za_start = za[0].za_start;
+		za[t].za_stop = za[0].za_stop;
+		za[t].za_kill = za[0].za_kill;
+
+		error = thr_create(0, 0, ztest_thread, &za[t], THR_BOUND,
+		    &za[t].za_thread);
+		if (error)
+			fatal(0, "can't create thread %d: error %d",
+			    t, error);
+	}
+	ztest_shared->zs_txg = 0;
+
+	while (--t >= 0) {
+		error = thr_join(za[t].za_thread, NULL, NULL);
+		if (error)
+			fatal(0, "thr_join(%d) = %d", t, error);
+		if (za[t].za_th)
+			traverse_fini(za[t].za_th);
+		if (t < zopt_datasets) {
+			zil_close(za[t].za_zilog);
+			dmu_objset_close(za[t].za_os);
+		}
+		spa_strfree(za[t].za_pool);
+	}
+
+	umem_free(za, zopt_threads * sizeof (ztest_args_t));
+
+	if (zopt_verbose >= 3)
+		show_pool_stats(spa);
+
+	txg_wait_synced(spa_get_dsl(spa), 0);
+
+	zs->zs_alloc = spa_get_alloc(spa);
+	zs->zs_space = spa_get_space(spa);
+
+	/*
+	 * Did we have out-of-space errors?  If so, destroy a random objset.
+	 */
+	if (zs->zs_enospc_count != 0) {
+		(void) rw_rdlock(&ztest_shared->zs_name_lock);
+		(void) snprintf(name, 100, "%s/%s_%d", pool, pool,
+		    (int)ztest_random(zopt_datasets));
 		if (zopt_verbose >= 3)
-			(void) printf("%s", zbuf);
+			(void) printf("Destroying %s to free up space\n", name);
+		(void) dmu_objset_find(name, ztest_destroy_cb, NULL,
+		    DS_FIND_SNAPSHOTS | DS_FIND_CHILDREN);
+		(void) rw_unlock(&ztest_shared->zs_name_lock);
+	}
 
-	status = pclose(fp);
+	txg_wait_synced(spa_get_dsl(spa), 0);
 
-	if (status == 0)
-		return;
+	/*
+	 * Right before closing the pool, kick off a bunch of async I/O;
+	 * spa_close() should wait for it to complete.
+	 */
+	for (t = 1; t < 50; t++)
+		dmu_prefetch(spa->spa_meta_objset, t, 0, 1 << 15);
+
+	spa_close(spa, FTAG);
+
+	kernel_fini();
+}
+
+void
+print_time(hrtime_t t, char *timebuf)
+{
+	hrtime_t s = t / NANOSEC;
+	hrtime_t m = s / 60;
+	hrtime_t h = m / 60;
+	hrtime_t d = h / 24;
+
+	s -= m * 60;
+	m -= h * 60;
+	h -= d * 24;
+
+	timebuf[0] = '\0';
+
+	if (d)
+		(void) sprintf(timebuf,
+		    "%llud%02lluh%02llum%02llus", d, h, m, s);
+	else if (h)
+		(void) sprintf(timebuf, "%lluh%02llum%02llus", h, m, s);
+	else if (m)
+		(void) sprintf(timebuf, "%llum%02llus", m, s);
+	else
+		(void) sprintf(timebuf, "%llus", s);
+}
+
+/*
+ * Benchmark mode (-b), a small fio: keep ZTEST_BENCH_DEPTH random
+ * reads outstanding for the given time and report each run.  The first
+ * benchmark reads the front label region of the pool's leaf vdevs,
+ * which is all that physical reads may touch, first with the
+ * synchronous file vdev backend, then with the asynchronous one, and
+ * then again with a sick first leaf whose I/O gets an injected latency.
+ * Only reads are issued, so the pool is left as it was.
+ */
+#define	ZTEST_BENCH_DEPTH	32
+#define	ZTEST_BENCH_IOSIZE	(8 << 10)
+#define	ZTEST_BENCH_MAXLEAVES	64
+#define	ZTEST_BENCH_SICK_US	2000	/* sick leaf: base latency, */
+#define	ZTEST_BENCH_SICK_TAIL_US 8000	/* plus this mean tail */
+#define	ZTEST_BENCH_MAXPARITY	2
+
+typedef struct ztest_bench {
+	kmutex_t	zb_lock;
+	kcondvar_t	zb_cv;
+	vdev_t		*zb_leaves[ZTEST_BENCH_MAXLEAVES];
+	int		zb_nleaves;
+	spa_t		*zb_spa;	/* if zb_nbps, read these instead */
+	blkptr_t	*zb_bps;
+	int		zb_nbps;
+	int		zb_inflight;
+	hrtime_t	zb_stop;
+	uint64_t	zb_ops;
+	uint64_t	zb_errors;
+	hrtime_t	zb_time;	/* total latency */
+	hrtime_t	zb_max;		/* worst latency */
+} ztest_bench_t;
+
+typedef struct ztest_bench_io {
+	ztest_bench_t	*zbi_zb;
+	hrtime_t	zbi_start;
+	char		zbi_buf[ZTEST_BENCH_IOSIZE];
+} ztest_bench_io_t;
+
+static void ztest_bench_issue(ztest_bench_io_t *zbi);
+
+static void
+ztest_bench_done(zio_t *zio)
+{
+	ztest_bench_io_t *zbi = zio->io_private;
+	ztest_bench_t *zb = zbi->zbi_zb;
+	hrtime_t now = gethrtime();
+	hrtime_t delta = now - zbi->zbi_start;
+	boolean_t again = B_TRUE;
+
+	mutex_enter(&zb->zb_lock);
+	zb->zb_ops++;
+	if (zio->io_error)
+		zb->zb_errors++;
+	zb->zb_time += delta;
+	if (delta > zb->zb_max)
+		zb->zb_max = delta;
+	if (now >= zb->zb_stop) {
+		zb->zb_inflight--;
+		cv_broadcast(&zb->zb_cv);
+		again = B_FALSE;
+	}
+	mutex_exit(&zb->zb_lock);
 
-	ztest_dump_core = 0;
-	if (WIFEXITED(status))
-		fatal(0, "'%s' exit code %d", zdb, WEXITSTATUS(status));
+	if (again)
+		ztest_bench_issue(zbi);
 	else
-		fatal(0, "'%s' died with signal %d", zdb, WTERMSIG(status));
+		umem_free(zbi, sizeof (ztest_bench_io_t));
 }
 
 static void
-ztest_walk_pool_directory(char *header)
+ztest_bench_issue(ztest_bench_io_t *zbi)
 {
-	spa_t *spa = NULL;
+	ztest_bench_t *zb = zbi->zbi_zb;
+	zbookmark_t zbm = { 0 };
+	vdev_t *vd;
 
-	if (zopt_verbose >= 6)
-		(void) printf("%s\n", header);
+	zbi->zbi_start = gethrtime();
 
-	mutex_enter(&spa_namespace_lock);
-	while ((spa = spa_next(spa)) != NULL)
-		if (zopt_verbose >= 6)
-			(void) printf("\t%s\n", spa_name(spa));
-	mutex_exit(&spa_namespace_lock);
+	if (zb->zb_nbps != 0) {
+		zio_nowait(zio_read(NULL, zb->zb_spa,
+		    &zb->zb_bps[ztest_random(zb->zb_nbps)], zbi->zbi_buf,
+		    ZTEST_BENCH_IOSIZE, ztest_bench_done, zbi,
+		    ZIO_PRIORITY_SYNC_READ, ZIO_FLAG_CANFAIL |
+		    ZIO_FLAG_DONT_CACHE, &zbm));
+		return;
+	}
+
+	vd = zb->zb_leaves[ztest_random(zb->zb_nleaves)];
+	zio_nowait(zio_read_phys(NULL, vd, ztest_random(VDEV_LABEL_START_SIZE /
+	    ZTEST_BENCH_IOSIZE) * ZTEST_BENCH_IOSIZE, ZTEST_BENCH_IOSIZE,
+	    zbi->zbi_buf, ZIO_CHECKSUM_OFF, ztest_bench_done, zbi,
+	    ZIO_PRIORITY_SYNC_READ, ZIO_FLAG_CANFAIL | ZIO_FLAG_DONT_CACHE |
+	    ZIO_FLAG_DONT_RETRY));
 }
 
+/*
+ * Run one timed pass of the benchmark and report it.
+ */
 static void
-ztest_spa_import_export(char *oldname, char *newname)
+ztest_bench_run(ztest_bench_t *zb, const char *name)
 {
-	nvlist_t *config;
-	uint64_t pool_guid;
-	spa_t *spa;
-	int error;
+	ztest_bench_io_t *zbi;
+	hrtime_t start, elapsed;
+	int i;
 
-	if (zopt_verbose >= 4) {
-		(void) printf("import/export: old = %s, new = %s\n",
-		    oldname, newname);
+	zb->zb_ops = zb->zb_errors = 0;
+	zb->zb_time = zb->zb_max = 0;
+	zb->zb_inflight = ZTEST_BENCH_DEPTH;
+	start = gethrtime();
+	zb->zb_stop = start + zopt_bench * NANOSEC;
+	for (i = 0; i < ZTEST_BENCH_DEPTH; i++) {
+		zbi = umem_alloc(sizeof (ztest_bench_io_t), UMEM_NOFAIL);
+		zbi->zbi_zb = zb;
+		ztest_bench_issue(zbi);
 	}
+	mutex_enter(&zb->zb_lock);
+	while (zb->zb_inflight != 0)
+		cv_wait(&zb->zb_cv, &zb->zb_lock);
+	mutex_exit(&zb->zb_lock);
+	elapsed = MAX(gethrtime() - start, 1);
+
+	(void) printf("%-12s depth %d, %dK reads: %llu ops/s, %llu KB/s, "
+	    "%llu us avg, %llu us max, %llu errors\n", name,
+	    ZTEST_BENCH_DEPTH, ZTEST_BENCH_IOSIZE >> 10,
+	    (u_longlong_t)(zb->zb_ops * NANOSEC / elapsed),
+	    (u_longlong_t)(zb->zb_ops * ZTEST_BENCH_IOSIZE *
+	    (NANOSEC >> 10) / elapsed),
+	    (u_longlong_t)(zb->zb_time / MAX(zb->zb_ops, 1) / 1000),
+	    (u_longlong_t)(zb->zb_max / 1000),
+	    (u_longlong_t)zb->zb_errors);
+}
 
-	/*
-	 * Clean up from previous runs.
-	 */
-	(void) spa_destroy(newname);
-
-	/*
-	 * Get the pool's configuration and guid.
-	 */
-	error = spa_open(oldname, &spa, FTAG);
-	if (error)
-		fatal(0, "spa_open('%s') = %d", oldname, error);
-
-	pool_guid = spa_guid(spa);
-	spa_close(spa, FTAG);
+static void
+ztest_bench_leaves(ztest_bench_t *zb, vdev_t *vd)
+{
+	int c;
 
-	ztest_walk_pool_directory("pools before export");
+	if (vd->vdev_ops->vdev_op_leaf) {
+		if (zb->zb_nleaves < ZTEST_BENCH_MAXLEAVES &&
+		    !vdev_is_dead(vd) && vd->vdev_psize >
+		    VDEV_LABEL_START_SIZE + VDEV_LABEL_END_SIZE)
+			zb->zb_leaves[zb->zb_nleaves++] = vd;
+		return;
+	}
+	for (c = 0; c < vd->vdev_children; c++)
+		ztest_bench_leaves(zb, vd->vdev_child[c]);
+}
 
-	/*
-	 * Export it.
-	 */
-	error = spa_export(oldname, &config);
-	if (error)
-		fatal(0, "spa_export('%s') = %d", oldname, error);
+/*
+ * Give the leaf with the given guid a latency of ZTEST_BENCH_SICK_US
+ * plus an exponential tail; returns the injection id.
+ */
+static int
+ztest_bench_sicken(char *pool, uint64_t guid)
+{
+	zinject_record_t record;
+	int id;
+
+	bzero(&record, sizeof (record));
+	record.zi_cmd = ZINJECT_CMD_DELAY_IO;
+	record.zi_guid = guid;
+	record.zi_timer = ZTEST_BENCH_SICK_US * 1000ULL;
+	record.zi_timer_spread = ZTEST_BENCH_SICK_TAIL_US * 1000ULL;
+	record.zi_dist = ZINJECT_DIST_EXPONENTIAL;
+	VERIFY(zio_inject_fault(pool, 0, &id, &record) == 0);
+
+	return (id);
+}
 
-	ztest_walk_pool_directory("pools after export");
+static void
+ztest_bench_read(char *pool)
+{
+	ztest_bench_t zb;
+	spa_t *spa;
+	uint64_t guid;
+	int id, error;
 
-	/*
-	 * Import it under the new name.
-	 */
-	error = spa_import(newname, config, NULL);
+	kernel_init(FREAD | FWRITE);
+	error = spa_open(pool, &spa, FTAG);
 	if (error)
-		fatal(0, "spa_import('%s') = %d", newname, error);
+		fatal(0, "spa_open() = %d", error);
 
-	ztest_walk_pool_directory("pools after import");
+	bzero(&zb, sizeof (zb));
+	mutex_init(&zb.zb_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&zb.zb_cv, NULL, CV_DEFAULT, NULL);
 
-	/*
-	 * Try to import it again -- should fail with EEXIST.
-	 */
-	error = spa_import(newname, config, NULL);
-	if (error != EEXIST)
-		fatal(0, "spa_import('%s') twice", newname);
+	spa_config_enter(spa, RW_READER, FTAG);
+	ztest_bench_leaves(&zb, spa->spa_root_vdev);
+	if (zb.zb_nleaves == 0)
+		fatal(0, "no leaf vdevs to benchmark");
+	guid = zb.zb_leaves[0]->vdev_guid;
 
-	/*
-	 * Try to import it under a different name -- should fail with EEXIST.
-	 */
-	error = spa_import(oldname, config, NULL);
-	if (error != EEXIST)
-		fatal(0, "spa_import('%s') under multiple names", newname);
+	vdev_file_aio = 0;
+	ztest_bench_run(&zb, "sync");
+	vdev_file_aio = 1;
+	ztest_bench_run(&zb, "async");
 
-	/*
-	 * Verify that the pool is no longer visible under the old name.
-	 */
-	error = spa_open(oldname, &spa, FTAG);
-	if (error != ENOENT)
-		fatal(0, "spa_open('%s') = %d", newname, error);
+	spa_config_exit(spa, FTAG);
+	id = ztest_bench_sicken(pool, guid);
+	spa_config_enter(spa, RW_READER, FTAG);
+	ztest_bench_run(&zb, "sick leaf");
 
-	/*
-	 * Verify that we can open and close the pool using the new name.
-	 */
-	error = spa_open(newname, &spa, FTAG);
-	if (error)
-		fatal(0, "spa_open('%s') = %d", newname, error);
-	ASSERT(pool_guid == spa_guid(spa));
+	spa_config_exit(spa, FTAG);
+	VERIFY(zio_clear_fault(id) == 0);
+	cv_destroy(&zb.zb_cv);
+	mutex_destroy(&zb.zb_lock);
 	spa_close(spa, FTAG);
-
-	nvlist_free(config);
+	kernel_fini();
 }
 
-static void *
-ztest_thread(void *arg)
-{
-	ztest_args_t *za = arg;
-	ztest_shared_t *zs = ztest_shared;
-	hrtime_t now, functime;
-	ztest_info_t *zi;
-	int f;
-
-	while ((now = gethrtime()) < za->za_stop) {
-		/*
-		 * See if it's time to force a crash.
-		 */
-		if (now > za->za_kill) {
-			dmu_tx_t *tx;
-			uint64_t txg;
-
-			mutex_enter(&spa_namespace_lock);
-			tx = dmu_tx_create(za->za_os);
-			VERIFY(0 == dmu_tx_assign(tx, TXG_NOWAIT));
-			txg = dmu_tx_get_txg(tx);
-			dmu_tx_commit(tx);
-			zs->zs_txg = txg;
-			if (zopt_verbose >= 3)
-				(void) printf(
-				    "killing process after txg %lld\n",
-				    (u_longlong_t)txg);
-			txg_wait_synced(dmu_objset_pool(za->za_os), txg);
-			zs->zs_alloc = spa_get_alloc(dmu_objset_spa(za->za_os));
-			zs->zs_space = spa_get_space(dmu_objset_spa(za->za_os));
-			(void) kill(getpid(), SIGKILL);
-		}
-
-		/*
-		 * Pick a random function.
-		 */
-		f = ztest_random(ZTEST_FUNCS);
-		zi = &zs->zs_info[f];
-
-		/*
-		 * Decide whether to call it, based on the requested frequency.
-		 */
-		if (zi->zi_call_target == 0 ||
-		    (double)zi->zi_call_total / zi->zi_call_target >
-		    (double)(now - zs->zs_start_time) / (zopt_time * NANOSEC))
-			continue;
-
-		atomic_add_64(&zi->zi_calls, 1);
-		atomic_add_64(&zi->zi_call_total, 1);
-
-		za->za_diroff = (za->za_instance * ZTEST_FUNCS + f) *
-		    ZTEST_DIRSIZE;
-		za->za_diroff_shared = (1ULL << 63);
+#define	ZTEST_BENCH_BLOCKS	1024
 
-		ztest_dmu_write_parallel(za);
+/*
+ * Write ZTEST_BENCH_BLOCKS blocks of random data to a new object, and
+ * collect in zb the block pointers of those that landed on top-level
+ * vdev vdev_id with a single copy and no gang header.  Returns the
+ * object, for ztest_bench_free().
+ */
+static uint64_t
+ztest_bench_blocks(objset_t *os, ztest_bench_t *zb, uint64_t vdev_id)
+{
+	dmu_tx_t *tx;
+	dmu_buf_t *db;
+	blkptr_t *bp;
+	uint64_t object, *wp;
+	char *buf;
+	int b, error;
 
-		zi->zi_func(za);
+	buf = umem_alloc(ZTEST_BENCH_IOSIZE, UMEM_NOFAIL);
+	for (wp = (uint64_t *)buf; (char *)wp < buf + ZTEST_BENCH_IOSIZE; wp++)
+		*wp = ztest_random(-1ULL);
 
-		functime = gethrtime() - now;
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_write(tx, DMU_NEW_OBJECT, 0,
+	    ZTEST_BENCH_BLOCKS * ZTEST_BENCH_IOSIZE);
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error)
+		fatal(0, "dmu_tx_assign() = %d", error);
+	object = dmu_object_alloc(os, DMU_OT_UINT64_OTHER, ZTEST_BENCH_IOSIZE,
+	    DMU_OT_NONE, 0, tx);
+	for (b = 0; b < ZTEST_BENCH_BLOCKS; b++) {
+		*(uint64_t *)buf = b;
+		dmu_write(os, object, b * ZTEST_BENCH_IOSIZE,
+		    ZTEST_BENCH_IOSIZE, buf, tx);
+	}
+	dmu_tx_commit(tx);
+	txg_wait_synced(dmu_objset_pool(os), 0);
+	umem_free(buf, ZTEST_BENCH_IOSIZE);
+
+	zb->zb_spa = dmu_objset_spa(os);
+	zb->zb_bps = umem_alloc(ZTEST_BENCH_BLOCKS * sizeof (blkptr_t),
+	    UMEM_NOFAIL);
+	zb->zb_nbps = 0;
+	for (b = 0; b < ZTEST_BENCH_BLOCKS; b++) {
+		VERIFY(dmu_buf_hold(os, object, b * ZTEST_BENCH_IOSIZE,
+		    FTAG, &db) == 0);
+		bp = ((dmu_buf_impl_t *)db)->db_blkptr;
+		if (bp != NULL && !BP_IS_HOLE(bp) && !BP_IS_GANG(bp) &&
+		    BP_GET_NDVAS(bp) == 1 &&
+		    DVA_GET_VDEV(&bp->blk_dva[0]) == vdev_id)
+			zb->zb_bps[zb->zb_nbps++] = *bp;
+		dmu_buf_rele(db, FTAG);
+	}
 
-		atomic_add_64(&zi->zi_call_time, functime);
+	return (object);
+}
 
-		if (zopt_verbose >= 4) {
-#ifdef __APPLE__
-			(void) printf("%6.2f sec in %s\n",
-				(double)functime / NANOSEC, zi->zi_name);
-#else
-			Dl_info dli;
-			(void) dladdr((void *)zi->zi_func, &dli);
-			(void) printf("%6.2f sec in %s\n",
-			    (double)functime / NANOSEC, dli.dli_sname);
-#endif
-		}
+static void
+ztest_bench_free(objset_t *os, ztest_bench_t *zb, uint64_t object)
+{
+	dmu_tx_t *tx;
+	int error;
 
-		/*
-		 * If we're getting ENOSPC with some regularity, stop.
-		 */
-		if (zs->zs_enospc_count > 10)
-			break;
-	}
+	umem_free(zb->zb_bps, ZTEST_BENCH_BLOCKS * sizeof (blkptr_t));
+	zb->zb_bps = NULL;
+	zb->zb_nbps = 0;
 
-	return (NULL);
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_free(tx, object, 0, DMU_OBJECT_END);
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error)
+		fatal(0, "dmu_tx_assign() = %d", error);
+	VERIFY(dmu_object_free(os, object, tx) == 0);
+	dmu_tx_commit(tx);
 }
 
 /*
- * Kick off threads to run tests on all datasets in parallel.
+ * Mirror benchmark: random reads of real blocks on the pool's first
+ * mirror while one side of it is sick, first with the old offset
+ * striping across the children and then with load-balanced selection
+ * (vdev_mirror_load_balance).  The blocks are read with the ARC out of
+ * the way, and freed again afterwards.
  */
 static void
-ztest_run(char *pool)
+ztest_bench_mirror(char *pool)
 {
-	int t, d, error;
-	ztest_shared_t *zs = ztest_shared;
-	ztest_args_t *za;
+	ztest_bench_t zb;
+	objset_t *os;
 	spa_t *spa;
-	char name[100];
+	vdev_t *rvd, *mvd = NULL, *sick;
+	uint64_t object, guid;
+	int c, id, error;
 
-	(void) _mutex_init(&zs->zs_vdev_lock, USYNC_THREAD, NULL);
-	(void) rwlock_init(&zs->zs_name_lock, USYNC_THREAD, NULL);
+	kernel_init(FREAD | FWRITE);
+	error = dmu_objset_open(pool, DMU_OST_OTHER, DS_MODE_STANDARD, &os);
+	if (error)
+		fatal(0, "dmu_objset_open('%s') = %d", pool, error);
+	spa = dmu_objset_spa(os);
 
-	for (t = 0; t < ZTEST_SYNC_LOCKS; t++)
-		(void) _mutex_init(&zs->zs_sync_lock[t], USYNC_THREAD, NULL);
+	spa_config_enter(spa, RW_READER, FTAG);
+	rvd = spa->spa_root_vdev;
+	for (c = 0; c < rvd->vdev_children && mvd == NULL; c++)
+		if (rvd->vdev_child[c]->vdev_ops == &vdev_mirror_ops)
+			mvd = rvd->vdev_child[c];
+	if (mvd != NULL) {
+		for (sick = mvd->vdev_child[0]; !sick->vdev_ops->vdev_op_leaf;
+		    sick = sick->vdev_child[0])
+			continue;
+		guid = sick->vdev_guid;
+	}
+	spa_config_exit(spa, FTAG);
 
-	/*
-	 * Destroy one disk before we even start.
-	 * It's mirrored, so everything should work just fine.
-	 * This makes us exercise fault handling very early in spa_load().
-	 */
-	ztest_obliterate_one_disk(0);
+	if (mvd == NULL) {
+		(void) printf("mirror: no mirrors in the pool, skipped\n");
+		dmu_objset_close(os);
+		kernel_fini();
+		return;
+	}
 
-	/*
-	 * Verify that the sum of the sizes of all blocks in the pool
-	 * equals the SPA's allocated space total.
-	 */
-	ztest_verify_blocks(pool);
+	bzero(&zb, sizeof (zb));
+	mutex_init(&zb.zb_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&zb.zb_cv, NULL, CV_DEFAULT, NULL);
+	object = ztest_bench_blocks(os, &zb, mvd->vdev_id);
 
-	/*
-	 * Kick off a replacement of the disk we just obliterated.
-	 */
-	kernel_init(FREAD | FWRITE);
-	error = spa_open(pool, &spa, FTAG);
-	if (error)
-		fatal(0, "spa_open(%s) = %d", pool, error);
-	ztest_replace_one_disk(spa, 0);
-	if (zopt_verbose >= 5)
-		show_pool_stats(spa);
-	spa_close(spa, FTAG);
+	if (zb.zb_nbps == 0) {
+		(void) printf("mirror: no blocks landed on the mirror, "
+		    "skipped\n");
+	} else {
+		id = ztest_bench_sicken(pool, guid);
+		vdev_mirror_load_balance = 0;
+		ztest_bench_run(&zb, "mirror old");
+		vdev_mirror_load_balance = 1;
+		ztest_bench_run(&zb, "mirror load");
+		VERIFY(zio_clear_fault(id) == 0);
+	}
+
+	ztest_bench_free(os, &zb, object);
+	cv_destroy(&zb.zb_cv);
+	mutex_destroy(&zb.zb_lock);
+	dmu_objset_close(os);
 	kernel_fini();
+}
+
+/*
+ * RAID-Z benchmark: random reads of real blocks on the pool's first
+ * RAID-Z vdev while healthy, and then with one and, given double
+ * parity, two of its children faulted, so that every read has to be
+ * rebuilt from parity.  When the RAID-Z vdevs are the sides of a
+ * mirror, the same children are faulted on every side.  The faults are
+ * cleared and the blocks freed again afterwards.
+ */
+static void
+ztest_bench_raidz(char *pool)
+{
+	ztest_bench_t zb;
+	objset_t *os;
+	spa_t *spa;
+	vdev_t *rvd, *tvd = NULL, *zvd[ZTEST_BENCH_MAXLEAVES], *vd;
+	uint64_t guid[ZTEST_BENCH_MAXPARITY][ZTEST_BENCH_MAXLEAVES];
+	uint64_t before[VDEV_RAIDZ_STAT_COLS], after[VDEV_RAIDZ_STAT_COLS];
+	uint64_t object, txg;
+	char name[20];
+	int nzvd = 0, nparity, faulted = 0;
+	int c, f, r, error;
 
 	kernel_init(FREAD | FWRITE);
+	error = dmu_objset_open(pool, DMU_OST_OTHER, DS_MODE_STANDARD, &os);
+	if (error)
+		fatal(0, "dmu_objset_open('%s') = %d", pool, error);
+	spa = dmu_objset_spa(os);
 
-	/*
-	 * Verify that we can export the pool and reimport it under a
-	 * different name.
-	 */
-	if (ztest_random(2) == 0) {
-		(void) snprintf(name, 100, "%s_import", pool);
-		ztest_spa_import_export(pool, name);
-		ztest_spa_import_export(name, pool);
+	spa_config_enter(spa, RW_READER, FTAG);
+	rvd = spa->spa_root_vdev;
+	for (c = 0; c < rvd->vdev_children && tvd == NULL; c++) {
+		vd = rvd->vdev_child[c];
+		if (vd->vdev_ops == &vdev_raidz_ops) {
+			tvd = vd;
+			zvd[nzvd++] = vd;
+		} else if (vd->vdev_ops == &vdev_mirror_ops &&
+		    vd->vdev_child[0]->vdev_ops == &vdev_raidz_ops) {
+			tvd = vd;
+			for (r = 0; r < vd->vdev_children &&
+			    r < ZTEST_BENCH_MAXLEAVES; r++)
+				zvd[nzvd++] = vd->vdev_child[r];
+		}
 	}
-
-	/*
-	 * Verify that we can loop over all pools.
-	 */
-	mutex_enter(&spa_namespace_lock);
-	for (spa = spa_next(NULL); spa != NULL; spa = spa_next(spa)) {
-		if (zopt_verbose > 3) {
-			(void) printf("spa_next: found %s\n", spa_name(spa));
+	nparity = (tvd == NULL) ? 0 :
+	    MIN(zvd[0]->vdev_nparity, ZTEST_BENCH_MAXPARITY);
+	for (r = 0; r < nzvd; r++) {
+		for (f = 0; f < nparity; f++) {
+			for (vd = zvd[r]->vdev_child[f];
+			    !vd->vdev_ops->vdev_op_leaf; vd = vd->vdev_child[0])
+				continue;
+			guid[f][r] = vd->vdev_guid;
 		}
 	}
-	mutex_exit(&spa_namespace_lock);
+	spa_config_exit(spa, FTAG);
 
-	/*
-	 * Open our pool.
-	 */
-	error = spa_open(pool, &spa, FTAG);
-	if (error)
-		fatal(0, "spa_open() = %d", error);
+	if (tvd == NULL) {
+		(void) printf("raidz: no RAID-Z vdevs in the pool, skipped\n");
+		dmu_objset_close(os);
+		kernel_fini();
+		return;
+	}
 
-	/*
-	 * Verify that we can safely inquire about about any object,
-	 * whether it's allocated or not.  To make it interesting,
-	 * we probe a 5-wide window around each power of two.
-	 * This hits all edge cases, including zero and the max.
-	 */
-	for (t = 0; t < 64; t++) {
-		for (d = -5; d <= 5; d++) {
-			error = dmu_object_info(spa->spa_meta_objset,
-			    (1ULL << t) + d, NULL);
-			ASSERT(error == 0 || error == ENOENT ||
-			    error == EINVAL);
+	bzero(&zb, sizeof (zb));
+	mutex_init(&zb.zb_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&zb.zb_cv, NULL, CV_DEFAULT, NULL);
+	object = ztest_bench_blocks(os, &zb, tvd->vdev_id);
+
+	if (zb.zb_nbps == 0) {
+		(void) printf("raidz: no blocks landed on RAID-Z, skipped\n");
+	} else {
+		ztest_bench_run(&zb, "raidz healthy");
+		for (f = 0; f < nparity; f++) {
+			for (r = 0; r < nzvd; r++)
+				VERIFY(vdev_fault(spa, guid[f][r]) == 0);
+			faulted++;
+
+			(void) snprintf(name, sizeof (name), "raidz %d failed",
+			    faulted);
+			vdev_raidz_col_repairs(before);
+			ztest_bench_run(&zb, name);
+			vdev_raidz_col_repairs(after);
+
+			if (zopt_verbose >= 3) {
+				(void) printf("%-12s repairs by column:", "");
+				for (c = 0; c < VDEV_RAIDZ_STAT_COLS &&
+				    c < zvd[0]->vdev_children; c++)
+					(void) printf(" %llu", (u_longlong_t)
+					    (after[c] - before[c]));
+				(void) printf("\n");
+			}
 		}
+
+		txg = spa_vdev_enter(spa);
+		for (f = 0; f < faulted; f++)
+			for (r = 0; r < nzvd; r++)
+				vdev_clear(spa, spa_lookup_by_guid(spa,
+				    guid[f][r]));
+		(void) spa_vdev_exit(spa, NULL, txg, 0);
 	}
 
-	/*
-	 * Now kick off all the tests that run in parallel.
-	 */
-	zs->zs_enospc_count = 0;
+	ztest_bench_free(os, &zb, object);
+	cv_destroy(&zb.zb_cv);
+	mutex_destroy(&zb.zb_lock);
+	dmu_objset_close(os);
+	kernel_fini();
+}
 
-	za = umem_zalloc(zopt_threads * sizeof (ztest_args_t), UMEM_NOFAIL);
+#define	ZTEST_SYNC_BLOCKS	64
+#define	ZTEST_SYNC_PASSES	8
 
-	if (zopt_verbose >= 4)
-		(void) printf("starting main threads...\n");
+/*
+ * Time spa_sync() of txgs full of gzip-compressed
+ * blocks with the pool's CPU taskq sized to 1, 2, 4, ... CPUs.  The
+ * pool is reopened for each size, since the taskq is created when
+ * the pool is activated.
+ */
+static void
+ztest_bench_sync(char *pool)
+{
+	objset_t *os;
+	dmu_tx_t *tx;
+	uint64_t object, *wp;
+	char *buf;
+	hrtime_t start, synctime;
+	int ncpus = MAX(sysconf(_SC_NPROCESSORS_ONLN), 1);
+	int threads, pass, b, error;
 
-	za[0].za_start = gethrtime();
-	za[0].za_stop = za[0].za_start + zopt_passtime * NANOSEC;
-	za[0].za_stop = MIN(za[0].za_stop, zs->zs_stop_time);
-	za[0].za_kill = za[0].za_stop;
-	if (ztest_random(100) < zopt_killrate)
-		za[0].za_kill -= ztest_random(zopt_passtime * NANOSEC);
+	buf = umem_alloc(SPA_MAXBLOCKSIZE, UMEM_NOFAIL);
 
-	for (t = 0; t < zopt_threads; t++) {
-		d = t % zopt_datasets;
-		if (t < zopt_datasets) {
-			ztest_replay_t zr;
-			int test_future = FALSE;
-			(void) rw_rdlock(&ztest_shared->zs_name_lock);
-			(void) snprintf(name, 100, "%s/%s_%d", pool, pool, d);
-			error = dmu_objset_create(name, DMU_OST_OTHER, NULL,
-			    ztest_create_cb, NULL);
-			if (error == EEXIST) {
-				test_future = TRUE;
-			} else if (error != 0) {
-				if (error == ENOSPC) {
-					zs->zs_enospc_count++;
-					(void) rw_unlock(
-					    &ztest_shared->zs_name_lock);
-					break;
-				}
-				fatal(0, "dmu_objset_create(%s) = %d",
-				    name, error);
-			}
-			error = dmu_objset_open(name, DMU_OST_OTHER,
-			    DS_MODE_STANDARD, &za[d].za_os);
+	for (threads = 1; ; threads = MIN(threads * 2, ncpus)) {
+		zio_cpu_taskq_threads = threads;
+		kernel_init(FREAD | FWRITE);
+		error = dmu_objset_open(pool, DMU_OST_OTHER,
+		    DS_MODE_STANDARD, &os);
+		if (error)
+			fatal(0, "dmu_objset_open('%s') = %d", pool, error);
+
+		tx = dmu_tx_create(os);
+		dmu_tx_hold_write(tx, DMU_NEW_OBJECT, 0,
+		    ZTEST_SYNC_BLOCKS * SPA_MAXBLOCKSIZE);
+		error = dmu_tx_assign(tx, TXG_WAIT);
+		if (error)
+			fatal(0, "dmu_tx_assign() = %d", error);
+		object = dmu_object_alloc(os, DMU_OT_UINT64_OTHER,
+		    SPA_MAXBLOCKSIZE, DMU_OT_NONE, 0, tx);
+		dmu_object_set_compress(os, object, ZIO_COMPRESS_GZIP_6, tx);
+		dmu_tx_commit(tx);
+		txg_wait_synced(dmu_objset_pool(os), 0);
+
+		synctime = 0;
+		for (pass = 0; pass < ZTEST_SYNC_PASSES; pass++) {
+			for (wp = (uint64_t *)buf;
+			    (char *)wp < buf + SPA_MAXBLOCKSIZE; wp++)
+				*wp = ztest_random(1024);
+
+			tx = dmu_tx_create(os);
+			dmu_tx_hold_write(tx, object, 0,
+			    ZTEST_SYNC_BLOCKS * SPA_MAXBLOCKSIZE);
+			error = dmu_tx_assign(tx, TXG_WAIT);
 			if (error)
-				fatal(0, "dmu_objset_open('%s') = %d",
-				    name, error);
-			(void) rw_unlock(&ztest_shared->zs_name_lock);
-			if (test_future && ztest_shared->zs_txg > 0)
-				ztest_dmu_check_future_leak(za[d].za_os,
-				    ztest_shared->zs_txg);
-			zr.zr_os = za[d].za_os;
-			zil_replay(zr.zr_os, &zr, &zr.zr_assign,
-			    ztest_replay_vector);
-			za[d].za_zilog = zil_open(za[d].za_os, NULL);
+				fatal(0, "dmu_tx_assign() = %d", error);
+			for (b = 0; b < ZTEST_SYNC_BLOCKS; b++) {
+				((uint64_t *)buf)[0] = b;
+				dmu_write(os, object, b * SPA_MAXBLOCKSIZE,
+				    SPA_MAXBLOCKSIZE, buf, tx);
+			}
+			dmu_tx_commit(tx);
+
+			start = gethrtime();
+			txg_wait_synced(dmu_objset_pool(os), 0);
+			synctime += gethrtime() - start;
 		}
-		za[t].za_pool = spa_strdup(pool);
-		za[t].za_os = za[d].za_os;
-		za[t].za_zilog = za[d].za_zilog;
-		za[t].za_instance = t;
-		za[t].za_random = ztest_random(-1ULL);
-		za[t].za_start = za[0].za_start;
-		za[t].za_stop = za[0].za_stop;
-		za[t].za_kill = za[0].za_kill;
 
-		error = thr_create(0, 0, ztest_thread, &za[t], THR_BOUND,
-		    &za[t].za_thread);
-		if (error)
-			fatal(0, "can't create thread %d: error %d",
-			    t, error);
-	}
-	ztest_shared->zs_txg = 0;
+		(void) printf("sync  %2d cpu threads: %llu ms per txg "
+		    "of %d %dK gzip blocks\n", threads,
+		    (u_longlong_t)(synctime / ZTEST_SYNC_PASSES / MICROSEC),
+		    ZTEST_SYNC_BLOCKS, SPA_MAXBLOCKSIZE >> 10);
 
-	while (--t >= 0) {
-		error = thr_join(za[t].za_thread, NULL, NULL);
+		tx = dmu_tx_create(os);
+		dmu_tx_hold_free(tx, object, 0, DMU_OBJECT_END);
+		error = dmu_tx_assign(tx, TXG_WAIT);
 		if (error)
-			fatal(0, "thr_join(%d) = %d", t, error);
-		if (za[t].za_th)
-			traverse_fini(za[t].za_th);
-		if (t < zopt_datasets) {
-			zil_close(za[t].za_zilog);
-			dmu_objset_close(za[t].za_os);
-		}
-		spa_strfree(za[t].za_pool);
+			fatal(0, "dmu_tx_assign() = %d", error);
+		VERIFY(dmu_object_free(os, object, tx) == 0);
+		dmu_tx_commit(tx);
+
+		dmu_objset_close(os);
+		kernel_fini();
+
+		if (threads == ncpus)
+			break;
 	}
+	zio_cpu_taskq_threads = 0;
 
-	umem_free(za, zopt_threads * sizeof (ztest_args_t));
+	umem_free(buf, SPA_MAXBLOCKSIZE);
+}
 
-	if (zopt_verbose >= 3)
-		show_pool_stats(spa);
+#define	ZTEST_REWRITE_BLOCKS	64
+#define	ZTEST_REWRITE_CHUNK	4096
 
-	txg_wait_synced(spa_get_dsl(spa), 0);
+/*
+ * Sequential rewrite benchmark: rewrite every block of an uncached
+ * object in place in ZTEST_REWRITE_CHUNK pieces, one tx per piece,
+ * first reading each old block up front and then with deferred partial
+ * fills (dbuf_partial_fill).  Every other block is left one piece
+ * short, so that its old data has to be merged in at sync time.  The
+ * object is read back and checked afterwards.
+ */
+static void
+ztest_bench_rewrite(char *pool)
+{
+	objset_t *os;
+	dmu_tx_t *tx;
+	vdev_stat_t vs;
+	uint64_t object, reads, off, *wp;
+	char *buf;
+	hrtime_t start, elapsed;
+	int mode, b, c, chunks, i, error;
 
-	zs->zs_alloc = spa_get_alloc(spa);
-	zs->zs_space = spa_get_space(spa);
+	buf = umem_alloc(SPA_MAXBLOCKSIZE, UMEM_NOFAIL);
+	wp = (uint64_t *)buf;
 
-	/*
-	 * Did we have out-of-space errors?  If so, destroy a random objset.
-	 */
-	if (zs->zs_enospc_count != 0) {
-		(void) rw_rdlock(&ztest_shared->zs_name_lock);
-		(void) snprintf(name, 100, "%s/%s_%d", pool, pool,
-		    (int)ztest_random(zopt_datasets));
-		if (zopt_verbose >= 3)
-			(void) printf("Destroying %s to free up space\n", name);
-		(void) dmu_objset_find(name, ztest_destroy_cb, NULL,
-		    DS_FIND_SNAPSHOTS | DS_FIND_CHILDREN);
-		(void) rw_unlock(&ztest_shared->zs_name_lock);
+	for (mode = 0; mode <= 1; mode++) {
+		kernel_init(FREAD | FWRITE);
+		error = dmu_objset_open(pool, DMU_OST_OTHER,
+		    DS_MODE_STANDARD, &os);
+		if (error)
+			fatal(0, "dmu_objset_open('%s') = %d", pool, error);
+
+		tx = dmu_tx_create(os);
+		dmu_tx_hold_write(tx, DMU_NEW_OBJECT, 0,
+		    ZTEST_REWRITE_BLOCKS * SPA_MAXBLOCKSIZE);
+		error = dmu_tx_assign(tx, TXG_WAIT);
+		if (error)
+			fatal(0, "dmu_tx_assign() = %d", error);
+		object = dmu_object_alloc(os, DMU_OT_UINT64_OTHER,
+		    SPA_MAXBLOCKSIZE, DMU_OT_NONE, 0, tx);
+		for (b = 0; b < ZTEST_REWRITE_BLOCKS; b++) {
+			off = (uint64_t)b * SPA_MAXBLOCKSIZE;
+			for (i = 0; i < SPA_MAXBLOCKSIZE / 8; i++)
+				wp[i] = off + i * 8;
+			dmu_write(os, object, off, SPA_MAXBLOCKSIZE, buf, tx);
+		}
+		dmu_tx_commit(tx);
+		txg_wait_synced(dmu_objset_pool(os), 0);
+
+		/* reopen the pool so that none of the object is cached */
+		dmu_objset_close(os);
+		kernel_fini();
+		kernel_init(FREAD | FWRITE);
+		error = dmu_objset_open(pool, DMU_OST_OTHER,
+		    DS_MODE_STANDARD, &os);
+		if (error)
+			fatal(0, "dmu_objset_open('%s') = %d", pool, error);
+
+		dbuf_partial_fill = mode;
+		vdev_get_stats(dmu_objset_spa(os)->spa_root_vdev, &vs);
+		reads = vs.vs_ops[ZIO_TYPE_READ];
+		start = gethrtime();
+		for (b = 0; b < ZTEST_REWRITE_BLOCKS; b++) {
+			chunks = SPA_MAXBLOCKSIZE / ZTEST_REWRITE_CHUNK -
+			    (b & 1);
+			for (c = 0; c < chunks; c++) {
+				off = (uint64_t)b * SPA_MAXBLOCKSIZE +
+				    c * ZTEST_REWRITE_CHUNK;
+				for (i = 0; i < ZTEST_REWRITE_CHUNK / 8; i++)
+					wp[i] = off + i * 8 + 1;
+				tx = dmu_tx_create(os);
+				dmu_tx_hold_write(tx, object, off,
+				    ZTEST_REWRITE_CHUNK);
+				error = dmu_tx_assign(tx, TXG_WAIT);
+				if (error)
+					fatal(0, "dmu_tx_assign() = %d", error);
+				dmu_write(os, object, off, ZTEST_REWRITE_CHUNK,
+				    buf, tx);
+				dmu_tx_commit(tx);
+			}
+		}
+		txg_wait_synced(dmu_objset_pool(os), 0);
+		elapsed = gethrtime() - start;
+		vdev_get_stats(dmu_objset_spa(os)->spa_root_vdev, &vs);
+		reads = vs.vs_ops[ZIO_TYPE_READ] - reads;
+
+		(void) printf("rewrite %-10s: %llu ms, %llu reads to rewrite "
+		    "%d %dK blocks in %dK pieces\n",
+		    mode ? "deferred" : "read first",
+		    (u_longlong_t)(elapsed / MICROSEC), (u_longlong_t)reads,
+		    ZTEST_REWRITE_BLOCKS, SPA_MAXBLOCKSIZE >> 10,
+		    ZTEST_REWRITE_CHUNK >> 10);
+
+		for (b = 0; b < ZTEST_REWRITE_BLOCKS; b++) {
+			off = (uint64_t)b * SPA_MAXBLOCKSIZE;
+			chunks = SPA_MAXBLOCKSIZE / ZTEST_REWRITE_CHUNK -
+			    (b & 1);
+			VERIFY(0 == dmu_read(os, object, off,
+			    SPA_MAXBLOCKSIZE, buf));
+			for (i = 0; i < SPA_MAXBLOCKSIZE / 8; i++) {
+				if (wp[i] == off + i * 8 +
+				    (i * 8 < chunks * ZTEST_REWRITE_CHUNK))
+					continue;
+				fatal(0, "rewrite block %d word %d = %llx", b,
+				    i, (u_longlong_t)wp[i]);
+			}
+		}
+
+		tx = dmu_tx_create(os);
+		dmu_tx_hold_free(tx, object, 0, DMU_OBJECT_END);
+		error = dmu_tx_assign(tx, TXG_WAIT);
+		if (error)
+			fatal(0, "dmu_tx_assign() = %d", error);
+		VERIFY(dmu_object_free(os, object, tx) == 0);
+		dmu_tx_commit(tx);
+
+		dmu_objset_close(os);
+		kernel_fini();
 	}
+	dbuf_partial_fill = 1;
 
-	txg_wait_synced(spa_get_dsl(spa), 0);
+	umem_free(buf, SPA_MAXBLOCKSIZE);
+}
 
-	/*
-	 * Right before closing the pool, kick off a bunch of async I/O;
-	 * spa_close() should wait for it to complete.
-	 */
-	for (t = 1; t < 50; t++)
-		dmu_prefetch(spa->spa_meta_objset, t, 0, 1 << 15);
+#define	ZTEST_RLOCK_THREADS	4
+#define	ZTEST_RLOCK_OPS		200000
+#define	ZTEST_RLOCK_LEN		(1 << 13)
 
-	spa_close(spa, FTAG);
+typedef struct ztest_rlock_arg {
+	znode_t		*zr_zp;
+	uint64_t	zr_off;
+	hrtime_t	zr_time;
+} ztest_rlock_arg_t;
 
-	kernel_fini();
+static void *
+ztest_rlock_thread(void *arg)
+{
+	ztest_rlock_arg_t *zr = arg;
+	hrtime_t start = gethrtime();
+	rl_t *rl;
+	int i;
+
+	for (i = 0; i < ZTEST_RLOCK_OPS; i++) {
+		rl = zfs_range_lock(zr->zr_zp,
+		    zr->zr_off + (i % 16) * ZTEST_RLOCK_LEN, ZTEST_RLOCK_LEN,
+		    RL_READER);
+		zfs_range_unlock(rl);
+	}
+	zr->zr_time = gethrtime() - start;
+	return (NULL);
 }
 
-void
-print_time(hrtime_t t, char *timebuf)
+/*
+ * Take range locks on a dummied-up znode, the way the volume engine
+ * does: ZTEST_RLOCK_THREADS readers, each on its own part of the file,
+ * and a writer on yet another part, first with every reader going
+ * through the tree and then with the reader fast path.  None of them
+ * overlap, so the writer should never have to wait for a reader.
+ */
+static void
+ztest_bench_rlock(void)
 {
-	hrtime_t s = t / NANOSEC;
-	hrtime_t m = s / 60;
-	hrtime_t h = m / 60;
-	hrtime_t d = h / 24;
+	znode_t zp;
+	ztest_rlock_arg_t zr[ZTEST_RLOCK_THREADS];
+	thread_t tid[ZTEST_RLOCK_THREADS];
+	hrtime_t start, wtime, rtime;
+	rl_t *rl;
+	int mode, t, i, error;
+
+	bzero(&zp, sizeof (zp));
+	mutex_init(&zp.z_range_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&zp.z_range_cv, NULL, CV_DEFAULT, NULL);
+	avl_create(&zp.z_range_avl, zfs_range_compare,
+	    sizeof (rl_t), offsetof(rl_t, r_node));
+
+	for (mode = 0; mode <= 1; mode++) {
+		zfs_range_fast_disable = !mode;
+		for (t = 0; t < ZTEST_RLOCK_THREADS; t++) {
+			zr[t].zr_zp = &zp;
+			zr[t].zr_off = (uint64_t)t << 20;
+			error = thr_create(0, 0, ztest_rlock_thread, &zr[t],
+			    THR_BOUND, &tid[t]);
+			if (error)
+				fatal(0, "rlock: can't create thread %d: "
+				    "error %d", t, error);
+		}
 
-	s -= m * 60;
-	m -= h * 60;
-	h -= d * 24;
+		start = gethrtime();
+		for (i = 0; i < ZTEST_RLOCK_OPS / 64; i++) {
+			rl = zfs_range_lock(&zp, 1ULL << 40, ZTEST_RLOCK_LEN,
+			    RL_WRITER);
+			zfs_range_unlock(rl);
+		}
+		wtime = gethrtime() - start;
 
-	timebuf[0] = '\0';
+		rtime = 0;
+		for (t = 0; t < ZTEST_RLOCK_THREADS; t++) {
+			error = thr_join(tid[t], NULL, NULL);
+			if (error)
+				fatal(0, "rlock: thr_join(%d) = %d", t, error);
+			rtime += zr[t].zr_time;
+		}
 
-	if (d)
-		(void) sprintf(timebuf,
-		    "%llud%02lluh%02llum%02llus", d, h, m, s);
-	else if (h)
-		(void) sprintf(timebuf, "%lluh%02llum%02llus", h, m, s);
-	else if (m)
-		(void) sprintf(timebuf, "%llum%02llus", m, s);
-	else
-		(void) sprintf(timebuf, "%llus", s);
+		(void) printf("rlock %-10s: %llu ns per read lock, "
+		    "%llu ns per write lock beside %d readers\n",
+		    mode ? "fast path" : "tree only",
+		    (u_longlong_t)(rtime / ZTEST_RLOCK_THREADS /
+		    ZTEST_RLOCK_OPS),
+		    (u_longlong_t)(wtime / (ZTEST_RLOCK_OPS / 64)),
+		    ZTEST_RLOCK_THREADS);
+	}
+	zfs_range_fast_disable = 0;
+
+	ASSERT(avl_numnodes(&zp.z_range_avl) == 0);
+	avl_destroy(&zp.z_range_avl);
+	cv_destroy(&zp.z_range_cv);
+	mutex_destroy(&zp.z_range_lock);
 }
 
 /*
@@ -3574,6 +5726,16 @@ main(int argc, char **argv)
 		ztest_init(zopt_pool);
 	}
 
+	if (zopt_bench != 0) {
+		ztest_bench_read(zopt_pool);
+		ztest_bench_mirror(zopt_pool);
+		ztest_bench_raidz(zopt_pool);
+		ztest_bench_sync(zopt_pool);
+		ztest_bench_rewrite(zopt_pool);
+		ztest_bench_rlock();
+		exit(0);
+	}
+
 	/*
 	 * Initialize the call targets for each function.
 	 */
@@ -353,7 +353,12 @@ top:
 		return (NULL);
 	}
 
-	if (zhp->zfs_dmustats.dds_inconsistent) {
+	/*
+	 * A dataset left behind by an interrupted resumable receive is
+	 * inconsistent on purpose; leave it for the receive to resume.
+	 */
+	if (zhp->zfs_dmustats.dds_inconsistent &&
+	    !zhp->zfs_dmustats.dds_resumable) {
 		zfs_cmd_t zc = { 0 };
 
 		/*
@@ -2393,6 +2398,16 @@ zfs_prop_get(zfs_handle_t *zhp, zfs_prop_t prop, char *propbuf, size_t proplen,
 			return (-1);
 		break;
 
+	case ZFS_PROP_RECEIVE_RESUME_TOKEN:
+		(void) strlcpy(propbuf, getprop_string(zhp, prop, &source),
+		    proplen);
+		/*
+		 * Only a partially received dataset has a resume token.
+		 */
+		if (propbuf[0] == '\0')
+			return (-1);
+		break;
+
 	case ZFS_PROP_QUOTA:
 	case ZFS_PROP_RESERVATION:
 		if (get_numeric_property(zhp, prop, src, &source, &val) != 0)
@@ -3447,12 +3462,44 @@ zfs_snapshot(libzfs_handle_t *hdl, const char *path, boolean_t recursive)
 	return (ret);
 }
 
+/*
+ * Parse a receive_resume_token into the arguments for a resumed send.
+ * The stream features it was started with are returned in *featuresp.
+ */
+static int
+zfs_parse_resume_token(const char *token, dmu_send_resume_t *resume,
+    uint64_t *featuresp)
+{
+	u_longlong_t val[ZFS_RESUME_TOKEN_FIELDS];
+
+	if (sscanf(token, ZFS_RESUME_TOKEN_FMT, &val[0], &val[1], &val[2],
+	    &val[3], &val[4], &val[5], &val[6], &val[7], &val[8]) !=
+	    ZFS_RESUME_TOKEN_FIELDS || val[0] != ZFS_RESUME_TOKEN_VERSION ||
+	    val[2] == 0)
+		return (-1);
+
+	*featuresp = DMU_GET_BACKUP_FEATURES(val[1]);
+	resume->dsr_toguid = val[2];
+	resume->dsr_object = val[3];
+	resume->dsr_offset = val[4];
+	resume->dsr_checksum[0] = val[5];
+	resume->dsr_checksum[1] = val[6];
+	resume->dsr_checksum[2] = val[7];
+	resume->dsr_checksum[3] = val[8];
+	return (0);
+}
+
 /*
  * Dumps a backup of the given snapshot (incremental from fromsnap if it's not
- * NULL) to the file descriptor specified by outfd.
+ * NULL) to the file descriptor specified by outfd.  If compressed is set,
+ * compressed blocks are sent as stored on disk; if dedup is set, blocks
+ * repeated within the stream are sent as references to the first copy.
+ * If resumetok is not NULL, only the part of the stream that the receiver
+ * which reported it is missing is sent, with the features it started with.
  */
 int
-zfs_send(zfs_handle_t *zhp, const char *fromsnap, int outfd)
+zfs_send(zfs_handle_t *zhp, const char *fromsnap, boolean_t compressed,
+    boolean_t dedup, const char *resumetok, int outfd)
 {
 	zfs_cmd_t zc = { 0 };
 	char errbuf[1024];
@@ -3460,15 +3507,32 @@ zfs_send(zfs_handle_t *zhp, const char *fromsnap, int outfd)
 
 	assert(zhp->zfs_type == ZFS_TYPE_SNAPSHOT);
 
+	(void) snprintf(errbuf, sizeof (errbuf), dgettext(TEXT_DOMAIN,
+	    "cannot send '%s'"), zhp->zfs_name);
+
 	(void) strlcpy(zc.zc_name, zhp->zfs_name, sizeof (zc.zc_name));
 	if (fromsnap)
 		(void) strlcpy(zc.zc_value, fromsnap, sizeof (zc.zc_name));
 	zc.zc_cookie = outfd;
+	if (resumetok != NULL) {
+		uint64_t features;
 
-	if (ioctl(zhp->zfs_hdl->libzfs_fd, ZFS_IOC_SENDBACKUP, &zc) != 0) {
-		(void) snprintf(errbuf, sizeof (errbuf), dgettext(TEXT_DOMAIN,
-		    "cannot send '%s'"), zhp->zfs_name);
+		if (zfs_parse_resume_token(resumetok, &zc.zc_resume,
+		    &features) != 0) {
+			zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
+			    "invalid resume token"));
+			return (zfs_error(hdl, EZFS_BADBACKUP, errbuf));
+		}
+		compressed = (features & DMU_BACKUP_FEATURE_COMPRESSED) != 0;
+		dedup = (features & DMU_BACKUP_FEATURE_DEDUP) != 0;
+		zc.zc_obj |= DMU_SEND_RESUME;
+	}
+	if (compressed)
+		zc.zc_obj |= DMU_SEND_COMPRESSED;
+	if (dedup)
+		zc.zc_obj |= DMU_SEND_DEDUP;
 
+	if (ioctl(zhp->zfs_hdl->libzfs_fd, ZFS_IOC_SENDBACKUP, &zc) != 0) {
 		switch (errno) {
 
 		case EXDEV:
@@ -3476,6 +3540,13 @@ zfs_send(zfs_handle_t *zhp, const char *fromsnap, int outfd)
 			    "not an earlier snapshot from the same fs"));
 			return (zfs_error(hdl, EZFS_CROSSTARGET, errbuf));
 
+		case EINVAL:
+			if (resumetok == NULL)
+				return (zfs_standard_error(hdl, errno, errbuf));
+			zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
+			    "resume token does not match this snapshot"));
+			return (zfs_error(hdl, EZFS_BADBACKUP, errbuf));
+
 		case EDQUOT:
 		case EFBIG:
 		case EIO:
@@ -3577,10 +3648,13 @@ ancestorerr:
 
 /*
  * Restores a backup of tosnap from the file descriptor specified by infd.
+ * If resumable is set, an interrupted receive leaves the partially
+ * received dataset in place, and its receive_resume_token property says
+ * how to send the rest of the stream.
  */
 int
 zfs_receive(libzfs_handle_t *hdl, const char *tosnap, int isprefix,
-    int verbose, int dryrun, boolean_t force, int infd)
+    int verbose, int dryrun, boolean_t force, boolean_t resumable, int infd)
 {
 	zfs_cmd_t zc = { 0 };
 	time_t begin_time;
@@ -3591,6 +3665,8 @@ zfs_receive(libzfs_handle_t *hdl, const char *tosnap, int isprefix,
 	char errbuf[1024];
 	prop_changelist_t *clp;
 	char chopprefix[ZFS_MAXNAMELEN];
+	uint64_t version;
+	boolean_t resuming;
 #ifdef __APPLE__
 	off_t myoff;
 #endif
@@ -3624,13 +3700,24 @@ zfs_receive(libzfs_handle_t *hdl, const char *tosnap, int isprefix,
 		return (zfs_error(hdl, EZFS_BADSTREAM, errbuf));
 	}
 
-	if (drrb->drr_version != DMU_BACKUP_VERSION &&
-	    drrb->drr_version != BSWAP_64(DMU_BACKUP_VERSION)) {
+	version = drrb->drr_version;
+	if (drrb->drr_magic == BSWAP_64(DMU_BACKUP_MAGIC))
+		version = BSWAP_64(version);
+	if (DMU_GET_BACKUP_VERSION(version) != DMU_BACKUP_VERSION) {
 		zfs_error_aux(hdl, dgettext(TEXT_DOMAIN, "only version "
 		    "0x%llx is supported (stream is version 0x%llx)"),
-		    DMU_BACKUP_VERSION, drrb->drr_version);
+		    DMU_BACKUP_VERSION, DMU_GET_BACKUP_VERSION(version));
 		return (zfs_error(hdl, EZFS_BADSTREAM, errbuf));
 	}
+	if (DMU_GET_BACKUP_FEATURES(version) & ~DMU_BACKUP_FEATURE_MASK) {
+		zfs_error_aux(hdl, dgettext(TEXT_DOMAIN, "stream uses "
+		    "unsupported features (0x%llx)"),
+		    DMU_GET_BACKUP_FEATURES(version) &
+		    ~DMU_BACKUP_FEATURE_MASK);
+		return (zfs_error(hdl, EZFS_BADSTREAM, errbuf));
+	}
+	resuming = (DMU_GET_BACKUP_FEATURES(version) &
+	    DMU_BACKUP_FEATURE_RESUMING) != 0;
 
 	if (strchr(drr.drr_u.drr_begin.drr_toname, '@') == NULL) {
 		zfs_error_aux(hdl, dgettext(TEXT_DOMAIN, "invalid "
@@ -3681,6 +3768,25 @@ zfs_receive(libzfs_handle_t *hdl, const char *tosnap, int isprefix,
 		return (zfs_error(hdl, EZFS_INVALIDNAME, errbuf));
 
 	(void) strcpy(zc.zc_name, zc.zc_value);
+	if (resuming) {
+		/* the partially received fs must be there to resume */
+		zfs_handle_t *h;
+
+		*strchr(zc.zc_name, '@') = '\0';
+		h = zfs_open(hdl, zc.zc_name,
+		    ZFS_TYPE_FILESYSTEM | ZFS_TYPE_VOLUME);
+		if (h == NULL)
+			return (-1);
+		if (!h->zfs_dmustats.dds_resumable) {
+			zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
+			    "'%s' has no partial receive to resume"),
+			    zc.zc_name);
+			zfs_close(h);
+			return (zfs_error(hdl, EZFS_BADRESTORE, errbuf));
+		}
+		zfs_close(h);
+	}
+
 	if (drrb->drr_fromguid) {
 		/* incremental backup stream */
 		zfs_handle_t *h;
@@ -3716,7 +3822,7 @@ zfs_receive(libzfs_handle_t *hdl, const char *tosnap, int isprefix,
 			}
 		}
 		zfs_close(h);
-	} else {
+	} else if (!resuming) {
 		/* full backup stream */
 
 		/* Make sure destination fs does not exist */
@@ -3757,12 +3863,14 @@ zfs_receive(libzfs_handle_t *hdl, const char *tosnap, int isprefix,
 	/* We overload the zfs_cmd_t structures here for the ioctl*/
 	zc.zc_cookie = infd;
 	zc.zc_guid = force;
+	zc.zc_obj = resumable;
 #ifdef __APPLE__
 	zc.zc_history_offset = myoff;
 #endif
 	if (verbose) {
-		(void) printf("%s %s stream of %s into %s\n",
+		(void) printf("%s %s%s stream of %s into %s\n",
 		    dryrun ? "would receive" : "receiving",
+		    resuming ? "rest of " : "",
 		    drrb->drr_fromguid ? "incremental" : "full",
 		    drr.drr_u.drr_begin.drr_toname,
 		    zc.zc_value);
@@ -3779,6 +3887,14 @@ zfs_receive(libzfs_handle_t *hdl, const char *tosnap, int isprefix,
 			    "source"));
 			(void) zfs_error(hdl, EZFS_BADRESTORE, errbuf);
 			break;
+		case EINVAL:
+			if (resuming) {
+				zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
+				    "stream does not resume the partial "
+				    "receive"));
+			}
+			(void) zfs_error(hdl, EZFS_BADSTREAM, errbuf);
+			break;
 		case ETXTBSY:
 			zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
 			    "destination has been modified since most recent "
@@ -3797,9 +3913,6 @@ zfs_receive(libzfs_handle_t *hdl, const char *tosnap, int isprefix,
 			    dgettext(TEXT_DOMAIN, "cannot restore to %s"),
 			    zc.zc_value);
 			break;
-		case EINVAL:
-			(void) zfs_error(hdl, EZFS_BADSTREAM, errbuf);
-			break;
 		case ECKSUM:
 			zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
 			    "invalid stream (checksum mismatch)"));
@@ -2381,6 +2381,14 @@ zpool_get_prop(zpool_handle_t *zhp, zpool_prop_t prop, char *propbuf,
 		}
 		(void) snprintf(propbuf, proplen, "%llu", value);
 		break;
+
+	case ZPOOL_PROP_FREEING:
+		if (nvlist_lookup_nvlist(zhp->zpool_props,
+		    zpool_prop_to_name(prop), &nvp) != 0 ||
+		    nvlist_lookup_uint64(nvp, ZFS_PROP_VALUE, &value) != 0)
+			value = 0;
+		zfs_nicenum(value, propbuf, proplen);
+		break;
   
 	default:
 		return (-1);
@@ -49,6 +49,7 @@
  */
 
 uint64_t physmem;
+unsigned int boot_ncpus;
 vnode_t *rootdir = (vnode_t *)0xabcd1234;
 char hw_serial[11];
 
@@ -365,8 +366,7 @@ top:
 #ifdef __APPLE__
 	VERIFY(gettimeofday(&tv, NULL) == 0);
 	
-	dsec = MAX(1, delta / hz);
-	ASSERT(dsec >= 1);
+	dsec = delta / hz;
 	ts.tv_sec = tv.tv_sec + dsec;
 	ts.tv_nsec = tv.tv_usec * 1000 + (delta % hz) * (NANOSEC / hz);
 	ASSERT(ts.tv_nsec >= 0);
@@ -952,6 +952,8 @@ kernel_init(int mode)
 	    (double)physmem * sysconf(_SC_PAGE_SIZE) / (1ULL << 30));
 #endif
 
+	boot_ncpus = MAX(sysconf(_SC_NPROCESSORS_ONLN), 1);
+
 	snprintf(hw_serial, sizeof (hw_serial), "%ld", gethostid());
 
 	spa_init(mode);
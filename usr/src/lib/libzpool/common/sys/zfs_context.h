@@ -184,6 +184,7 @@ typedef int cred_t;
 extern SInt64 OSAddAtomic64_NV(SInt64 theAmount, volatile SInt64 *address);
 #define atomic_add_64_nv(addr, amt)	(uint64_t)OSAddAtomic64_NV(amt, (volatile SInt64 *)addr)
 
+extern uint32_t atomic_cas_32(volatile uint32_t *, uint32_t, uint32_t);
 extern uint64_t atomic_cas_64(volatile uint64_t *, uint64_t, uint64_t);
 /*
  * logical OR bits with target
@@ -930,6 +931,7 @@ extern void delay(clock_t ticks);
 #define	gethrestime_sec() time(NULL)
 
 #define	max_ncpus	64
+extern unsigned int boot_ncpus;	/* cpus online, set by kernel_init() */
 
 #define	minclsyspri	60
 #define	maxclsyspri	99
@@ -32,6 +32,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/spa.h>
+#include <sys/spa_impl.h>
 #include <sys/fs/zfs.h>
 #include <sys/refcount.h>
 
@@ -148,4 +149,11 @@ show_pool_stats(spa_t *spa)
 	    &name) == 0);
 
 	show_vdev_stats(name, nvroot, 0);
+
+	(void) printf("gang blocks %llu (%llu forced), %llu members; "
+	    "%llu avoided by allocation fallback\n",
+	    (u_longlong_t)spa->spa_gang_stats.sgs_gang_blocks.value.ui64,
+	    (u_longlong_t)spa->spa_gang_stats.sgs_gang_forced.value.ui64,
+	    (u_longlong_t)spa->spa_gang_stats.sgs_gang_members.value.ui64,
+	    (u_longlong_t)spa->spa_gang_stats.sgs_alloc_fallback.value.ui64);
 }
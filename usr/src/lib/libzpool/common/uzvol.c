@@ -0,0 +1,524 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2008 Sun Microsystems, Inc.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+#pragma ident	"%Z%%M%	%I%	%E% SMI"
+
+/*
+ * Userland volume engine.
+ *
+ * The kernel zvol driver is compiled out of this port, so this is the
+ * only way to get at a volume's blocks.  It follows zvol_strategy():
+ * every request range locks its extent on a dummied up znode, reads
+ * with dmu_read() or writes in zvol_maxphys sized transactions, and
+ * logs writes to the ZIL as TX_WRITE records.  Small writes are copied
+ * into the log; large ones are written out with dmu_sync() when the
+ * log is committed, under a reader range lock so the block can't
+ * change while it is being checksummed.  A write marked UZVOL_FUA, and
+ * UZVOL_FLUSH, commit the log before completing.  A read marked
+ * UZVOL_LOAN takes a dmu_read_loan() of at most DMU_MAX_ACCESS / 2
+ * bytes instead of copying into uzr_data.  The request keeps its reader
+ * range lock for as long as it has the loan, so writes to the extent
+ * wait until the caller is done with the data and uzvol_loan_rele()s
+ * it; a loan should be given back promptly.
+ *
+ * Requests are queued to a taskq of the volume's own.  At most
+ * uzvol_queue_depth requests per thread are outstanding; uzvol_submit()
+ * blocks the caller beyond that rather than queueing without bound.
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/spa.h>
+#include <sys/dmu.h>
+#include <sys/dsl_prop.h>
+#include <sys/txg.h>
+#include <sys/zap.h>
+#include <sys/zil.h>
+#include <sys/zio.h>
+#include <sys/zfs_rlock.h>
+#include <sys/zvol.h>
+#include <sys/fs/zfs.h>
+
+struct uzvol {
+	char		uzv_name[MAXNAMELEN]; /* pool/dd name */
+	objset_t	*uzv_objset;	/* objset handle */
+	uint64_t	uzv_volsize;	/* amount of space we advertise */
+	uint64_t	uzv_volblocksize; /* volume block size */
+	boolean_t	uzv_readonly;	/* snapshot or readonly property */
+	zilog_t		*uzv_zilog;	/* ZIL handle */
+	uint64_t	uzv_txg_assign;	/* txg to assign during ZIL replay */
+	znode_t		uzv_znode;	/* for range locking */
+	taskq_t		*uzv_taskq;	/* runs queued requests */
+	kmutex_t	uzv_lock;	/* protects uzv_inflight */
+	kcondvar_t	uzv_cv;		/* wait for uzv_inflight to drop */
+	int		uzv_inflight;	/* requests submitted, not done */
+	int		uzv_depth;	/* most requests in flight */
+};
+
+int uzvol_maxphys = DMU_MAX_ACCESS / 2;	/* most bytes in one tx */
+ssize_t uzvol_immediate_write_sz = 32768;
+int uzvol_queue_depth = 32;		/* requests in flight per thread */
+
+typedef struct uzvol_create_arg {
+	uint64_t	uca_volsize;
+	uint64_t	uca_volblocksize;
+} uzvol_create_arg_t;
+
+/* ARGSUSED */
+static void
+uzvol_create_cb(objset_t *os, void *arg, cred_t *cr, dmu_tx_t *tx)
+{
+	uzvol_create_arg_t *uca = arg;
+
+	VERIFY(dmu_object_claim(os, ZVOL_OBJ, DMU_OT_ZVOL,
+	    uca->uca_volblocksize, DMU_OT_NONE, 0, tx) == 0);
+	VERIFY(zap_create_claim(os, ZVOL_ZAP_OBJ, DMU_OT_ZVOL_PROP,
+	    DMU_OT_NONE, 0, tx) == 0);
+	VERIFY(zap_update(os, ZVOL_ZAP_OBJ, "size", 8, 1,
+	    &uca->uca_volsize, tx) == 0);
+}
+
+/*
+ * Create a volume, as "zfs create -V" would.
+ */
+int
+uzvol_create(const char *name, uint64_t volsize, uint64_t volblocksize)
+{
+	uzvol_create_arg_t uca;
+
+	if (volblocksize < SPA_MINBLOCKSIZE ||
+	    volblocksize > SPA_MAXBLOCKSIZE || !ISP2(volblocksize))
+		return (EDOM);
+	if (volsize == 0 || volsize % volblocksize != 0)
+		return (EINVAL);
+
+	uca.uca_volsize = volsize;
+	uca.uca_volblocksize = volblocksize;
+	return (dmu_objset_create(name, DMU_OST_ZVOL, NULL,
+	    uzvol_create_cb, &uca));
+}
+
+/*
+ * Replay a TX_WRITE ZIL transaction that didn't get committed
+ * after a system failure
+ */
+static int
+uzvol_replay_write(uzvol_t *zv, lr_write_t *lr, boolean_t byteswap)
+{
+	objset_t *os = zv->uzv_objset;
+	char *data = (char *)(lr + 1);	/* data follows lr_write_t */
+	uint64_t off, len;
+	dmu_tx_t *tx;
+	int error;
+
+	if (byteswap)
+		byteswap_uint64_array(lr, sizeof (*lr));
+	off = lr->lr_offset;
+	len = lr->lr_length;
+
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_write(tx, ZVOL_OBJ, off, len);
+	error = dmu_tx_assign(tx, zv->uzv_txg_assign);
+	if (error) {
+		dmu_tx_abort(tx);
+	} else {
+		dmu_write(os, ZVOL_OBJ, off, len, data, tx);
+		dmu_tx_commit(tx);
+	}
+
+	return (error);
+}
+
+/* ARGSUSED */
+static int
+uzvol_replay_err(uzvol_t *zv, lr_t *lr, boolean_t byteswap)
+{
+	return (ENOTSUP);
+}
+
+/*
+ * Callback vectors for replaying records.
+ * Only TX_WRITE is needed for a volume.
+ */
+static zil_replay_func_t *uzvol_replay_vector[TX_MAX_TYPE] = {
+	uzvol_replay_err,	/* 0 no such transaction type */
+	uzvol_replay_err,	/* TX_CREATE */
+	uzvol_replay_err,	/* TX_MKDIR */
+	uzvol_replay_err,	/* TX_MKXATTR */
+	uzvol_replay_err,	/* TX_SYMLINK */
+	uzvol_replay_err,	/* TX_REMOVE */
+	uzvol_replay_err,	/* TX_RMDIR */
+	uzvol_replay_err,	/* TX_LINK */
+	uzvol_replay_err,	/* TX_RENAME */
+	uzvol_replay_write,	/* TX_WRITE */
+	uzvol_replay_err,	/* TX_TRUNCATE */
+	uzvol_replay_err,	/* TX_SETATTR */
+	uzvol_replay_err,	/* TX_ACL */
+};
+
+static void
+uzvol_get_done(dmu_buf_t *db, void *vzgd)
+{
+	zgd_t *zgd = (zgd_t *)vzgd;
+	rl_t *rl = zgd->zgd_rl;
+
+	dmu_buf_rele(db, vzgd);
+	zfs_range_unlock(rl);
+	zil_add_vdev(zgd->zgd_zilog, DVA_GET_VDEV(BP_IDENTITY(zgd->zgd_bp)));
+	kmem_free(zgd, sizeof (zgd_t));
+}
+
+/*
+ * Get data to generate a TX_WRITE intent log record.
+ */
+static int
+uzvol_get_data(void *arg, lr_write_t *lr, char *buf, zio_t *zio)
+{
+	uzvol_t *zv = arg;
+	objset_t *os = zv->uzv_objset;
+	dmu_buf_t *db;
+	rl_t *rl;
+	zgd_t *zgd;
+	uint64_t boff;			/* block starting offset */
+	int dlen = lr->lr_length;	/* length of user data */
+	int error;
+
+	ASSERT(zio);
+	ASSERT(dlen != 0);
+
+	if (buf != NULL) /* immediate write */
+		return (dmu_read(os, ZVOL_OBJ, lr->lr_offset, dlen, buf));
+
+	zgd = (zgd_t *)kmem_alloc(sizeof (zgd_t), KM_SLEEP);
+	zgd->zgd_zilog = zv->uzv_zilog;
+	zgd->zgd_bp = &lr->lr_blkptr;
+
+	/*
+	 * Lock the range of the block to ensure that when the data is
+	 * written out and it's checksum is being calculated that no other
+	 * thread can change the block.
+	 */
+	boff = P2ALIGN_TYPED(lr->lr_offset, zv->uzv_volblocksize, uint64_t);
+	rl = zfs_range_lock(&zv->uzv_znode, boff, zv->uzv_volblocksize,
+	    RL_READER);
+	zgd->zgd_rl = rl;
+
+	VERIFY(0 == dmu_buf_hold(os, ZVOL_OBJ, lr->lr_offset, zgd, &db));
+	/* the hold merged any deferred partial fill; see dmu_sync() */
+	error = dmu_sync(zio, db, &lr->lr_blkptr,
+	    lr->lr_common.lrc_txg, uzvol_get_done, zgd);
+	if (error == 0)
+		zil_add_vdev(zv->uzv_zilog,
+		    DVA_GET_VDEV(BP_IDENTITY(&lr->lr_blkptr)));
+	/*
+	 * If we get EINPROGRESS, then we need to wait for a
+	 * write IO initiated by dmu_sync() to complete before
+	 * we can release this dbuf.  We will finish everything
+	 * up in the uzvol_get_done() callback.
+	 */
+	if (error == EINPROGRESS)
+		return (0);
+	dmu_buf_rele(db, zgd);
+	zfs_range_unlock(rl);
+	kmem_free(zgd, sizeof (zgd_t));
+	return (error);
+}
+
+/*
+ * Log a write as TX_WRITE records, one per volume block, and return
+ * the sequence number to commit for it to be stable.
+ */
+static uint64_t
+uzvol_log_write(uzvol_t *zv, dmu_tx_t *tx, uint64_t off, uint64_t len)
+{
+	uint32_t blocksize = zv->uzv_volblocksize;
+	uint64_t seq = 0;
+	lr_write_t *lr;
+
+	while (len) {
+		uint64_t nbytes = MIN(len, blocksize - P2PHASE(off, blocksize));
+		itx_t *itx = zil_itx_create(TX_WRITE, sizeof (*lr));
+
+		itx->itx_wr_state = len > uzvol_immediate_write_sz ?
+		    WR_INDIRECT : WR_NEED_COPY;
+		itx->itx_private = zv;
+		lr = (lr_write_t *)&itx->itx_lr;
+		lr->lr_foid = ZVOL_OBJ;
+		lr->lr_offset = off;
+		lr->lr_length = nbytes;
+		lr->lr_blkoff = off - P2ALIGN_TYPED(off, blocksize, uint64_t);
+		BP_ZERO(&lr->lr_blkptr);
+
+		seq = zil_itx_assign(zv->uzv_zilog, itx, tx);
+		len -= nbytes;
+		off += nbytes;
+	}
+	return (seq);
+}
+
+/*
+ * Make writes logged up to seq stable.  With the ZIL disabled that
+ * takes a full txg sync.
+ */
+static void
+uzvol_commit(uzvol_t *zv, uint64_t seq)
+{
+	if (zil_disable)
+		txg_wait_synced(dmu_objset_pool(zv->uzv_objset), 0);
+	else
+		zil_commit(zv->uzv_zilog, seq, ZVOL_OBJ);
+}
+
+static int
+uzvol_strategy(uzvol_t *zv, uzvol_req_t *req)
+{
+	objset_t *os = zv->uzv_objset;
+	uint64_t off = req->uzr_offset;
+	uint64_t resid = req->uzr_length;
+	uint64_t size, seq = 0;
+	char *addr = req->uzr_data;
+	boolean_t reading = (req->uzr_op == UZVOL_READ);
+	rl_t *rl;
+	int error = 0;
+
+	if (req->uzr_op == UZVOL_FLUSH) {
+		uzvol_commit(zv, UINT64_MAX);
+		return (0);
+	}
+
+	if (off > zv->uzv_volsize || resid > zv->uzv_volsize - off)
+		return (EINVAL);
+	if (!reading && zv->uzv_readonly)
+		return (EROFS);
+	if (resid == 0)
+		return (0);
+
+	if (reading && (req->uzr_flags & UZVOL_LOAN)) {
+		rl = zfs_range_lock(&zv->uzv_znode, off, resid, RL_READER);
+		error = dmu_read_loan(os, ZVOL_OBJ, off, resid,
+		    &req->uzr_loan);
+		if (error)
+			zfs_range_unlock(rl);
+		else
+			req->uzr_rl = rl;
+		return (error);
+	}
+
+	/*
+	 * There must be no buffer changes when doing a dmu_sync() because
+	 * we can't change the data whilst calculating the checksum.
+	 */
+	rl = zfs_range_lock(&zv->uzv_znode, off, resid,
+	    reading ? RL_READER : RL_WRITER);
+
+	while (resid != 0) {
+		size = MIN(resid, uzvol_maxphys); /* uzvol_maxphys per tx */
+
+		if (reading) {
+			error = dmu_read(os, ZVOL_OBJ, off, size, addr);
+		} else {
+			dmu_tx_t *tx = dmu_tx_create(os);
+			dmu_tx_hold_write(tx, ZVOL_OBJ, off, size);
+			error = dmu_tx_assign(tx, TXG_WAIT);
+			if (error) {
+				dmu_tx_abort(tx);
+			} else {
+				dmu_write(os, ZVOL_OBJ, off, size, addr, tx);
+				seq = uzvol_log_write(zv, tx, off, size);
+				dmu_tx_commit(tx);
+			}
+		}
+		if (error)
+			break;
+		off += size;
+		addr += size;
+		resid -= size;
+	}
+	zfs_range_unlock(rl);
+
+	if (error == 0 && !reading && (req->uzr_flags & UZVOL_FUA))
+		uzvol_commit(zv, seq);
+
+	return (error);
+}
+
+static void
+uzvol_task(void *arg)
+{
+	uzvol_req_t *req = arg;
+	uzvol_t *zv = req->uzr_vol;
+
+	req->uzr_error = uzvol_strategy(zv, req);
+	req->uzr_done(req);
+
+	/* wakes both uzvol_submit() and uzvol_close() */
+	mutex_enter(&zv->uzv_lock);
+	zv->uzv_inflight--;
+	cv_broadcast(&zv->uzv_cv);
+	mutex_exit(&zv->uzv_lock);
+}
+
+/*
+ * Queue a request; req->uzr_done is called from the volume's taskq
+ * once it has completed.
+ */
+void
+uzvol_submit(uzvol_t *zv, uzvol_req_t *req)
+{
+	req->uzr_vol = zv;
+
+	mutex_enter(&zv->uzv_lock);
+	while (zv->uzv_inflight >= zv->uzv_depth)
+		cv_wait(&zv->uzv_cv, &zv->uzv_lock);
+	zv->uzv_inflight++;
+	mutex_exit(&zv->uzv_lock);
+
+	VERIFY(taskq_dispatch(zv->uzv_taskq, uzvol_task, req, TQ_SLEEP));
+}
+
+/*
+ * Do a request in the calling thread; req->uzr_done is not called.
+ */
+int
+uzvol_io(uzvol_t *zv, uzvol_req_t *req)
+{
+	req->uzr_vol = zv;
+	req->uzr_error = uzvol_strategy(zv, req);
+	return (req->uzr_error);
+}
+
+/*
+ * Give back the data lent to a UZVOL_LOAN read, letting writes to its
+ * extent proceed.
+ */
+void
+uzvol_loan_rele(uzvol_req_t *req)
+{
+	if (req->uzr_loan == NULL)
+		return;
+	dmu_loan_rele(req->uzr_loan);
+	req->uzr_loan = NULL;
+	zfs_range_unlock(req->uzr_rl);
+	req->uzr_rl = NULL;
+}
+
+/*
+ * Open a volume for I/O, replaying its intent log, with nthreads
+ * threads to run queued requests.
+ */
+int
+uzvol_open(const char *name, int nthreads, uzvol_t **zvp)
+{
+	uzvol_t *zv;
+	objset_t *os;
+	dmu_object_info_t doi;
+	uint64_t volsize, readonly;
+	int ds_mode = DS_MODE_PRIMARY;
+	int error;
+
+	if (nthreads < 1)
+		return (EINVAL);
+
+	if (strchr(name, '@') != 0)
+		ds_mode |= DS_MODE_READONLY;
+
+	error = dmu_objset_open(name, DMU_OST_ZVOL, ds_mode, &os);
+	if (error)
+		return (error);
+
+	error = zap_lookup(os, ZVOL_ZAP_OBJ, "size", 8, 1, &volsize);
+	if (error == 0)
+		error = dmu_object_info(os, ZVOL_OBJ, &doi);
+	if (error) {
+		dmu_objset_close(os);
+		return (error);
+	}
+
+	zv = kmem_zalloc(sizeof (uzvol_t), KM_SLEEP);
+	(void) strlcpy(zv->uzv_name, name, sizeof (zv->uzv_name));
+	zv->uzv_objset = os;
+	zv->uzv_volsize = volsize;
+	zv->uzv_volblocksize = doi.doi_data_block_size;
+	zv->uzv_readonly = DS_MODE_IS_READONLY(ds_mode) ||
+	    (dsl_prop_get_integer(name, "readonly", &readonly, NULL) == 0 &&
+	    readonly != 0);
+
+	mutex_init(&zv->uzv_znode.z_range_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&zv->uzv_znode.z_range_cv, NULL, CV_DEFAULT, NULL);
+	avl_create(&zv->uzv_znode.z_range_avl, zfs_range_compare,
+	    sizeof (rl_t), offsetof(rl_t, r_node));
+
+	zv->uzv_zilog = zil_open(os, uzvol_get_data);
+	zil_replay(os, zv, &zv->uzv_txg_assign, uzvol_replay_vector);
+
+	mutex_init(&zv->uzv_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&zv->uzv_cv, NULL, CV_DEFAULT, NULL);
+	zv->uzv_depth = nthreads * uzvol_queue_depth;
+	zv->uzv_taskq = taskq_create("uzvol_taskq", nthreads, maxclsyspri,
+	    zv->uzv_depth, zv->uzv_depth, TASKQ_PREPOPULATE);
+
+	*zvp = zv;
+	return (0);
+}
+
+/*
+ * Wait for queued requests to finish and close the volume.
+ */
+void
+uzvol_close(uzvol_t *zv)
+{
+	mutex_enter(&zv->uzv_lock);
+	while (zv->uzv_inflight != 0)
+		cv_wait(&zv->uzv_cv, &zv->uzv_lock);
+	mutex_exit(&zv->uzv_lock);
+	taskq_destroy(zv->uzv_taskq);
+
+	zil_close(zv->uzv_zilog);
+	avl_destroy(&zv->uzv_znode.z_range_avl);
+	cv_destroy(&zv->uzv_znode.z_range_cv);
+	mutex_destroy(&zv->uzv_znode.z_range_lock);
+	dmu_objset_close(zv->uzv_objset);
+
+	cv_destroy(&zv->uzv_cv);
+	mutex_destroy(&zv->uzv_lock);
+	kmem_free(zv, sizeof (uzvol_t));
+}
+
+uint64_t
+uzvol_size(uzvol_t *zv)
+{
+	return (zv->uzv_volsize);
+}
+
+uint64_t
+uzvol_blocksize(uzvol_t *zv)
+{
+	return (zv->uzv_volblocksize);
+}
+
+boolean_t
+uzvol_readonly(uzvol_t *zv)
+{
+	return (zv->uzv_readonly);
+}
@@ -99,6 +99,7 @@ extern uint64_t    max_mem;
 
 
 unsigned int	max_ncpus;		/* max number of cpus */
+unsigned int	boot_ncpus;		/* cpus online at boot */
 
 
 #define KERN_MAP_MIN_SIZE	(8192+1)
@@ -125,6 +126,8 @@ void
 zfs_context_init(void)
 {
 	uint64_t kern_mem_size;
+	int ncpu;
+	size_t len;
 
 	zfs_lock_attr = lck_attr_alloc_init();
 	zfs_group_attr = lck_grp_attr_alloc_init();
@@ -140,6 +143,15 @@ zfs_context_init(void)
 
 	max_ncpus = 1;
 
+	/*
+	 * Per-CPU transaction state is still disabled (see max_ncpus), but
+	 * the CPU-bound zio taskqs are sized to the real processor count.
+	 */
+	len = sizeof (ncpu);
+	if (sysctlbyname("hw.ncpu", &ncpu, &len, NULL, 0) != 0 || ncpu < 1)
+		ncpu = 1;
+	boot_ncpus = ncpu;
+
 	/* kernel memory space is 4 GB max */
 	kern_mem_size = MIN(max_mem, (uint64_t)0x0FFFFFFFFULL);
 
@@ -386,20 +398,42 @@ OSIncrementAtomic64(volatile SInt64 *address)
 
 
 
+/*
+ * The compare-and-swap routines return the value found at target, as
+ * on Solaris: cmp if the swap happened, otherwise a value that differs
+ * from cmp.  OSCompareAndSwap*() only return a success flag, so retry
+ * until the swap succeeds or the value observed no longer matches.
+ */
 uint32_t
 atomic_cas_32(volatile uint32_t *target, uint32_t cmp, uint32_t new)
 {
-	uint32_t old = *target;
+	uint32_t old;
 
-	OSCompareAndSwap( cmp, new, (volatile UInt32 *)target );
-	return old;
+	do {
+		old = *target;
+		if (old != cmp)
+			return (old);
+	} while (!OSCompareAndSwap(cmp, new, (volatile UInt32 *)target));
+	return (old);
 }
 
+#if defined(__i386__) || defined(__x86_64__)
+uint64_t
+atomic_cas_64(volatile uint64_t *target, uint64_t cmp, uint64_t new)
+{
+	uint64_t old;
+
+	do {
+		old = *target;
+		if (old != cmp)
+			return (old);
+	} while (!OSCompareAndSwap64(cmp, new, (volatile UInt64 *)target));
+	return (old);
+}
+#else
 /*
  * This operation is not thread-safe and the user must
- * protect it my some other means.  The only known caller
- * is zfs_vnop_write() and the value is protected by the
- * znode's mutex.
+ * protect it my some other means.
  */
 uint64_t
 atomic_cas_64(volatile uint64_t *target, uint64_t cmp, uint64_t new)
@@ -409,18 +443,24 @@ atomic_cas_64(volatile uint64_t *target, uint64_t cmp, uint64_t new)
 		*target = new;
 	return (old);
 }
+#endif
 
 void *
 atomic_cas_ptr(volatile void *target, void *cmp, void *new)
 {
-	void *old = *(void **)target;
-	
+	void *old;
+
+	do {
+		old = *(void * volatile *)target;
+		if (old != cmp)
+			return (old);
 #ifdef __LP64__
-	OSCompareAndSwapPtr(cmp, new, target);
+	} while (!OSCompareAndSwapPtr(cmp, new, target));
 #else
-	OSCompareAndSwap( (uint32_t)cmp, (uint32_t)new, (unsigned long *)target );
+	} while (!OSCompareAndSwap((uint32_t)cmp, (uint32_t)new,
+	    (volatile UInt32 *)target));
 #endif
-	return old;
+	return (old);
 }
 
 
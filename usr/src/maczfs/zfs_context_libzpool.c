@@ -459,34 +459,74 @@ OSAtomicIncrement64(volatile SInt64 *address)
 #endif  /* !__i386__ && !__x86_64__ */
 
 /*
- * This operation is not thread-safe and the user must
- * protect it my some other means.  The only known caller
- * is zfs_vnop_write() and the value is protected by the
- * znode's mutex.
+ * The compare-and-swap routines return the value found at target, as
+ * on Solaris: cmp if the swap happened, otherwise a value that differs
+ * from cmp.
  */
+#if defined(__i386__) || defined(__x86_64__)
 uint64_t
 atomic_cas_64(volatile uint64_t *target, uint64_t cmp, uint64_t new)
 {
+	uint64_t old;
+
+	do {
+		old = *target;
+		if (old != cmp)
+			return (old);
+	} while (!OSAtomicCompareAndSwap64Barrier(cmp, new,
+	    (volatile int64_t *)target));
+	return (old);
+}
+#else
+/*
+ * No 64-bit compare-and-swap here, so this is only atomic with respect
+ * to the other callers of this routine.
+ */
+uint64_t
+atomic_cas_64(volatile uint64_t *target, uint64_t cmp, uint64_t new)
+{
+	uint64_t old;
 
 	pthread_mutex_lock(&zfs_global_atomic_mutex);
-	uint64_t old = *target;
+	old = *target;
 	if (old == cmp)
 		*target = new;
 	pthread_mutex_unlock(&zfs_global_atomic_mutex);
 	return (old);
 }
+#endif
+
+uint32_t
+atomic_cas_32(volatile uint32_t *target, uint32_t cmp, uint32_t new)
+{
+	uint32_t old;
+
+	do {
+		old = *target;
+		if (old != cmp)
+			return (old);
+	} while (!OSAtomicCompareAndSwap32Barrier((int32_t)cmp, (int32_t)new,
+	    (volatile int32_t *)target));
+	return (old);
+}
 
 void *
 atomic_cas_ptr(volatile void *target, void *cmp, void *new)
 {
-	void *old = *(void **)target;
-	
+	void *old;
+
+	do {
+		old = *(void * volatile *)target;
+		if (old != cmp)
+			return (old);
 #ifdef __LP64__
-	OSAtomicCompareAndSwapPtr(cmp, new, target);
+	} while (!OSAtomicCompareAndSwapPtrBarrier(cmp, new,
+	    (void * volatile *)target));
 #else
-	OSAtomicCompareAndSwap32( (uint32_t)cmp, (uint32_t)new, (unsigned long *)target );
+	} while (!OSAtomicCompareAndSwap32Barrier((int32_t)cmp, (int32_t)new,
+	    (volatile int32_t *)target));
 #endif
-	return old;
+	return (old);
 }
 
 
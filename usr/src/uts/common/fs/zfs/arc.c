@@ -441,6 +441,7 @@ static buf_hash_table_t buf_hash_table;
 	(BUF_HASH_LOCK(BUF_HASH_INDEX(buf->b_spa, &buf->b_dva, buf->b_birth)))
 
 uint64_t zfs_crc64_table[256];
+uint64_t zfs_crc64_slice[8][256];
 
 static uint64_t
 buf_hash(spa_t *spa, dva_t *dva, uint64_t birth)
@@ -662,6 +663,15 @@ retry:
 		for (ct = zfs_crc64_table + i, *ct = i, j = 8; j > 0; j--)
 			*ct = (*ct >> 1) ^ (-(*ct & 1) & ZFS_CRC64_POLY);
 
+	bcopy(zfs_crc64_table, zfs_crc64_slice[0], sizeof (zfs_crc64_table));
+	for (j = 1; j < 8; j++) {
+		for (i = 0; i < 256; i++) {
+			ct = &zfs_crc64_slice[j - 1][i];
+			zfs_crc64_slice[j][i] = (*ct >> 8) ^
+			    zfs_crc64_table[*ct & 0xFFULL];
+		}
+	}
+
 	for (i = 0; i < BUF_LOCKS; i++) {
 		mutex_init(&buf_hash_table.ht_locks[i].ht_lock,
 		    NULL, MUTEX_DEFAULT, NULL);
@@ -2622,28 +2632,46 @@ arc_write_done(zio_t *zio)
 		arc_cksum_verify(buf);
 
 		exists = buf_hash_insert(hdr, &hash_lock);
-		if (exists) {
+		if (exists && BP_GET_DEDUP(zio->io_bp)) {
 			/*
-			 * This can only happen if we overwrite for
-			 * sync-to-convergence, because we remove
-			 * buffers from the hash table when we arc_free().
+			 * The dedup table pointed this write at a block
+			 * that is already cached under the same identity
+			 * (e.g. two identical writes in one txg).  The
+			 * cached copy has the same contents, so leave
+			 * this buffer anonymous, as if nothing had been
+			 * written.
 			 */
-			ASSERT(DVA_EQUAL(BP_IDENTITY(&zio->io_bp_orig),
-			    BP_IDENTITY(zio->io_bp)));
-			ASSERT3U(zio->io_bp_orig.blk_birth, ==,
-			    zio->io_bp->blk_birth);
-
-			ASSERT(refcount_is_zero(&exists->b_refcnt));
-			arc_change_state(arc_anon, exists, hash_lock);
 			mutex_exit(hash_lock);
-			arc_hdr_destroy(exists);
-			exists = buf_hash_insert(hdr, &hash_lock);
-			ASSERT3P(exists, ==, NULL);
+			bzero(&hdr->b_dva, sizeof (dva_t));
+			hdr->b_birth = 0;
+			hdr->b_cksum0 = 0;
+		} else {
+			if (exists) {
+				/*
+				 * This can only happen if we overwrite for
+				 * sync-to-convergence, because we remove
+				 * buffers from the hash table when we
+				 * arc_free().
+				 */
+				ASSERT(DVA_EQUAL(BP_IDENTITY(&zio->io_bp_orig),
+				    BP_IDENTITY(zio->io_bp)));
+				ASSERT3U(zio->io_bp_orig.blk_birth, ==,
+				    zio->io_bp->blk_birth);
+
+				ASSERT(refcount_is_zero(&exists->b_refcnt));
+				arc_change_state(arc_anon, exists, hash_lock);
+				mutex_exit(hash_lock);
+				arc_hdr_destroy(exists);
+				exists = buf_hash_insert(hdr, &hash_lock);
+				ASSERT3P(exists, ==, NULL);
+			}
+			hdr->b_flags &= ~ARC_IO_IN_PROGRESS;
+			arc_access(hdr, hash_lock);
+			mutex_exit(hash_lock);
 		}
-		hdr->b_flags &= ~ARC_IO_IN_PROGRESS;
-		arc_access(hdr, hash_lock);
-		mutex_exit(hash_lock);
-	} else if (callback->awcb_done == NULL) {
+	}
+
+	if (BUF_EMPTY(hdr) && callback->awcb_done == NULL) {
 		int destroy_hdr;
 		/*
 		 * This is an anonymous buffer with no user callback,
@@ -2655,7 +2683,7 @@ arc_write_done(zio_t *zio)
 		mutex_exit(&arc_eviction_mtx);
 		if (destroy_hdr)
 			arc_hdr_destroy(hdr);
-	} else {
+	} else if (BUF_EMPTY(hdr)) {
 		hdr->b_flags &= ~ARC_IO_IN_PROGRESS;
 	}
 
@@ -2706,9 +2734,14 @@ arc_free(zio_t *pio, spa_t *spa, uint64_t txg, blkptr_t *bp,
 
 	/*
 	 * If this buffer is in the cache, release it, so it
-	 * can be re-used.
+	 * can be re-used.  A deduplicated block may still be cached
+	 * under this identity for other block pointers, so it is
+	 * left for the ARC to evict in the normal way.
 	 */
-	ab = buf_hash_find(spa, BP_IDENTITY(bp), bp->blk_birth, &hash_lock);
+	ab = NULL;
+	if (!BP_GET_DEDUP(bp))
+		ab = buf_hash_find(spa, BP_IDENTITY(bp), bp->blk_birth,
+		    &hash_lock);
 	if (ab != NULL) {
 		/*
 		 * The checksum of blocks to free is not always
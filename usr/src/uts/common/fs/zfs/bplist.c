@@ -126,6 +126,22 @@ bplist_empty(bplist_t *bpl)
 	return (rv);
 }
 
+uint64_t
+bplist_entries(bplist_t *bpl)
+{
+	uint64_t entries;
+
+	if (bpl->bpl_object == 0)
+		return (0);
+
+	mutex_enter(&bpl->bpl_lock);
+	VERIFY(0 == bplist_hold(bpl));
+	entries = bpl->bpl_phys->bpl_entries;
+	mutex_exit(&bpl->bpl_lock);
+
+	return (entries);
+}
+
 static int
 bplist_cache(bplist_t *bpl, uint64_t blkid)
 {
@@ -209,8 +225,12 @@ bplist_enqueue(bplist_t *bpl, blkptr_t *bp, dmu_tx_t *tx)
 	/* We never need the fill count. */
 	bparray[off].blk_fill = 0;
 
-	/* The bplist will compress better if we can leave off the checksum */
-	bzero(&bparray[off].blk_cksum, sizeof (bparray[off].blk_cksum));
+	/*
+	 * The bplist will compress better if we can leave off the checksum,
+	 * but a deduplicated block needs it to find its dedup table entry.
+	 */
+	if (!BP_GET_DEDUP(bp))
+		bzero(&bparray[off].blk_cksum, sizeof (bparray[off].blk_cksum));
 
 	dmu_buf_will_dirty(bpl->bpl_dbuf, tx);
 	bpl->bpl_phys->bpl_entries++;
@@ -275,6 +295,50 @@ bplist_vacate(bplist_t *bpl, dmu_tx_t *tx)
 	mutex_exit(&bpl->bpl_lock);
 }
 
+/*
+ * Drop every entry from index 'entries' onward, e.g. once the caller
+ * has freed them, leaving the rest of the list intact.
+ */
+void
+bplist_truncate(bplist_t *bpl, uint64_t entries, dmu_tx_t *tx)
+{
+	spa_t *spa = dmu_objset_spa(bpl->bpl_mos);
+	uint64_t itor, blk, off;
+	blkptr_t *bp;
+
+	mutex_enter(&bpl->bpl_lock);
+	ASSERT3P(bpl->bpl_queue, ==, NULL);
+	VERIFY(0 == bplist_hold(bpl));
+	ASSERT3U(entries, <=, bpl->bpl_phys->bpl_entries);
+	dmu_buf_will_dirty(bpl->bpl_dbuf, tx);
+
+	for (itor = entries; itor < bpl->bpl_phys->bpl_entries; itor++) {
+		blk = itor >> bpl->bpl_bpshift;
+		off = P2PHASE(itor, 1ULL << bpl->bpl_bpshift);
+		VERIFY(0 == bplist_cache(bpl, blk));
+		bp = (blkptr_t *)bpl->bpl_cached_dbuf->db_data + off;
+
+		bpl->bpl_phys->bpl_bytes -= bp_get_dasize(spa, bp);
+		if (bpl->bpl_havecomp) {
+			bpl->bpl_phys->bpl_comp -= BP_GET_PSIZE(bp);
+			bpl->bpl_phys->bpl_uncomp -= BP_GET_UCSIZE(bp);
+		}
+	}
+	bpl->bpl_phys->bpl_entries = entries;
+
+	if (bpl->bpl_cached_dbuf != NULL) {
+		dmu_buf_rele(bpl->bpl_cached_dbuf, bpl);
+		bpl->bpl_cached_dbuf = NULL;
+	}
+
+	/* Give back the blocks that no longer hold any entries. */
+	off = P2ROUNDUP(entries << SPA_BLKPTRSHIFT,
+	    1ULL << bpl->bpl_blockshift);
+	VERIFY(0 == dmu_free_range(bpl->bpl_mos, bpl->bpl_object,
+	    off, -1ULL, tx));
+	mutex_exit(&bpl->bpl_lock);
+}
+
 int
 bplist_space(bplist_t *bpl, uint64_t *usedp, uint64_t *compp, uint64_t *uncompp)
 {
@@ -38,6 +38,7 @@
 #include <sys/spa.h>
 #include <sys/zio.h>
 #include <sys/dmu_zfetch.h>
+#include <sys/kstat.h>
 
 static void dbuf_destroy(dmu_buf_impl_t *db);
 static int dbuf_undirty(dmu_buf_impl_t *db, dmu_tx_t *tx);
@@ -48,6 +49,36 @@ static arc_done_func_t dbuf_write_done;
 
 int zfs_mdcomp_disable = 0;
 
+/*
+ * A partial write to a block that is not cached leaves the rest of
+ * the old block unread until it is needed (see dmu_buf_will_fill_range()),
+ * and skips the read altogether if the block is overwritten first.
+ * This helps sequential rewrites of existing data in pieces smaller
+ * than a block; appends gain nothing, as blocks past the end of file
+ * are holes that are never read anyway.
+ * Set to zero to read the old block up front, as dbuf_will_dirty() does.
+ */
+int dbuf_partial_fill = 1;
+
+typedef struct dbuf_stats {
+	kstat_named_t dbufstat_partial_fills;
+	kstat_named_t dbufstat_partial_completed;
+	kstat_named_t dbufstat_partial_merged;
+	kstat_named_t dbufstat_partial_freed;
+} dbuf_stats_t;
+
+static dbuf_stats_t dbuf_stats = {
+	{ "partial_fills",		KSTAT_DATA_UINT64 },
+	{ "partial_completed",		KSTAT_DATA_UINT64 },
+	{ "partial_merged",		KSTAT_DATA_UINT64 },
+	{ "partial_freed",		KSTAT_DATA_UINT64 }
+};
+
+#define	DBUFSTAT_BUMP(stat) \
+	atomic_add_64(&dbuf_stats.stat.value.ui64, 1)
+
+static kstat_t *dbuf_ksp;
+
 /*
  * Global data structures and functions for the dbuf cache.
  */
@@ -83,22 +114,145 @@ static dbuf_hash_table_t dbuf_hash_table;
 
 static uint64_t dbuf_hash_count;
 
-static uint64_t
+/*
+ * Lookups walk the hash chains without DBUF_HASH_MUTEX; only inserts and
+ * removes take it.  A lookup instead counts itself in for the current
+ * dbuf_epoch, in one of DBUF_READER_SLOTS counters picked by thread so
+ * that concurrent lookups don't share a cache line.  A dbuf unlinked
+ * from the table keeps its db_hash_next, so a lookup standing on it can
+ * walk on, and dbuf_destroy() parks it on dbuf_limbo tagged with the
+ * epoch it was unlinked in.  dbuf_limbo_reclaim() only advances the
+ * epoch from e to e + 1 once no lookup counted in e - 1 remains, so at
+ * e + 2 nothing can still reach a dbuf unlinked in e and it is freed.
+ */
+#define	DBUF_READER_SLOTS	64
+#define	DBUF_READER_SLOT()	(&dbuf_readers[((uintptr_t)curthread ^ \
+	((uintptr_t)curthread >> 10)) & (DBUF_READER_SLOTS - 1)])
+
+typedef struct dbuf_reader_slot {
+	uint64_t	drs_count[2];
+	char		drs_pad[64 - 2 * sizeof (uint64_t)];
+} dbuf_reader_slot_t;
+
+static dbuf_reader_slot_t dbuf_readers[DBUF_READER_SLOTS];
+static volatile uint64_t dbuf_epoch;
+static kmutex_t dbuf_limbo_lock;
+static list_t dbuf_limbo;		/* linked through db_link */
+static uint64_t dbuf_limbo_count;
+
+int dbuf_limbo_batch = 32;	/* dbufs parked before trying to free them */
+
+static dbuf_reader_slot_t *
+dbuf_read_enter(uint64_t *epochp)
+{
+	dbuf_reader_slot_t *drs = DBUF_READER_SLOT();
+	uint64_t e;
+
+	/*
+	 * Only count ourselves in for an epoch that is still current
+	 * after we have done so; dbuf_limbo_reclaim() may have checked
+	 * an older epoch's counters already.
+	 */
+	for (;;) {
+		e = dbuf_epoch;
+		atomic_add_64(&drs->drs_count[e & 1], 1);
+		if (dbuf_epoch == e)
+			break;
+		atomic_add_64(&drs->drs_count[e & 1], -1);
+	}
+	*epochp = e;
+	return (drs);
+}
+
+static void
+dbuf_read_exit(dbuf_reader_slot_t *drs, uint64_t e)
+{
+	ASSERT(drs->drs_count[e & 1] != 0);
+	atomic_add_64(&drs->drs_count[e & 1], -1);
+}
+
+/*
+ * Try to advance dbuf_epoch, then free the parked dbufs nothing can
+ * reach any more.  With all set there must be no lookups in progress,
+ * and every parked dbuf is freed.
+ */
+static void
+dbuf_limbo_reclaim(boolean_t all)
+{
+	dmu_buf_impl_t *db;
+	list_t tofree;
+	uint64_t e, readers;
+	int i;
+
+	list_create(&tofree, sizeof (dmu_buf_impl_t),
+	    offsetof(dmu_buf_impl_t, db_link));
+
+	mutex_enter(&dbuf_limbo_lock);
+	e = dbuf_epoch;
+	readers = 0;
+	for (i = 0; i < DBUF_READER_SLOTS; i++)
+		readers += dbuf_readers[i].drs_count[(e - 1) & 1];
+	if (readers == 0) {
+		dbuf_epoch = ++e;
+		membar_producer();
+	}
+	while ((db = list_head(&dbuf_limbo)) != NULL &&
+	    (all || db->db_limbo_epoch + 2 <= e)) {
+		list_remove(&dbuf_limbo, db);
+		list_insert_tail(&tofree, db);
+		dbuf_limbo_count--;
+	}
+	mutex_exit(&dbuf_limbo_lock);
+
+	while ((db = list_head(&tofree)) != NULL) {
+		list_remove(&tofree, db);
+		db->db_hash_next = NULL;
+		kmem_cache_free(dbuf_cache, db);
+	}
+	list_destroy(&tofree);
+}
+
+/*
+ * Park a dbuf that has left the hash table until no lookup can still
+ * be walking through it.
+ */
+static void
+dbuf_limbo_add(dmu_buf_impl_t *db)
+{
+	boolean_t reclaim;
+
+	mutex_enter(&dbuf_limbo_lock);
+	db->db_limbo_epoch = dbuf_epoch;
+	list_insert_tail(&dbuf_limbo, db);
+	reclaim = (++dbuf_limbo_count >= dbuf_limbo_batch);
+	mutex_exit(&dbuf_limbo_lock);
+
+	if (reclaim)
+		dbuf_limbo_reclaim(B_FALSE);
+}
+
+/*
+ * The dbuf hash is never stored anywhere, so it only needs to spread
+ * (objset, object, level, blkid) over the table's low-order bits.  A
+ * couple of multiplies and the 64-bit finalizer from MurmurHash3 do
+ * that far more cheaply than a byte-at-a-time table CRC.
+ */
+uint64_t
 dbuf_hash(void *os, uint64_t obj, uint8_t lvl, uint64_t blkid)
 {
-	uintptr_t osv = (uintptr_t)os;
-	uint64_t crc = -1ULL;
-
-	ASSERT(zfs_crc64_table[128] == ZFS_CRC64_POLY);
-	crc = (crc >> 8) ^ zfs_crc64_table[(crc ^ (lvl)) & 0xFFULL];
-	crc = (crc >> 8) ^ zfs_crc64_table[(crc ^ (osv >> 6)) & 0xFFULL];
-	crc = (crc >> 8) ^ zfs_crc64_table[(crc ^ (obj >> 0)) & 0xFFULL];
-	crc = (crc >> 8) ^ zfs_crc64_table[(crc ^ (obj >> 8)) & 0xFFULL];
-	crc = (crc >> 8) ^ zfs_crc64_table[(crc ^ (blkid >> 0)) & 0xFFULL];
-	crc = (crc >> 8) ^ zfs_crc64_table[(crc ^ (blkid >> 8)) & 0xFFULL];
-	crc ^= (osv>>14) ^ (obj>>16) ^ (blkid>>16);
-
-	return (crc);
+	uint64_t h = (uint64_t)(uintptr_t)os >> 6;
+
+	h = h * 0x9E3779B97F4A7C15ULL + obj;
+	h = h * 0x9E3779B97F4A7C15ULL + blkid;
+	h = h * 0x9E3779B97F4A7C15ULL + lvl;
+
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ULL;
+	h ^= h >> 33;
+
+	return (h);
 }
 
 #define	DBUF_HASH(os, obj, level, blkid) dbuf_hash(os, obj, level, blkid);
@@ -117,20 +271,28 @@ dbuf_find(dnode_t *dn, uint8_t level, uint64_t blkid)
 	uint64_t obj = dn->dn_object;
 	uint64_t hv = DBUF_HASH(os, obj, level, blkid);
 	uint64_t idx = hv & h->hash_table_mask;
+	dbuf_reader_slot_t *drs;
 	dmu_buf_impl_t *db;
+	uint64_t e;
 
-	mutex_enter(DBUF_HASH_MUTEX(h, idx));
-	for (db = h->hash_table[idx]; db != NULL; db = db->db_hash_next) {
+	/*
+	 * No bucket lock: a dbuf we reach can't be freed until we call
+	 * dbuf_read_exit(), and once we hold its db_mtx and it isn't
+	 * DB_EVICTING it can't leave the table either.
+	 */
+	drs = dbuf_read_enter(&e);
+	for (db = ((dmu_buf_impl_t * volatile *)h->hash_table)[idx];
+	    db != NULL; db = db->db_hash_next) {
 		if (DBUF_EQUAL(db, os, obj, level, blkid)) {
 			mutex_enter(&db->db_mtx);
 			if (db->db_state != DB_EVICTING) {
-				mutex_exit(DBUF_HASH_MUTEX(h, idx));
+				dbuf_read_exit(drs, e);
 				return (db);
 			}
 			mutex_exit(&db->db_mtx);
 		}
 	}
-	mutex_exit(DBUF_HASH_MUTEX(h, idx));
+	dbuf_read_exit(drs, e);
 	return (NULL);
 }
 
@@ -166,6 +328,8 @@ dbuf_hash_insert(dmu_buf_impl_t *db)
 
 	mutex_enter(&db->db_mtx);
 	db->db_hash_next = h->hash_table[idx];
+	/* lookups may see db as soon as it is linked in */
+	membar_producer();
 	h->hash_table[idx] = db;
 	mutex_exit(DBUF_HASH_MUTEX(h, idx));
 	atomic_add_64(&dbuf_hash_count, 1);
@@ -200,8 +364,11 @@ dbuf_hash_remove(dmu_buf_impl_t *db)
 		dbp = &dbf->db_hash_next;
 		ASSERT(dbf != NULL);
 	}
+	/*
+	 * Leave db_hash_next alone: a lookup may be standing on db.  It
+	 * is cleared when dbuf_limbo_reclaim() frees db.
+	 */
 	*dbp = db->db_hash_next;
-	db->db_hash_next = NULL;
 	mutex_exit(DBUF_HASH_MUTEX(h, idx));
 	atomic_add_64(&dbuf_hash_count, -1);
 }
@@ -270,6 +437,18 @@ retry:
 
 	for (i = 0; i < DBUF_MUTEXES; i++)
 		mutex_init(&h->hash_mutexes[i], NULL, MUTEX_DEFAULT, NULL);
+
+	mutex_init(&dbuf_limbo_lock, NULL, MUTEX_DEFAULT, NULL);
+	list_create(&dbuf_limbo, sizeof (dmu_buf_impl_t),
+	    offsetof(dmu_buf_impl_t, db_link));
+
+	dbuf_ksp = kstat_create("zfs", 0, "dbufstats", "misc",
+	    KSTAT_TYPE_NAMED, sizeof (dbuf_stats) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL);
+	if (dbuf_ksp != NULL) {
+		dbuf_ksp->ks_data = &dbuf_stats;
+		kstat_install(dbuf_ksp);
+	}
 }
 
 void
@@ -278,6 +457,16 @@ dbuf_fini(void)
 	dbuf_hash_table_t *h = &dbuf_hash_table;
 	int i;
 
+	if (dbuf_ksp != NULL) {
+		kstat_delete(dbuf_ksp);
+		dbuf_ksp = NULL;
+	}
+
+	dbuf_limbo_reclaim(B_TRUE);
+	ASSERT(dbuf_limbo_count == 0);
+	list_destroy(&dbuf_limbo);
+	mutex_destroy(&dbuf_limbo_lock);
+
 	for (i = 0; i < DBUF_MUTEXES; i++)
 		mutex_destroy(&h->hash_mutexes[i]);
 	kmem_free(h->hash_table, (h->hash_table_mask + 1) * sizeof (void *));
@@ -543,6 +732,78 @@ dbuf_read_impl(dmu_buf_impl_t *db, zio_t *zio, uint32_t *flags)
 		*flags |= DB_RF_CACHED;
 }
 
+/*
+ * Merge the old block read in by dbuf_fill_partial() in around the
+ * range written under the partially filled dirty record.
+ */
+static void
+dbuf_fill_partial_done(zio_t *zio, arc_buf_t *obuf, void *vdr)
+{
+	dbuf_dirty_record_t *dr = vdr;
+	dmu_buf_impl_t *db = dr->dr_dbuf;
+	int end;
+
+	mutex_enter(&db->db_mtx);
+	end = dr->dt.dl.dr_fill_end;
+	if (zio == NULL || zio->io_error == 0) {
+		ASSERT3U(arc_buf_size(obuf), ==, db->db.db_size);
+		ASSERT(end != 0);
+		bcopy((char *)obuf->b_data + end,
+		    (char *)dr->dt.dl.dr_data->b_data + end,
+		    db->db.db_size - end);
+		dr->dt.dl.dr_fill_end = 0;
+		DBUFSTAT_BUMP(dbufstat_partial_merged);
+	}
+	VERIFY(arc_buf_remove_ref(obuf, vdr) == 1);
+	if (db->db_state == DB_READ && dr->dt.dl.dr_data == db->db_buf)
+		db->db_state = dr->dt.dl.dr_fill_end ? DB_PARTIAL : DB_CACHED;
+	cv_broadcast(&db->db_changed);
+	mutex_exit(&db->db_mtx);
+}
+
+/*
+ * Start reading in the old block under a partially filled dirty record,
+ * as a child of pio.  While the record still shares its data with the
+ * dbuf, the dbuf sits in DB_READ so that readers and writers wait for
+ * the merge.  Called with db_mtx held, which is dropped.
+ */
+static void
+dbuf_fill_partial(dmu_buf_impl_t *db, dbuf_dirty_record_t *dr, zio_t *pio,
+    int zflags)
+{
+	uint32_t aflags = ARC_NOWAIT;
+	blkptr_t bp;
+	zbookmark_t zb;
+
+	ASSERT(MUTEX_HELD(&db->db_mtx));
+	ASSERT(db->db_level == 0);
+	ASSERT(db->db_blkid != DB_BONUS_BLKID);
+
+	while (dr->dt.dl.dr_fill_end != 0 && db->db_state == DB_READ)
+		cv_wait(&db->db_changed, &db->db_mtx);
+	if (dr->dt.dl.dr_fill_end == 0) {
+		mutex_exit(&db->db_mtx);
+		return;
+	}
+
+	ASSERT(dr->dt.dl.dr_data != db->db_buf || db->db_state == DB_PARTIAL);
+	ASSERT(db->db_blkptr != NULL && !BP_IS_HOLE(db->db_blkptr));
+	bp = *db->db_blkptr;
+	if (dr->dt.dl.dr_data == db->db_buf)
+		db->db_state = DB_READ;
+	mutex_exit(&db->db_mtx);
+
+	zb.zb_objset = db->db_objset->os_dsl_dataset ?
+	    db->db_objset->os_dsl_dataset->ds_object : 0;
+	zb.zb_object = db->db.db_object;
+	zb.zb_level = db->db_level;
+	zb.zb_blkid = db->db_blkid;
+
+	(void) arc_read(pio, db->db_dnode->dn_objset->os_spa, &bp,
+	    dmu_ot[db->db_dnode->dn_type].ot_byteswap, dbuf_fill_partial_done,
+	    dr, ZIO_PRIORITY_SYNC_READ, zflags, &aflags, &zb);
+}
+
 int
 dbuf_read(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags)
 {
@@ -563,6 +824,16 @@ dbuf_read(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags)
 	    (flags & DB_RF_NOPREFETCH) == 0 && db->db_dnode != NULL;
 
 	mutex_enter(&db->db_mtx);
+	if (db->db_state == DB_PARTIAL) {
+		zio_t *pzio = zio_root(db->db_dnode->dn_objset->os_spa,
+		    NULL, NULL, ZIO_FLAG_CANFAIL);
+
+		dbuf_fill_partial(db, db->db_last_dirty, pzio,
+		    (flags & DB_RF_CANFAIL) ? ZIO_FLAG_CANFAIL :
+		    ZIO_FLAG_MUSTSUCCEED);
+		err = zio_wait(pzio);
+		mutex_enter(&db->db_mtx);
+	}
 	if (db->db_state == DB_CACHED) {
 		mutex_exit(&db->db_mtx);
 		if (prefetch)
@@ -604,7 +875,8 @@ dbuf_read(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags)
 				    (flags & DB_RF_HAVESTRUCT) == 0);
 				cv_wait(&db->db_changed, &db->db_mtx);
 			}
-			if (db->db_state == DB_UNCACHED)
+			if (db->db_state == DB_UNCACHED ||
+			    db->db_state == DB_PARTIAL)
 				err = EIO;
 		}
 		mutex_exit(&db->db_mtx);
@@ -615,14 +887,29 @@ dbuf_read(dmu_buf_impl_t *db, zio_t *zio, uint32_t flags)
 }
 
 static void
-dbuf_noread(dmu_buf_impl_t *db)
+dbuf_noread(dmu_buf_impl_t *db, dmu_tx_t *tx)
 {
 	ASSERT(!refcount_is_zero(&db->db_holds));
 	ASSERT(db->db_blkid != DB_BONUS_BLKID);
 	mutex_enter(&db->db_mtx);
-	while (db->db_state == DB_READ || db->db_state == DB_FILL)
+	/*
+	 * An earlier txg's partial fill is merged when that txg syncs;
+	 * wait for it rather than read the block in here.
+	 */
+	while (db->db_state == DB_READ || db->db_state == DB_FILL ||
+	    (db->db_state == DB_PARTIAL &&
+	    db->db_last_dirty->dr_txg != tx->tx_txg))
 		cv_wait(&db->db_changed, &db->db_mtx);
-	if (db->db_state == DB_UNCACHED) {
+	if (db->db_state == DB_PARTIAL) {
+		dbuf_dirty_record_t *dr = db->db_last_dirty;
+
+		/* the fill covers everything that was never read in */
+		ASSERT3U(dr->dr_txg, ==, tx->tx_txg);
+		dr->dt.dl.dr_fill_end = 0;
+		db->db_state = DB_CACHED;
+		cv_broadcast(&db->db_changed);
+		DBUFSTAT_BUMP(dbufstat_partial_completed);
+	} else if (db->db_state == DB_UNCACHED) {
 		arc_buf_contents_t type = DBUF_GET_BUFC_TYPE(db);
 
 		ASSERT(db->db_buf == NULL);
@@ -688,6 +975,17 @@ dbuf_fix_old_data(dmu_buf_impl_t *db, uint64_t txg)
 	}
 }
 
+static void
+dbuf_drop_compressed(dbuf_dirty_record_t *dr)
+{
+	if (dr->dt.dl.dr_cdata != NULL) {
+		zio_buf_free(dr->dt.dl.dr_cdata, dr->dt.dl.dr_csize);
+		dr->dt.dl.dr_cdata = NULL;
+		dr->dt.dl.dr_csize = 0;
+		dr->dt.dl.dr_ccompress = 0;
+	}
+}
+
 void
 dbuf_unoverride(dbuf_dirty_record_t *dr)
 {
@@ -698,6 +996,12 @@ dbuf_unoverride(dbuf_dirty_record_t *dr)
 	ASSERT(dr->dt.dl.dr_override_state != DR_IN_DMU_SYNC);
 	ASSERT(db->db_level == 0);
 
+	/*
+	 * Every caller is about to modify (or discard) the buffer, so
+	 * any precompressed image of it is now stale.
+	 */
+	dbuf_drop_compressed(dr);
+
 	if (db->db_blkid == DB_BONUS_BLKID ||
 	    dr->dt.dl.dr_override_state == DR_NOT_OVERRIDDEN)
 		return;
@@ -743,6 +1047,12 @@ dbuf_free_range(dnode_t *dn, uint64_t blkid, uint64_t nblks, dmu_tx_t *tx)
 			continue;
 
 		mutex_enter(&db->db_mtx);
+		/*
+		 * A partial fill being merged still shares its data
+		 * with the dbuf; let the merge finish.
+		 */
+		while (db->db_state == DB_READ && db->db_buf != NULL)
+			cv_wait(&db->db_changed, &db->db_mtx);
 		if (db->db_state == DB_UNCACHED ||
 		    db->db_state == DB_EVICTING) {
 			ASSERT(db->db.db_data == NULL);
@@ -784,6 +1094,20 @@ dbuf_free_range(dnode_t *dn, uint64_t blkid, uint64_t nblks, dmu_tx_t *tx)
 				dbuf_fix_old_data(db, txg);
 			}
 		}
+		if (db->db_state == DB_PARTIAL) {
+			dbuf_dirty_record_t *dr = db->db_last_dirty;
+
+			/*
+			 * Nothing of the old block outlives the free, so
+			 * there is no longer anything to merge in.  A copy
+			 * made for an older txg still needs its merge.
+			 */
+			if (dr->dt.dl.dr_data == db->db_buf)
+				dr->dt.dl.dr_fill_end = 0;
+			db->db_state = DB_CACHED;
+			cv_broadcast(&db->db_changed);
+			DBUFSTAT_BUMP(dbufstat_partial_freed);
+		}
 		/* clear the contents if its cached */
 		if (db->db_state == DB_CACHED) {
 			ASSERT(db->db.db_data != NULL);
@@ -911,8 +1235,8 @@ dbuf_dirty(dmu_buf_impl_t *db, dmu_tx_t *tx)
 	 * transactions created with dmu_tx_create_assigned() from
 	 * syncing context don't bother holding ahead.
 	 */
-	ASSERT(db->db_level != 0 ||
-	    db->db_state == DB_CACHED || db->db_state == DB_FILL);
+	ASSERT(db->db_level != 0 || db->db_state == DB_CACHED ||
+	    db->db_state == DB_FILL || db->db_state == DB_PARTIAL);
 
 	mutex_enter(&dn->dn_mtx);
 	/*
@@ -1039,12 +1363,14 @@ dbuf_dirty(dmu_buf_impl_t *db, dmu_tx_t *tx)
 	/*
 	 * We could have been freed_in_flight between the dbuf_noread
 	 * and dbuf_dirty.  We win, as though the dbuf_noread() had
-	 * happened after the free.
+	 * happened after the free.  For a partial fill that means the
+	 * rest of the block is zeroes, so note it in the record.
 	 */
 	if (db->db_level == 0 && db->db_blkid != DB_BONUS_BLKID) {
 		mutex_enter(&dn->dn_mtx);
 		dnode_clear_range(dn, db->db_blkid, 1, tx);
 		mutex_exit(&dn->dn_mtx);
+		dr->dt.dl.dr_fill_freed = db->db_freed_in_flight;
 		db->db_freed_in_flight = FALSE;
 	}
 
@@ -1185,6 +1511,17 @@ dbuf_undirty(dmu_buf_impl_t *db, dmu_tx_t *tx)
 	if (db->db_level == 0) {
 		dbuf_unoverride(dr);
 
+		/*
+		 * The partial fill goes with its record; the block is
+		 * being freed, so there is nothing left to merge in.
+		 */
+		if (db->db_state == DB_PARTIAL) {
+			ASSERT(dr->dt.dl.dr_data == db->db_buf);
+			db->db_state = DB_CACHED;
+			cv_broadcast(&db->db_changed);
+			DBUFSTAT_BUMP(dbufstat_partial_freed);
+		}
+
 		ASSERT(db->db_buf != NULL);
 		ASSERT(dr->dt.dl.dr_data != NULL);
 		if (dr->dt.dl.dr_data != db->db_buf)
@@ -1244,14 +1581,158 @@ dmu_buf_will_fill(dmu_buf_t *db_fake, dmu_tx_t *tx)
 	ASSERT(db->db.db_object != DMU_META_DNODE_OBJECT ||
 	    dmu_tx_private_ok(tx));
 
-	dbuf_noread(db);
+	dbuf_noread(db, tx);
 	(void) dbuf_dirty(db, tx);
 }
 
+/*
+ * Prepare to write [off, off + len) of a level-0 buffer when that is
+ * less than the whole block.  dbuf_will_dirty() reads the old block in
+ * first; if the buffer isn't cached and the write starts at the
+ * beginning of the block, we dirty it without reading and keep track of
+ * how far it has been filled in this txg instead.  Writes that carry on
+ * from there and go on to cover the whole block never read it at all;
+ * otherwise the old data is merged in when the buffer is read or when
+ * the txg syncs.  Any other write falls back to dbuf_will_dirty(),
+ * including one that picks up mid-block where an earlier txg left the
+ * end of file, since the head of that block has to be read in.
+ */
+void
+dmu_buf_will_fill_range(dmu_buf_t *db_fake, uint64_t off, uint64_t len,
+    dmu_tx_t *tx)
+{
+	dmu_buf_impl_t *db = (dmu_buf_impl_t *)db_fake;
+	dnode_t *dn = db->db_dnode;
+	dbuf_dirty_record_t *dr;
+	int end = off + len;
+	int havestruct, partial = FALSE;
+
+	ASSERT(db->db_blkid != DB_BONUS_BLKID);
+	ASSERT(tx->tx_txg != 0);
+	ASSERT(db->db_level == 0);
+	ASSERT(!refcount_is_zero(&db->db_holds));
+	ASSERT(len != 0 && off + len <= db->db.db_size);
+
+	if (!dbuf_partial_fill || dmu_tx_is_syncing(tx) ||
+	    db->db.db_object == DMU_META_DNODE_OBJECT) {
+		dbuf_will_dirty(db, tx);
+		return;
+	}
+
+	/*
+	 * An earlier txg's partial fill is merged when that txg syncs;
+	 * wait for it before taking the struct_rwlock, which syncing
+	 * context may need.
+	 */
+	mutex_enter(&db->db_mtx);
+	while (db->db_state == DB_PARTIAL &&
+	    db->db_last_dirty->dr_txg != tx->tx_txg)
+		cv_wait(&db->db_changed, &db->db_mtx);
+	mutex_exit(&db->db_mtx);
+
+	/* We need the struct_rwlock to look at db_blkptr. */
+	havestruct = RW_WRITE_HELD(&dn->dn_struct_rwlock);
+	if (!havestruct)
+		rw_enter(&dn->dn_struct_rwlock, RW_READER);
+	mutex_enter(&db->db_mtx);
+	while (db->db_state == DB_READ || db->db_state == DB_FILL)
+		cv_wait(&db->db_changed, &db->db_mtx);
+
+	dr = db->db_last_dirty;
+	if (db->db_state == DB_PARTIAL && off == dr->dt.dl.dr_fill_end) {
+		/* this write carries on from where the last one stopped */
+		ASSERT3U(dr->dr_txg, ==, tx->tx_txg);
+		dr->dt.dl.dr_fill_end = end;
+		if (end == db->db.db_size) {
+			dr->dt.dl.dr_fill_end = 0;
+			db->db_state = DB_CACHED;
+			cv_broadcast(&db->db_changed);
+			DBUFSTAT_BUMP(dbufstat_partial_completed);
+		}
+		mutex_exit(&db->db_mtx);
+		if (!havestruct)
+			rw_exit(&dn->dn_struct_rwlock);
+		(void) dbuf_dirty(db, tx);
+		return;
+	}
+
+	/*
+	 * Only an uncached block with something on disk is worth
+	 * deferring; a hole or freed block is just zero-filled by
+	 * dbuf_read() without any I/O.
+	 */
+	if (off == 0 && db->db_state == DB_UNCACHED && dr == NULL &&
+	    db->db_blkptr != NULL && !BP_IS_HOLE(db->db_blkptr) &&
+	    !dnode_block_freed(dn, db->db_blkid)) {
+		arc_buf_contents_t type = DBUF_GET_BUFC_TYPE(db);
+
+		ASSERT(db->db_buf == NULL);
+		ASSERT(db->db.db_data == NULL);
+		dbuf_set_data(db, arc_buf_alloc(dn->dn_objset->os_spa,
+		    db->db.db_size, db, type));
+		db->db_state = DB_FILL;
+		partial = TRUE;
+	}
+	mutex_exit(&db->db_mtx);
+	if (!havestruct)
+		rw_exit(&dn->dn_struct_rwlock);
+
+	if (!partial) {
+		dbuf_will_dirty(db, tx);
+		return;
+	}
+
+	dr = dbuf_dirty(db, tx);
+
+	mutex_enter(&db->db_mtx);
+	ASSERT3U(db->db_state, ==, DB_FILL);
+	if (db->db_freed_in_flight || dr->dt.dl.dr_fill_freed) {
+		/* freed since we looked; the rest of the block is zeroes */
+		bzero(db->db.db_data, db->db.db_size);
+		db->db_freed_in_flight = FALSE;
+		db->db_state = DB_CACHED;
+		DBUFSTAT_BUMP(dbufstat_partial_freed);
+	} else {
+		dr->dt.dl.dr_fill_end = end;
+		db->db_state = DB_PARTIAL;
+		DBUFSTAT_BUMP(dbufstat_partial_fills);
+	}
+	cv_broadcast(&db->db_changed);
+	mutex_exit(&db->db_mtx);
+}
+
+/*
+ * Called from dmu_tx_count_write() for a write that starts off bytes
+ * into level-0 block blkid.  Returns TRUE if dmu_buf_will_fill_range()
+ * may take it without reading the old block: it starts the block, or
+ * carries on from where a partial fill stopped.  There is then no read
+ * to check for I/O errors; the old block is read, if at all, when the
+ * buffer is read or its txg syncs.
+ */
+boolean_t
+dbuf_fill_defers_read(dnode_t *dn, uint64_t blkid, uint64_t off)
+{
+	dmu_buf_impl_t *db;
+	boolean_t defer;
+
+	if (!dbuf_partial_fill || dn->dn_object == DMU_META_DNODE_OBJECT)
+		return (B_FALSE);
+
+	/* dbuf_find() returns with db_mtx held */
+	db = dbuf_find(dn, 0, blkid);
+	if (db == NULL)
+		return (off == 0);
+	if (db->db_state == DB_PARTIAL)
+		defer = (db->db_last_dirty->dt.dl.dr_fill_end == off);
+	else
+		defer = (off == 0);
+	mutex_exit(&db->db_mtx);
+	return (defer);
+}
+
 #ifndef __APPLE__
 #pragma weak dmu_buf_fill_done = dbuf_fill_done
 #endif
-/* ARGSUSED */
 void
 dbuf_fill_done(dmu_buf_impl_t *db, dmu_tx_t *tx)
 {
@@ -1265,6 +1746,9 @@ dbuf_fill_done(dmu_buf_impl_t *db, dmu_tx_t *tx)
 			/* XXX dbuf_undirty? */
 			bzero(db->db.db_data, db->db.db_size);
 			db->db_freed_in_flight = FALSE;
+			if (db->db_last_dirty != NULL &&
+			    db->db_last_dirty->dr_txg == tx->tx_txg)
+				dbuf_drop_compressed(db->db_last_dirty);
 		}
 		db->db_state = DB_CACHED;
 		cv_broadcast(&db->db_changed);
@@ -1272,6 +1756,35 @@ dbuf_fill_done(dmu_buf_impl_t *db, dmu_tx_t *tx)
 	mutex_exit(&db->db_mtx);
 }
 
+/*
+ * Attach a compressed image of a level-0 buffer's new contents to its
+ * dirty record so that the write in syncing context can use it instead
+ * of compressing the data again.  Must be called between
+ * dmu_buf_will_fill() and dmu_buf_fill_done() for a full-block fill,
+ * by the only writer of the block in this txg.  Ownership of cdata,
+ * which must come from zio_buf_alloc(csize), passes to the dbuf layer.
+ */
+void
+dbuf_assign_compressed(dmu_buf_impl_t *db, void *cdata, uint64_t csize,
+    uint8_t compress, dmu_tx_t *tx)
+{
+	dbuf_dirty_record_t *dr;
+
+	ASSERT(db->db_level == 0);
+	ASSERT(db->db_blkid != DB_BONUS_BLKID);
+	ASSERT3U(csize, <, db->db.db_size);
+
+	mutex_enter(&db->db_mtx);
+	ASSERT(db->db_state == DB_FILL || db->db_state == DB_CACHED);
+	dr = db->db_last_dirty;
+	ASSERT(dr != NULL && dr->dr_txg == tx->tx_txg);
+	dbuf_drop_compressed(dr);
+	dr->dt.dl.dr_cdata = cdata;
+	dr->dt.dl.dr_csize = csize;
+	dr->dt.dl.dr_ccompress = compress;
+	mutex_exit(&db->db_mtx);
+}
+
 /*
  * "Clear" the contents of this dbuf.  This will mark the dbuf
  * EVICTING and clear *most* of its references.  Unfortunetely,
@@ -1298,7 +1811,8 @@ dbuf_clear(dmu_buf_impl_t *db)
 
 	dbuf_evict_user(db);
 
-	if (db->db_state == DB_CACHED) {
+	/* a partial fill whose record was dropped is simply discarded */
+	if (db->db_state == DB_CACHED || db->db_state == DB_PARTIAL) {
 		ASSERT(db->db.db_data != NULL);
 		if (db->db_blkid == DB_BONUS_BLKID) {
 			zio_buf_free(db->db.db_data, DN_MAX_BONUSLEN);
@@ -1515,12 +2029,17 @@ dbuf_destroy(dmu_buf_impl_t *db)
 
 	ASSERT(!list_link_active(&db->db_link));
 	ASSERT(db->db.db_data == NULL);
-	ASSERT(db->db_hash_next == NULL);
 	ASSERT(db->db_blkptr == NULL);
 	ASSERT(db->db_data_pending == NULL);
 
-	kmem_cache_free(dbuf_cache, db);
 	arc_space_return(sizeof (dmu_buf_impl_t));
+	if (db->db_blkid != DB_BONUS_BLKID) {
+		/* lookups may still be walking through it */
+		dbuf_limbo_add(db);
+	} else {
+		ASSERT(db->db_hash_next == NULL);
+		kmem_cache_free(dbuf_cache, db);
+	}
 }
 
 void
@@ -1916,6 +2435,9 @@ dbuf_sync_leaf(dbuf_dirty_record_t *dr, dmu_tx_t *tx)
 	dprintf_dbuf_bp(db, db->db_blkptr, "blkptr=%p", db->db_blkptr);
 
 	mutex_enter(&db->db_mtx);
+	/* dbuf_sync_list() has merged in any partial fill */
+	VERIFY3U(dr->dt.dl.dr_fill_end, ==, 0);
+
 	/*
 	 * To be synced, we must be dirtied.  But we
 	 * might have been freed after the dirty.
@@ -1996,6 +2518,7 @@ dbuf_sync_leaf(dbuf_dirty_record_t *dr, dmu_tx_t *tx)
 
 		*db->db_blkptr = dr->dt.dl.dr_overridden_by;
 		dr->dt.dl.dr_override_state = DR_NOT_OVERRIDDEN;
+		dbuf_drop_compressed(dr);
 		db->db_data_pending = dr;
 		dr->dr_zio = &zio_fake;
 		mutex_exit(&db->db_mtx);
@@ -2055,6 +2578,12 @@ dbuf_sync_leaf(dbuf_dirty_record_t *dr, dmu_tx_t *tx)
 		    os->os_checksum);
 		compress = zio_compress_select(dn->dn_compress,
 		    os->os_compress);
+		/*
+		 * The dedup table is keyed by checksum, so it has to be
+		 * one we can trust to tell blocks apart.
+		 */
+		if (os->os_dedup)
+			checksum = ZIO_CHECKSUM_SHA256;
 	}
 
 	dbuf_write(dr, *datap, checksum, compress, tx);
@@ -2070,6 +2599,29 @@ void
 dbuf_sync_list(list_t *list, dmu_tx_t *tx)
 {
 	dbuf_dirty_record_t *dr;
+	dmu_buf_impl_t *db;
+	zio_t *zio = NULL;
+
+	/*
+	 * Blocks that were only partly written in this txg have the
+	 * rest of their old contents read in before any of them goes
+	 * out, all at once rather than one at a time.
+	 */
+	for (dr = list_head(list); dr != NULL && dr->dr_zio == NULL;
+	    dr = list_next(list, dr)) {
+		db = dr->dr_dbuf;
+		if (db->db_level != 0 || db->db_blkid == DB_BONUS_BLKID ||
+		    dr->dt.dl.dr_fill_end == 0)
+			continue;
+		if (zio == NULL) {
+			zio = zio_root(db->db_dnode->dn_objset->os_spa,
+			    NULL, NULL, ZIO_FLAG_MUSTSUCCEED);
+		}
+		mutex_enter(&db->db_mtx);
+		dbuf_fill_partial(db, dr, zio, ZIO_FLAG_MUSTSUCCEED);
+	}
+	if (zio != NULL)
+		VERIFY(zio_wait(zio) == 0);
 
 	while (dr = list_head(list)) {
 		if (dr->dr_zio != NULL) {
@@ -2129,6 +2681,8 @@ dbuf_write(dbuf_dirty_record_t *dr, arc_buf_t *data, int checksum,
 	zio_flags = ZIO_FLAG_MUSTSUCCEED;
 	if (dmu_ot[dn->dn_type].ot_metadata || zb.zb_level != 0)
 		zio_flags |= ZIO_FLAG_METADATA;
+	else if (os->os_dedup)
+		zio_flags |= ZIO_FLAG_DEDUP;
 	if (BP_IS_OLDER(db->db_blkptr, txg))
 		dsl_dataset_block_kill(
 		    os->os_dsl_dataset, db->db_blkptr, zio, tx);
@@ -2137,6 +2691,13 @@ dbuf_write(dbuf_dirty_record_t *dr, arc_buf_t *data, int checksum,
 	    dmu_get_replication_level(os, &zb, dn->dn_type), txg,
 	    db->db_blkptr, data, dbuf_write_ready, dbuf_write_done, db,
 	    ZIO_PRIORITY_ASYNC_WRITE, zio_flags, &zb);
+
+	if (db->db_level == 0 && dr->dt.dl.dr_cdata != NULL) {
+		zio_write_set_compressed(dr->dr_zio, dr->dt.dl.dr_cdata,
+		    dr->dt.dl.dr_csize, dr->dt.dl.dr_ccompress);
+		dr->dt.dl.dr_cdata = NULL;
+		dr->dt.dl.dr_csize = 0;
+	}
 }
 
 /* ARGSUSED */
@@ -2204,8 +2765,13 @@ dbuf_write_ready(zio_t *zio, arc_buf_t *buf, void *vdb)
 
 	mutex_exit(&db->db_mtx);
 
-	/* We must do this after we've set the bp's type and level */
-	if (!DVA_EQUAL(BP_IDENTITY(zio->io_bp), BP_IDENTITY(bp_orig))) {
+	/*
+	 * We must do this after we've set the bp's type and level.
+	 * A deduplicated block may come back with the DVA it had
+	 * before, but it has still taken a new reference.
+	 */
+	if (!DVA_EQUAL(BP_IDENTITY(zio->io_bp), BP_IDENTITY(bp_orig)) ||
+	    BP_GET_DEDUP(zio->io_bp)) {
 		dsl_dataset_t *ds = os->os_dsl_dataset;
 		dmu_tx_t *tx = os->os_synctx;
 
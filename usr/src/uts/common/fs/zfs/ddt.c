@@ -0,0 +1,398 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2008 Sun Microsystems, Inc.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+#pragma ident	"%Z%%M%	%I%	%E% SMI"
+
+#include <sys/zfs_context.h>
+#include <sys/spa.h>
+#include <sys/spa_impl.h>
+#include <sys/zio.h>
+#include <sys/zap.h>
+#include <sys/dmu_tx.h>
+#include <sys/ddt.h>
+
+/*
+ * The dedup table maps the SHA256 checksum of every block written with
+ * dedup=on to the single copy of that block on disk, together with the
+ * number of block pointers that refer to it.  It is a ZAP object in the
+ * MOS, so lookups are cached by the ARC like any other metadata.  The
+ * entries looked up or changed in the syncing txg are kept in ddt_tree
+ * until ddt_sync() writes them back; all of this happens in syncing
+ * context, under ddt_lock.  The lock is dropped while an entry is read
+ * in from the table, so that one slow lookup doesn't hold up every
+ * other dedup write in the pipeline, and the lookup itself is done on
+ * the write issue taskq (see zio_checksum_generate()).
+ *
+ * Only the pool's allocated space sees the saving.  Every dataset
+ * that references a shared block is charged for all of it, just as
+ * it would be without dedup, so the datasets' "used" add up to more
+ * than the pool has allocated.  This keeps quotas and reservations
+ * from depending on what other datasets happen to hold.
+ */
+
+static int
+ddt_entry_compare(const void *x1, const void *x2)
+{
+	const ddt_entry_t *dde1 = x1;
+	const ddt_entry_t *dde2 = x2;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		if (dde1->dde_key.zc_word[i] < dde2->dde_key.zc_word[i])
+			return (-1);
+		if (dde1->dde_key.zc_word[i] > dde2->dde_key.zc_word[i])
+			return (1);
+	}
+	return (0);
+}
+
+static void
+ddt_key_name(const zio_cksum_t *key, char *name)
+{
+	(void) snprintf(name, DDT_NAMELEN, "%016llx%016llx%016llx%016llx",
+	    (u_longlong_t)key->zc_word[0], (u_longlong_t)key->zc_word[1],
+	    (u_longlong_t)key->zc_word[2], (u_longlong_t)key->zc_word[3]);
+}
+
+/*
+ * Two blocks with the same checksum are only interchangeable if they
+ * were also stored the same way.
+ */
+static boolean_t
+ddt_bp_match(const blkptr_t *ddbp, const blkptr_t *bp)
+{
+	return (BP_GET_LSIZE(ddbp) == BP_GET_LSIZE(bp) &&
+	    BP_GET_PSIZE(ddbp) == BP_GET_PSIZE(bp) &&
+	    BP_GET_COMPRESS(ddbp) == BP_GET_COMPRESS(bp) &&
+	    BP_GET_CHECKSUM(ddbp) == BP_GET_CHECKSUM(bp) &&
+	    BP_GET_BYTEORDER(ddbp) == BP_GET_BYTEORDER(bp) &&
+	    !BP_IS_GANG(ddbp));
+}
+
+void
+ddt_create(spa_t *spa)
+{
+	ddt_t *ddt = kmem_zalloc(sizeof (ddt_t), KM_SLEEP);
+
+	mutex_init(&ddt->ddt_lock, NULL, MUTEX_DEFAULT, NULL);
+	avl_create(&ddt->ddt_tree, ddt_entry_compare,
+	    sizeof (ddt_entry_t), offsetof(ddt_entry_t, dde_node));
+	ddt->ddt_spa = spa;
+
+	spa->spa_ddt = ddt;
+}
+
+void
+ddt_destroy(spa_t *spa)
+{
+	ddt_t *ddt = spa->spa_ddt;
+	ddt_entry_t *dde;
+	void *cookie = NULL;
+
+	while ((dde = avl_destroy_nodes(&ddt->ddt_tree, &cookie)) != NULL)
+		kmem_free(dde, sizeof (ddt_entry_t));
+	avl_destroy(&ddt->ddt_tree);
+	mutex_destroy(&ddt->ddt_lock);
+	kmem_free(ddt, sizeof (ddt_t));
+
+	spa->spa_ddt = NULL;
+}
+
+int
+ddt_load(spa_t *spa)
+{
+	ddt_t *ddt = spa->spa_ddt;
+	int err;
+
+	err = zap_lookup(spa->spa_meta_objset, DMU_POOL_DIRECTORY_OBJECT,
+	    DMU_POOL_DDT, sizeof (uint64_t), 1, &ddt->ddt_object);
+	if (err == ENOENT) {
+		ddt->ddt_object = 0;
+		err = 0;
+	} else if (err == 0 && spa_version(spa) < SPA_VERSION_DEDUP) {
+		/* A pool this old can't hold a dedup table. */
+		ddt->ddt_object = 0;
+		err = EINVAL;
+	}
+	return (err);
+}
+
+/*
+ * Find the entry for 'key', reading it in from the table if need be.
+ * If it isn't in the table and 'create' is set, make an empty one.
+ * Called with ddt_lock held; drops it around the table lookup, so the
+ * caller must not rely on anything else it looked at under the lock.
+ */
+static int
+ddt_lookup(ddt_t *ddt, const zio_cksum_t *key, boolean_t create,
+    ddt_entry_t **ddep)
+{
+	ddt_entry_t search, *dde;
+	ddt_phys_t phys;
+	avl_index_t where;
+	char name[DDT_NAMELEN];
+	uint64_t object, gen;
+	int err;
+
+	ASSERT(MUTEX_HELD(&ddt->ddt_lock));
+
+	search.dde_key = *key;
+	ddt_key_name(key, name);
+top:
+	if ((dde = avl_find(&ddt->ddt_tree, &search, &where)) != NULL) {
+		*ddep = dde;
+		return (0);
+	}
+
+	bzero(&phys, sizeof (ddt_phys_t));
+	err = ENOENT;
+	if ((object = ddt->ddt_object) != 0) {
+		gen = ddt->ddt_gen;
+		mutex_exit(&ddt->ddt_lock);
+		err = zap_lookup(ddt->ddt_spa->spa_meta_objset, object,
+		    name, sizeof (uint64_t), DDT_PHYS_WORDS, &phys);
+		mutex_enter(&ddt->ddt_lock);
+
+		/*
+		 * If the table was written back in the meantime, what we
+		 * read may be stale, so start over.  If someone else read
+		 * the same entry in, theirs is current: use it.
+		 */
+		if (ddt->ddt_gen != gen)
+			goto top;
+		if ((dde = avl_find(&ddt->ddt_tree, &search, &where)) != NULL) {
+			*ddep = dde;
+			return (0);
+		}
+	}
+
+	if (err != 0 && (err != ENOENT || !create))
+		return (err);
+
+	dde = kmem_zalloc(sizeof (ddt_entry_t), KM_SLEEP);
+	dde->dde_key = *key;
+	if (err == 0)
+		dde->dde_phys = phys;
+
+	avl_insert(&ddt->ddt_tree, dde, where);
+	*ddep = dde;
+	return (0);
+}
+
+/*
+ * Called from the write pipeline, before allocation, for a block being
+ * written with dedup=on.  If an identical block is already on disk,
+ * point 'bp' at it, take a reference and return B_TRUE; the caller then
+ * skips allocation and I/O altogether.
+ */
+boolean_t
+ddt_write(spa_t *spa, blkptr_t *bp, int ndvas, uint64_t txg)
+{
+	ddt_t *ddt = spa->spa_ddt;
+	ddt_entry_t *dde;
+	blkptr_t *ddbp;
+	boolean_t hit = B_FALSE;
+	int d;
+
+	ASSERT(BP_GET_CHECKSUM(bp) == ZIO_CHECKSUM_SHA256);
+
+	mutex_enter(&ddt->ddt_lock);
+	if (ddt_lookup(ddt, &bp->blk_cksum, B_FALSE, &dde) == 0 &&
+	    dde->dde_phys.ddp_refcnt != 0 &&
+	    ddt_bp_match(&dde->dde_phys.ddp_bp, bp) &&
+	    BP_GET_NDVAS(&dde->dde_phys.ddp_bp) >= ndvas) {
+		ddbp = &dde->dde_phys.ddp_bp;
+		for (d = 0; d < SPA_DVAS_PER_BP; d++)
+			bp->blk_dva[d] = ddbp->blk_dva[d];
+		bp->blk_birth = txg;
+		dde->dde_phys.ddp_refcnt++;
+		dde->dde_dirty = B_TRUE;
+		hit = B_TRUE;
+	}
+	mutex_exit(&ddt->ddt_lock);
+
+	BP_SET_DEDUP(bp, 1);
+
+	return (hit);
+}
+
+/*
+ * Called once a new dedup=on block has been written, to enter it in
+ * the table.  If an identical block got there first, this copy is left
+ * out of the table and will be freed like an ordinary block.
+ */
+void
+ddt_add(spa_t *spa, const blkptr_t *bp)
+{
+	ddt_t *ddt = spa->spa_ddt;
+	ddt_entry_t *dde;
+
+	ASSERT(BP_GET_DEDUP(bp));
+
+	mutex_enter(&ddt->ddt_lock);
+	if (ddt_lookup(ddt, &bp->blk_cksum, B_TRUE, &dde) == 0 &&
+	    dde->dde_phys.ddp_refcnt == 0) {
+		dde->dde_phys.ddp_bp = *bp;
+		dde->dde_phys.ddp_refcnt = 1;
+		dde->dde_dirty = B_TRUE;
+	}
+	mutex_exit(&ddt->ddt_lock);
+}
+
+/*
+ * Drop the reference 'bp' holds on its table entry.  Returns B_TRUE if
+ * the block is still in use, in which case the caller must not free it.
+ */
+boolean_t
+ddt_free(spa_t *spa, const blkptr_t *bp)
+{
+	ddt_t *ddt = spa->spa_ddt;
+	ddt_entry_t *dde;
+	boolean_t inuse = B_FALSE;
+	int err;
+
+	ASSERT(BP_GET_DEDUP(bp));
+
+	mutex_enter(&ddt->ddt_lock);
+	err = ddt_lookup(ddt, &bp->blk_cksum, B_FALSE, &dde);
+	if (err == 0 && dde->dde_phys.ddp_refcnt != 0 &&
+	    DVA_EQUAL(BP_IDENTITY(&dde->dde_phys.ddp_bp), BP_IDENTITY(bp))) {
+		dde->dde_phys.ddp_refcnt--;
+		dde->dde_dirty = B_TRUE;
+		inuse = (dde->dde_phys.ddp_refcnt != 0);
+	} else if (err != 0 && err != ENOENT) {
+		/*
+		 * We can't tell whether anyone else uses this block;
+		 * leaking it is better than freeing it out from under them.
+		 */
+		inuse = B_TRUE;
+	}
+	mutex_exit(&ddt->ddt_lock);
+
+	return (inuse);
+}
+
+/*
+ * Write back the entries changed in this txg, and drop the rest.  The
+ * changes are applied to the table as two batches, so that each leaf
+ * of the zap is rewritten once per txg rather than once per entry.
+ */
+void
+ddt_sync(spa_t *spa, dmu_tx_t *tx)
+{
+	ddt_t *ddt = spa->spa_ddt;
+	objset_t *mos = spa->spa_meta_objset;
+	ddt_entry_t *dde;
+	ddt_phys_t *phys;
+	const char **upd, **rem;
+	char *names, *name;
+	int n, nupd = 0, nrem = 0;
+	int err;
+
+	mutex_enter(&ddt->ddt_lock);
+	n = avl_numnodes(&ddt->ddt_tree);
+	if (n == 0) {
+		mutex_exit(&ddt->ddt_lock);
+		return;
+	}
+
+	names = kmem_alloc(n * DDT_NAMELEN, KM_SLEEP);
+	upd = kmem_alloc(n * sizeof (char *), KM_SLEEP);
+	rem = kmem_alloc(n * sizeof (char *), KM_SLEEP);
+	phys = kmem_alloc(n * sizeof (ddt_phys_t), KM_SLEEP);
+
+	while ((dde = avl_first(&ddt->ddt_tree)) != NULL) {
+		avl_remove(&ddt->ddt_tree, dde);
+
+		if (dde->dde_dirty) {
+			name = names + (nupd + nrem) * DDT_NAMELEN;
+			ddt_key_name(&dde->dde_key, name);
+			if (dde->dde_phys.ddp_refcnt == 0) {
+				rem[nrem++] = name;
+			} else {
+				phys[nupd] = dde->dde_phys;
+				upd[nupd++] = name;
+			}
+		}
+		kmem_free(dde, sizeof (ddt_entry_t));
+	}
+	ddt->ddt_gen++;
+
+	if (nupd != 0 && ddt->ddt_object == 0) {
+		ddt->ddt_object = zap_create(mos,
+		    DMU_OT_ZAP_OTHER, DMU_OT_NONE, 0, tx);
+		VERIFY(zap_add(mos, DMU_POOL_DIRECTORY_OBJECT,
+		    DMU_POOL_DDT, sizeof (uint64_t), 1,
+		    &ddt->ddt_object, tx) == 0);
+	}
+	if (nrem != 0 && ddt->ddt_object != 0) {
+		err = zap_remove_many(mos, ddt->ddt_object, nrem, rem, tx);
+		ASSERT(err == 0 || err == ENOENT);
+	}
+	if (nupd != 0) {
+		VERIFY(zap_update_many(mos, ddt->ddt_object, nupd, upd,
+		    sizeof (uint64_t), DDT_PHYS_WORDS, phys, tx) == 0);
+	}
+	mutex_exit(&ddt->ddt_lock);
+
+	kmem_free(names, n * DDT_NAMELEN);
+	kmem_free(upd, n * sizeof (char *));
+	kmem_free(rem, n * sizeof (char *));
+	kmem_free(phys, n * sizeof (ddt_phys_t));
+}
+
+int
+ddt_get_stats(spa_t *spa, ddt_stat_t *dds)
+{
+	ddt_t *ddt = spa->spa_ddt;
+	objset_t *mos = spa->spa_meta_objset;
+	zap_cursor_t zc;
+	zap_attribute_t za;
+	ddt_phys_t ddp;
+	uint64_t asize;
+	int err = 0;
+
+	bzero(dds, sizeof (ddt_stat_t));
+
+	if (ddt->ddt_object == 0)
+		return (0);
+
+	for (zap_cursor_init(&zc, mos, ddt->ddt_object);
+	    (err = zap_cursor_retrieve(&zc, &za)) == 0;
+	    zap_cursor_advance(&zc)) {
+		err = zap_lookup(mos, ddt->ddt_object, za.za_name,
+		    sizeof (uint64_t), DDT_PHYS_WORDS, &ddp);
+		if (err != 0)
+			break;
+		asize = BP_GET_ASIZE(&ddp.ddp_bp);
+		dds->dds_entries++;
+		dds->dds_refs += ddp.ddp_refcnt;
+		dds->dds_asize += asize;
+		dds->dds_ref_asize += asize * ddp.ddp_refcnt;
+	}
+	zap_cursor_fini(&zc);
+
+	return (err == ENOENT ? 0 : err);
+}
@@ -246,7 +246,8 @@ dmu_buf_hold_array_by_dnode(dnode_t *dn, uint64_t offset,
 			while (db->db_state == DB_READ ||
 			    db->db_state == DB_FILL)
 				cv_wait(&db->db_changed, &db->db_mtx);
-			if (db->db_state == DB_UNCACHED)
+			if (db->db_state == DB_UNCACHED ||
+			    db->db_state == DB_PARTIAL)
 				err = EIO;
 			mutex_exit(&db->db_mtx);
 			if (err) {
@@ -435,6 +436,96 @@ dmu_read(objset_t *os, uint64_t object, uint64_t offset, uint64_t size,
 	return (err);
 }
 
+/*
+ * Lend the cached data for a range of an object to the caller instead
+ * of copying it out as dmu_read() does.  The loan holds the dbufs that
+ * cover the range, so their data stays in the ARC and in place until
+ * the last dmu_loan_rele().  As with any dbuf hold, later writes to the
+ * range show through; callers wanting a stable image must keep writers
+ * out until the loan is released, as the userland volume engine does
+ * by holding its reader range lock until uzvol_loan_rele().
+ */
+int
+dmu_read_loan(objset_t *os, uint64_t object, uint64_t offset, uint64_t size,
+    dmu_loan_t **dlp)
+{
+	dnode_t *dn;
+	dmu_loan_t *dl;
+	dmu_buf_t *db;
+	uint64_t bufoff;
+	int i, err;
+
+	if (size > DMU_MAX_ACCESS / 2)
+		return (EINVAL);
+
+	err = dnode_hold(os->os, object, FTAG, &dn);
+	if (err)
+		return (err);
+
+	/* as in dmu_read(), nothing lies past an odd-sized only block */
+	if (dn->dn_datablkshift == 0)
+		size = offset > dn->dn_datablksz ? 0 :
+		    MIN(size, dn->dn_datablksz - offset);
+
+	dl = kmem_zalloc(sizeof (dmu_loan_t), KM_SLEEP);
+	dl->dl_offset = offset;
+	dl->dl_length = size;
+	dl->dl_refcnt = 1;
+
+	if (size != 0) {
+		err = dmu_buf_hold_array_by_dnode(dn, offset, size, TRUE, dl,
+		    &dl->dl_numbufs, &dl->dl_dbp);
+	}
+	dnode_rele(dn, FTAG);
+	if (err) {
+		kmem_free(dl, sizeof (dmu_loan_t));
+		return (err);
+	}
+
+	if (dl->dl_numbufs != 0) {
+		dl->dl_segs = kmem_alloc(dl->dl_numbufs *
+		    sizeof (dmu_loan_seg_t), KM_SLEEP);
+	}
+	for (i = 0; i < dl->dl_numbufs; i++) {
+		db = dl->dl_dbp[i];
+		bufoff = offset - db->db_offset;
+		dl->dl_segs[i].dls_data = (char *)db->db_data + bufoff;
+		dl->dl_segs[i].dls_len = MIN(db->db_size - bufoff, size);
+		offset += dl->dl_segs[i].dls_len;
+		size -= dl->dl_segs[i].dls_len;
+	}
+	ASSERT(size == 0);
+
+	*dlp = dl;
+	return (0);
+}
+
+/*
+ * Take another reference on a loan, for handing it to a second user.
+ */
+void
+dmu_loan_hold(dmu_loan_t *dl)
+{
+	VERIFY(atomic_add_64_nv(&dl->dl_refcnt, 1) > 1);
+}
+
+/*
+ * Drop a reference on a loan; the last one returns the buffers.
+ */
+void
+dmu_loan_rele(dmu_loan_t *dl)
+{
+	if (atomic_add_64_nv(&dl->dl_refcnt, -1) != 0)
+		return;
+
+	if (dl->dl_numbufs != 0) {
+		dmu_buf_rele_array(dl->dl_dbp, dl->dl_numbufs, dl);
+		kmem_free(dl->dl_segs,
+		    dl->dl_numbufs * sizeof (dmu_loan_seg_t));
+	}
+	kmem_free(dl, sizeof (dmu_loan_t));
+}
+
 void
 dmu_write(objset_t *os, uint64_t object, uint64_t offset, uint64_t size,
     const void *buf, dmu_tx_t *tx)
@@ -463,7 +554,7 @@ dmu_write(objset_t *os, uint64_t object, uint64_t offset, uint64_t size,
 		if (tocpy == db->db_size)
 			dmu_buf_will_fill(db, tx);
 		else
-			dmu_buf_will_dirty(db, tx);
+			dmu_buf_will_fill_range(db, bufoff, tocpy, tx);
 
 		bcopy(buf, (char *)db->db_data + bufoff, tocpy);
 
@@ -477,6 +568,44 @@ dmu_write(objset_t *os, uint64_t object, uint64_t offset, uint64_t size,
 	dmu_buf_rele_array(dbp, numbufs, FTAG);
 }
 
+/*
+ * Write a single, whole block whose compressed image is already known
+ * (cbuf/csize, compressed with 'compress').  The logical contents in
+ * buf are written as with dmu_write(), and the compressed image is
+ * passed down so the block need not be compressed again.  Ownership of
+ * cbuf, which must come from zio_buf_alloc(csize), passes to the DMU
+ * in all cases.  If the range is not exactly one block, cbuf is simply
+ * discarded.
+ */
+void
+dmu_write_compressed(objset_t *os, uint64_t object, uint64_t offset,
+    uint64_t size, const void *buf, void *cbuf, uint64_t csize,
+    uint8_t compress, dmu_tx_t *tx)
+{
+	dmu_buf_t **dbp;
+	dmu_buf_t *db;
+	int numbufs;
+
+	VERIFY(0 == dmu_buf_hold_array(os, object, offset, size,
+	    FALSE, FTAG, &numbufs, &dbp));
+	db = dbp[0];
+
+	if (numbufs != 1 || db->db_offset != offset || db->db_size != size ||
+	    csize >= size) {
+		dmu_buf_rele_array(dbp, numbufs, FTAG);
+		zio_buf_free(cbuf, csize);
+		dmu_write(os, object, offset, size, buf, tx);
+		return;
+	}
+
+	dmu_buf_will_fill(db, tx);
+	bcopy(buf, db->db_data, size);
+	dbuf_assign_compressed((dmu_buf_impl_t *)db, cbuf, csize, compress, tx);
+	dmu_buf_fill_done(db, tx);
+
+	dmu_buf_rele_array(dbp, numbufs, FTAG);
+}
+
 #ifdef _KERNEL
 int
 #ifdef __APPLE__
@@ -571,7 +700,7 @@ dmu_write_uio(objset_t *os, uint64_t object, uio_t *uio, uint64_t size, dmu_tx_t
 		if (tocpy == db->db_size)
 			dmu_buf_will_fill(db, tx);
 		else
-			dmu_buf_will_dirty(db, tx);
+			dmu_buf_will_fill_range(db, bufoff, tocpy, tx);
 
 		/*
 		 * XXX uiomove could block forever (eg. nfs-backed
@@ -634,7 +763,7 @@ dmu_write_pages(objset_t *os, uint64_t object, uint64_t offset, uint64_t size,
 		if (tocpy == db->db_size)
 			dmu_buf_will_fill(db, tx);
 		else
-			dmu_buf_will_dirty(db, tx);
+			dmu_buf_will_fill_range(db, bufoff, tocpy, tx);
 
 #ifdef __APPLE__
 		ubc_upl_map(pp, (vm_offset_t *)&va);
@@ -721,6 +850,12 @@ dmu_sync_done(zio_t *zio, arc_buf_t *buf, void *varg)
  *	EALREADY: this block is already in the process of being synced.
  *		The caller should track its progress (somehow).
  *
+ *	EIO: the rest of a partially filled block has yet to be read in.
+ *		The caller should wait for the txg to sync.  Holding the
+ *		dbuf with dmu_buf_hold() merges a partial fill that is
+ *		still in the dbuf, so this is left for one copied out to
+ *		an older txg's record when the range was freed.
+ *
  *	EINPROGRESS: the IO has been initiated.
  *		The caller should log this blkptr in the callback.
  *
@@ -836,6 +971,15 @@ dmu_sync(zio_t *pio, dmu_buf_t *db_fake,
 		mutex_exit(&db->db_mtx);
 		txg_resume(dp);
 		return (0);
+	} else if (dr->dt.dl.dr_fill_end != 0) {
+		/*
+		 * The old contents are merged in when this txg syncs;
+		 * until then there is no whole block to write.
+		 */
+		ASSERT(dr->dt.dl.dr_data != db->db_buf);
+		mutex_exit(&db->db_mtx);
+		txg_resume(dp);
+		return (EIO);
 	}
 
 	dr->dt.dl.dr_override_state = DR_IN_DMU_SYNC;
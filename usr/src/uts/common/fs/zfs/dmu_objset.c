@@ -137,6 +137,19 @@ copies_changed_cb(void *arg, uint64_t newval)
 	osi->os_copies = newval;
 }
 
+static void
+dedup_changed_cb(void *arg, uint64_t newval)
+{
+	objset_impl_t *osi = arg;
+
+	/*
+	 * The property can't be turned on below SPA_VERSION_DEDUP, but
+	 * don't write deduplicated blocks an older pool can't describe.
+	 */
+	osi->os_dedup = (newval != 0 &&
+	    spa_version(osi->os_spa) >= SPA_VERSION_DEDUP);
+}
+
 void
 dmu_objset_byteswap(void *buf, size_t size)
 {
@@ -203,6 +216,9 @@ dmu_objset_open_impl(spa_t *spa, dsl_dataset_t *ds, blkptr_t *bp,
 		if (err == 0)
 			err = dsl_prop_register(ds, "copies",
 			    copies_changed_cb, osi);
+		if (err == 0)
+			err = dsl_prop_register(ds, "dedup",
+			    dedup_changed_cb, osi);
 		if (err) {
 			VERIFY(arc_buf_remove_ref(osi->os_phys_buf,
 			    &osi->os_phys_buf) == 1);
@@ -239,10 +255,14 @@ dmu_objset_open_impl(spa_t *spa, dsl_dataset_t *ds, blkptr_t *bp,
 		list_create(&osi->os_free_dnodes[i], sizeof (dnode_t),
 		    offsetof(dnode_t, dn_dirty_link[i]));
 	}
-	list_create(&osi->os_dnodes, sizeof (dnode_t),
-	    offsetof(dnode_t, dn_link));
 	list_create(&osi->os_downgraded_dbufs, sizeof (dmu_buf_impl_t),
 	    offsetof(dmu_buf_impl_t, db_link));
+	for (i = 0; i < DNODE_SHARDS; i++) {
+		avl_create(&osi->os_dnodes[i].dns_tree, dnode_link_compare,
+		    sizeof (dnode_link_t), offsetof(dnode_link_t, dl_node));
+		mutex_init(&osi->os_dnodes[i].dns_lock, NULL, MUTEX_DEFAULT,
+		    NULL);
+	}
 
 	mutex_init(&osi->os_lock, NULL, MUTEX_DEFAULT, NULL);
 	mutex_init(&osi->os_obj_lock, NULL, MUTEX_DEFAULT, NULL);
@@ -311,44 +331,63 @@ dmu_objset_close(objset_t *os)
 	kmem_free(os, sizeof (objset_t));
 }
 
+/*
+ * Can we hold this dnode for dmu_objset_evict_dbufs()?  The mdn is
+ * skipped in the shards and processed last, since the other dnodes
+ * have holds on it.
+ */
+#define	DMU_OBJSET_EVICT_HOLD(osi, dn) \
+	((dn) != (osi)->os_meta_dnode && dnode_add_ref((dn), FTAG))
+
 int
 dmu_objset_evict_dbufs(objset_t *os)
 {
 	objset_impl_t *osi = os->os;
-	dnode_t *dn;
+	dnode_shard_t *dns;
+	dnode_link_t *dl, *next_dl;
+	uint64_t count;
+	int i;
 
-	mutex_enter(&osi->os_lock);
+	for (i = 0; i < DNODE_SHARDS; i++) {
+		dns = &osi->os_dnodes[i];
+		mutex_enter(&dns->dns_lock);
 
-	/* process the mdn last, since the other dnodes have holds on it */
-	list_remove(&osi->os_dnodes, osi->os_meta_dnode);
-	list_insert_tail(&osi->os_dnodes, osi->os_meta_dnode);
+		/*
+		 * Find the first dnode with holds.  We have to do this
+		 * dance because dnode_add_ref() only works if you already
+		 * have a hold.  If there are no holds then it has no dbufs
+		 * so OK to skip.
+		 */
+		for (dl = avl_first(&dns->dns_tree);
+		    dl && !DMU_OBJSET_EVICT_HOLD(osi, dl->dl_dnode);
+		    dl = AVL_NEXT(&dns->dns_tree, dl))
+			continue;
+
+		while (dl) {
+			next_dl = dl;
+			do {
+				next_dl = AVL_NEXT(&dns->dns_tree, next_dl);
+			} while (next_dl &&
+			    !DMU_OBJSET_EVICT_HOLD(osi, next_dl->dl_dnode));
+
+			mutex_exit(&dns->dns_lock);
+			dnode_evict_dbufs(dl->dl_dnode);
+			dnode_rele(dl->dl_dnode, FTAG);
+			mutex_enter(&dns->dns_lock);
+			dl = next_dl;
+		}
+		mutex_exit(&dns->dns_lock);
+	}
 
-	/*
-	 * Find the first dnode with holds.  We have to do this dance
-	 * because dnode_add_ref() only works if you already have a
-	 * hold.  If there are no holds then it has no dbufs so OK to
-	 * skip.
-	 */
-	for (dn = list_head(&osi->os_dnodes);
-	    dn && !dnode_add_ref(dn, FTAG);
-	    dn = list_next(&osi->os_dnodes, dn))
-		continue;
-
-	while (dn) {
-		dnode_t *next_dn = dn;
-
-		do {
-			next_dn = list_next(&osi->os_dnodes, next_dn);
-		} while (next_dn && !dnode_add_ref(next_dn, FTAG));
-
-		mutex_exit(&osi->os_lock);
-		dnode_evict_dbufs(dn);
-		dnode_rele(dn, FTAG);
-		mutex_enter(&osi->os_lock);
-		dn = next_dn;
+	if (dnode_add_ref(osi->os_meta_dnode, FTAG)) {
+		dnode_evict_dbufs(osi->os_meta_dnode);
+		dnode_rele(osi->os_meta_dnode, FTAG);
 	}
-	mutex_exit(&osi->os_lock);
-	return (list_head(&osi->os_dnodes) != osi->os_meta_dnode);
+
+	count = 0;
+	for (i = 0; i < DNODE_SHARDS; i++)
+		count += avl_numnodes(&osi->os_dnodes[i].dns_tree);
+	return (count != 1);
 }
 
 void
@@ -356,7 +395,7 @@ dmu_objset_evict(dsl_dataset_t *ds, void *arg)
 {
 	objset_impl_t *osi = arg;
 	objset_t os;
-	int i;
+	int i, busy;
 
 	for (i = 0; i < TXG_SIZE; i++) {
 		ASSERT(list_head(&osi->os_dirty_dnodes[i]) == NULL);
@@ -370,6 +409,8 @@ dmu_objset_evict(dsl_dataset_t *ds, void *arg)
 		    compression_changed_cb, osi));
 		VERIFY(0 == dsl_prop_unregister(ds, "copies",
 		    copies_changed_cb, osi));
+		VERIFY(0 == dsl_prop_unregister(ds, "dedup",
+		    dedup_changed_cb, osi));
 	}
 
 	/*
@@ -377,16 +418,20 @@ dmu_objset_evict(dsl_dataset_t *ds, void *arg)
 	 * nothing can be added to the list at this point.
 	 */
 	os.os = osi;
-	(void) dmu_objset_evict_dbufs(&os);
+	busy = dmu_objset_evict_dbufs(&os);
+	ASSERT(!busy);
 
-	ASSERT3P(list_head(&osi->os_dnodes), ==, osi->os_meta_dnode);
-	ASSERT3P(list_tail(&osi->os_dnodes), ==, osi->os_meta_dnode);
 	ASSERT3P(list_head(&osi->os_meta_dnode->dn_dbufs), ==, NULL);
 
 	dnode_special_close(osi->os_meta_dnode);
 	zil_free(osi->os_zil);
 
 	VERIFY(arc_buf_remove_ref(osi->os_phys_buf, &osi->os_phys_buf) == 1);
+	for (i = 0; i < DNODE_SHARDS; i++) {
+		ASSERT(avl_numnodes(&osi->os_dnodes[i].dns_tree) == 0);
+		avl_destroy(&osi->os_dnodes[i].dns_tree);
+		mutex_destroy(&osi->os_dnodes[i].dns_lock);
+	}
 	mutex_destroy(&osi->os_lock);
 	mutex_destroy(&osi->os_obj_lock);
 	kmem_free(osi, sizeof (objset_impl_t));
@@ -42,6 +42,23 @@
 #include <sys/zfs_ioctl.h>
 #include <sys/zap.h>
 #include <sys/zio_checksum.h>
+#include <sys/zio_compress.h>
+#include <sys/avl.h>
+
+/*
+ * Maximum number of blocks remembered by a deduplicated send; once the
+ * table is full, later blocks are only looked up, never added.
+ */
+int zfs_send_dedup_max = 1 << 16;
+
+typedef struct send_dedup_entry {
+	avl_node_t	sde_node;
+	zio_cksum_t	sde_cksum;	/* SHA-256 of the payload */
+	uint64_t	sde_length;	/* logical length */
+	uint8_t		sde_compress;	/* payload compression */
+	uint64_t	sde_object;
+	uint64_t	sde_offset;
+} send_dedup_entry_t;
 
 struct backuparg {
 	dmu_replay_record_t *drr;
@@ -49,14 +66,62 @@ struct backuparg {
 	objset_t *os;
 	zio_cksum_t zc;
 	int err;
+	int flags;
+	int advance;
+	avl_tree_t dedup;
+	int dedup_count;
+	/*
+	 * When resuming, nothing is written until we have passed the
+	 * WRITE record for (resume_object, resume_offset).
+	 */
+	boolean_t resume_skip;
+	uint64_t resume_object;
+	uint64_t resume_offset;
 };
 
+static int
+send_dedup_compare(const void *arg1, const void *arg2)
+{
+	const send_dedup_entry_t *sde1 = arg1;
+	const send_dedup_entry_t *sde2 = arg2;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		if (sde1->sde_cksum.zc_word[i] < sde2->sde_cksum.zc_word[i])
+			return (-1);
+		if (sde1->sde_cksum.zc_word[i] > sde2->sde_cksum.zc_word[i])
+			return (1);
+	}
+	if (sde1->sde_length != sde2->sde_length)
+		return (sde1->sde_length < sde2->sde_length ? -1 : 1);
+	if (sde1->sde_compress != sde2->sde_compress)
+		return (sde1->sde_compress < sde2->sde_compress ? -1 : 1);
+	return (0);
+}
+
+static void
+send_dedup_fini(struct backuparg *ba)
+{
+	send_dedup_entry_t *sde;
+	void *cookie = NULL;
+
+	if (!(ba->flags & DMU_SEND_DEDUP))
+		return;
+
+	while ((sde = avl_destroy_nodes(&ba->dedup, &cookie)) != NULL)
+		kmem_free(sde, sizeof (send_dedup_entry_t));
+	avl_destroy(&ba->dedup);
+}
+
 static int
 dump_bytes(struct backuparg *ba, void *buf, int len)
 {
 	ssize_t resid; /* have to get resid to get detailed errno */
 	ASSERT3U(len % 8, ==, 0);
 
+	if (ba->resume_skip)
+		return (0);
+
 	fletcher_4_incremental_native(buf, len, &ba->zc);
 
 	/*
@@ -91,22 +156,86 @@ dump_free(struct backuparg *ba, uint64_t object, uint64_t offset,
 	return (0);
 }
 
+/*
+ * Once we have (not) sent the last WRITE record that the receiver
+ * already applied, start sending for real.
+ */
+static void
+send_resume_check(struct backuparg *ba, uint64_t object, uint64_t offset)
+{
+	if (ba->resume_skip && object == ba->resume_object &&
+	    offset == ba->resume_offset)
+		ba->resume_skip = B_FALSE;
+}
+
+static int
+dump_write_byref(struct backuparg *ba, uint64_t object, uint64_t offset,
+    uint64_t length, send_dedup_entry_t *sde)
+{
+	/* write a WRITE_BYREF record */
+	bzero(ba->drr, sizeof (dmu_replay_record_t));
+	ba->drr->drr_type = DRR_WRITE_BYREF;
+	ba->drr->drr_u.drr_write_byref.drr_object = object;
+	ba->drr->drr_u.drr_write_byref.drr_offset = offset;
+	ba->drr->drr_u.drr_write_byref.drr_length = length;
+	ba->drr->drr_u.drr_write_byref.drr_refobject = sde->sde_object;
+	ba->drr->drr_u.drr_write_byref.drr_refoffset = sde->sde_offset;
+
+	if (dump_bytes(ba, ba->drr, sizeof (dmu_replay_record_t)))
+		return (EINTR);
+	send_resume_check(ba, object, offset);
+	return (0);
+}
+
+/*
+ * Write a DATA record.  If compress is set, data holds the block as
+ * stored on disk (psize bytes, compressed with 'compress'); otherwise
+ * it holds blksz bytes of logical data.
+ */
 static int
 dump_data(struct backuparg *ba, dmu_object_type_t type,
-    uint64_t object, uint64_t offset, int blksz, void *data)
+    uint64_t object, uint64_t offset, int blksz, uint8_t compress,
+    int psize, void *data)
 {
-	/* write a DATA record */
+	int len = compress ? psize : blksz;
+
+	if (ba->flags & DMU_SEND_DEDUP) {
+		send_dedup_entry_t sde_search, *sde;
+		avl_index_t where;
+
+		zio_checksum_SHA256(data, len, &sde_search.sde_cksum);
+		sde_search.sde_length = blksz;
+		sde_search.sde_compress = compress;
+		sde = avl_find(&ba->dedup, &sde_search, &where);
+		if (sde != NULL)
+			return (dump_write_byref(ba, object, offset, blksz, sde));
+		if (ba->dedup_count < zfs_send_dedup_max) {
+			sde = kmem_alloc(sizeof (send_dedup_entry_t),
+			    KM_SLEEP);
+			*sde = sde_search;
+			sde->sde_object = object;
+			sde->sde_offset = offset;
+			avl_insert(&ba->dedup, sde, where);
+			ba->dedup_count++;
+		}
+	}
+
 	bzero(ba->drr, sizeof (dmu_replay_record_t));
 	ba->drr->drr_type = DRR_WRITE;
 	ba->drr->drr_u.drr_write.drr_object = object;
 	ba->drr->drr_u.drr_write.drr_type = type;
 	ba->drr->drr_u.drr_write.drr_offset = offset;
 	ba->drr->drr_u.drr_write.drr_length = blksz;
+	if (compress) {
+		ba->drr->drr_u.drr_write.drr_compress = compress;
+		ba->drr->drr_u.drr_write.drr_psize = psize;
+	}
 
 	if (dump_bytes(ba, ba->drr, sizeof (dmu_replay_record_t)))
 		return (EINTR);
-	if (dump_bytes(ba, data, blksz))
+	if (dump_bytes(ba, data, len))
 		return (EINTR);
+	send_resume_check(ba, object, offset);
 	return (0);
 }
 
@@ -176,7 +305,7 @@ backup_cb(traverse_blk_cache_t *bc, spa_t *spa, void *arg)
 	if (issig(JUSTLOOKING) && issig(FORREAL))
 		return (EINTR);
 
-	ASSERT(data || bp == NULL);
+	ASSERT(data || bp == NULL || !(ba->advance & ADVANCE_DATA));
 
 	if (bp == NULL && object == 0) {
 		uint64_t span = BP_SPAN(bc->bc_dnode, level);
@@ -200,7 +329,35 @@ backup_cb(traverse_blk_cache_t *bc, spa_t *spa, void *arg)
 	} else if (level == 0 &&
 	    type != DMU_OT_DNODE && type != DMU_OT_OBJSET) {
 		int blksz = BP_GET_LSIZE(bp);
-		if (data == NULL) {
+
+		/*
+		 * Send compressed blocks exactly as they are stored.  A
+		 * block written in the other byte order can't be fixed
+		 * up without decompressing it, so send it as logical data.
+		 * Blocks the receiver already has need not be read at
+		 * all, unless we need their contents for the dedup table.
+		 */
+		if (ba->resume_skip && !(ba->flags & DMU_SEND_DEDUP)) {
+			send_resume_check(ba, object, blkid * blksz);
+		} else if ((ba->flags & DMU_SEND_COMPRESSED) &&
+		    BP_GET_COMPRESS(bp) != ZIO_COMPRESS_OFF &&
+		    !BP_SHOULD_BYTESWAP(bp)) {
+			int psize = BP_GET_PSIZE(bp);
+			void *cbuf = zio_buf_alloc(psize);
+			zbookmark_t zb;
+
+			zb.zb_objset = ba->os->os->os_dsl_dataset->ds_object;
+			zb.zb_object = object;
+			zb.zb_level = level;
+			zb.zb_blkid = blkid;
+			(void) zio_wait(zio_read(NULL, spa, bp, cbuf, psize,
+			    NULL, NULL, ZIO_PRIORITY_ASYNC_READ,
+			    ZIO_FLAG_MUSTSUCCEED | ZIO_FLAG_RAW, &zb));
+
+			err = dump_data(ba, type, object, blkid * blksz,
+			    blksz, BP_GET_COMPRESS(bp), psize, cbuf);
+			zio_buf_free(cbuf, psize);
+		} else if (data == NULL) {
 			uint32_t aflags = ARC_WAIT;
 			arc_buf_t *abuf;
 			zbookmark_t zb;
@@ -216,12 +373,12 @@ backup_cb(traverse_blk_cache_t *bc, spa_t *spa, void *arg)
 
 			if (abuf) {
 				err = dump_data(ba, type, object, blkid * blksz,
-				    blksz, abuf->b_data);
+				    blksz, 0, 0, abuf->b_data);
 				(void) arc_buf_remove_ref(abuf, &abuf);
 			}
 		} else {
 			err = dump_data(ba, type, object, blkid * blksz,
-			    blksz, data);
+			    blksz, 0, 0, data);
 		}
 	}
 
@@ -229,12 +386,15 @@ backup_cb(traverse_blk_cache_t *bc, spa_t *spa, void *arg)
 	return (err);
 }
 
-dmu_sendbackup(objset_t *tosnap, objset_t *fromsnap, vnode_t *vp)
+int
+dmu_sendbackup(objset_t *tosnap, objset_t *fromsnap, int flags,
+    dmu_send_resume_t *resume, vnode_t *vp)
 {
 	dsl_dataset_t *ds = tosnap->os->os_dsl_dataset;
 	dsl_dataset_t *fromds = fromsnap ? fromsnap->os->os_dsl_dataset : NULL;
 	dmu_replay_record_t *drr;
 	struct backuparg ba;
+	int advance;
 	int err;
 
 	/* tosnap must be a snapshot */
@@ -247,10 +407,22 @@ dmu_sendbackup(objset_t *tosnap, objset_t *fromsnap, vnode_t *vp)
 	    ds->ds_phys->ds_creation_txg))
 		return (EXDEV);
 
+	/* a resumed send must be of the stream that was interrupted */
+	if ((flags & DMU_SEND_RESUME) &&
+	    (resume == NULL || resume->dsr_toguid != ds->ds_phys->ds_guid))
+		return (EINVAL);
+
 	drr = kmem_zalloc(sizeof (dmu_replay_record_t), KM_SLEEP);
 	drr->drr_type = DRR_BEGIN;
 	drr->drr_u.drr_begin.drr_magic = DMU_BACKUP_MAGIC;
 	drr->drr_u.drr_begin.drr_version = DMU_BACKUP_VERSION;
+	if (flags & DMU_SEND_COMPRESSED)
+		drr->drr_u.drr_begin.drr_version |=
+		    DMU_BACKUP_FEATURE_COMPRESSED;
+	if (flags & DMU_SEND_DEDUP)
+		drr->drr_u.drr_begin.drr_version |= DMU_BACKUP_FEATURE_DEDUP;
+	if (flags & DMU_SEND_RESUME)
+		drr->drr_u.drr_begin.drr_version |= DMU_BACKUP_FEATURE_RESUMING;
 	drr->drr_u.drr_begin.drr_creation_time =
 	    ds->ds_phys->ds_creation_time;
 	drr->drr_u.drr_begin.drr_type = tosnap->os->os_phys->os_type;
@@ -262,17 +434,54 @@ dmu_sendbackup(objset_t *tosnap, objset_t *fromsnap, vnode_t *vp)
 	ba.drr = drr;
 	ba.vp = vp;
 	ba.os = tosnap;
+	ba.err = 0;
+	ba.flags = flags;
+	ba.dedup_count = 0;
+	ba.resume_skip = B_FALSE;
 	ZIO_SET_CHECKSUM(&ba.zc, 0, 0, 0, 0);
+	if (flags & DMU_SEND_DEDUP) {
+		avl_create(&ba.dedup, send_dedup_compare,
+		    sizeof (send_dedup_entry_t),
+		    offsetof(send_dedup_entry_t, sde_node));
+	}
 
 	if (dump_bytes(&ba, drr, sizeof (dmu_replay_record_t))) {
+		send_dedup_fini(&ba);
 		kmem_free(drr, sizeof (dmu_replay_record_t));
 		return (ba.err);
 	}
 
+	/*
+	 * The receiver has already checksummed everything up to where
+	 * it stopped, so continue its checksum rather than our own.
+	 */
+	if (flags & DMU_SEND_RESUME) {
+		ZIO_SET_CHECKSUM(&ba.zc, resume->dsr_checksum[0],
+		    resume->dsr_checksum[1], resume->dsr_checksum[2],
+		    resume->dsr_checksum[3]);
+		ba.resume_object = resume->dsr_object;
+		ba.resume_offset = resume->dsr_offset;
+		ba.resume_skip = (resume->dsr_object != 0);
+	}
+
+	/*
+	 * A compressed or resumed send reads the data blocks itself, so
+	 * it can read them in their on-disk form, or skip them.
+	 */
+	advance = ADVANCE_PRE | ADVANCE_HOLES | ADVANCE_NOLOCK;
+	if (!(flags & (DMU_SEND_COMPRESSED | DMU_SEND_RESUME)))
+		advance |= ADVANCE_DATA;
+	ba.advance = advance;
+
 	err = traverse_dsl_dataset(ds,
 	    fromds ? fromds->ds_phys->ds_creation_txg : 0,
-	    ADVANCE_PRE | ADVANCE_HOLES | ADVANCE_DATA | ADVANCE_NOLOCK,
-	    backup_cb, &ba);
+	    advance, backup_cb, &ba);
+
+	send_dedup_fini(&ba);
+
+	/* we never got to where the receiver stopped */
+	if (err == 0 && ba.resume_skip)
+		err = EINVAL;
 
 	if (err) {
 		if (err == EINTR && ba.err)
@@ -305,14 +514,41 @@ struct restorearg {
 	int bufoff; /* next offset to read */
 	int bufsize; /* amount of memory allocated for buf */
 	zio_cksum_t zc;
+	uint64_t features; /* DMU_BACKUP_FEATURE_* of the stream */
+	boolean_t resumable; /* keep progress, and the fs, on failure */
+};
+
+struct recvbeginarg {
+	struct drr_begin *drrb;
+	boolean_t resumable;
+	zio_cksum_t zc; /* stream checksum through the BEGIN record */
 };
 
+/*
+ * Record in the dataset that a resumable receive of this stream is
+ * under way, and that nothing past the BEGIN record has been applied.
+ */
+static void
+replay_resume_begin(dsl_dataset_t *ds, struct recvbeginarg *rba, dmu_tx_t *tx)
+{
+	if (!rba->resumable)
+		return;
+
+	dmu_buf_will_dirty(ds->ds_dbuf, tx);
+	ds->ds_phys->ds_resume_toguid = rba->drrb->drr_toguid;
+	ds->ds_phys->ds_resume_version = rba->drrb->drr_version;
+	ds->ds_phys->ds_resume_object = 0;
+	ds->ds_phys->ds_resume_offset = 0;
+	ds->ds_phys->ds_resume_checksum = rba->zc;
+}
+
 /* ARGSUSED */
 static int
 replay_incremental_check(void *arg1, void *arg2, dmu_tx_t *tx)
 {
 	dsl_dataset_t *ds = arg1;
-	struct drr_begin *drrb = arg2;
+	struct recvbeginarg *rba = arg2;
+	struct drr_begin *drrb = rba->drrb;
 	const char *snapname;
 	int err;
 	uint64_t val;
@@ -352,6 +588,7 @@ replay_incremental_sync(void *arg1, void *arg2, cred_t *cr, dmu_tx_t *tx)
 	dsl_dataset_t *ds = arg1;
 	dmu_buf_will_dirty(ds->ds_dbuf, tx);
 	ds->ds_phys->ds_flags |= DS_FLAG_INCONSISTENT;
+	replay_resume_begin(ds, arg2, tx);
 
 	spa_history_internal_log(LOG_DS_REPLAY_INC_SYNC,
 	    ds->ds_dir->dd_pool->dp_spa, tx, cr, "dataset = %lld",
@@ -363,7 +600,8 @@ static int
 replay_full_check(void *arg1, void *arg2, dmu_tx_t *tx)
 {
 	dsl_dir_t *dd = arg1;
-	struct drr_begin *drrb = arg2;
+	struct recvbeginarg *rba = arg2;
+	struct drr_begin *drrb = rba->drrb;
 	objset_t *mos = dd->dd_pool->dp_meta_objset;
 	char *cp;
 	uint64_t val;
@@ -386,7 +624,8 @@ static void
 replay_full_sync(void *arg1, void *arg2, cred_t *cr, dmu_tx_t *tx)
 {
 	dsl_dir_t *dd = arg1;
-	struct drr_begin *drrb = arg2;
+	struct recvbeginarg *rba = arg2;
+	struct drr_begin *drrb = rba->drrb;
 	char *cp;
 	dsl_dataset_t *ds;
 	uint64_t dsobj;
@@ -404,6 +643,7 @@ replay_full_sync(void *arg1, void *arg2, cred_t *cr, dmu_tx_t *tx)
 
 	dmu_buf_will_dirty(ds->ds_dbuf, tx);
 	ds->ds_phys->ds_flags |= DS_FLAG_INCONSISTENT;
+	replay_resume_begin(ds, rba, tx);
 
 	spa_history_internal_log(LOG_DS_REPLAY_FULL_SYNC,
 	    ds->ds_dir->dd_pool->dp_spa, tx, cr, "dataset = %lld",
@@ -463,6 +703,54 @@ replay_end_sync(void *arg1, void *arg2, cred_t *cr, dmu_tx_t *tx)
 
 	dmu_buf_will_dirty(hds->ds_dbuf, tx);
 	hds->ds_phys->ds_flags &= ~DS_FLAG_INCONSISTENT;
+	dsl_dataset_clear_resume(hds);
+}
+
+/*
+ * Check that ds holds a partial resumable receive of the stream
+ * described by drrb, and pick up the stream checksum where it left off.
+ */
+static int
+replay_resume_check(struct restorearg *ra, dsl_dataset_t *ds,
+    struct drr_begin *drrb)
+{
+	uint64_t features = DMU_BACKUP_FEATURE_RESUMING;
+
+	if (!(ds->ds_phys->ds_flags & DS_FLAG_INCONSISTENT) ||
+	    ds->ds_phys->ds_resume_toguid != drrb->drr_toguid ||
+	    (ds->ds_phys->ds_resume_version | features) != drrb->drr_version)
+		return (EINVAL);
+
+	/* must be built on the same incremental source */
+	if (drrb->drr_fromguid != 0 ? (ds->ds_prev == NULL ||
+	    ds->ds_prev->ds_phys->ds_guid != drrb->drr_fromguid) :
+	    ds->ds_phys->ds_prev_snap_obj != 0)
+		return (ENODEV);
+
+	ra->zc = ds->ds_phys->ds_resume_checksum;
+	return (0);
+}
+
+/*
+ * Remember how far a resumable receive has got: the WRITE record for
+ * (object, offset) is applied in tx, along with everything before it.
+ */
+static void
+save_resume_state(struct restorearg *ra, objset_t *os, uint64_t object,
+    uint64_t offset, dmu_tx_t *tx)
+{
+	dsl_dataset_t *ds = os->os->os_dsl_dataset;
+	int t = tx->tx_txg & TXG_MASK;
+
+	if (!ra->resumable)
+		return;
+
+	ASSERT(object != 0);
+	mutex_enter(&ds->ds_lock);
+	ds->ds_resume_object[t] = object;
+	ds->ds_resume_offset[t] = offset;
+	ds->ds_resume_checksum[t] = ra->zc;
+	mutex_exit(&ds->ds_lock);
 }
 
 static void *
@@ -547,6 +835,14 @@ backup_byteswap(dmu_replay_record_t *drr)
 		DO32(drr_write.drr_type);
 		DO64(drr_write.drr_offset);
 		DO64(drr_write.drr_length);
+		DO64(drr_write.drr_psize);
+		break;
+	case DRR_WRITE_BYREF:
+		DO64(drr_write_byref.drr_object);
+		DO64(drr_write_byref.drr_offset);
+		DO64(drr_write_byref.drr_length);
+		DO64(drr_write_byref.drr_refobject);
+		DO64(drr_write_byref.drr_refoffset);
 		break;
 	case DRR_FREE:
 		DO64(drr_free.drr_object);
@@ -684,6 +980,79 @@ restore_freeobjects(struct restorearg *ra, objset_t *os,
 	return (0);
 }
 
+/*
+ * Restore a compressed WRITE record.  The payload is decompressed to
+ * recover the logical data, and, if the pool can store it, the payload
+ * itself is kept so that the block need not be compressed again.
+ */
+static int
+restore_write_compressed(struct restorearg *ra, objset_t *os,
+    struct drr_write *drrw)
+{
+	uint64_t lsize = drrw->drr_length;
+	uint64_t psize = drrw->drr_psize;
+	int compress = drrw->drr_compress;
+	void *cdata, *data;
+	void *cbuf = NULL;
+	dmu_tx_t *tx;
+	int err;
+
+	if (!(ra->features & DMU_BACKUP_FEATURE_COMPRESSED) ||
+	    compress <= ZIO_COMPRESS_OFF || compress == ZIO_COMPRESS_EMPTY ||
+	    compress >= ZIO_COMPRESS_FUNCTIONS ||
+	    lsize > SPA_MAXBLOCKSIZE || psize == 0 || psize >= lsize ||
+	    P2PHASE(psize, SPA_MINBLOCKSIZE))
+		return (EINVAL);
+
+	cdata = restore_read(ra, psize);
+	if (cdata == NULL)
+		return (ra->err);
+
+	if (dmu_object_info(os, drrw->drr_object, NULL) != 0)
+		return (EINVAL);
+
+	data = zio_buf_alloc(lsize);
+	if (zio_decompress_data(compress, cdata, psize, data, lsize) != 0) {
+		zio_buf_free(data, lsize);
+		return (EINVAL);
+	}
+
+	/*
+	 * The payload can only be stored as-is if it is in our byte
+	 * order and the pool knows its compression algorithm.
+	 */
+	if (!ra->byteswap && (compress < ZIO_COMPRESS_GZIP_1 ||
+	    spa_version(dmu_objset_spa(os)) >= SPA_VERSION_GZIP_COMPRESSION)) {
+		cbuf = zio_buf_alloc(psize);
+		bcopy(cdata, cbuf, psize);
+	}
+
+	tx = dmu_tx_create(os);
+
+	dmu_tx_hold_write(tx, drrw->drr_object, drrw->drr_offset, lsize);
+	err = dmu_tx_assign(tx, TXG_WAIT);
+	if (err) {
+		dmu_tx_abort(tx);
+		if (cbuf != NULL)
+			zio_buf_free(cbuf, psize);
+		zio_buf_free(data, lsize);
+		return (err);
+	}
+	if (ra->byteswap)
+		dmu_ot[drrw->drr_type].ot_byteswap(data, lsize);
+	if (cbuf != NULL) {
+		dmu_write_compressed(os, drrw->drr_object, drrw->drr_offset,
+		    lsize, data, cbuf, psize, compress, tx);
+	} else {
+		dmu_write(os, drrw->drr_object, drrw->drr_offset, lsize,
+		    data, tx);
+	}
+	save_resume_state(ra, os, drrw->drr_object, drrw->drr_offset, tx);
+	dmu_tx_commit(tx);
+	zio_buf_free(data, lsize);
+	return (0);
+}
+
 static int
 restore_write(struct restorearg *ra, objset_t *os,
     struct drr_write *drrw)
@@ -696,6 +1065,9 @@ restore_write(struct restorearg *ra, objset_t *os,
 	    drrw->drr_type >= DMU_OT_NUMTYPES)
 		return (EINVAL);
 
+	if (drrw->drr_compress != 0)
+		return (restore_write_compressed(ra, os, drrw));
+
 	data = restore_read(ra, drrw->drr_length);
 	if (data == NULL)
 		return (ra->err);
@@ -716,10 +1088,58 @@ restore_write(struct restorearg *ra, objset_t *os,
 		dmu_ot[drrw->drr_type].ot_byteswap(data, drrw->drr_length);
 	dmu_write(os, drrw->drr_object,
 	    drrw->drr_offset, drrw->drr_length, data, tx);
+	save_resume_state(ra, os, drrw->drr_object, drrw->drr_offset, tx);
 	dmu_tx_commit(tx);
 	return (0);
 }
 
+/*
+ * Restore a WRITE_BYREF record by copying the (already restored, and
+ * therefore already in our byte order) block it refers to.
+ */
+static int
+restore_write_byref(struct restorearg *ra, objset_t *os,
+    struct drr_write_byref *drrwbr)
+{
+	dmu_tx_t *tx;
+	void *data;
+	int err;
+
+	if (!(ra->features & DMU_BACKUP_FEATURE_DEDUP) ||
+	    drrwbr->drr_offset + drrwbr->drr_length < drrwbr->drr_offset ||
+	    drrwbr->drr_length == 0 || drrwbr->drr_length > SPA_MAXBLOCKSIZE)
+		return (EINVAL);
+
+	if (dmu_object_info(os, drrwbr->drr_object, NULL) != 0 ||
+	    dmu_object_info(os, drrwbr->drr_refobject, NULL) != 0)
+		return (EINVAL);
+
+	data = zio_buf_alloc(drrwbr->drr_length);
+	err = dmu_read(os, drrwbr->drr_refobject, drrwbr->drr_refoffset,
+	    drrwbr->drr_length, data);
+	if (err) {
+		zio_buf_free(data, drrwbr->drr_length);
+		return (EINVAL);
+	}
+
+	tx = dmu_tx_create(os);
+
+	dmu_tx_hold_write(tx, drrwbr->drr_object,
+	    drrwbr->drr_offset, drrwbr->drr_length);
+	err = dmu_tx_assign(tx, TXG_WAIT);
+	if (err) {
+		dmu_tx_abort(tx);
+		zio_buf_free(data, drrwbr->drr_length);
+		return (err);
+	}
+	dmu_write(os, drrwbr->drr_object,
+	    drrwbr->drr_offset, drrwbr->drr_length, data, tx);
+	save_resume_state(ra, os, drrwbr->drr_object, drrwbr->drr_offset, tx);
+	dmu_tx_commit(tx);
+	zio_buf_free(data, drrwbr->drr_length);
+	return (0);
+}
+
 /* ARGSUSED */
 static int
 restore_free(struct restorearg *ra, objset_t *os,
@@ -752,15 +1172,17 @@ restore_free(struct restorearg *ra, objset_t *os,
 
 int
 dmu_recvbackup(char *tosnap, struct drr_begin *drrb, uint64_t *sizep,
-    boolean_t force, vnode_t *vp, uint64_t voffset)
+    boolean_t force, boolean_t resumable, vnode_t *vp, uint64_t voffset)
 {
 	struct restorearg ra;
+	struct recvbeginarg rba;
 	dmu_replay_record_t *drr;
 	char *cp;
 	objset_t *os = NULL;
 	zio_cksum_t pzc;
 
 	bzero(&ra, sizeof (ra));
+	ra.resumable = resumable;
 	ra.vp = vp;
 	ra.voff = voffset;
 	ra.bufsize = 1<<20;
@@ -803,17 +1225,38 @@ dmu_recvbackup(char *tosnap, struct drr_begin *drrb, uint64_t *sizep,
 
 	ASSERT3U(drrb->drr_magic, ==, DMU_BACKUP_MAGIC);
 
-	if (drrb->drr_version != DMU_BACKUP_VERSION ||
+	ra.features = DMU_GET_BACKUP_FEATURES(drrb->drr_version);
+
+	if (DMU_GET_BACKUP_VERSION(drrb->drr_version) != DMU_BACKUP_VERSION ||
+	    (ra.features & ~DMU_BACKUP_FEATURE_MASK) != 0 ||
 	    drrb->drr_type >= DMU_OST_NUMTYPES ||
 	    strchr(drrb->drr_toname, '@') == NULL) {
 		ra.err = EINVAL;
 		goto out;
 	}
 
-	/*
-	 * Process the begin in syncing context.
-	 */
-	if (drrb->drr_fromguid) {
+	rba.drrb = drrb;
+	rba.resumable = resumable;
+	rba.zc = ra.zc;
+
+	if (ra.features & DMU_BACKUP_FEATURE_RESUMING) {
+		/* pick up a partial receive into the existing fs */
+		dsl_dataset_t *ds = NULL;
+
+		ra.resumable = B_TRUE;
+		cp = strchr(tosnap, '@');
+		*cp = '\0';
+		ra.err = dsl_dataset_open(tosnap,
+		    DS_MODE_EXCLUSIVE | DS_MODE_INCONSISTENT, FTAG, &ds);
+		*cp = '@';
+		if (ra.err)
+			goto out;
+		ra.err = replay_resume_check(&ra, ds, drrb);
+		dsl_dataset_close(ds, DS_MODE_EXCLUSIVE, FTAG);
+	} else if (drrb->drr_fromguid) {
+		/*
+		 * Process the begin in syncing context.
+		 */
 		/* incremental backup */
 		dsl_dataset_t *ds = NULL;
 
@@ -840,7 +1283,7 @@ dmu_recvbackup(char *tosnap, struct drr_begin *drrb, uint64_t *sizep,
 		}
 		ra.err = dsl_sync_task_do(ds->ds_dir->dd_pool,
 		    replay_incremental_check, replay_incremental_sync,
-		    ds, drrb, 1);
+		    ds, &rba, 1);
 		dsl_dataset_close(ds, DS_MODE_EXCLUSIVE, FTAG);
 	} else {
 		/* full backup */
@@ -865,7 +1308,7 @@ dmu_recvbackup(char *tosnap, struct drr_begin *drrb, uint64_t *sizep,
 		}
 
 		ra.err = dsl_sync_task_do(dd->dd_pool, replay_full_check,
-		    replay_full_sync, dd, drrb, 5);
+		    replay_full_sync, dd, &rba, 5);
 		dsl_dir_close(dd, FTAG);
 	}
 	if (ra.err)
@@ -921,6 +1364,13 @@ dmu_recvbackup(char *tosnap, struct drr_begin *drrb, uint64_t *sizep,
 			ra.err = restore_write(&ra, os, &drrw);
 			break;
 		}
+		case DRR_WRITE_BYREF:
+		{
+			struct drr_write_byref drrwbr =
+			    drr->drr_u.drr_write_byref;
+			ra.err = restore_write_byref(&ra, os, &drrwbr);
+			break;
+		}
 		case DRR_FREE:
 		{
 			struct drr_free drrf = drr->drr_u.drr_free;
@@ -960,9 +1410,9 @@ out:
 	/*
 	 * Make sure we don't rollback/destroy unless we actually
 	 * processed the begin properly.  'os' will only be set if this
-	 * is the case.
+	 * is the case.  A resumable receive keeps what it has applied.
 	 */
-	if (ra.err && os && tosnap && strchr(tosnap, '@')) {
+	if (ra.err && os && !ra.resumable && tosnap && strchr(tosnap, '@')) {
 		/*
 		 * rollback or destroy what we created, so we don't
 		 * leave it in the restoring state.
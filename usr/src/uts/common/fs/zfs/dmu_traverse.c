@@ -573,18 +573,27 @@ traverse_segment(traverse_handle_t *th, zseg_t *zseg, blkptr_t *mosbp)
 
 	if (zb->zb_objset != 0) {
 		uint64_t objset = zb->zb_objset;
-		dsl_dataset_phys_t *dsp;
+		dsl_dataset_phys_t *dsp = NULL;
+		blkptr_t *osbp = &zseg->seg_osbp;
 
-		rc = get_dnode(th, 0, dn, &objset, &dn_tmp, 0,
-		    DMU_OT_DSL_DATASET, ZB_MOS_CACHE);
+		/*
+		 * A destroyed objset has no dataset left in the MOS to
+		 * find its root through; the segment carries it instead.
+		 */
+		if (BP_IS_HOLE(osbp)) {
+			rc = get_dnode(th, 0, dn, &objset, &dn_tmp, 0,
+			    DMU_OT_DSL_DATASET, ZB_MOS_CACHE);
 
-		if (objset != zb->zb_objset)
-			rc = advance_objset(zseg, objset, th->th_advance);
+			if (objset != zb->zb_objset)
+				rc = advance_objset(zseg, objset,
+				    th->th_advance);
 
-		if (rc != 0)
-			return (rc);
+			if (rc != 0)
+				return (rc);
 
-		dsp = DN_BONUS(dn_tmp);
+			dsp = DN_BONUS(dn_tmp);
+			osbp = &dsp->ds_bp;
+		}
 
 		bc = &th->th_cache[ZB_MDN_CACHE][ZB_MAXLEVEL - 1];
 		dn = &((objset_phys_t *)bc->bc_data)->os_meta_dnode;
@@ -599,13 +608,13 @@ traverse_segment(traverse_handle_t *th, zseg_t *zseg, blkptr_t *mosbp)
 		 * we no longer need to synchronize with spa_sync(); we're
 		 * traversing a completely static block tree from here on.
 		 */
-		if (th->th_advance & ADVANCE_NOLOCK) {
+		if ((th->th_advance & ADVANCE_NOLOCK) && dsp != NULL) {
 			ASSERT(th->th_locked);
 			rw_exit(spa_traverse_rwlock(th->th_spa));
 			th->th_locked = 0;
 		}
 
-		rc = traverse_read(th, bc, &dsp->ds_bp, dn);
+		rc = traverse_read(th, bc, osbp, dn);
 
 		if (rc != 0) {
 			if (rc == ERESTART)
@@ -614,7 +623,7 @@ traverse_segment(traverse_handle_t *th, zseg_t *zseg, blkptr_t *mosbp)
 			return (rc);
 		}
 
-		if (th->th_advance & ADVANCE_PRUNE)
+		if ((th->th_advance & ADVANCE_PRUNE) && dsp != NULL)
 			zseg->seg_mintxg =
 			    MAX(zseg->seg_mintxg, dsp->ds_prev_snap_txg);
 	}
@@ -787,6 +796,8 @@ traverse_add_segment(traverse_handle_t *th, uint64_t mintxg, uint64_t maxtxg,
 	zseg->seg_end.zb_level = elevel;
 	zseg->seg_end.zb_blkid = eblkid;
 
+	BP_ZERO(&zseg->seg_osbp);
+
 	list_insert_tail(&th->th_seglist, zseg);
 }
 
@@ -818,6 +829,30 @@ traverse_add_objset(traverse_handle_t *th, uint64_t mintxg, uint64_t maxtxg,
 		    objset, 0, -1, 0);
 }
 
+/*
+ * Add an objset whose dataset has already been destroyed, so its root
+ * block pointer can no longer be found through the MOS.  If zb is not
+ * NULL, the traversal resumes there (see traverse_bookmark()) rather
+ * than at the start of the objset.
+ */
+void
+traverse_add_destroyed_objset(traverse_handle_t *th, uint64_t mintxg,
+    uint64_t objset, blkptr_t *osbp, zbookmark_t *zb)
+{
+	zseg_t *zseg;
+
+	ASSERT(!BP_IS_HOLE(osbp));
+
+	traverse_add_objset(th, mintxg, -1ULL, objset);
+
+	zseg = list_tail(&th->th_seglist);
+	zseg->seg_osbp = *osbp;
+	if (zb != NULL) {
+		ASSERT3U(zb->zb_objset, ==, objset);
+		zseg->seg_start = *zb;
+	}
+}
+
 void
 traverse_add_pool(traverse_handle_t *th, uint64_t mintxg, uint64_t maxtxg)
 {
@@ -831,6 +866,23 @@ traverse_add_pool(traverse_handle_t *th, uint64_t mintxg, uint64_t maxtxg)
 		    0, 0, -1, 0);
 }
 
+/*
+ * Return the next block the traversal will visit, so that it can be
+ * picked up again later with traverse_add_destroyed_objset().
+ * Returns ENOENT once there is nothing left to traverse.
+ */
+int
+traverse_bookmark(traverse_handle_t *th, zbookmark_t *zb)
+{
+	zseg_t *zseg = list_head(&th->th_seglist);
+
+	if (zseg == NULL)
+		return (ENOENT);
+
+	*zb = zseg->seg_start;
+	return (0);
+}
+
 traverse_handle_t *
 traverse_init(spa_t *spa, blkptr_cb_t func, void *arg, int advance,
     int zio_flags)
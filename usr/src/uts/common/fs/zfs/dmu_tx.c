@@ -34,6 +34,7 @@
 #include <sys/dsl_dir.h> /* for dsl_dir_tempreserve_*() */
 #include <sys/dsl_pool.h>
 #include <sys/zap_impl.h> /* for fzap_default_block_shift */
+#include <sys/zap_leaf.h> /* for ZAP_LEAF_CHUNKSIZE */
 #include <sys/spa.h>
 #include <sys/zfs_context.h>
 
@@ -183,6 +184,8 @@ dmu_tx_count_write(dmu_tx_hold_t *txh, uint64_t off, uint64_t len)
 	/*
 	 * For i/o error checking, read the first and last level-0
 	 * blocks (if they are not aligned), and all the level-1 blocks.
+	 * A level-0 block that dmu_buf_will_fill_range() may fill
+	 * without reading is left alone.
 	 */
 
 	if (dn) {
@@ -196,8 +199,10 @@ dmu_tx_count_write(dmu_tx_hold_t *txh, uint64_t off, uint64_t len)
 
 			/* first level-0 block */
 			start = off >> dn->dn_datablkshift;
-			if (P2PHASE(off, dn->dn_datablksz) ||
-			    len < dn->dn_datablksz) {
+			if ((P2PHASE(off, dn->dn_datablksz) ||
+			    len < dn->dn_datablksz) &&
+			    !dbuf_fill_defers_read(dn, start,
+			    P2PHASE(off, dn->dn_datablksz))) {
 				err = dmu_tx_check_ioerr(zio, dn, 0, start);
 				if (err)
 					goto out;
@@ -206,7 +211,8 @@ dmu_tx_count_write(dmu_tx_hold_t *txh, uint64_t off, uint64_t len)
 			/* last level-0 block */
 			end = (off+len-1) >> dn->dn_datablkshift;
 			if (end != start &&
-			    P2PHASE(off+len, dn->dn_datablksz)) {
+			    P2PHASE(off+len, dn->dn_datablksz) &&
+			    !dbuf_fill_defers_read(dn, end, 0)) {
 				err = dmu_tx_check_ioerr(zio, dn, 0, end);
 				if (err)
 					goto out;
@@ -586,6 +592,89 @@ dmu_tx_hold_zap(dmu_tx_t *tx, uint64_t object, int add, char *name)
 		txh->txh_space_towrite += 3 << dn->dn_indblkshift;
 }
 
+/*
+ * Hold a zap for zap_add_many(), zap_update_many() or zap_remove_many()
+ * of count names.  Unlike count calls to dmu_tx_hold_zap(), this
+ * charges each leaf (and the header and pointer table) once: a batch
+ * can rewrite at most count of the existing leaves, and if adding, can
+ * create about one new leaf per half-leaf's worth of new entries.
+ */
+void
+dmu_tx_hold_zap_many(dmu_tx_t *tx, uint64_t object, int add, int count)
+{
+	dmu_tx_hold_t *txh;
+	dnode_t *dn;
+	uint64_t nblocks, nleaves, ntwigs;
+	int bs, epbs, err;
+
+	ASSERT(tx->tx_txg == 0);
+	ASSERT(count > 0);
+
+	txh = dmu_tx_hold_object_impl(tx, tx->tx_objset,
+	    object, THT_ZAP, add, 0);
+	if (txh == NULL)
+		return;
+	dn = txh->txh_dnode;
+
+	dmu_tx_count_dnode(txh);
+
+	/*
+	 * Assume the usual entry (a short name and one integer) of
+	 * 4 chunks, in leaves that are half full after splitting.
+	 */
+	nleaves = add ? 1 + (((uint64_t)count * 4 * 2 * ZAP_LEAF_CHUNKSIZE) >>
+	    fzap_default_block_shift) : 0;
+
+	if (dn == NULL) {
+		/* the header block plus the leaves */
+		dmu_tx_count_write(txh, 0,
+		    (1 + nleaves) << fzap_default_block_shift);
+		return;
+	}
+
+	ASSERT3P(dmu_ot[dn->dn_type].ot_byteswap, ==, zap_byteswap);
+
+	if (dn->dn_maxblkid == 0 && !add) {
+		/* removing from a micro-zap only rewrites its one block */
+		err = dmu_tx_check_ioerr(NULL, dn, 0, 0);
+		if (err) {
+			tx->tx_err = err;
+			return;
+		}
+		if (dsl_dataset_block_freeable(dn->dn_objset->os_dsl_dataset,
+		    dn->dn_phys->dn_blkptr[0].blk_birth))
+			txh->txh_space_tooverwrite += SPA_MAXBLOCKSIZE;
+		else
+			txh->txh_space_towrite += SPA_MAXBLOCKSIZE;
+		return;
+	}
+
+	/*
+	 * The leaves touched, plus the header and pointer table blocks;
+	 * if adding, the new leaves and 2 grown ptrtbl blocks.  A
+	 * micro-zap being upgraded gets blocks at least fat-zap sized,
+	 * however small its one block is now.
+	 */
+	if (dn->dn_maxblkid == 0 || dn->dn_datablkshift == 0)
+		bs = MAX(dn->dn_datablkshift, fzap_default_block_shift);
+	else
+		bs = dn->dn_datablkshift;
+	nblocks = MIN(count, dn->dn_maxblkid) + 2;
+	if (add)
+		nblocks += nleaves + 2;
+	dmu_tx_count_write(txh, dn->dn_maxblkid * dn->dn_datablksz,
+	    nblocks << bs);
+
+	/*
+	 * Each modified block may need its own indirect twig at each
+	 * level, up to the number of twigs at that level.
+	 */
+	epbs = dn->dn_indblkshift - SPA_BLKPTRSHIFT;
+	for (ntwigs = dn->dn_maxblkid >> epbs; ntwigs != 0; ntwigs >>= epbs)
+		txh->txh_space_towrite +=
+		    MIN(nblocks, ntwigs + 1) << dn->dn_indblkshift;
+}
+
 void
 dmu_tx_hold_bonus(dmu_tx_t *tx, uint64_t object)
 {
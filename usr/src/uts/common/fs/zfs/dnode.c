@@ -296,6 +296,7 @@ dnode_create(objset_impl_t *os, dnode_phys_t *dnp, dmu_buf_impl_t *db,
     uint64_t object)
 {
 	dnode_t *dn = kmem_cache_alloc(dnode_cache, KM_SLEEP);
+	dnode_shard_t *dns;
 	(void) dnode_cons(dn, NULL, 0); /* XXX */
 
 	dn->dn_objset = os;
@@ -318,9 +319,12 @@ dnode_create(objset_impl_t *os, dnode_phys_t *dnp, dmu_buf_impl_t *db,
 	dmu_zfetch_init(&dn->dn_zfetch, dn);
 
 	ASSERT(dn->dn_phys->dn_type < DMU_OT_NUMTYPES);
-	mutex_enter(&os->os_lock);
-	list_insert_head(&os->os_dnodes, dn);
-	mutex_exit(&os->os_lock);
+	dn->dn_link.dl_object = object;
+	dn->dn_link.dl_dnode = dn;
+	dns = DNODE_SHARD(os, object);
+	mutex_enter(&dns->dns_lock);
+	avl_add(&dns->dns_tree, &dn->dn_link);
+	mutex_exit(&dns->dns_lock);
 
 	arc_space_consume(sizeof (dnode_t));
 	return (dn);
@@ -329,7 +333,7 @@ dnode_create(objset_impl_t *os, dnode_phys_t *dnp, dmu_buf_impl_t *db,
 static void
 dnode_destroy(dnode_t *dn)
 {
-	objset_impl_t *os = dn->dn_objset;
+	dnode_shard_t *dns = DNODE_SHARD(dn->dn_objset, dn->dn_object);
 
 #ifdef ZFS_DEBUG
 	int i;
@@ -342,9 +346,9 @@ dnode_destroy(dnode_t *dn)
 	ASSERT(NULL == list_head(&dn->dn_dbufs));
 #endif
 
-	mutex_enter(&os->os_lock);
-	list_remove(&os->os_dnodes, dn);
-	mutex_exit(&os->os_lock);
+	mutex_enter(&dns->dns_lock);
+	avl_remove(&dns->dns_tree, &dn->dn_link);
+	mutex_exit(&dns->dns_lock);
 
 	if (dn->dn_dirtyctx_firstset) {
 		kmem_free(dn->dn_dirtyctx_firstset, 1);
@@ -565,6 +569,71 @@ dnode_buf_pageout(dmu_buf_t *db, void *arg)
 	kmem_free(children_dnodes, epb * sizeof (dnode_t *));
 }
 
+int
+dnode_link_compare(const void *x1, const void *x2)
+{
+	const dnode_link_t *dl1 = x1;
+	const dnode_link_t *dl2 = x2;
+
+	if (dl1->dl_object < dl2->dl_object)
+		return (-1);
+	if (dl1->dl_object > dl2->dl_object)
+		return (1);
+	if ((uintptr_t)dl1->dl_dnode < (uintptr_t)dl2->dl_dnode)
+		return (-1);
+	if ((uintptr_t)dl1->dl_dnode > (uintptr_t)dl2->dl_dnode)
+		return (1);
+	return (0);
+}
+
+/*
+ * Add a hold to an instantiated dnode that is already held and in the
+ * state the caller wants.  A held dnode holds its dbuf in the
+ * meta-dnode, so it can't go away under us and neither the meta-dnode
+ * nor its dbuf need be touched.  Returns NULL if there is no such
+ * dnode; dnode_hold_impl() then takes the long way, which also sorts
+ * out the error to return.
+ */
+static dnode_t *
+dnode_hold_cached(objset_impl_t *os, uint64_t object, int flag, void *tag)
+{
+	dnode_shard_t *dns = DNODE_SHARD(os, object);
+	dnode_link_t search, *dl;
+	dnode_t *dn = NULL;
+	avl_index_t where;
+
+	search.dl_object = object;
+	search.dl_dnode = NULL;
+
+	mutex_enter(&dns->dns_lock);
+	(void) avl_find(&dns->dns_tree, &search, &where);
+	for (dl = avl_nearest(&dns->dns_tree, where, AVL_AFTER);
+	    dl != NULL && dl->dl_object == object;
+	    dl = AVL_NEXT(&dns->dns_tree, dl)) {
+		mutex_enter(&dl->dl_dnode->dn_mtx);
+		if (!refcount_is_zero(&dl->dl_dnode->dn_holds))
+			break;
+		mutex_exit(&dl->dl_dnode->dn_mtx);
+	}
+	if (dl != NULL && dl->dl_object == object) {
+		dn = dl->dl_dnode;
+		if (dn->dn_free_txg ||
+		    ((flag & DNODE_MUST_BE_ALLOCATED) &&
+		    dn->dn_type == DMU_OT_NONE) ||
+		    ((flag & DNODE_MUST_BE_FREE) &&
+		    dn->dn_type != DMU_OT_NONE)) {
+			mutex_exit(&dn->dn_mtx);
+			mutex_exit(&dns->dns_lock);
+			return (NULL);
+		}
+		VERIFY(1 < refcount_add(&dn->dn_holds, tag));
+		mutex_exit(&dn->dn_mtx);
+	}
+	mutex_exit(&dns->dns_lock);
+
+	return (dn);
+}
+
 /*
  * errors:
  * EINVAL - invalid object number.
@@ -586,6 +655,11 @@ dnode_hold_impl(objset_impl_t *os, uint64_t object, int flag,
 	if (object == 0 || object >= DN_MAX_OBJECT)
 		return (EINVAL);
 
+	if ((dn = dnode_hold_cached(os, object, flag, tag)) != NULL) {
+		*dnp = dn;
+		return (0);
+	}
+
 	mdn = os->os_meta_dnode;
 
 	DNODE_VERIFY(mdn);
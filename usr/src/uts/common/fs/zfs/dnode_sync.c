@@ -425,6 +425,18 @@ dnode_undirty_dbufs(list_t *list)
 			ASSERT(db->db_blkid == DB_BONUS_BLKID ||
 			    dr->dt.dl.dr_data == db->db_buf);
 			dbuf_unoverride(dr);
+			/*
+			 * The object is being freed, so a partial fill is
+			 * never merged; let a merge already under way
+			 * finish with the record before it goes.
+			 */
+			while (db->db_state == DB_READ &&
+			    dr->dt.dl.dr_fill_end != 0)
+				cv_wait(&db->db_changed, &db->db_mtx);
+			if (db->db_state == DB_PARTIAL) {
+				db->db_state = DB_CACHED;
+				cv_broadcast(&db->db_changed);
+			}
 			mutex_exit(&db->db_mtx);
 		} else {
 			mutex_exit(&db->db_mtx);
@@ -98,6 +98,7 @@ dsl_dataset_block_born(dsl_dataset_t *ds, blkptr_t *bp, dmu_tx_t *tx)
 		dsl_dir_dirty(tx->tx_pool->dp_mos_dir, tx);
 		return;
 	}
+	/* a deduplicated block is charged in full; see ddt.c */
 	dmu_buf_will_dirty(ds->ds_dbuf, tx);
 	mutex_enter(&ds->ds_lock);
 	ds->ds_phys->ds_used_bytes += used;
@@ -761,32 +762,39 @@ dsl_dataset_destroy(const char *name)
 	}
 
 	/*
-	 * remove the objects in open context, so that we won't
-	 * have too much to do in syncing context.
+	 * From SPA_VERSION_FREE_PENDING on, the blocks themselves are
+	 * freed a bit at a time in later txgs (see
+	 * dsl_pool_free_pending_sync()).  Older pools can't record that,
+	 * so remove the objects in open context, so that we won't have
+	 * too much to do in syncing context.
 	 */
-	for (obj = 0; err == 0; err = dmu_object_next(os, &obj, FALSE,
-	    ds->ds_phys->ds_prev_snap_txg)) {
-		dmu_tx_t *tx = dmu_tx_create(os);
-		dmu_tx_hold_free(tx, obj, 0, DMU_OBJECT_END);
-		dmu_tx_hold_bonus(tx, obj);
-		err = dmu_tx_assign(tx, TXG_WAIT);
-		if (err) {
-			/*
-			 * Perhaps there is not enough disk
-			 * space.  Just deal with it from
-			 * dsl_dataset_destroy_sync().
-			 */
-			dmu_tx_abort(tx);
-			continue;
+	if (spa_version(dd->dd_pool->dp_spa) < SPA_VERSION_FREE_PENDING) {
+		for (obj = 0; err == 0; err = dmu_object_next(os, &obj, FALSE,
+		    ds->ds_phys->ds_prev_snap_txg)) {
+			dmu_tx_t *tx = dmu_tx_create(os);
+			dmu_tx_hold_free(tx, obj, 0, DMU_OBJECT_END);
+			dmu_tx_hold_bonus(tx, obj);
+			err = dmu_tx_assign(tx, TXG_WAIT);
+			if (err) {
+				/*
+				 * Perhaps there is not enough disk
+				 * space.  Just deal with it from
+				 * dsl_dataset_destroy_sync().
+				 */
+				dmu_tx_abort(tx);
+				continue;
+			}
+			VERIFY(0 == dmu_object_free(os, obj, tx));
+			dmu_tx_commit(tx);
 		}
-		VERIFY(0 == dmu_object_free(os, obj, tx));
-		dmu_tx_commit(tx);
+		if (err == ESRCH)
+			err = 0;
 	}
 	/* Make sure it's not dirty before we finish destroying it. */
 	txg_wait_synced(dd->dd_pool, 0);
 
 	dmu_objset_close(os);
-	if (err != ESRCH)
+	if (err)
 		return (err);
 
 	err = dsl_dataset_open(name,
@@ -1014,6 +1022,7 @@ dsl_dataset_rollback_sync(void *arg1, void *arg2, cred_t *cr, dmu_tx_t *tx)
 	    ds->ds_prev->ds_phys->ds_uncompressed_bytes;
 	ds->ds_phys->ds_flags = ds->ds_prev->ds_phys->ds_flags;
 	ds->ds_phys->ds_unique_bytes = 0;
+	dsl_dataset_clear_resume(ds);
 
 	if (ds->ds_prev->ds_phys->ds_next_snap_obj == ds->ds_object) {
 		dmu_buf_will_dirty(ds->ds_prev->ds_dbuf, tx);
@@ -1261,7 +1270,7 @@ dsl_dataset_destroy_sync(void *arg1, void *tag, cred_t *cr, dmu_tx_t *tx)
 		 * deadlist should be empty.  (If it's a clone, it's
 		 * safe to ignore the deadlist contents.)
 		 */
-		struct killarg ka;
+		dsl_dir_t *dd = ds->ds_dir;
 
 		ASSERT(after_branch_point || bplist_empty(&ds->ds_deadlist));
 		bplist_close(&ds->ds_deadlist);
@@ -1269,19 +1278,34 @@ dsl_dataset_destroy_sync(void *arg1, void *tag, cred_t *cr, dmu_tx_t *tx)
 		ds->ds_phys->ds_deadlist_obj = 0;
 
 		/*
-		 * Free everything that we point to (that's born after
-		 * the previous snapshot, if we are a clone)
-		 *
-		 * XXX we're doing this long task with the config lock held
+		 * Everything that we point to (that's born after the
+		 * previous snapshot, if we are a clone) is ours alone,
+		 * and is all the space our dsl_dir is charged for.
+		 * Rather than free it now, with the config lock held,
+		 * hand the block tree to the pool to free over the
+		 * next few txgs.  Pools older than
+		 * SPA_VERSION_FREE_PENDING have nowhere to keep it,
+		 * so free it all here.
 		 */
-		ka.usedp = &used;
-		ka.compressedp = &compressed;
-		ka.uncompressedp = &uncompressed;
-		ka.zio = zio;
-		ka.tx = tx;
-		err = traverse_dsl_dataset(ds, ds->ds_phys->ds_prev_snap_txg,
-		    ADVANCE_POST, kill_blkptr, &ka);
-		ASSERT3U(err, ==, 0);
+		if (spa_version(dp->dp_spa) >= SPA_VERSION_FREE_PENDING) {
+			used = dd->dd_used_bytes;
+			compressed = dd->dd_phys->dd_compressed_bytes;
+			uncompressed = dd->dd_phys->dd_uncompressed_bytes;
+			dsl_pool_free_pending_add(dp, obj, &ds->ds_phys->ds_bp,
+			    ds->ds_phys->ds_prev_snap_txg, used, tx);
+		} else {
+			struct killarg ka;
+
+			ka.usedp = &used;
+			ka.compressedp = &compressed;
+			ka.uncompressedp = &uncompressed;
+			ka.zio = zio;
+			ka.tx = tx;
+			err = traverse_dsl_dataset(ds,
+			    ds->ds_phys->ds_prev_snap_txg, ADVANCE_POST,
+			    kill_blkptr, &ka);
+			ASSERT3U(err, ==, 0);
+		}
 	}
 
 	err = zio_wait(zio);
@@ -1468,6 +1492,23 @@ dsl_dataset_sync(dsl_dataset_t *ds, zio_t *zio, dmu_tx_t *tx)
 	dmu_buf_will_dirty(ds->ds_dbuf, tx);
 	ds->ds_phys->ds_fsid_guid = ds->ds_fsid_guid;
 
+	/*
+	 * Record how far a resumable receive got in this txg, along
+	 * with the data it wrote.
+	 */
+	mutex_enter(&ds->ds_lock);
+	if (ds->ds_resume_object[tx->tx_txg & TXG_MASK] != 0) {
+		int t = tx->tx_txg & TXG_MASK;
+
+		ASSERT(ds->ds_phys->ds_resume_toguid != 0);
+		ds->ds_phys->ds_resume_object = ds->ds_resume_object[t];
+		ds->ds_phys->ds_resume_offset = ds->ds_resume_offset[t];
+		ds->ds_phys->ds_resume_checksum = ds->ds_resume_checksum[t];
+		ds->ds_resume_object[t] = 0;
+		ds->ds_resume_offset[t] = 0;
+	}
+	mutex_exit(&ds->ds_lock);
+
 	dsl_dir_dirty(ds->ds_dir, tx);
 	dmu_objset_sync(ds->ds_user_ptr, zio, tx);
 }
@@ -1496,6 +1537,47 @@ dsl_dataset_stats(dsl_dataset_t *ds, nvlist_t *nv)
 		    (ds->ds_phys->ds_uncompressed_bytes * 100 /
 		    ds->ds_phys->ds_compressed_bytes));
 	}
+
+	if ((ds->ds_phys->ds_flags & DS_FLAG_INCONSISTENT) &&
+	    ds->ds_phys->ds_resume_toguid != 0) {
+		char token[ZFS_RESUME_TOKEN_LEN];
+
+		(void) snprintf(token, sizeof (token), ZFS_RESUME_TOKEN_FMT,
+		    (u_longlong_t)ZFS_RESUME_TOKEN_VERSION,
+		    (u_longlong_t)ds->ds_phys->ds_resume_version,
+		    (u_longlong_t)ds->ds_phys->ds_resume_toguid,
+		    (u_longlong_t)ds->ds_phys->ds_resume_object,
+		    (u_longlong_t)ds->ds_phys->ds_resume_offset,
+		    (u_longlong_t)ds->ds_phys->ds_resume_checksum.zc_word[0],
+		    (u_longlong_t)ds->ds_phys->ds_resume_checksum.zc_word[1],
+		    (u_longlong_t)ds->ds_phys->ds_resume_checksum.zc_word[2],
+		    (u_longlong_t)ds->ds_phys->ds_resume_checksum.zc_word[3]);
+		dsl_prop_nvlist_add_string(nv, ZFS_PROP_RECEIVE_RESUME_TOKEN,
+		    token);
+	}
+}
+
+/*
+ * Forget any resumable receive progress.  Called in syncing context
+ * with ds_dbuf dirty, when the receive completes or is rolled back.
+ */
+void
+dsl_dataset_clear_resume(dsl_dataset_t *ds)
+{
+	int t;
+
+	ds->ds_phys->ds_resume_toguid = 0;
+	ds->ds_phys->ds_resume_version = 0;
+	ds->ds_phys->ds_resume_object = 0;
+	ds->ds_phys->ds_resume_offset = 0;
+	ZIO_SET_CHECKSUM(&ds->ds_phys->ds_resume_checksum, 0, 0, 0, 0);
+
+	mutex_enter(&ds->ds_lock);
+	for (t = 0; t < TXG_SIZE; t++) {
+		ds->ds_resume_object[t] = 0;
+		ds->ds_resume_offset[t] = 0;
+	}
+	mutex_exit(&ds->ds_lock);
 }
 
 void
@@ -1506,6 +1588,8 @@ dsl_dataset_fast_stat(dsl_dataset_t *ds, dmu_objset_stats_t *stat)
 #endif
 	stat->dds_creation_txg = ds->ds_phys->ds_creation_txg;
 	stat->dds_inconsistent = ds->ds_phys->ds_flags & DS_FLAG_INCONSISTENT;
+	stat->dds_resumable = stat->dds_inconsistent &&
+	    ds->ds_phys->ds_resume_toguid != 0;
 	if (ds->ds_phys->ds_next_snap_obj) {
 		stat->dds_is_snapshot = B_TRUE;
 		stat->dds_num_clones = ds->ds_phys->ds_num_children - 1;
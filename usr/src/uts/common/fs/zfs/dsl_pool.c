@@ -31,12 +31,19 @@
 #include <sys/dsl_synctask.h>
 #include <sys/dmu_tx.h>
 #include <sys/dmu_objset.h>
+#include <sys/dmu_traverse.h>
 #include <sys/arc.h>
 #include <sys/zap.h>
 #include <sys/zio.h>
+#include <sys/ddt.h>
 #include <sys/zfs_context.h>
 #include <sys/fs/zfs.h>
 
+/*
+ * Maximum number of blocks of destroyed datasets to free in each txg.
+ */
+int zfs_free_max_blocks = 100000;
+
 static int
 dsl_pool_open_mos_dir(dsl_pool_t *dp, dsl_dir_t **ddp)
 {
@@ -104,6 +111,31 @@ dsl_pool_open(spa_t *spa, uint64_t txg, dsl_pool_t **dpp)
 	if (err)
 		goto out;
 
+	err = zap_lookup(dp->dp_meta_objset, DMU_POOL_DIRECTORY_OBJECT,
+	    DMU_POOL_FREE_PENDING, sizeof (uint64_t), 1,
+	    &dp->dp_free_pending_obj);
+	if (err == 0) {
+		zap_cursor_t zc;
+		zap_attribute_t za;
+		dsl_free_pending_phys_t fp;
+
+		for (zap_cursor_init(&zc, dp->dp_meta_objset,
+		    dp->dp_free_pending_obj);
+		    (err = zap_cursor_retrieve(&zc, &za)) == 0;
+		    zap_cursor_advance(&zc)) {
+			err = zap_lookup(dp->dp_meta_objset,
+			    dp->dp_free_pending_obj, za.za_name,
+			    sizeof (uint64_t), sizeof (fp) / sizeof (uint64_t),
+			    &fp);
+			if (err)
+				break;
+			dp->dp_free_pending_bytes += fp.fp_bytes;
+		}
+		zap_cursor_fini(&zc);
+	}
+	if (err == ENOENT)
+		err = 0;
+
 out:
 	rw_exit(&dp->dp_config_rwlock);
 	if (err)
@@ -194,6 +226,8 @@ dsl_pool_sync(dsl_pool_t *dp, uint64_t txg)
 	while (dd = txg_list_remove(&dp->dp_dirty_dirs, txg))
 		dsl_dir_sync(dd, tx);
 
+	ddt_sync(dp->dp_spa, tx);
+
 	if (list_head(&mosi->os_dirty_dnodes[txg & TXG_MASK]) != NULL ||
 	    list_head(&mosi->os_free_dnodes[txg & TXG_MASK]) != NULL) {
 		zio = zio_root(dp->dp_spa, NULL, NULL, ZIO_FLAG_MUSTSUCCEED);
@@ -251,5 +285,189 @@ dsl_pool_adjustedsize(dsl_pool_t *dp, boolean_t netfree)
 	if (netfree)
 		resv >>= 1;
 
-	return (space - resv);
+	/*
+	 * Space still held by destroyed datasets is no longer charged
+	 * to any dsl_dir, so don't hand it out until it is really free.
+	 */
+	resv += dp->dp_free_pending_bytes;
+
+	return (space - MIN(space, resv));
+}
+
+/*
+ * Queue the block tree of a destroyed dataset to be freed in the
+ * background.  Called in syncing context.
+ */
+void
+dsl_pool_free_pending_add(dsl_pool_t *dp, uint64_t dsobj, blkptr_t *bp,
+    uint64_t mintxg, uint64_t bytes, dmu_tx_t *tx)
+{
+	objset_t *mos = dp->dp_meta_objset;
+	dsl_free_pending_phys_t fp = { 0 };
+	char name[20];
+
+	ASSERT(dmu_tx_is_syncing(tx));
+
+	if (BP_IS_HOLE(bp))
+		return;
+
+	if (dp->dp_free_pending_obj == 0) {
+		dp->dp_free_pending_obj = zap_create(mos,
+		    DMU_OT_ZAP_OTHER, DMU_OT_NONE, 0, tx);
+		VERIFY(0 == zap_add(mos, DMU_POOL_DIRECTORY_OBJECT,
+		    DMU_POOL_FREE_PENDING, sizeof (uint64_t), 1,
+		    &dp->dp_free_pending_obj, tx));
+	}
+
+	fp.fp_bp = *bp;
+	fp.fp_dsobj = dsobj;
+	fp.fp_mintxg = mintxg;
+	fp.fp_bytes = bytes;
+	fp.fp_level = ZB_NO_LEVEL;
+
+	(void) snprintf(name, sizeof (name), "%llx", (u_longlong_t)dsobj);
+	VERIFY(0 == zap_add(mos, dp->dp_free_pending_obj, name,
+	    sizeof (uint64_t), sizeof (fp) / sizeof (uint64_t), &fp, tx));
+
+	dp->dp_free_pending_bytes += bytes;
+}
+
+typedef struct free_pending_arg {
+	dsl_free_pending_phys_t *fpa_fp;
+	zio_t *fpa_zio;
+	dmu_tx_t *fpa_tx;
+	uint64_t fpa_blocks;
+} free_pending_arg_t;
+
+static int
+dsl_pool_free_pending_cb(traverse_blk_cache_t *bc, spa_t *spa, void *arg)
+{
+	free_pending_arg_t *fpa = arg;
+	blkptr_t *bp = &bc->bc_blkptr;
+	uint64_t used;
+
+	/*
+	 * If an indirect block can't be read, neither can the blocks
+	 * under it be found.  Leak them rather than fail the sync.
+	 */
+	if (bc->bc_errno)
+		return (ERESTART);
+
+	used = bp_get_dasize(spa, bp);
+	used = MIN(used, fpa->fpa_fp->fp_bytes);
+	fpa->fpa_fp->fp_bytes -= used;
+	spa_get_dsl(spa)->dp_free_pending_bytes -= used;
+
+	(void) arc_free(fpa->fpa_zio, spa, fpa->fpa_tx->tx_txg,
+	    bp, NULL, NULL, ARC_NOWAIT);
+	fpa->fpa_blocks++;
+
+	return (0);
+}
+
+/*
+ * Free blocks of one destroyed dataset until it is all gone or we have
+ * used up this txg's allowance.  Returns B_TRUE once it is all gone.
+ */
+static boolean_t
+dsl_pool_free_pending_one(dsl_pool_t *dp, dsl_free_pending_phys_t *fp,
+    free_pending_arg_t *fpa)
+{
+	traverse_handle_t *th;
+	zbookmark_t zb, *zbp = NULL;
+	boolean_t done;
+
+	fpa->fpa_fp = fp;
+
+	if (fp->fp_level != ZB_NO_LEVEL) {
+		zb.zb_objset = fp->fp_dsobj;
+		zb.zb_object = fp->fp_object;
+		zb.zb_level = fp->fp_level;
+		zb.zb_blkid = fp->fp_blkid;
+		zbp = &zb;
+	}
+
+	th = traverse_init(dp->dp_spa, dsl_pool_free_pending_cb, fpa,
+	    ADVANCE_POST, ZIO_FLAG_CANFAIL);
+	traverse_add_destroyed_objset(th, fp->fp_mintxg, fp->fp_dsobj,
+	    &fp->fp_bp, zbp);
+
+	while (fpa->fpa_blocks < zfs_free_max_blocks &&
+	    traverse_more(th) == EAGAIN)
+		continue;
+
+	done = (traverse_bookmark(th, &zb) == ENOENT);
+	if (!done) {
+		fp->fp_object = zb.zb_object;
+		fp->fp_level = zb.zb_level;
+		fp->fp_blkid = zb.zb_blkid;
+	}
+
+	traverse_fini(th);
+
+	return (done);
+}
+
+/*
+ * Free some of the blocks of destroyed datasets.  Called from
+ * spa_sync() in every txg, so the work is bounded by zfs_free_max_blocks
+ * to keep a large destroy from holding up the txg.
+ */
+void
+dsl_pool_free_pending_sync(dsl_pool_t *dp, dmu_tx_t *tx)
+{
+	objset_t *mos = dp->dp_meta_objset;
+	free_pending_arg_t fpa;
+	zap_cursor_t zc;
+	zap_attribute_t za;
+	dsl_free_pending_phys_t fp;
+	int err;
+
+	if (dp->dp_free_pending_obj == 0)
+		return;
+
+	fpa.fpa_zio = zio_root(dp->dp_spa, NULL, NULL, ZIO_FLAG_MUSTSUCCEED);
+	fpa.fpa_tx = tx;
+	fpa.fpa_blocks = 0;
+
+	while (fpa.fpa_blocks < zfs_free_max_blocks) {
+		zap_cursor_init(&zc, mos, dp->dp_free_pending_obj);
+		err = zap_cursor_retrieve(&zc, &za);
+		zap_cursor_fini(&zc);
+		if (err == ENOENT) {
+			/*
+			 * Nothing left to free; get rid of the queue.
+			 */
+			VERIFY(0 == zap_remove(mos, DMU_POOL_DIRECTORY_OBJECT,
+			    DMU_POOL_FREE_PENDING, tx));
+			VERIFY(0 == zap_destroy(mos,
+			    dp->dp_free_pending_obj, tx));
+			dp->dp_free_pending_obj = 0;
+			ASSERT3U(dp->dp_free_pending_bytes, ==, 0);
+			dp->dp_free_pending_bytes = 0;
+			break;
+		}
+		VERIFY(err == 0);
+
+		VERIFY(0 == zap_lookup(mos, dp->dp_free_pending_obj,
+		    za.za_name, sizeof (uint64_t),
+		    sizeof (fp) / sizeof (uint64_t), &fp));
+
+		if (dsl_pool_free_pending_one(dp, &fp, &fpa)) {
+			/*
+			 * Anything not accounted for by now sat under an
+			 * unreadable block and has been leaked.
+			 */
+			dp->dp_free_pending_bytes -=
+			    MIN(fp.fp_bytes, dp->dp_free_pending_bytes);
+			VERIFY(0 == zap_remove(mos, dp->dp_free_pending_obj,
+			    za.za_name, tx));
+		} else {
+			VERIFY(0 == zap_update(mos, dp->dp_free_pending_obj,
+			    za.za_name, sizeof (uint64_t),
+			    sizeof (fp) / sizeof (uint64_t), &fp, tx));
+		}
+	}
+
+	VERIFY(0 == zio_wait(fpa.fpa_zio));
 }
@@ -36,6 +36,18 @@
 
 uint64_t metaslab_aliquot = 512ULL << 10;
 
+/*
+ * When no metaslab in the class can satisfy an allocation the usual way,
+ * search every metaslab with enough free space before giving up and
+ * letting the caller gang the block.
+ */
+int metaslab_alloc_fallback = 1;
+
+/*
+ * The most metaslabs a single fallback search will load and walk.
+ */
+int metaslab_fallback_limit = 16;
+
 /*
  * ==========================================================================
  * Metaslab classes
@@ -280,6 +292,41 @@ static space_map_ops_t metaslab_ff_ops = {
 	metaslab_ff_free
 };
 
+/*
+ * Find the smallest free segment that holds size bytes, aligned only to
+ * the sectors the map is kept in rather than to the natural alignment of
+ * size that metaslab_ff_alloc() insists on, and claim it.  This walks
+ * the whole map, so it's only for metaslab_group_alloc_fallback().
+ * If nothing fits, *maxlenp is set to the largest segment seen.
+ */
+static uint64_t
+metaslab_bf_alloc(space_map_t *sm, uint64_t size, uint64_t *maxlenp)
+{
+	avl_tree_t *t = &sm->sm_root;
+	space_seg_t *ss, *best = NULL;
+	uint64_t offset, len, bestlen = -1ULL;
+
+	*maxlenp = 0;
+	for (ss = avl_first(t); ss != NULL; ss = AVL_NEXT(t, ss)) {
+		len = ss->ss_end - ss->ss_start;
+		if (len > *maxlenp)
+			*maxlenp = len;
+		if (len >= size && len < bestlen) {
+			best = ss;
+			bestlen = len;
+			if (len == size)
+				break;
+		}
+	}
+
+	if (best == NULL)
+		return (-1ULL);
+
+	offset = best->ss_start;
+	space_map_claim(sm, offset, size);
+	return (offset);
+}
+
 /*
  * ==========================================================================
  * Metaslabs
@@ -583,6 +630,8 @@ metaslab_sync_done(metaslab_t *msp, uint64_t txg)
 	 * Then, add everything we freed in this txg to the map.
 	 */
 	space_map_load_wait(sm);
+	if (freed_map->sm_space != 0)
+		msp->ms_maxseg = 0;
 	space_map_vacate(freed_map, sm->sm_loaded ? space_map_free : NULL, sm);
 
 	*smo = *smosync;
@@ -710,12 +759,65 @@ metaslab_group_alloc(metaslab_group_t *mg, uint64_t size, uint64_t txg,
 	return (offset);
 }
 
+/*
+ * The last resort before ganging: try the metaslabs in the group whose
+ * free space could hold the block, whatever their weight, and take the
+ * best fitting segment at any sector alignment.  Metaslabs that still
+ * can't are passivated with their weight capped below size, as in
+ * metaslab_group_alloc(), and remember their largest free segment in
+ * ms_maxseg until they next free something, so later searches for a
+ * block that size don't walk them again.  At most
+ * metaslab_fallback_limit metaslabs are walked per call.
+ */
+static uint64_t
+metaslab_group_alloc_fallback(metaslab_group_t *mg, uint64_t size,
+    uint64_t txg)
+{
+	vdev_t *vd = mg->mg_vd;
+	metaslab_t *msp;
+	uint64_t offset = -1ULL;
+	uint64_t space, maxseg;
+	int m, walked = 0;
+
+	for (m = 0; m < vd->vdev_ms_count && offset == -1ULL &&
+	    walked < metaslab_fallback_limit; m++) {
+		msp = vd->vdev_ms[m];
+		mutex_enter(&msp->ms_lock);
+
+		space = msp->ms_map.sm_loaded ? msp->ms_map.sm_space :
+		    msp->ms_map.sm_size - msp->ms_smo.smo_alloc;
+		if (space < size ||
+		    (msp->ms_maxseg != 0 && msp->ms_maxseg < size) ||
+		    metaslab_activate(msp, METASLAB_WEIGHT_SECONDARY) != 0) {
+			mutex_exit(&msp->ms_lock);
+			continue;
+		}
+		walked++;
+
+		offset = metaslab_bf_alloc(&msp->ms_map, size, &maxseg);
+		if (offset == -1ULL) {
+			msp->ms_maxseg = maxseg;
+			metaslab_passivate(msp, size - 1);
+		} else {
+			if (msp->ms_allocmap[txg & TXG_MASK].sm_space == 0)
+				vdev_dirty(vd, VDD_METASLAB, msp, txg);
+			space_map_add(&msp->ms_allocmap[txg & TXG_MASK],
+			    offset, size);
+		}
+
+		mutex_exit(&msp->ms_lock);
+	}
+
+	return (offset);
+}
+
 /*
  * Allocate a block for the specified i/o.
  */
 static int
 metaslab_alloc_dva(spa_t *spa, metaslab_class_t *mc, uint64_t psize,
-    dva_t *dva, int d, dva_t *hintdva, uint64_t txg, boolean_t hintdva_avoid)
+    dva_t *dva, int d, dva_t *hintdva, uint64_t txg, boolean_t hintdva_avoid,
+    boolean_t fallback)
 {
 	metaslab_group_t *mg, *rotor;
 	vdev_t *vd;
@@ -838,6 +940,32 @@ top:
 		goto top;
 	}
 
+	/*
+	 * Nothing fit at its natural alignment in any metaslab that was
+	 * weighted as having room.  Rather than have the caller gang the
+	 * block, with the extra header I/O that costs on every access
+	 * for the life of the block, go through every metaslab of every
+	 * group once more, starting from the rotor.  Only the callers
+	 * that would gang ask for this; gang headers and members, and
+	 * log blocks, fail as before.
+	 */
+	if (fallback && metaslab_alloc_fallback) {
+		mg = rotor;
+		do {
+			vd = mg->mg_vd;
+			asize = vdev_psize_to_asize(vd, psize);
+			offset = metaslab_group_alloc_fallback(mg, asize, txg);
+			if (offset != -1ULL) {
+				SPA_GANGSTAT_BUMP(spa, sgs_alloc_fallback);
+				DVA_SET_VDEV(&dva[d], vd->vdev_id);
+				DVA_SET_OFFSET(&dva[d], offset);
+				DVA_SET_GANG(&dva[d], 0);
+				DVA_SET_ASIZE(&dva[d], asize);
+				return (0);
+			}
+		} while ((mg = mg->mg_next) != rotor);
+	}
+
 	bzero(&dva[d], sizeof (dva_t));
 
 	return (ENOSPC);
@@ -969,7 +1097,8 @@ metaslab_claim_dva(spa_t *spa, const dva_t *dva, uint64_t txg)
 
 int
 metaslab_alloc(spa_t *spa, metaslab_class_t *mc, uint64_t psize, blkptr_t *bp,
-    int ndvas, uint64_t txg, blkptr_t *hintbp, boolean_t hintbp_avoid)
+    int ndvas, uint64_t txg, blkptr_t *hintbp, boolean_t hintbp_avoid,
+    boolean_t fallback)
 {
 	dva_t *dva = bp->blk_dva;
 	dva_t *hintdva = hintbp->blk_dva;
@@ -985,7 +1114,7 @@ metaslab_alloc(spa_t *spa, metaslab_class_t *mc, uint64_t psize, blkptr_t *bp,
 
 	for (d = 0; d < ndvas; d++) {
 		error = metaslab_alloc_dva(spa, mc, psize, dva, d, hintdva,
-		    txg, hintbp_avoid);
+		    txg, hintbp_avoid, fallback);
 		if (error) {
 			for (d--; d >= 0; d--) {
 				metaslab_free_dva(spa, &dva[d], txg, B_TRUE);
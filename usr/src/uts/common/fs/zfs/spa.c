@@ -57,12 +57,14 @@
 #include <sys/dsl_dir.h>
 #include <sys/dsl_prop.h>
 #include <sys/dsl_synctask.h>
+#include <sys/ddt.h>
 #include <sys/fs/zfs.h>
 #include <sys/callb.h>
 #include <sys/systeminfo.h>
 #include <sys/sunddi.h>
 
 int zio_taskq_threads = 8;
+int zio_cpu_taskq_threads = 0;		/* 0: one per CPU */
 
 /*
  * ==========================================================================
@@ -108,6 +110,13 @@ spa_get_errlists(spa_t *spa, avl_tree_t *last, avl_tree_t *scrub)
 	    offsetof(spa_error_entry_t, se_avl));
 }
 
+static const spa_gang_stats_t spa_gang_stats_template = {
+	{ "gang_blocks",		KSTAT_DATA_UINT64 },
+	{ "gang_members",		KSTAT_DATA_UINT64 },
+	{ "gang_forced",		KSTAT_DATA_UINT64 },
+	{ "alloc_fallback",		KSTAT_DATA_UINT64 }
+};
+
 /*
  * Activate an uninitialized pool.
  */
@@ -132,6 +141,33 @@ spa_activate(spa_t *spa)
 		    TASKQ_PREPOPULATE);
 	}
 
+	spa->spa_zio_cpu_taskq = taskq_create("spa_zio_cpu",
+	    zio_cpu_taskq_threads != 0 ? zio_cpu_taskq_threads : boot_ncpus,
+	    maxclsyspri, 50, INT_MAX, TASKQ_PREPOPULATE);
+
+	/*
+	 * The latency histograms are only filled in while zio_latency_stats
+	 * is set, but are always there so that it can be flipped at any time.
+	 */
+	spa->spa_lat = kmem_zalloc(sizeof (spa_lat_stat_t), KM_SLEEP);
+	spa->spa_lat_ksp = kstat_create("zfs", 0, spa->spa_name, "latency",
+	    KSTAT_TYPE_RAW, 1, KSTAT_FLAG_VIRTUAL);
+	if (spa->spa_lat_ksp != NULL) {
+		spa->spa_lat_ksp->ks_data = spa->spa_lat;
+		spa->spa_lat_ksp->ks_data_size = sizeof (spa_lat_stat_t);
+		kstat_install(spa->spa_lat_ksp);
+	}
+
+	spa->spa_gang_stats = spa_gang_stats_template;
+	spa->spa_gang_ksp = kstat_create("zfs_gang", 0, spa->spa_name, "misc",
+	    KSTAT_TYPE_NAMED,
+	    sizeof (spa_gang_stats_t) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL);
+	if (spa->spa_gang_ksp != NULL) {
+		spa->spa_gang_ksp->ks_data = &spa->spa_gang_stats;
+		kstat_install(spa->spa_gang_ksp);
+	}
+
 	list_create(&spa->spa_dirty_list, sizeof (vdev_t),
 	    offsetof(vdev_t, vdev_dirty_node));
 
@@ -144,6 +180,8 @@ spa_activate(spa_t *spa)
 	avl_create(&spa->spa_errlist_last,
 	    spa_error_entry_compare, sizeof (spa_error_entry_t),
 	    offsetof(spa_error_entry_t, se_avl));
+
+	ddt_create(spa);
 }
 
 /*
@@ -161,6 +199,8 @@ spa_deactivate(spa_t *spa)
 
 	ASSERT(spa->spa_state != POOL_STATE_UNINITIALIZED);
 
+	ddt_destroy(spa);
+
 	txg_list_destroy(&spa->spa_vdev_txg_list);
 
 	list_destroy(&spa->spa_dirty_list);
@@ -172,6 +212,21 @@ spa_deactivate(spa_t *spa)
 		spa->spa_zio_intr_taskq[t] = NULL;
 	}
 
+	taskq_destroy(spa->spa_zio_cpu_taskq);
+	spa->spa_zio_cpu_taskq = NULL;
+
+	if (spa->spa_lat_ksp != NULL) {
+		kstat_delete(spa->spa_lat_ksp);
+		spa->spa_lat_ksp = NULL;
+	}
+	kmem_free(spa->spa_lat, sizeof (spa_lat_stat_t));
+	spa->spa_lat = NULL;
+
+	if (spa->spa_gang_ksp != NULL) {
+		kstat_delete(spa->spa_gang_ksp);
+		spa->spa_gang_ksp = NULL;
+	}
+
 	metaslab_class_destroy(spa->spa_normal_class);
 	spa->spa_normal_class = NULL;
 
@@ -647,6 +702,17 @@ spa_load(spa_t *spa, nvlist_t *config, spa_load_state_t state, int mosconfig)
 		goto out;
 	}
 
+	/*
+	 * Load the dedup table.  It isn't created until the first dedup
+	 * write, so it may not be present.
+	 */
+	if (ddt_load(spa) != 0) {
+		vdev_set_state(rvd, B_TRUE, VDEV_STATE_CANT_OPEN,
+		    VDEV_AUX_CORRUPT_DATA);
+		error = EIO;
+		goto out;
+	}
+
 	/*
 	 * Load the persistent error log.  If we have an older pool, this will
 	 * not be present.
@@ -2859,33 +2925,105 @@ spa_async_request(spa_t *spa, int task)
  * ==========================================================================
  */
 
+/*
+ * Maximum number of deferred frees to issue in one txg.  Whatever is
+ * left stays on the bplist and is carried over to the next txg.
+ */
+int zfs_deferred_free_max = 16384;
+
+typedef struct spa_deferred_free {
+	avl_node_t	sdf_node;
+	blkptr_t	sdf_blk;
+} spa_deferred_free_t;
+
+/*
+ * Order frees by vdev and offset, so each metaslab is visited once
+ * and its free map grows in order.
+ */
+static int
+spa_deferred_free_compare(const void *x1, const void *x2)
+{
+	const spa_deferred_free_t *s1 = x1;
+	const spa_deferred_free_t *s2 = x2;
+	const dva_t *d1 = &s1->sdf_blk.blk_dva[0];
+	const dva_t *d2 = &s2->sdf_blk.blk_dva[0];
+
+	if (DVA_GET_VDEV(d1) < DVA_GET_VDEV(d2))
+		return (-1);
+	if (DVA_GET_VDEV(d1) > DVA_GET_VDEV(d2))
+		return (1);
+
+	if (DVA_GET_OFFSET(d1) < DVA_GET_OFFSET(d2))
+		return (-1);
+	if (DVA_GET_OFFSET(d1) > DVA_GET_OFFSET(d2))
+		return (1);
+
+	if (s1 < s2)
+		return (-1);
+	if (s1 > s2)
+		return (1);
+
+	return (0);
+}
+
 static void
 spa_sync_deferred_frees(spa_t *spa, uint64_t txg)
 {
 	bplist_t *bpl = &spa->spa_sync_bplist;
+	spa_deferred_free_t *sdf;
+	avl_tree_t t;
+	void *cookie = NULL;
 	dmu_tx_t *tx;
-	blkptr_t blk;
-	uint64_t itor = 0;
+	uint64_t entries, itor;
 	zio_t *zio;
 	int error;
 	uint8_t c = 1;
 
+	/*
+	 * Take the frees from the end of the list, so that what's left
+	 * over is still a valid bplist to carry over to the next txg.
+	 */
+	entries = bplist_entries(bpl);
+	itor = entries - MIN(entries, zfs_deferred_free_max);
+	spa->spa_sync_bplist_carry = (itor != 0);
+
+	avl_create(&t, spa_deferred_free_compare,
+	    sizeof (spa_deferred_free_t),
+	    offsetof(spa_deferred_free_t, sdf_node));
+
+	entries = itor;
+	sdf = kmem_alloc(sizeof (spa_deferred_free_t), KM_SLEEP);
+	while (bplist_iterate(bpl, &itor, &sdf->sdf_blk) == 0) {
+		avl_add(&t, sdf);
+		sdf = kmem_alloc(sizeof (spa_deferred_free_t), KM_SLEEP);
+	}
+	kmem_free(sdf, sizeof (spa_deferred_free_t));
+
 	zio = zio_root(spa, NULL, NULL, ZIO_FLAG_CONFIG_HELD);
 
-	while (bplist_iterate(bpl, &itor, &blk) == 0)
-		zio_nowait(zio_free(zio, spa, txg, &blk, NULL, NULL));
+	for (sdf = avl_first(&t); sdf != NULL; sdf = AVL_NEXT(&t, sdf))
+		zio_nowait(zio_free(zio, spa, txg, &sdf->sdf_blk, NULL, NULL));
 
 	error = zio_wait(zio);
 	ASSERT3U(error, ==, 0);
 
+	while ((sdf = avl_destroy_nodes(&t, &cookie)) != NULL)
+		kmem_free(sdf, sizeof (spa_deferred_free_t));
+	avl_destroy(&t);
+
 	tx = dmu_tx_create_assigned(spa->spa_dsl_pool, txg);
-	bplist_vacate(bpl, tx);
+	if (entries == 0) {
+		bplist_vacate(bpl, tx);
 
-	/*
-	 * Pre-dirty the first block so we sync to convergence faster.
-	 * (Usually only the first block is needed.)
-	 */
-	dmu_write(spa->spa_meta_objset, spa->spa_sync_bplist_obj, 0, 1, &c, tx);
+		/*
+		 * Pre-dirty the first block so we sync to convergence
+		 * faster.  (Usually only the first block is needed.)
+		 */
+		dmu_write(spa->spa_meta_objset, spa->spa_sync_bplist_obj,
+		    0, 1, &c, tx);
+	} else {
+		bplist_truncate(bpl, entries, tx);
+	}
 	dmu_tx_commit(tx);
 }
 
@@ -3098,13 +3236,21 @@ spa_sync(spa_t *spa, uint64_t txg)
 	/*
 	 * If anything has changed in this txg, push the deferred frees
 	 * from the previous txg.  If not, leave them alone so that we
-	 * don't generate work on an otherwise idle system.
+	 * don't generate work on an otherwise idle system -- unless the
+	 * last push was cut short, in which case keep going until it's
+	 * done.
 	 */
 	if (!txg_list_empty(&dp->dp_dirty_datasets, txg) ||
 	    !txg_list_empty(&dp->dp_dirty_dirs, txg) ||
-	    !txg_list_empty(&dp->dp_sync_tasks, txg))
+	    !txg_list_empty(&dp->dp_sync_tasks, txg) ||
+	    spa->spa_sync_bplist_carry)
 		spa_sync_deferred_frees(spa, txg);
 
+	/*
+	 * Free some more of any datasets that have been destroyed.
+	 */
+	dsl_pool_free_pending_sync(dp, tx);
+
 	/*
 	 * Iterate to convergence.
 	 */
@@ -3347,6 +3493,18 @@ spa_get_props(spa_t *spa, nvlist_t **nvp)
 
 	VERIFY(nvlist_alloc(nvp, NV_UNIQUE_NAME, KM_SLEEP) == 0);
 
+	/*
+	 * Space of destroyed datasets that hasn't been freed yet.
+	 */
+	VERIFY(nvlist_alloc(&propval, NV_UNIQUE_NAME, KM_SLEEP) == 0);
+	VERIFY(nvlist_add_uint64(propval, ZFS_PROP_SOURCE,
+	    ZFS_SRC_NONE) == 0);
+	VERIFY(nvlist_add_uint64(propval, ZFS_PROP_VALUE,
+	    spa_get_dsl(spa)->dp_free_pending_bytes) == 0);
+	VERIFY(nvlist_add_nvlist(*nvp, zpool_prop_to_name(ZPOOL_PROP_FREEING),
+	    propval) == 0);
+	nvlist_free(propval);
+
 	mutex_enter(&spa->spa_props_lock);
 	/* If no props object, then just return empty nvlist */
 	if (spa->spa_pool_props_object == 0) {
@@ -807,11 +807,12 @@ sprintf_blkptr(char *buf, int len, const blkptr_t *bp)
 	}
 
 	(void) snprintf(buf + strlen(buf), len - strlen(buf),
-	    "%s %s %s %s birth=%llu fill=%llu cksum=%llx:%llx:%llx:%llx",
+	    "%s %s %s %s%s birth=%llu fill=%llu cksum=%llx:%llx:%llx:%llx",
 	    zio_checksum_table[BP_GET_CHECKSUM(bp)].ci_name,
 	    zio_compress_table[BP_GET_COMPRESS(bp)].ci_name,
 	    BP_GET_BYTEORDER(bp) == 0 ? "BE" : "LE",
 	    BP_IS_GANG(bp) ? "gang" : "contiguous",
+	    BP_GET_DEDUP(bp) ? " dedup" : "",
 	    (u_longlong_t)bp->blk_birth,
 	    (u_longlong_t)bp->blk_fill,
 	    (u_longlong_t)bp->blk_cksum.zc_word[0],
@@ -1079,6 +1080,7 @@ spa_init(int mode)
 	refcount_init();
 	unique_init();
 	zio_init();
+	vdev_raidz_stat_init();
 	dmu_init();
 	zil_init();
 	zfs_prop_init();
@@ -1092,6 +1094,7 @@ spa_fini(void)
 
 	zil_fini();
 	dmu_fini();
+	vdev_raidz_stat_fini();
 	zio_fini();
 	unique_fini();
 	refcount_fini();
@@ -64,10 +64,18 @@ extern "C" {
  *		|		^
  *		|		|
  *		+----> FILL ----+
+ *			|	^
+ *			V	|
+ *		     PARTIAL ---+
+ *
+ * A PARTIAL buffer has only the start of its data written in the open
+ * txg; the rest of the old block is read in when the buffer is next
+ * read or its txg syncs, unless it is overwritten first.
  */
 typedef enum dbuf_states {
 	DB_UNCACHED,
 	DB_FILL,
+	DB_PARTIAL,
 	DB_READ,
 	DB_CACHED,
 	DB_EVICTING
@@ -132,6 +140,25 @@ typedef struct dbuf_dirty_record {
 			arc_buf_t *dr_data;
 			blkptr_t dr_overridden_by;
 			override_states_t dr_override_state;
+
+			/*
+			 * dr_cdata, if set, is an already-compressed image
+			 * of dr_data (e.g. from a compressed send stream),
+			 * which dbuf_write() hands to the write zio.
+			 */
+			void *dr_cdata;
+			uint64_t dr_csize;
+			uint8_t dr_ccompress;
+
+			/*
+			 * If dr_fill_end is set, only [0, dr_fill_end) of
+			 * dr_data has been written and the rest must still
+			 * be merged in from the old block.  dr_fill_freed
+			 * notes that the block was freed before it was
+			 * dirtied, so there is nothing to merge.
+			 */
+			int dr_fill_end;
+			uint8_t dr_fill_freed;
 		} dl;
 	} dt;
 } dbuf_dirty_record_t;
@@ -166,6 +193,12 @@ typedef struct dmu_buf_impl {
 	 */
 	struct dmu_buf_impl *db_hash_next;
 
+	/*
+	 * dbuf_epoch in which we left the hash table; we go back to
+	 * dbuf_cache once no lookup can still be looking at us.
+	 */
+	uint64_t db_limbo_epoch;
+
 	/* our block number */
 	uint64_t db_blkid;
 
@@ -237,6 +270,7 @@ typedef struct dbuf_hash_table {
 
 
 uint64_t dbuf_whichblock(struct dnode *di, uint64_t offset);
+uint64_t dbuf_hash(void *os, uint64_t obj, uint8_t lvl, uint64_t blkid);
 
 dmu_buf_impl_t *dbuf_create_tlib(struct dnode *dn, char *data);
 void dbuf_create_bonus(struct dnode *dn);
@@ -262,6 +296,10 @@ void dmu_buf_will_fill(dmu_buf_t *db, dmu_tx_t *tx);
 void dbuf_fill_done(dmu_buf_impl_t *db, dmu_tx_t *tx);
 void dmu_buf_will_fill(dmu_buf_t *db, dmu_tx_t *tx);
 void dmu_buf_fill_done(dmu_buf_t *db, dmu_tx_t *tx);
+void dmu_buf_will_fill_range(dmu_buf_t *db, uint64_t off, uint64_t len,
+    dmu_tx_t *tx);
+boolean_t dbuf_fill_defers_read(struct dnode *dn, uint64_t blkid,
+    uint64_t off);
 dbuf_dirty_record_t *dbuf_dirty(dmu_buf_impl_t *db, dmu_tx_t *tx);
 
 void dbuf_clear(dmu_buf_impl_t *db);
@@ -269,6 +307,8 @@ void dbuf_evict(dmu_buf_impl_t *db);
 
 void dbuf_setdirty(dmu_buf_impl_t *db, dmu_tx_t *tx);
 void dbuf_unoverride(dbuf_dirty_record_t *dr);
+void dbuf_assign_compressed(dmu_buf_impl_t *db, void *cdata, uint64_t csize,
+    uint8_t compress, dmu_tx_t *tx);
 void dbuf_sync_list(list_t *list, dmu_tx_t *tx);
 
 void dbuf_free_range(struct dnode *dn, uint64_t blkid, uint64_t nblks,
@@ -279,6 +319,8 @@ void dbuf_new_size(dmu_buf_impl_t *db, int size, dmu_tx_t *tx);
 void dbuf_init(void);
 void dbuf_fini(void);
 
+extern int dbuf_partial_fill;
+
 #define	DBUF_GET_BUFC_TYPE(db)					\
 	((((db)->db_level > 0) ||				\
 	    (dmu_ot[(db)->db_dnode->dn_type].ot_metadata)) ?	\
@@ -0,0 +1,87 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2008 Sun Microsystems, Inc.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+#ifndef	_SYS_DDT_H
+#define	_SYS_DDT_H
+
+#pragma ident	"%Z%%M%	%I%	%E% SMI"
+
+#include <sys/spa.h>
+#include <sys/dmu.h>
+#include <sys/avl.h>
+#include <sys/zfs_context.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * On-disk dedup table entry.  The table is a ZAP object in the MOS,
+ * named by the SHA256 checksum of the block's (compressed) contents.
+ */
+typedef struct ddt_phys {
+	blkptr_t	ddp_bp;		/* the one copy on disk */
+	uint64_t	ddp_refcnt;	/* block pointers that refer to it */
+} ddt_phys_t;
+
+#define	DDT_PHYS_WORDS	(sizeof (ddt_phys_t) / sizeof (uint64_t))
+#define	DDT_NAMELEN	(4 * 16 + 1)
+
+typedef struct ddt_entry {
+	avl_node_t	dde_node;
+	zio_cksum_t	dde_key;
+	ddt_phys_t	dde_phys;
+	boolean_t	dde_dirty;	/* must be written out by ddt_sync */
+} ddt_entry_t;
+
+typedef struct ddt {
+	kmutex_t	ddt_lock;
+	spa_t		*ddt_spa;
+	uint64_t	ddt_object;	/* MOS ZAP, 0 until first dedup write */
+	avl_tree_t	ddt_tree;	/* entries touched this txg */
+	uint64_t	ddt_gen;	/* bumped by each ddt_sync */
+} ddt_t;
+
+typedef struct ddt_stat {
+	uint64_t	dds_entries;	/* unique blocks in the table */
+	uint64_t	dds_refs;	/* block pointers referring to them */
+	uint64_t	dds_asize;	/* space they occupy */
+	uint64_t	dds_ref_asize;	/* space they would occupy undeduped */
+} ddt_stat_t;
+
+extern void ddt_create(spa_t *spa);
+extern void ddt_destroy(spa_t *spa);
+extern int ddt_load(spa_t *spa);
+extern boolean_t ddt_write(spa_t *spa, blkptr_t *bp, int ndvas, uint64_t txg);
+extern void ddt_add(spa_t *spa, const blkptr_t *bp);
+extern boolean_t ddt_free(spa_t *spa, const blkptr_t *bp);
+extern void ddt_sync(spa_t *spa, dmu_tx_t *tx);
+extern int ddt_get_stats(spa_t *spa, ddt_stat_t *dds);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_DDT_H */
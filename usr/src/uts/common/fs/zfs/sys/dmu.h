@@ -199,6 +199,8 @@ typedef void dmu_buf_evict_func_t(struct dmu_buf *db, void *user_ptr);
 #define	DMU_POOL_DEFLATE		"deflate"
 #define	DMU_POOL_HISTORY		"history"
 #define	DMU_POOL_PROPS			"pool_props"
+#define	DMU_POOL_FREE_PENDING		"free_pending"
+#define	DMU_POOL_DDT			"ddt_sha256"
 
 /*
  * Allocate an object from this objset.  The range of object numbers
@@ -408,6 +410,7 @@ void dmu_tx_hold_write(dmu_tx_t *tx, uint64_t object, uint64_t off, int len);
 void dmu_tx_hold_free(dmu_tx_t *tx, uint64_t object, uint64_t off,
     uint64_t len);
 void dmu_tx_hold_zap(dmu_tx_t *tx, uint64_t object, int add, char *name);
+void dmu_tx_hold_zap_many(dmu_tx_t *tx, uint64_t object, int add, int count);
 void dmu_tx_hold_bonus(dmu_tx_t *tx, uint64_t object);
 void dmu_tx_abort(dmu_tx_t *tx);
 int dmu_tx_assign(dmu_tx_t *tx, uint64_t txg_how);
@@ -431,6 +434,38 @@ int dmu_read(objset_t *os, uint64_t object, uint64_t offset, uint64_t size,
 	void *buf);
 void dmu_write(objset_t *os, uint64_t object, uint64_t offset, uint64_t size,
 	const void *buf, dmu_tx_t *tx);
+
+/*
+ * Loaned reads: dmu_read_loan() describes where the cached data for a
+ * range of an object lies, in dl_segs, instead of copying it.  The
+ * range may be at most DMU_MAX_ACCESS / 2 bytes; dl_length comes back
+ * shorter than asked only for objects whose single block is smaller,
+ * and the rest reads as zeros.  The loan starts with one reference,
+ * dmu_loan_hold() adds more and the last dmu_loan_rele() returns the
+ * buffers.  The data must not be modified.
+ */
+typedef struct dmu_loan_seg {
+	void		*dls_data;
+	uint64_t	dls_len;
+} dmu_loan_seg_t;
+
+typedef struct dmu_loan {
+	uint64_t	dl_offset;
+	uint64_t	dl_length;
+	int		dl_numbufs;	/* == number of dl_segs */
+	dmu_loan_seg_t	*dl_segs;
+	/* private: */
+	dmu_buf_t	**dl_dbp;
+	volatile uint64_t dl_refcnt;
+} dmu_loan_t;
+
+int dmu_read_loan(objset_t *os, uint64_t object, uint64_t offset,
+	uint64_t size, dmu_loan_t **dlp);
+void dmu_loan_hold(dmu_loan_t *dl);
+void dmu_loan_rele(dmu_loan_t *dl);
+void dmu_write_compressed(objset_t *os, uint64_t object, uint64_t offset,
+	uint64_t size, const void *buf, void *cbuf, uint64_t csize,
+	uint8_t compress, dmu_tx_t *tx);
 #ifdef _KERNEL /*XXX NOEL Why?*/
 int dmu_read_uio(objset_t *os, uint64_t object, struct uio *uio, uint64_t size);
 int dmu_write_uio(objset_t *os, uint64_t object, struct uio *uio, uint64_t size,
@@ -495,6 +530,7 @@ typedef struct dmu_objset_stats {
 	dmu_objset_type_t dds_type;
 	uint8_t dds_is_snapshot;
 	uint8_t dds_inconsistent;
+	uint8_t dds_resumable;	/* inconsistent, but can resume receive */
 	char dds_clone_of[MAXNAMELEN];
 } dmu_objset_stats_t;
 
@@ -582,9 +618,27 @@ typedef void (*dmu_traverse_cb_t)(objset_t *os, void *arg, struct blkptr *bp,
 void dmu_traverse_objset(objset_t *os, uint64_t txg_start,
     dmu_traverse_cb_t cb, void *arg);
 
-int dmu_sendbackup(objset_t *tosnap, objset_t *fromsnap, struct vnode *vp);
+/*
+ * Flags for dmu_sendbackup().
+ */
+#define	DMU_SEND_COMPRESSED	0x1	/* send compressed blocks as-is */
+#define	DMU_SEND_DEDUP		0x2	/* send repeated blocks by reference */
+#define	DMU_SEND_RESUME		0x4	/* resume an interrupted send */
+
+/*
+ * Where to pick up an interrupted send, from a receive resume token.
+ */
+typedef struct dmu_send_resume {
+	uint64_t	dsr_toguid;
+	uint64_t	dsr_object;	/* last WRITE applied, 0 if none */
+	uint64_t	dsr_offset;
+	uint64_t	dsr_checksum[4]; /* stream checksum up to there */
+} dmu_send_resume_t;
+
+int dmu_sendbackup(objset_t *tosnap, objset_t *fromsnap, int flags,
+    dmu_send_resume_t *resume, struct vnode *vp);
 int dmu_recvbackup(char *tosnap, struct drr_begin *drrb, uint64_t *sizep,
-    boolean_t force, struct vnode *vp, uint64_t voffset);
+    boolean_t force, boolean_t resumable, struct vnode *vp, uint64_t voffset);
 
 /* Mac OSX interface for vnop_allocate */
 #ifdef __APPLE__
@@ -595,6 +649,14 @@ int dmu_allocate_check(objset_t *z_os, off_t length);
 #define	ZFS_CRC64_POLY	0xC96C5795D7870F42ULL	/* ECMA-182, reflected form */
 extern uint64_t zfs_crc64_table[256];
 
+/*
+ * The same CRC64 extended for slicing-by-8: zfs_crc64_slice[k][i] is the
+ * CRC of byte i followed by k zero bytes, so eight input bytes can be
+ * folded in with eight independent lookups.  zfs_crc64_slice[0] is
+ * zfs_crc64_table.
+ */
+extern uint64_t zfs_crc64_slice[8][256];
+
 #ifdef	__cplusplus
 }
 #endif
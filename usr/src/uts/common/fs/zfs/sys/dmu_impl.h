@@ -197,16 +197,25 @@ extern "C" {
  *   protects:
  *   	os_dirty_dnodes
  *   	os_free_dnodes
- *   	os_dnodes
  *   	os_downgraded_dbufs
  *   	dn_dirtyblksz
  *   	dn_dirty_link
  *   held from:
- *   	dnode_create: none (os_dnodes)
- *   	dnode_destroy: none (os_dnodes)
  *   	dnode_setdirty: none (dn_dirtyblksz, os_*_dnodes)
  *   	dnode_free: none (dn_dirtyblksz, os_*_dnodes)
  *
+ * dns_lock
+ *   must be held before:
+ *   	dn_mtx
+ *   protects:
+ *   	dns_tree (one os_dnodes shard)
+ *   	dn_link
+ *   held from:
+ *   	dnode_create: none (dns_tree)
+ *   	dnode_destroy: none (dns_tree)
+ *   	dnode_hold_cached: none (dns_tree)
+ *   	dmu_objset_evict_dbufs: none (dns_tree)
+ *
  * ds_lock (leaf)
  *    protects:
  *    	ds_user_ptr
@@ -57,6 +57,21 @@ struct objset {
 	int os_mode;
 };
 
+/*
+ * Instantiated dnodes are spread over DNODE_SHARDS trees by object
+ * number, each under its own lock, so that creating and destroying
+ * dnodes of different objects doesn't serialize on one lock, and so
+ * that dnode_hold_impl() can find a dnode that is already held without
+ * going through the meta-dnode's dbuf.
+ */
+#define	DNODE_SHARDS		16
+#define	DNODE_SHARD(osi, obj)	(&(osi)->os_dnodes[(obj) & (DNODE_SHARDS - 1)])
+
+typedef struct dnode_shard {
+	kmutex_t dns_lock;
+	avl_tree_t dns_tree;	/* dnode_link_t's */
+} dnode_shard_t;
+
 typedef struct objset_impl {
 	/* Immutable: */
 	struct dsl_dataset *os_dsl_dataset;
@@ -69,6 +84,7 @@ typedef struct objset_impl {
 	uint8_t os_checksum;	/* can change, under dsl_dir's locks */
 	uint8_t os_compress;	/* can change, under dsl_dir's locks */
 	uint8_t os_copies;	/* can change, under dsl_dir's locks */
+	uint8_t os_dedup;	/* can change, under dsl_dir's locks */
 	uint8_t os_md_checksum;
 	uint8_t os_md_compress;
 
@@ -84,8 +100,10 @@ typedef struct objset_impl {
 	kmutex_t os_lock;
 	list_t os_dirty_dnodes[TXG_SIZE];
 	list_t os_free_dnodes[TXG_SIZE];
-	list_t os_dnodes;
 	list_t os_downgraded_dbufs;
+
+	/* Each shard has its own lock */
+	dnode_shard_t os_dnodes[DNODE_SHARDS];
 } objset_impl_t;
 
 #define	DMU_META_DNODE_OBJECT	0
@@ -63,6 +63,7 @@ typedef struct zseg {
 	uint64_t	seg_maxtxg;
 	zbookmark_t	seg_start;
 	zbookmark_t	seg_end;
+	blkptr_t	seg_osbp;	/* root of a destroyed objset */
 	list_node_t	seg_node;
 } zseg_t;
 
@@ -109,9 +110,12 @@ void traverse_add_dnode(traverse_handle_t *th,
     uint64_t mintxg, uint64_t maxtxg, uint64_t objset, uint64_t object);
 void traverse_add_objset(traverse_handle_t *th,
     uint64_t mintxg, uint64_t maxtxg, uint64_t objset);
+void traverse_add_destroyed_objset(traverse_handle_t *th, uint64_t mintxg,
+    uint64_t objset, blkptr_t *osbp, zbookmark_t *zb);
 void traverse_add_pool(traverse_handle_t *th, uint64_t mintxg, uint64_t maxtxg);
 
 int traverse_more(traverse_handle_t *th);
+int traverse_bookmark(traverse_handle_t *th, zbookmark_t *zb);
 
 #ifdef	__cplusplus
 }
@@ -118,6 +118,17 @@ typedef struct dnode_phys {
 	uint8_t dn_bonus[DN_MAX_BONUSLEN];
 } dnode_phys_t;
 
+/*
+ * A dnode's entry in its objset's os_dnodes shard.  Entries sort by
+ * object and then by dnode address, since two dnodes for the same
+ * object briefly coexist while dnode_hold_impl() settles a race.
+ */
+typedef struct dnode_link {
+	avl_node_t dl_node;
+	uint64_t dl_object;
+	struct dnode *dl_dnode;
+} dnode_link_t;
+
 typedef struct dnode {
 	/*
 	 * dn_struct_rwlock protects the structure of the dnode,
@@ -127,10 +138,10 @@ typedef struct dnode {
 	krwlock_t dn_struct_rwlock;
 
 	/*
-	 * Our link on dataset's dd_dnodes list.
-	 * Protected by dd_accounting_mtx.
+	 * Our entry in the objset's os_dnodes shard.
+	 * Protected by that shard's dns_lock.
 	 */
-	list_node_t dn_link;
+	dnode_link_t dn_link;
 
 	/* immutable: */
 	struct objset_impl *dn_objset;
@@ -230,6 +241,7 @@ void dnode_fini(void);
 int dnode_next_offset(dnode_t *dn, boolean_t hole, uint64_t *off, int minlvl,
     uint64_t blkfill, uint64_t txg);
 void dnode_evict_dbufs(dnode_t *dn);
+int dnode_link_compare(const void *x1, const void *x2);
 
 #ifdef ZFS_DEBUG
 
@@ -78,7 +78,17 @@ typedef struct dsl_dataset_phys {
 	uint64_t ds_guid;
 	uint64_t ds_flags;
 	blkptr_t ds_bp;
-	uint64_t ds_pad[8]; /* pad out to 320 bytes for good measure */
+	/*
+	 * Progress of a resumable 'zfs receive' into this (inconsistent)
+	 * head dataset; ds_resume_toguid is 0 if there is none.  The
+	 * object and offset are those of the last WRITE record applied,
+	 * and the checksum is that of the stream up to and including it.
+	 */
+	uint64_t ds_resume_toguid;
+	uint64_t ds_resume_version;	/* drr_version of the stream */
+	uint64_t ds_resume_object;
+	uint64_t ds_resume_offset;
+	zio_cksum_t ds_resume_checksum; /* pads out to 320 bytes */
 } dsl_dataset_phys_t;
 
 typedef struct dsl_dataset {
@@ -114,6 +124,11 @@ typedef struct dsl_dataset {
 	/* for objset_open() */
 	kmutex_t ds_opening_lock;
 
+	/* Protected by ds_lock; receive progress to sync out, by txg */
+	uint64_t ds_resume_object[TXG_SIZE];
+	uint64_t ds_resume_offset[TXG_SIZE];
+	zio_cksum_t ds_resume_checksum[TXG_SIZE];
+
 	/* Protected by ds_lock; keep at end of struct for better locality */
 	char ds_snapname[MAXNAMELEN];
 } dsl_dataset_t;
@@ -159,6 +174,7 @@ uint64_t dsl_dataset_prev_snap_txg(dsl_dataset_t *ds);
 void dsl_dataset_dirty(dsl_dataset_t *ds, dmu_tx_t *tx);
 void dsl_dataset_stats(dsl_dataset_t *os, nvlist_t *nv);
 void dsl_dataset_fast_stat(dsl_dataset_t *ds, dmu_objset_stats_t *stat);
+void dsl_dataset_clear_resume(dsl_dataset_t *ds);
 void dsl_dataset_space(dsl_dataset_t *ds,
     uint64_t *refdbytesp, uint64_t *availbytesp,
     uint64_t *usedobjsp, uint64_t *availobjsp);
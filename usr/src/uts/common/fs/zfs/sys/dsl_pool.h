@@ -40,6 +40,22 @@ extern "C" {
 struct objset;
 struct dsl_dir;
 
+/*
+ * A destroyed head dataset whose blocks are still being freed, a
+ * bounded number per txg, by dsl_pool_free_pending_sync().  Stored as
+ * an array of uint64_t's in the dp_free_pending_obj ZAP, named by the
+ * dataset's object number in hex.
+ */
+typedef struct dsl_free_pending_phys {
+	blkptr_t fp_bp;			/* root of the destroyed objset */
+	uint64_t fp_dsobj;		/* object number of the dataset */
+	uint64_t fp_mintxg;		/* blocks born by then are not ours */
+	uint64_t fp_bytes;		/* space not yet freed */
+	uint64_t fp_object;		/* bookmark to resume the */
+	int64_t fp_level;		/* traversal from; fp_level is */
+	uint64_t fp_blkid;		/* ZB_NO_LEVEL if not yet begun */
+} dsl_free_pending_phys_t;
+
 typedef struct dsl_pool {
 	/* Immutable */
 	spa_t *dp_spa;
@@ -51,6 +67,8 @@ typedef struct dsl_pool {
 	/* No lock needed - sync context only */
 	blkptr_t dp_meta_rootbp;
 	list_t dp_synced_objsets;
+	uint64_t dp_free_pending_obj;
+	uint64_t dp_free_pending_bytes;
 
 	/* Has its own locking */
 	tx_state_t dp_tx;
@@ -74,6 +92,9 @@ void dsl_pool_sync(dsl_pool_t *dp, uint64_t txg);
 void dsl_pool_zil_clean(dsl_pool_t *dp);
 int dsl_pool_sync_context(dsl_pool_t *dp);
 uint64_t dsl_pool_adjustedsize(dsl_pool_t *dp, boolean_t netfree);
+void dsl_pool_free_pending_add(dsl_pool_t *dp, uint64_t dsobj,
+    blkptr_t *bp, uint64_t mintxg, uint64_t bytes, dmu_tx_t *tx);
+void dsl_pool_free_pending_sync(dsl_pool_t *dp, dmu_tx_t *tx);
 
 #ifdef	__cplusplus
 }
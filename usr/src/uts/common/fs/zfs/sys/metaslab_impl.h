@@ -69,6 +69,7 @@ struct metaslab {
 	space_map_t	ms_freemap[TXG_SIZE];	/* freed this txg	*/
 	space_map_t	ms_map;		/* in-core free space map	*/
 	uint64_t	ms_weight;	/* weight vs. others in group	*/
+	uint64_t	ms_maxseg;	/* largest free seg, 0 = unknown */
 	metaslab_group_t *ms_group;	/* metaslab group		*/
 	avl_node_t	ms_group_node;	/* node in metaslab group tree	*/
 	txg_node_t	ms_txg_node;	/* per-txg dirty metaslab links	*/
@@ -63,6 +63,21 @@ typedef struct spa_props {
 	list_node_t	spa_list_node;
 } spa_props_t;
 
+/*
+ * Gang block counters, exported per pool as the zfs_gang kstat.  Gang
+ * blocks forced by zio_gang_bang (for testing) are counted in
+ * gang_forced as well as in gang_blocks.
+ */
+typedef struct spa_gang_stats {
+	kstat_named_t	sgs_gang_blocks;	/* gang headers allocated */
+	kstat_named_t	sgs_gang_members;	/* blocks under them */
+	kstat_named_t	sgs_gang_forced;	/* of which were forced */
+	kstat_named_t	sgs_alloc_fallback;	/* gangs avoided by fallback */
+} spa_gang_stats_t;
+
+#define	SPA_GANGSTAT_BUMP(spa, stat) \
+	atomic_add_64(&(spa)->spa_gang_stats.stat.value.ui64, 1)
+
 struct spa {
 	/*
 	 * Fields protected by spa_namespace_lock.
@@ -81,6 +96,11 @@ struct spa {
 	spa_load_state_t spa_load_state;	/* current load operation */
 	taskq_t		*spa_zio_issue_taskq[ZIO_TYPES];
 	taskq_t		*spa_zio_intr_taskq[ZIO_TYPES];
+	taskq_t		*spa_zio_cpu_taskq;	/* compress and checksum */
+	spa_lat_stat_t	*spa_lat;		/* zio latency histograms */
+	kstat_t		*spa_lat_ksp;		/* raw kstat of spa_lat */
+	spa_gang_stats_t spa_gang_stats;	/* gang block counters */
+	kstat_t		*spa_gang_ksp;		/* kstat of spa_gang_stats */
 	dsl_pool_t	*spa_dsl_pool;
 	metaslab_class_t *spa_normal_class;	/* normal data class */
 	metaslab_class_t *spa_log_class;	/* intent log data class */
@@ -101,6 +121,8 @@ struct spa {
 	uint64_t	spa_syncing_txg;	/* txg currently syncing */
 	uint64_t	spa_sync_bplist_obj;	/* object for deferred frees */
 	bplist_t	spa_sync_bplist;	/* deferred-free bplist */
+	boolean_t	spa_sync_bplist_carry;	/* frees left for next txg */
+	struct ddt	*spa_ddt;		/* dedup table */
 	krwlock_t	spa_traverse_lock;	/* traverse vs. spa_sync() */
 	uberblock_t	spa_ubsync;		/* last synced uberblock */
 	uberblock_t	spa_uberblock;		/* current uberblock */
@@ -39,6 +39,9 @@ extern "C" {
 
 typedef struct vdev_file {
 	vnode_t		*vf_vnode;
+#ifndef _KERNEL
+	struct vdev_file_aio *vf_aio;	/* userland async I/O */
+#endif
 } vdev_file_t;
 
 #ifdef	__cplusplus
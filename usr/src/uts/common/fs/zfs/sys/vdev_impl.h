@@ -128,6 +128,7 @@ struct vdev {
 	space_map_t	vdev_dtl_map;	/* dirty time log in-core state	*/
 	space_map_t	vdev_dtl_scrub;	/* DTL for scrub repair writes	*/
 	vdev_stat_t	vdev_stat;	/* virtual device statistics	*/
+	vdev_lat_stat_t	vdev_lat;	/* queue/disk latency, leaves	*/
 
 	/*
 	 * Top-level vdev state.
@@ -168,6 +169,10 @@ struct vdev {
 	uint64_t	vdev_isspare;	/* was a hot spare		*/
 	vdev_queue_t	vdev_queue;	/* I/O deadline schedule queue	*/
 	vdev_cache_t	vdev_cache;	/* physical block cache		*/
+	uint64_t	vdev_mirror_lat; /* mirror read latency EWMA, ns */
+	hrtime_t	vdev_mirror_stamp; /* time of last EWMA sample	*/
+	uint64_t	vdev_mirror_next; /* end of last mirror read	*/
+	uint32_t	vdev_mirror_inflight; /* mirror reads outstanding */
 	uint64_t	vdev_not_present; /* not present during import	*/
 	hrtime_t	vdev_last_try;	/* last reopen time		*/
 	boolean_t	vdev_nowritecache; /* true if flushwritecache failed */
@@ -283,6 +288,15 @@ extern vdev_ops_t vdev_file_ops;
 extern vdev_ops_t vdev_missing_ops;
 extern vdev_ops_t vdev_spare_ops;
 
+/*
+ * RAID-Z reconstruction statistics
+ */
+#define	VDEV_RAIDZ_STAT_COLS	16
+
+extern void vdev_raidz_stat_init(void);
+extern void vdev_raidz_stat_fini(void);
+extern void vdev_raidz_col_repairs(uint64_t *repairs);
+
 /*
  * Common size functions
  */
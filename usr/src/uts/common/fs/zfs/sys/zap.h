@@ -183,6 +183,28 @@ int zap_length(objset_t *ds, uint64_t zapobj, const char *name,
  */
 int zap_remove(objset_t *ds, uint64_t zapobj, const char *name, dmu_tx_t *tx);
 
+/*
+ * Batched versions of zap_add(), zap_update() and zap_remove().  The
+ * names are sorted by hash and applied with the zap locked once, so
+ * each leaf of a fat zap is visited at most once (barring splits).
+ * The value of names[i] is the num_integers integers starting at
+ * val + i * integer_size * num_integers.
+ *
+ * Every name is attempted even if some already exist (zap_add_many)
+ * or do not exist (zap_remove_many); EEXIST or ENOENT is returned
+ * once the others have been applied.  Any other error stops the batch
+ * with some of the names applied.  Hold the tx with
+ * dmu_tx_hold_zap_many().
+ */
+int zap_add_many(objset_t *ds, uint64_t zapobj, int count,
+    const char **names, int integer_size, uint64_t num_integers,
+    const void *val, dmu_tx_t *tx);
+int zap_update_many(objset_t *ds, uint64_t zapobj, int count,
+    const char **names, int integer_size, uint64_t num_integers,
+    const void *val, dmu_tx_t *tx);
+int zap_remove_many(objset_t *ds, uint64_t zapobj, int count,
+    const char **names, dmu_tx_t *tx);
+
 /*
  * Returns (in *count) the number of attributes in the specified zap
  * object.
@@ -64,13 +64,21 @@ typedef struct mzap_phys {
 	/* actually variable size depending on block size */
 } mzap_phys_t;
 
+/*
+ * In-core index of a micro-zap: one of these per entry, kept in a
+ * single array sorted by (hash, cd).  The name and value stay in the
+ * on-disk chunk.
+ */
 typedef struct mzap_ent {
-	avl_node_t mze_node;
-	int mze_chunkid;
 	uint64_t mze_hash;
-	mzap_ent_phys_t mze_phys;
+	uint32_t mze_cd;
+	uint16_t mze_chunkid;
+	uint16_t mze_pad;
 } mzap_ent_t;
 
+#define	MZE_PHYS(zap, mze) \
+	(&(zap)->zap_m.zap_phys->mz_chunk[(mze)->mze_chunkid])
+
 
 /*
  * The (fat) zap is stored in one object. It is an array of
@@ -160,7 +168,8 @@ typedef struct zap {
 			int16_t zap_num_entries;
 			int16_t zap_num_chunks;
 			int16_t zap_alloc_next;
-			avl_tree_t zap_avl;
+			int16_t zap_num_alloc;	/* zap_ents slots */
+			mzap_ent_t *zap_ents;	/* zap_num_entries of them */
 		} zap_micro;
 	} zap_u;
 } zap_t;
@@ -197,6 +206,25 @@ int fzap_add_cd(zap_t *zap, const char *name,
     const void *val, uint32_t cd, dmu_tx_t *tx);
 void fzap_upgrade(zap_t *zap, dmu_tx_t *tx);
 
+/*
+ * One name of a zap_add_many(), zap_update_many() or zap_remove_many()
+ * batch.  The batch is sorted by hash before it is applied.
+ */
+typedef enum zap_batch_op {
+	ZAP_BATCH_ADD,
+	ZAP_BATCH_UPDATE,
+	ZAP_BATCH_REMOVE
+} zap_batch_op_t;
+
+typedef struct zap_batch_ent {
+	uint64_t zbe_hash;
+	const char *zbe_name;
+	const void *zbe_val;		/* NULL for ZAP_BATCH_REMOVE */
+} zap_batch_ent_t;
+
+int fzap_batch(zap_t *zap, zap_batch_op_t op, zap_batch_ent_t *zbe,
+    int count, int integer_size, uint64_t num_integers, dmu_tx_t *tx);
+
 #ifdef	__cplusplus
 }
 #endif
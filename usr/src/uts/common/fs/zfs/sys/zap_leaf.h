@@ -147,12 +147,35 @@ typedef union zap_leaf_chunk {
 	} l_free;
 } zap_leaf_chunk_t;
 
+/*
+ * In-core decoded index of a leaf's entries, sorted by hash, with the
+ * names copied out of their chunk chains so that a lookup is a binary
+ * search and a single bcmp.  It is built on demand by
+ * zap_leaf_lookup_index() and discarded whenever the leaf's entries
+ * change or the leaf is evicted.
+ */
+typedef struct zap_leaf_index_ent {
+	uint64_t zie_hash;
+	uint16_t zie_chunk;		/* chunk of the zap_leaf_entry */
+	uint16_t zie_namelen;		/* bytes in name, incl null */
+	uint32_t zie_nameoff;		/* offset of name in zli_names */
+} zap_leaf_index_ent_t;
+
+typedef struct zap_leaf_index {
+	size_t zli_size;		/* bytes allocated for the index */
+	int zli_nentries;
+	char *zli_names;		/* names, each null-terminated */
+	zap_leaf_index_ent_t zli_ents[1]; /* sorted by zie_hash */
+} zap_leaf_index_t;
+
 typedef struct zap_leaf {
 	krwlock_t l_rwlock; 		/* only used on head of chain */
 	uint64_t l_blkid;		/* 1<<ZAP_BLOCK_SHIFT byte block off */
 	int l_bs;			/* block size shift */
 	dmu_buf_t *l_dbuf;
 	zap_leaf_phys_t *l_phys;
+	zap_leaf_index_t *l_index;	/* decoded entries, or NULL */
+	int l_index_lookups;		/* lookups since l_index dropped */
 } zap_leaf_t;
 
 
@@ -176,6 +199,14 @@ typedef struct zap_entry_handle {
 extern int zap_leaf_lookup(zap_leaf_t *l,
 	const char *name, uint64_t h, zap_entry_handle_t *zeh);
 
+/*
+ * Same as zap_leaf_lookup(), but may use (and build) the leaf's in-core
+ * index.  The handle returned can only be used to read the entry, not
+ * to update or remove it.  The leaf must be held at least as reader.
+ */
+extern int zap_leaf_lookup_index(zap_leaf_t *l,
+	const char *name, uint64_t h, zap_entry_handle_t *zeh);
+
 /*
  * Return a handle to the entry with this hash+cd, or the entry with the
  * next closest hash+cd.
@@ -223,6 +254,7 @@ extern int zap_entry_create(zap_leaf_t *l,
  */
 
 extern void zap_leaf_init(zap_leaf_t *l);
+extern void zap_leaf_index_free(zap_leaf_t *l);
 extern void zap_leaf_byteswap(zap_leaf_phys_t *buf, int len);
 extern void zap_leaf_split(zap_leaf_t *l, zap_leaf_t *nl);
 extern void zap_leaf_stats(zap_t *zap, zap_leaf_t *l, zap_stats_t *zs);
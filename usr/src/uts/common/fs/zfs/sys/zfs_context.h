@@ -452,6 +452,7 @@ extern void vmem_free(vmem_t *, void *, size_t);
 
 //extern	unsigned int	real_ncpus;		/* real number of cpus */
 extern	unsigned int	max_ncpus;		/* max number of cpus */
+extern	unsigned int	boot_ncpus;		/* cpus online at boot */
 
 #define ncpus max_ncpus
 
@@ -0,0 +1,89 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2008 Sun Microsystems, Inc.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+#ifndef	_SYS_FS_ZFS_DIRCACHE_H
+#define	_SYS_FS_ZFS_DIRCACHE_H
+
+#pragma ident	"%Z%%M%	%I%	%E% SMI"
+
+#include <sys/zfs_context.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * Per-directory cache of name -> object number lookups, covering both
+ * names that exist and names that don't.  It sits below the OS name
+ * cache and saves a zap_lookup() when that misses.
+ *
+ * Each directory gets a small direct-mapped table, allocated the first
+ * time something is entered, so a name only ever lives in one slot.
+ * zfs_link_create() and zfs_link_destroy() remove the name they change,
+ * under the same dirlock that lookups of that name hold, so the cache
+ * is never stale.  The number of tables is capped by zfs_dircache_max.
+ */
+#define	ZFS_DIRCACHE_NAMELEN	40	/* longer names are not cached */
+#define	ZFS_DIRCACHE_NENTS	64	/* slots per directory */
+
+typedef struct zfs_dircache_ent {
+	uint64_t	dce_hash;	/* hash of dce_name */
+	uint64_t	dce_zoid;	/* object number, 0 if no such name */
+	uint16_t	dce_namelen;	/* 0 if slot is empty */
+	char		dce_name[ZFS_DIRCACHE_NAMELEN];
+} zfs_dircache_ent_t;
+
+typedef struct zfs_dircache {
+	kmutex_t	dc_lock;
+	zfs_dircache_ent_t dc_ents[ZFS_DIRCACHE_NENTS];
+} zfs_dircache_t;
+
+extern int zfs_dircache_max;
+
+void zfs_dircache_init(void);
+void zfs_dircache_fini(void);
+
+/*
+ * Returns 0 and the object number if the name is cached, ENOENT if the
+ * name is cached as not existing, or ESRCH if nothing is known.
+ */
+int zfs_dircache_lookup(zfs_dircache_t *dc, const char *name,
+    uint64_t *zoidp);
+
+/*
+ * Cache the result of a lookup; a zoid of 0 means the name does not
+ * exist.  Allocates *dcp if need be (and the cap allows).
+ */
+void zfs_dircache_enter(zfs_dircache_t **dcp, const char *name,
+    uint64_t zoid);
+
+void zfs_dircache_remove(zfs_dircache_t *dc, const char *name);
+void zfs_dircache_destroy(zfs_dircache_t **dcp);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_FS_ZFS_DIRCACHE_H */
@@ -48,13 +48,41 @@ extern "C" {
 #define	DMU_BACKUP_VERSION (1ULL)
 #define	DMU_BACKUP_MAGIC 0x2F5bacbacULL
 
+/*
+ * The upper 32 bits of drr_version carry stream feature flags.  A
+ * receiver must refuse any stream with a feature bit it does not know.
+ */
+#define	DMU_BACKUP_VERSION_MASK		0xffffffffULL
+#define	DMU_BACKUP_FEATURE_COMPRESSED	(1ULL << 32)
+#define	DMU_BACKUP_FEATURE_DEDUP	(1ULL << 33)
+#define	DMU_BACKUP_FEATURE_RESUMING	(1ULL << 34)
+#define	DMU_BACKUP_FEATURE_MASK		\
+	(DMU_BACKUP_FEATURE_COMPRESSED | DMU_BACKUP_FEATURE_DEDUP | \
+	DMU_BACKUP_FEATURE_RESUMING)
+
+#define	DMU_GET_BACKUP_VERSION(vers)	((vers) & DMU_BACKUP_VERSION_MASK)
+#define	DMU_GET_BACKUP_FEATURES(vers)	((vers) & ~DMU_BACKUP_VERSION_MASK)
+
+/*
+ * A receive resume token names the point at which an interrupted
+ * resumable receive stopped: the token version, then the stream's
+ * drr_version and drr_toguid, the object and offset of the last WRITE
+ * record applied, and the four words of the stream checksum up to that
+ * record, all in hex.
+ */
+#define	ZFS_RESUME_TOKEN_VERSION	1
+#define	ZFS_RESUME_TOKEN_FMT	\
+	"%llx-%llx-%llx-%llx-%llx-%llx-%llx-%llx-%llx"
+#define	ZFS_RESUME_TOKEN_FIELDS		9
+#define	ZFS_RESUME_TOKEN_LEN		(ZFS_RESUME_TOKEN_FIELDS * 17)
+
 /*
  * zfs ioctl command structure
  */
 typedef struct dmu_replay_record {
 	enum {
 		DRR_BEGIN, DRR_OBJECT, DRR_FREEOBJECTS,
-		DRR_WRITE, DRR_FREE, DRR_END,
+		DRR_WRITE, DRR_FREE, DRR_END, DRR_WRITE_BYREF,
 	} drr_type;
 	uint32_t drr_pad;
 	union {
@@ -89,9 +117,11 @@ typedef struct dmu_replay_record {
 		struct drr_write {
 			uint64_t drr_object;
 			dmu_object_type_t drr_type;
-			uint32_t drr_pad;
+			uint8_t drr_compress;	/* payload compression or 0 */
+			uint8_t drr_pad[3];
 			uint64_t drr_offset;
-			uint64_t drr_length;
+			uint64_t drr_length;	/* logical size */
+			uint64_t drr_psize;	/* payload size if compressed */
 			/* content follows */
 		} drr_write;
 		struct drr_free {
@@ -99,6 +129,14 @@ typedef struct dmu_replay_record {
 			uint64_t drr_offset;
 			uint64_t drr_length;
 		} drr_free;
+		struct drr_write_byref {
+			uint64_t drr_object;
+			uint64_t drr_offset;
+			uint64_t drr_length;
+			/* where an identical block was earlier in the stream */
+			uint64_t drr_refobject;
+			uint64_t drr_refoffset;
+		} drr_write_byref;
 	} drr_u;
 } dmu_replay_record_t;
 
@@ -112,6 +150,11 @@ typedef struct zinject_record {
 	uint32_t	zi_error;
 	uint64_t	zi_type;
 	uint32_t	zi_freq;
+	uint32_t	zi_cmd;		/* zinject_type_t */
+	uint64_t	zi_timer;	/* DELAY_IO: base latency, ns */
+	uint64_t	zi_timer_spread; /* DELAY_IO: see zi_dist, ns */
+	uint64_t	zi_bandwidth;	/* BANDWIDTH: bytes per second */
+	uint32_t	zi_dist;	/* DELAY_IO: zinject_dist_t */
 	uint32_t	zi_pad;	/* pad out to 64 bit alignment */
 } zinject_record_t;
 
@@ -119,6 +162,28 @@ typedef struct zinject_record {
 #define	ZINJECT_FLUSH_ARC	0x2
 #define	ZINJECT_UNLOAD_SPA	0x4
 
+/*
+ * What a record injects.  Errors may target data or a device; delays
+ * and bandwidth limits target the device named by zi_guid, and apply to
+ * its reads and writes (or only zi_freq percent of them, if set).
+ */
+typedef enum zinject_type {
+	ZINJECT_CMD_ERROR = 0,		/* fail I/O with zi_error */
+	ZINJECT_CMD_DELAY_IO,		/* add latency to each I/O */
+	ZINJECT_CMD_BANDWIDTH		/* serve I/O at zi_bandwidth */
+} zinject_type_t;
+
+/*
+ * How an injected latency is drawn: always zi_timer, or zi_timer plus a
+ * uniform draw from [0, zi_timer_spread), or zi_timer plus an
+ * exponential draw with mean zi_timer_spread for a long tail.
+ */
+typedef enum zinject_dist {
+	ZINJECT_DIST_FIXED = 0,
+	ZINJECT_DIST_UNIFORM,
+	ZINJECT_DIST_EXPONENTIAL
+} zinject_dist_t;
+
 typedef struct zfs_share {
 	uint64_t	z_exportdata;
 	uint64_t	z_sharedata;
@@ -145,6 +210,7 @@ typedef struct zfs_cmd {
 	dmu_objset_stats_t zc_objset_stats;
 	struct drr_begin zc_begin_record;
 	zinject_record_t zc_inject_record;
+	dmu_send_resume_t zc_resume;
 #ifdef __APPLE__ 
 	int		zc_ioc_error; /* ioctl error value */
 	uint64_t	zc_dev;	     /* OSX doesn't have ddi_driver_major*/ 
@@ -32,8 +32,6 @@
 extern "C" {
 #endif
 
-#ifdef _KERNEL
-
 #include <sys/zfs_znode.h>
 
 typedef enum {
@@ -54,6 +52,7 @@ typedef struct rl {
 	uint8_t r_proxy;	/* acting for original range */
 	uint8_t r_write_wanted;	/* writer wants to lock this range */
 	uint8_t r_read_wanted;	/* reader wants to lock this range */
+	uint8_t r_fast;		/* reader not in the tree; see zfs_rlock.c */
 } rl_t;
 
 /*
@@ -80,7 +79,10 @@ void zfs_range_reduce(rl_t *rl, uint64_t off, uint64_t len);
  */
 int zfs_range_compare(const void *arg1, const void *arg2);
 
-#endif /* _KERNEL */
+/*
+ * Set to make readers always go through the tree.
+ */
+extern int zfs_range_fast_disable;
 
 #ifdef	__cplusplus
 }
@@ -150,6 +150,12 @@ typedef struct znode_phys {
 	 */
 } znode_phys_t;
 
+/*
+ * Readers that may hold a range lock outside z_range_avl at once;
+ * see zfs_rlock.c.
+ */
+#define	ZFS_RANGE_FAST_SLOTS	8
+
 /*
  * Directory entry locks control access to directory entries.
  * They are used to protect creates, deletes, and renames.
@@ -204,8 +210,13 @@ typedef struct znode {
 	krwlock_t	z_parent_lock;	/* parent lock for directories */
 	krwlock_t	z_name_lock;	/* "master" lock for dirent locks */
 	zfs_dirlock_t	*z_dirlocks;	/* directory entry lock list */
+	struct zfs_dircache *z_dircache; /* directory lookup cache */
 	kmutex_t	z_range_lock;	/* protects changes to z_range_avl */
 	avl_tree_t	z_range_avl;	/* avl tree of file range locks */
+	struct rl * volatile z_range_fast[ZFS_RANGE_FAST_SLOTS];
+					/* readers not in z_range_avl */
+	volatile uint32_t z_range_writers; /* writers holding or waiting */
+	kcondvar_t	z_range_cv;	/* wait for z_range_fast to drain */
 	uint8_t		z_unlinked;	/* file has been unlinked */
 	uint8_t		z_atime_dirty;	/* atime needs to be synced */
 	uint8_t		z_dbuf_held;	/* Is z_dbuf already held? */
@@ -380,6 +391,25 @@ extern void znode_stalker(znode_t *zp, whereami_t event);
 extern void znode_stalker_fini(znode_t *zp);
 #endif
 
+#else	/* _KERNEL */
+
+#include <sys/avl.h>
+
+/*
+ * The subset of znode_t libzpool needs: just enough for zfs_range_lock()
+ * on behalf of the userland volume engine, which like zvol uses a
+ * dummied up znode with no vnode.
+ */
+typedef struct znode {
+	void		*z_vnode;	/* always NULL */
+	kmutex_t	z_range_lock;	/* protects changes to z_range_avl */
+	avl_tree_t	z_range_avl;	/* avl tree of file range locks */
+	struct rl * volatile z_range_fast[ZFS_RANGE_FAST_SLOTS];
+					/* readers not in z_range_avl */
+	volatile uint32_t z_range_writers; /* writers holding or waiting */
+	kcondvar_t	z_range_cv;	/* wait for z_range_fast to drain */
+} znode_t;
+
 #endif /* _KERNEL */
 
 extern int zfs_obj_to_path(objset_t *osp, uint64_t obj, char *buf, int len);
@@ -144,6 +144,8 @@ enum zio_compress {
 #define	ZIO_FLAG_USER			0x20000
 
 #define	ZIO_FLAG_METADATA		0x40000
+#define	ZIO_FLAG_RAW			0x80000	/* no decompression */
+#define	ZIO_FLAG_DEDUP			0x100000 /* consult the dedup table */
 
 #define	ZIO_FLAG_GANG_INHERIT		\
 	(ZIO_FLAG_CANFAIL |		\
@@ -228,12 +230,21 @@ struct zio {
 	void		*io_data;
 	uint64_t	io_size;
 
+	/* Precompressed image of io_data, see zio_write_set_compressed() */
+	void		*io_cdata;
+	uint64_t	io_csize;
+	uint8_t		io_ccompress;
+
 	/* Stuff for the vdev stack */
 	vdev_t		*io_vd;
 	void		*io_vsd;
 	uint64_t	io_offset;
 	uint64_t	io_deadline;
 	uint64_t	io_timestamp;
+	hrtime_t	io_queued_ts;	/* entered the vdev queue */
+	hrtime_t	io_issued_ts;	/* left the vdev queue */
+	hrtime_t	io_delay_target; /* injected delay ends */
+	list_node_t	io_delay_node;	/* on the injected delay list */
 	avl_node_t	io_offset_node;
 	avl_node_t	io_deadline_node;
 	avl_tree_t	*io_vdev_tree;
@@ -253,6 +264,10 @@ struct zio {
 	uint32_t	io_numerrors;
 	uint32_t	io_pipeline;
 	uint32_t	io_async_stages;
+	uint32_t	io_cpu_stages;	/* stages to hand to the CPU taskq */
+	boolean_t	io_cpu_taskq;	/* running on spa_zio_cpu_taskq */
+	hrtime_t	io_start_ts;	/* zio_create(), if zio_latency_stats */
+	hrtime_t	io_stage_ts;	/* entered the current stage */
 	uint64_t	io_children_notready;
 	uint64_t	io_children_notdone;
 	void		*io_waiter;
@@ -278,6 +293,9 @@ extern zio_t *zio_write(zio_t *pio, spa_t *spa, int checksum, int compress,
     zio_done_func_t *ready, zio_done_func_t *done, void *private, int priority,
     int flags, zbookmark_t *zb);
 
+extern void zio_write_set_compressed(zio_t *zio, void *cdata, uint64_t csize,
+    uint8_t compress);
+
 extern zio_t *zio_rewrite(zio_t *pio, spa_t *spa, int checksum,
     uint64_t txg, blkptr_t *bp, void *data, uint64_t size,
     zio_done_func_t *done, void *private, int priority, int flags,
@@ -347,6 +365,12 @@ boolean_t zio_should_retry(zio_t *zio);
 extern void zio_init(void);
 extern void zio_fini(void);
 
+/*
+ * Latency histograms
+ */
+extern int zio_latency_stats;
+extern void zio_latency_add(uint64_t *buckets, hrtime_t start);
+
 /*
  * Fault injection
  */
@@ -359,6 +383,7 @@ extern int zio_inject_list_next(int *id, char *name, size_t buflen,
 extern int zio_clear_fault(int id);
 extern int zio_handle_fault_injection(zio_t *zio, int error);
 extern int zio_handle_device_injection(vdev_t *vd, int error);
+extern boolean_t zio_handle_io_delay(zio_t *zio);
 
 #ifdef	__cplusplus
 }
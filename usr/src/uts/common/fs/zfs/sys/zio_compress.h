@@ -75,6 +75,15 @@ extern int zio_compress_data(int cpfunc, void *src, uint64_t srcsize,
 extern int zio_decompress_data(int cpfunc, void *src, uint64_t srcsize,
     void *dest, uint64_t destsize);
 
+/*
+ * Early abort of compression for incompressible data.
+ */
+extern void zio_compress_init(void);
+extern void zio_compress_fini(void);
+extern boolean_t zio_compress_backoff(zio_t *zio);
+extern void zio_compress_feedback(zio_t *zio, boolean_t compressed);
+extern void zio_compress_get_stats(uint64_t *skipped, uint64_t *saved);
+
 #ifdef	__cplusplus
 }
 #endif
@@ -45,6 +45,7 @@ typedef enum zio_stage {
 
 	ZIO_STAGE_WRITE_COMPRESS,		/* -W--- */
 	ZIO_STAGE_CHECKSUM_GENERATE,		/* -W--- */
+	ZIO_STAGE_DDT_WRITE,			/* -W--- */
 
 	ZIO_STAGE_GANG_PIPELINE,		/* -WFC- */
 
@@ -77,13 +78,24 @@ typedef enum zio_stage {
 /*
  * The stages for which there's some performance value in going async.
  * When compression is enabled, ZIO_STAGE_WRITE_COMPRESS is ORed in as well.
+ * ZIO_STAGE_DDT_WRITE may have to read the dedup table in.
  */
 #define	ZIO_ASYNC_PIPELINE_STAGES				\
 	((1U << ZIO_STAGE_CHECKSUM_GENERATE) |			\
+	(1U << ZIO_STAGE_DDT_WRITE) |				\
 	(1U << ZIO_STAGE_VDEV_IO_DONE) |			\
 	(1U << ZIO_STAGE_CHECKSUM_VERIFY) |			\
 	(1U << ZIO_STAGE_READ_DECOMPRESS))
 
+/*
+ * The CPU-bound stages of a logical write.  These run on the pool's
+ * spa_zio_cpu_taskq, one thread per CPU, so that spa_sync() can
+ * compress and checksum many dirty blocks at once.
+ */
+#define	ZIO_CPU_STAGES						\
+	((1U << ZIO_STAGE_WRITE_COMPRESS) |			\
+	(1U << ZIO_STAGE_CHECKSUM_GENERATE))
+
 #define	ZIO_VDEV_IO_PIPELINE					\
 	((1U << ZIO_STAGE_VDEV_IO_START) |			\
 	(1U << ZIO_STAGE_VDEV_IO_DONE) |			\
@@ -133,7 +145,8 @@ typedef enum zio_stage {
 	ZIO_WRITE_COMMON_PIPELINE)
 
 #define	ZIO_WRITE_ALLOCATE_PIPELINE				\
-	((1U << ZIO_STAGE_DVA_ALLOCATE) |			\
+	((1U << ZIO_STAGE_DDT_WRITE) |				\
+	(1U << ZIO_STAGE_DVA_ALLOCATE) |			\
 	ZIO_WRITE_COMMON_PIPELINE)
 
 #define	ZIO_GANG_FREE_STAGES					\
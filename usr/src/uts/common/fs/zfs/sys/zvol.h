@@ -35,6 +35,9 @@
 extern "C" {
 #endif
 
+#define	ZVOL_OBJ		1ULL
+#define	ZVOL_ZAP_OBJ		2ULL
+
 #ifdef _KERNEL
 extern int zvol_check_volsize(uint64_t volsize, uint64_t blocksize);
 extern int zvol_check_volblocksize(uint64_t volblocksize);
@@ -61,7 +64,50 @@ extern int zvol_ioctl(dev_t dev, int cmd, intptr_t arg, int flag, cred_t *cr,
 extern int zvol_busy(void);
 extern void zvol_init(void);
 extern void zvol_fini(void);
-#endif
+#else	/* _KERNEL */
+
+/*
+ * Userland volume engine.  It serves a volume's blocks from libzpool
+ * the way zvol_strategy() would, for block servers and benchmarks.
+ * Requests run asynchronously on the volume's taskq and complete by
+ * calling uzr_done.
+ */
+typedef struct uzvol uzvol_t;
+
+typedef enum uzvol_op {
+	UZVOL_READ,
+	UZVOL_WRITE,
+	UZVOL_FLUSH		/* make all completed writes stable */
+} uzvol_op_t;
+
+#define	UZVOL_FUA	0x1	/* write is stable when it completes */
+#define	UZVOL_LOAN	0x2	/* read: lend the data, see uzr_loan */
+
+typedef struct uzvol_req {
+	uzvol_op_t	uzr_op;
+	int		uzr_flags;	/* UZVOL_* */
+	uint64_t	uzr_offset;
+	uint64_t	uzr_length;
+	void		*uzr_data;
+	struct dmu_loan	*uzr_loan;	/* UZVOL_LOAN; see uzvol_loan_rele() */
+	int		uzr_error;	/* set before uzr_done is called */
+	void		(*uzr_done)(struct uzvol_req *);
+	void		*uzr_private;	/* for the caller */
+	struct uzvol	*uzr_vol;	/* for the engine */
+	struct rl	*uzr_rl;	/* for the engine */
+} uzvol_req_t;
+
+extern int uzvol_create(const char *name, uint64_t volsize,
+    uint64_t volblocksize);
+extern int uzvol_open(const char *name, int nthreads, uzvol_t **zvp);
+extern void uzvol_close(uzvol_t *zv);
+extern uint64_t uzvol_size(uzvol_t *zv);
+extern uint64_t uzvol_blocksize(uzvol_t *zv);
+extern boolean_t uzvol_readonly(uzvol_t *zv);
+extern void uzvol_submit(uzvol_t *zv, uzvol_req_t *req);
+extern int uzvol_io(uzvol_t *zv, uzvol_req_t *req);
+extern void uzvol_loan_rele(uzvol_req_t *req);
+#endif	/* _KERNEL */
 
 #ifdef	__cplusplus
 }
@@ -33,11 +33,275 @@
 #include <sys/vdev_impl.h>
 #include <sys/zio.h>
 #include <sys/fs/zfs.h>
+#ifndef _KERNEL
+#include <aio.h>
+#include <fcntl.h>
+#endif
 
 /*
  * Virtual device vector for files.
  */
 
+#ifndef _KERNEL
+/*
+ * Userland asynchronous I/O.
+ *
+ * vn_rdwr() is a blocking pread()/pwrite(), so each leaf I/O would tie
+ * up an issue taskq thread and the thread count would cap the queue
+ * depth of every device.  Instead, each open file vdev gets a POSIX aio
+ * context.  vdev_file_io_start() queues a request and returns; whichever
+ * thread finds no submission under way hands everything queued so far,
+ * up to vdev_file_aio_depth in flight, to the kernel in one lio_listio().
+ * That way the I/Os vdev_queue_io_done() releases together go down
+ * together.  A reaper thread per vdev waits in aio_suspend(), and hands
+ * completions to zio_next_stage_async() as the synchronous path would.
+ *
+ * Requests the kernel refuses (the per-process aio limit is low on
+ * Mac OS X) are done synchronously by the submitter instead, and the
+ * reaper completes them like the rest.  aio_suspend() only watches what
+ * was in flight when it was called, so it also wakes up every
+ * vdev_file_aio_poll_us to pick up later submissions.
+ *
+ * vdev_file_nocache opens the file with F_NOCACHE, this platform's
+ * O_DIRECT, so that benchmarks measure the device and not the buffer
+ * cache.
+ */
+int vdev_file_aio = 1;
+int vdev_file_aio_depth = 16;
+int vdev_file_aio_poll_us = 500;
+int vdev_file_nocache = 0;
+
+typedef struct vdev_file_aio_req {
+	struct aiocb	var_cb;
+	zio_t		*var_zio;
+	list_node_t	var_node;
+	boolean_t	var_sync;	/* done by vn_rdwr(), not aio */
+	int		var_error;	/* for var_sync */
+} vdev_file_aio_req_t;
+
+typedef struct vdev_file_aio {
+	kmutex_t	va_lock;
+	kcondvar_t	va_cv;
+	vnode_t		*va_vnode;
+	list_t		va_pending;	/* not yet submitted */
+	list_t		va_inflight;	/* submitted, not yet reaped */
+	int		va_ninflight;	/* including those being submitted */
+	int		va_depth;
+	boolean_t	va_submitting;
+	boolean_t	va_exit;	/* tell the reaper to exit */
+	boolean_t	va_exited;
+	struct aiocb	**va_batch;	/* for the submitter */
+	const struct aiocb **va_wait;	/* for the reaper */
+} vdev_file_aio_t;
+
+/*
+ * Submit what is pending, in batches.  Called and returns with va_lock
+ * held, by the one thread that set va_submitting.
+ */
+static void
+vdev_file_aio_submit(vdev_file_aio_t *va)
+{
+	vdev_file_aio_req_t *req, *batch_head;
+	ssize_t resid;
+	int i, n;
+
+	ASSERT(MUTEX_HELD(&va->va_lock));
+	ASSERT(va->va_submitting);
+
+	while ((req = list_head(&va->va_pending)) != NULL &&
+	    va->va_ninflight < va->va_depth) {
+		batch_head = req;
+		for (n = 0; req != NULL && va->va_ninflight < va->va_depth;
+		    n++) {
+			va->va_batch[n] = &req->var_cb;
+			va->va_ninflight++;
+			req = list_next(&va->va_pending, req);
+		}
+		mutex_exit(&va->va_lock);
+
+		if (lio_listio(LIO_NOWAIT, va->va_batch, n, NULL) != 0) {
+			for (i = 0; i < n; i++) {
+				int error = aio_error(va->va_batch[i]);
+				if (error == EINPROGRESS || error == 0)
+					continue;
+				(void) aio_return(va->va_batch[i]);
+				req = (vdev_file_aio_req_t *)va->va_batch[i];
+				req->var_sync = B_TRUE;
+				req->var_error = vn_rdwr(
+				    req->var_zio->io_type == ZIO_TYPE_READ ?
+				    UIO_READ : UIO_WRITE, va->va_vnode,
+				    req->var_zio->io_data,
+				    req->var_zio->io_size,
+				    req->var_zio->io_offset, UIO_SYSSPACE,
+				    0, RLIM64_INFINITY, kcred, &resid);
+				if (resid != 0 && req->var_error == 0)
+					req->var_error = ENOSPC;
+			}
+		}
+
+		mutex_enter(&va->va_lock);
+		for (i = 0, req = batch_head; i < n; i++) {
+			vdev_file_aio_req_t *next =
+			    list_next(&va->va_pending, req);
+			list_remove(&va->va_pending, req);
+			list_insert_tail(&va->va_inflight, req);
+			req = next;
+		}
+		cv_broadcast(&va->va_cv);
+	}
+}
+
+static void
+vdev_file_aio_reaper(void *arg)
+{
+	vdev_file_aio_t *va = arg;
+	vdev_file_aio_req_t *req, *next;
+	struct timespec ts;
+	list_t done;
+	zio_t *zio;
+	ssize_t rv;
+	int n;
+
+	list_create(&done, sizeof (vdev_file_aio_req_t),
+	    offsetof(vdev_file_aio_req_t, var_node));
+
+	mutex_enter(&va->va_lock);
+	for (;;) {
+		while (list_head(&va->va_inflight) == NULL &&
+		    !(va->va_exit && va->va_ninflight == 0 &&
+		    list_head(&va->va_pending) == NULL))
+			cv_wait(&va->va_cv, &va->va_lock);
+		if (list_head(&va->va_inflight) == NULL)
+			break;
+
+		n = 0;
+		for (req = list_head(&va->va_inflight); req != NULL;
+		    req = list_next(&va->va_inflight, req)) {
+			if (req->var_sync) {
+				n = 0;
+				break;
+			}
+			va->va_wait[n++] = &req->var_cb;
+		}
+		mutex_exit(&va->va_lock);
+
+		if (n != 0) {
+			ts.tv_sec = 0;
+			ts.tv_nsec = vdev_file_aio_poll_us * 1000;
+			(void) aio_suspend(va->va_wait, n, &ts);
+		}
+
+		mutex_enter(&va->va_lock);
+		for (req = list_head(&va->va_inflight); req != NULL;
+		    req = next) {
+			next = list_next(&va->va_inflight, req);
+			if (!req->var_sync) {
+				req->var_error = aio_error(&req->var_cb);
+				if (req->var_error == EINPROGRESS)
+					continue;
+				rv = aio_return(&req->var_cb);
+				if (req->var_error == 0 &&
+				    rv != req->var_cb.aio_nbytes)
+					req->var_error = ENOSPC;
+			}
+			list_remove(&va->va_inflight, req);
+			list_insert_tail(&done, req);
+			va->va_ninflight--;
+		}
+		if (!va->va_submitting && list_head(&va->va_pending) != NULL) {
+			va->va_submitting = B_TRUE;
+			vdev_file_aio_submit(va);
+			va->va_submitting = B_FALSE;
+		}
+		mutex_exit(&va->va_lock);
+
+		while ((req = list_head(&done)) != NULL) {
+			list_remove(&done, req);
+			zio = req->var_zio;
+			zio->io_error = req->var_error;
+			kmem_free(req, sizeof (vdev_file_aio_req_t));
+			zio_next_stage_async(zio);
+		}
+
+		mutex_enter(&va->va_lock);
+	}
+	va->va_exited = B_TRUE;
+	cv_broadcast(&va->va_cv);
+	mutex_exit(&va->va_lock);
+
+	list_destroy(&done);
+	thread_exit();
+}
+
+static void
+vdev_file_aio_start(vdev_file_aio_t *va, zio_t *zio)
+{
+	vdev_file_aio_req_t *req;
+
+	req = kmem_zalloc(sizeof (vdev_file_aio_req_t), KM_SLEEP);
+	req->var_zio = zio;
+	req->var_cb.aio_fildes = va->va_vnode->v_fd;
+	req->var_cb.aio_buf = zio->io_data;
+	req->var_cb.aio_nbytes = zio->io_size;
+	req->var_cb.aio_offset = zio->io_offset;
+	req->var_cb.aio_lio_opcode =
+	    (zio->io_type == ZIO_TYPE_READ) ? LIO_READ : LIO_WRITE;
+	req->var_cb.aio_sigevent.sigev_notify = SIGEV_NONE;
+
+	mutex_enter(&va->va_lock);
+	list_insert_tail(&va->va_pending, req);
+	if (!va->va_submitting) {
+		va->va_submitting = B_TRUE;
+		vdev_file_aio_submit(va);
+		va->va_submitting = B_FALSE;
+	}
+	mutex_exit(&va->va_lock);
+}
+
+static vdev_file_aio_t *
+vdev_file_aio_init(vnode_t *vp)
+{
+	vdev_file_aio_t *va = kmem_zalloc(sizeof (vdev_file_aio_t), KM_SLEEP);
+
+	mutex_init(&va->va_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&va->va_cv, NULL, CV_DEFAULT, NULL);
+	list_create(&va->va_pending, sizeof (vdev_file_aio_req_t),
+	    offsetof(vdev_file_aio_req_t, var_node));
+	list_create(&va->va_inflight, sizeof (vdev_file_aio_req_t),
+	    offsetof(vdev_file_aio_req_t, var_node));
+	va->va_vnode = vp;
+	va->va_depth = MAX(vdev_file_aio_depth, 1);
+	va->va_batch = kmem_alloc(va->va_depth * sizeof (struct aiocb *),
+	    KM_SLEEP);
+	va->va_wait = kmem_alloc(va->va_depth * sizeof (struct aiocb *),
+	    KM_SLEEP);
+
+	(void) thread_create(NULL, 0, vdev_file_aio_reaper, va, 0, &p0,
+	    TS_RUN, minclsyspri);
+
+	return (va);
+}
+
+static void
+vdev_file_aio_fini(vdev_file_aio_t *va)
+{
+	mutex_enter(&va->va_lock);
+	va->va_exit = B_TRUE;
+	cv_broadcast(&va->va_cv);
+	while (!va->va_exited)
+		cv_wait(&va->va_cv, &va->va_lock);
+	mutex_exit(&va->va_lock);
+
+	kmem_free(va->va_batch, va->va_depth * sizeof (struct aiocb *));
+	kmem_free(va->va_wait, va->va_depth * sizeof (struct aiocb *));
+	list_destroy(&va->va_pending);
+	list_destroy(&va->va_inflight);
+	cv_destroy(&va->va_cv);
+	mutex_destroy(&va->va_lock);
+	kmem_free(va, sizeof (vdev_file_aio_t));
+}
+#endif	/* _KERNEL */
+
 static int
 vdev_file_open(vdev_t *vd, uint64_t *psize, uint64_t *ashift)
 {
@@ -123,6 +387,12 @@ vdev_file_open(vdev_t *vd, uint64_t *psize, uint64_t *ashift)
 #endif /* __APPLE__ */
 	*ashift = SPA_MINBLOCKSHIFT;
 
+#ifndef _KERNEL
+	if (vdev_file_nocache)
+		(void) fcntl(vp->v_fd, F_NOCACHE, 1);
+	vf->vf_aio = vdev_file_aio_init(vp);
+#endif
+
 	return (0);
 }
 
@@ -134,6 +404,11 @@ vdev_file_close(vdev_t *vd)
 	if (vf == NULL)
 		return;
 
+#ifndef _KERNEL
+	if (vf->vf_aio != NULL)
+		vdev_file_aio_fini(vf->vf_aio);
+#endif
+
 	if (vf->vf_vnode != NULL) {
 #ifdef __APPLE__
 		vfs_context_t context;
@@ -207,6 +482,13 @@ vdev_file_io_start(zio_t *zio)
 		return;
 	}
 
+#ifndef _KERNEL
+	if (vdev_file_aio && vf->vf_aio != NULL) {
+		vdev_file_aio_start(vf->vf_aio, zio);
+		return;
+	}
+#endif
+
 	zio->io_error = vn_rdwr(zio->io_type == ZIO_TYPE_READ ?
 	    UIO_READ : UIO_WRITE, vf->vf_vnode, zio->io_data,
 	    zio->io_size, zio->io_offset, UIO_SYSSPACE,
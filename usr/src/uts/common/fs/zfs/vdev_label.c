@@ -267,6 +267,17 @@ vdev_config_generate(spa_t *spa, vdev_t *vd, boolean_t getstats,
 		vdev_get_stats(vd, &vs);
 		VERIFY(nvlist_add_uint64_array(nv, ZPOOL_CONFIG_STATS,
 		    (uint64_t *)&vs, sizeof (vs) / sizeof (uint64_t)) == 0);
+
+		if (zio_latency_stats && vd->vdev_ops->vdev_op_leaf)
+			VERIFY(nvlist_add_uint64_array(nv,
+			    ZPOOL_CONFIG_VDEV_LATENCY,
+			    (uint64_t *)&vd->vdev_lat,
+			    sizeof (vdev_lat_stat_t) / sizeof (uint64_t)) == 0);
+		if (zio_latency_stats && vd == spa->spa_root_vdev &&
+		    spa->spa_lat != NULL)
+			VERIFY(nvlist_add_uint64_array(nv,
+			    ZPOOL_CONFIG_POOL_LATENCY, (uint64_t *)spa->spa_lat,
+			    sizeof (spa_lat_stat_t) / sizeof (uint64_t)) == 0);
 	}
 
 	if (!vd->vdev_ops->vdev_op_leaf) {
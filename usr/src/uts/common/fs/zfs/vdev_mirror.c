@@ -38,6 +38,7 @@
 typedef struct mirror_child {
 	vdev_t		*mc_vd;
 	uint64_t	mc_offset;
+	hrtime_t	mc_start;	/* read issued, for the EWMA */
 	int		mc_error;
 	short		mc_tried;
 	short		mc_skipped;
@@ -53,6 +54,45 @@ typedef struct mirror_map {
 
 int vdev_mirror_shift = 21;
 
+/*
+ * Reads go to the child expected to answer first: its read latency
+ * (an EWMA weighted 1/2^vdev_mirror_ewma_shift to the newest sample,
+ * at least vdev_mirror_min_lat) times one more than the I/Os ahead of
+ * it.  Only the child chosen gets a new sample, so the EWMA is halved
+ * for every vdev_mirror_decay that passes without one; a child that was
+ * slow once is picked again before long and its figure brought up to
+ * date.  For a leaf those are what its
+ * vdev_queue holds; for an interior vdev, the mirror's own reads still
+ * outstanding.  A read that continues where the child's last one ended
+ * has its cost shifted down by vdev_mirror_seq_shift, to keep sequential
+ * streams on one disk.  Equal costs fall back to the offset striping of
+ * mm_preferred.  Set vdev_mirror_load_balance to 0 for the old choice.
+ *
+ * The per-vdev EWMA and offsets are updated without a lock; they are
+ * only hints.
+ */
+int vdev_mirror_load_balance = 1;
+int vdev_mirror_ewma_shift = 3;
+uint64_t vdev_mirror_min_lat = 100000;		/* 100us */
+hrtime_t vdev_mirror_decay = NANOSEC;		/* 1s */
+int vdev_mirror_seq_shift = 1;
+
+/*
+ * A child's read latency EWMA, decayed for the time since its last sample.
+ */
+static uint64_t
+vdev_mirror_lat(vdev_t *vd, hrtime_t now)
+{
+	hrtime_t age = now - vd->vdev_mirror_stamp;
+	uint64_t lat = vd->vdev_mirror_lat;
+
+	if (age > 0 && vdev_mirror_decay > 0) {
+		age /= vdev_mirror_decay;
+		lat = age >= 64 ? 0 : lat >> age;
+	}
+	return (lat);
+}
+
 static mirror_map_t *
 vdev_mirror_map_alloc(zio_t *zio)
 {
@@ -169,6 +209,23 @@ static void
 vdev_mirror_child_done(zio_t *zio)
 {
 	mirror_child_t *mc = zio->io_private;
+	vdev_t *vd = mc->mc_vd;
+	hrtime_t now;
+	uint64_t lat;
+	int64_t delta;
+
+	if (mc->mc_start != 0) {
+		atomic_add_32(&vd->vdev_mirror_inflight, -1);
+		if (zio->io_error == 0) {
+			now = gethrtime();
+			lat = vdev_mirror_lat(vd, now);
+			delta = (int64_t)(now - mc->mc_start) - (int64_t)lat;
+			vd->vdev_mirror_lat =
+			    lat + delta / (1 << vdev_mirror_ewma_shift);
+			vd->vdev_mirror_stamp = now;
+		}
+		mc->mc_start = 0;
+	}
 
 	mc->mc_error = zio->io_error;
 	mc->mc_tried = 1;
@@ -203,8 +260,33 @@ vdev_mirror_repair_done(zio_t *zio)
 }
 
 /*
- * Try to find a child whose DTL doesn't contain the block we want to read.
- * If we can't, try the read on any vdev we haven't already tried.
+ * The expected time for a child to serve a read; see above.
+ */
+static uint64_t
+vdev_mirror_load(mirror_child_t *mc)
+{
+	vdev_t *vd = mc->mc_vd;
+	vdev_queue_t *vq = &vd->vdev_queue;
+	uint64_t pending, load;
+
+	if (vd->vdev_ops->vdev_op_leaf)
+		pending = avl_numnodes(&vq->vq_deadline_tree) +
+		    avl_numnodes(&vq->vq_pending_tree);
+	else
+		pending = vd->vdev_mirror_inflight;
+
+	load = MAX(vdev_mirror_lat(vd, gethrtime()), vdev_mirror_min_lat) *
+	    (pending + 1);
+	if (mc->mc_offset == vd->vdev_mirror_next)
+		load >>= vdev_mirror_seq_shift;
+
+	return (load);
+}
+
+/*
+ * Try to find a child whose DTL doesn't contain the block we want to read,
+ * the least loaded one if there are several.  If we can't, try the read on
+ * any vdev we haven't already tried.
  */
 static int
 vdev_mirror_child_select(zio_t *zio)
@@ -212,7 +294,8 @@ vdev_mirror_child_select(zio_t *zio)
 	mirror_map_t *mm = zio->io_vsd;
 	mirror_child_t *mc;
 	uint64_t txg = zio->io_txg;
-	int i, c;
+	uint64_t load, best_load = 0;
+	int i, c, best = -1;
 
 	ASSERT(zio->io_bp == NULL || zio->io_bp->blk_birth == txg);
 
@@ -233,12 +316,23 @@ vdev_mirror_child_select(zio_t *zio)
 			mc->mc_skipped = 1;
 			continue;
 		}
-		if (!vdev_dtl_contains(&mc->mc_vd->vdev_dtl_map, txg, 1))
-			return (c);
+		if (!vdev_dtl_contains(&mc->mc_vd->vdev_dtl_map, txg, 1)) {
+			if (mm->mm_replacing || !vdev_mirror_load_balance)
+				return (c);
+			load = vdev_mirror_load(mc);
+			if (best == -1 || load < best_load) {
+				best = c;
+				best_load = load;
+			}
+			continue;
+		}
 		mc->mc_error = ESTALE;
 		mc->mc_skipped = 1;
 	}
 
+	if (best != -1)
+		return (best);
+
 	/*
 	 * Every device is either missing or has this txg in its DTL.
 	 * Look for any child we haven't already tried before giving up.
@@ -307,6 +401,13 @@ vdev_mirror_io_start(zio_t *zio)
 		}
 	}
 
+	if (zio->io_type == ZIO_TYPE_READ && children != 0) {
+		mc = &mm->mm_child[c];
+		mc->mc_vd->vdev_mirror_next = mc->mc_offset + zio->io_size;
+		atomic_add_32(&mc->mc_vd->vdev_mirror_inflight, 1);
+		mc->mc_start = gethrtime();
+	}
+
 	while (children--) {
 		mc = &mm->mm_child[c];
 		zio_nowait(zio_vdev_child_io(zio, zio->io_bp,
@@ -137,6 +137,8 @@ vdev_queue_fini(vdev_t *vd)
 static void
 vdev_queue_io_add(vdev_queue_t *vq, zio_t *zio)
 {
+	if (zio->io_stage_ts != 0)
+		zio->io_queued_ts = gethrtime();
 	avl_add(&vq->vq_deadline_tree, zio);
 	avl_add(zio->io_vdev_tree, zio);
 }
@@ -148,6 +150,21 @@ vdev_queue_io_remove(vdev_queue_t *vq, zio_t *zio)
 	avl_remove(zio->io_vdev_tree, zio);
 }
 
+/*
+ * Account the time a zio waited in the queue and, if latency stats are
+ * on, start the clock on the zio that actually goes to the device,
+ * which for an aggregated I/O is the aggregate.
+ */
+static void
+vdev_queue_io_issued(zio_t *zio, zio_t *nio)
+{
+	if (zio->io_queued_ts != 0)
+		zio_latency_add(zio->io_vd->vdev_lat.vl_queue[zio->io_type],
+		    zio->io_queued_ts);
+	if (zio_latency_stats)
+		nio->io_issued_ts = gethrtime();
+}
+
 static void
 vdev_queue_agg_io_done(zio_t *aio)
 {
@@ -232,6 +249,7 @@ vdev_queue_io_to_issue(vdev_queue_t *vq, uint64_t pending_limit,
 				bcopy(dio->io_data, buf + offset, dio->io_size);
 			offset += dio->io_size;
 			vdev_queue_io_remove(vq, dio);
+			vdev_queue_io_issued(dio, aio);
 			zio_vdev_io_bypass(dio);
 			nagg++;
 		}
@@ -251,6 +269,7 @@ vdev_queue_io_to_issue(vdev_queue_t *vq, uint64_t pending_limit,
 
 	ASSERT(fio->io_vdev_tree == tree);
 	vdev_queue_io_remove(vq, fio);
+	vdev_queue_io_issued(fio, fio);
 
 	avl_add(&vq->vq_pending_tree, fio);
 
@@ -308,6 +327,10 @@ vdev_queue_io_done(zio_t *zio)
 
 	avl_remove(&vq->vq_pending_tree, zio);
 
+	if (zio->io_issued_ts != 0)
+		zio_latency_add(zio->io_vd->vdev_lat.vl_disk[zio->io_type],
+		    zio->io_issued_ts);
+
 	for (i = 0; i < zfs_vdev_ramp_rate; i++) {
 		nio = vdev_queue_io_to_issue(vq, zfs_vdev_max_pending, &func);
 		if (nio == NULL)
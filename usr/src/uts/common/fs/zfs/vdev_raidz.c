@@ -33,6 +33,7 @@
 #include <sys/zio_checksum.h>
 #include <sys/fs/zfs.h>
 #include <sys/fm/fs/zfs.h>
+#include <sys/kstat.h>
 
 /*
  * Virtual device vector for RAID-Z.
@@ -100,6 +101,54 @@ typedef struct raidz_map {
 
 #define	VDEV_RAIDZ_MAXPARITY	2
 
+/*
+ * How reads get their data back, for the raidzstats kstat.  A healthy
+ * read is satisfied from the data columns alone ("normal"); the rest
+ * needed parity, either to rebuild columns that were known to be
+ * missing (reconstruct_*) or, when the data still failed its checksum,
+ * by combinatorial reconstruction (combrec_*).
+ */
+typedef struct raidz_stats {
+	kstat_named_t raidzstat_normal;
+	kstat_named_t raidzstat_reconstruct_p;
+	kstat_named_t raidzstat_reconstruct_q;
+	kstat_named_t raidzstat_reconstruct_pq;
+	kstat_named_t raidzstat_extra_reads;
+	kstat_named_t raidzstat_parity_mismatch;
+	kstat_named_t raidzstat_combrec_attempts;
+	kstat_named_t raidzstat_combrec_p;
+	kstat_named_t raidzstat_combrec_q;
+	kstat_named_t raidzstat_combrec_pq;
+	kstat_named_t raidzstat_combrec_failed;
+} raidz_stats_t;
+
+static raidz_stats_t raidz_stats = {
+	{ "normal",			KSTAT_DATA_UINT64 },
+	{ "reconstruct_p",		KSTAT_DATA_UINT64 },
+	{ "reconstruct_q",		KSTAT_DATA_UINT64 },
+	{ "reconstruct_pq",		KSTAT_DATA_UINT64 },
+	{ "extra_reads",		KSTAT_DATA_UINT64 },
+	{ "parity_mismatch",		KSTAT_DATA_UINT64 },
+	{ "combrec_attempts",		KSTAT_DATA_UINT64 },
+	{ "combrec_p",			KSTAT_DATA_UINT64 },
+	{ "combrec_q",			KSTAT_DATA_UINT64 },
+	{ "combrec_pq",			KSTAT_DATA_UINT64 },
+	{ "combrec_failed",		KSTAT_DATA_UINT64 }
+};
+
+#define	RAIDZSTAT_BUMP(stat)	atomic_add_64(&raidz_stats.stat.value.ui64, 1)
+
+/*
+ * Per-column repair counts, indexed by column within the map (parity
+ * first), exported raw as the raidzcols kstat: the number of reads
+ * that got good data back despite an error in that column.  Columns
+ * past the end are counted in the last slot.
+ */
+static uint64_t raidz_col_repairs[VDEV_RAIDZ_STAT_COLS];
+
+static kstat_t *raidz_ksp;
+static kstat_t *raidz_col_ksp;
+
 #define	VDEV_RAIDZ_MUL_2(a)	(((a) << 1) ^ (((a) & 0x80) ? 0x1d : 0))
 
 /*
@@ -648,7 +697,7 @@ vdev_raidz_io_start(zio_t *zio)
 	blkptr_t *bp = zio->io_bp;
 	raidz_map_t *rm;
 	raidz_col_t *rc;
-	int c;
+	int c, n;
 
 	rm = vdev_raidz_map_alloc(zio, tvd->vdev_ashift, vd->vdev_children,
 	    vd->vdev_nparity);
@@ -680,8 +729,7 @@ vdev_raidz_io_start(zio_t *zio)
 
 	/*
 	 * Iterate over the columns in reverse order so that we hit the parity
-	 * last -- any errors along the way will force us to read the parity
-	 * data.
+	 * last -- by then we know how many data columns can't be read.
 	 */
 	for (c = rm->rm_cols - 1; c >= 0; c--) {
 		rc = &rm->rm_col[c];
@@ -705,8 +753,7 @@ vdev_raidz_io_start(zio_t *zio)
 			rc->rc_skipped = 1;
 			continue;
 		}
-		if (c >= rm->rm_firstdatacol || rm->rm_missingdata > 0 ||
-		    (zio->io_flags & ZIO_FLAG_SCRUB)) {
+		if (c >= rm->rm_firstdatacol) {
 			zio_nowait(zio_vdev_child_io(zio, NULL, cvd,
 			    rc->rc_offset, rc->rc_data, rc->rc_size,
 			    zio->io_type, zio->io_priority, ZIO_FLAG_CANFAIL,
@@ -714,6 +761,27 @@ vdev_raidz_io_start(zio_t *zio)
 		}
 	}
 
+	/*
+	 * Read only as many parity columns as there are data columns missing,
+	 * P before Q, since P is the cheaper one to reconstruct from.  A
+	 * healthy read touches no parity at all; should the data turn out to
+	 * be bad, vdev_raidz_io_done() reads whatever parity is left.  Scrubs
+	 * read all of it so that it gets verified.
+	 */
+	for (c = 0, n = 0; c < rm->rm_firstdatacol; c++) {
+		rc = &rm->rm_col[c];
+		if (rc->rc_skipped)
+			continue;
+		if (n == rm->rm_missingdata &&
+		    !(zio->io_flags & ZIO_FLAG_SCRUB))
+			break;
+		zio_nowait(zio_vdev_child_io(zio, NULL,
+		    vd->vdev_child[rc->rc_devidx], rc->rc_offset, rc->rc_data,
+		    rc->rc_size, zio->io_type, zio->io_priority,
+		    ZIO_FLAG_CANFAIL, vdev_raidz_child_done, rc));
+		n++;
+	}
+
 	zio_wait_children_done(zio);
 }
 
@@ -771,6 +839,7 @@ raidz_parity_verify(zio_t *zio, raidz_map_t *rm)
 		if (bcmp(orig[c], rc->rc_data, rc->rc_size) != 0) {
 			raidz_checksum_error(zio, rc);
 			rc->rc_error = ECKSUM;
+			RAIDZSTAT_BUMP(raidzstat_parity_mismatch);
 			ret++;
 		}
 		zio_buf_free(orig[c], rc->rc_size);
@@ -779,9 +848,174 @@ raidz_parity_verify(zio_t *zio, raidz_map_t *rm)
 	return (ret);
 }
 
-static uint64_t raidz_corrected_p;
-static uint64_t raidz_corrected_q;
-static uint64_t raidz_corrected_pq;
+/*
+ * Save or restore the contents of the target columns of a reconstruction
+ * attempt.
+ */
+static void
+vdev_raidz_cols_save(raidz_map_t *rm, int *tgt, int ntgt, void **orig)
+{
+	int i;
+
+	for (i = 0; i < ntgt; i++)
+		bcopy(rm->rm_col[tgt[i]].rc_data, orig[i],
+		    rm->rm_col[tgt[i]].rc_size);
+}
+
+static void
+vdev_raidz_cols_restore(raidz_map_t *rm, int *tgt, int ntgt, void **orig)
+{
+	int i;
+
+	for (i = 0; i < ntgt; i++)
+		bcopy(orig[i], rm->rm_col[tgt[i]].rc_data,
+		    rm->rm_col[tgt[i]].rc_size);
+}
+
+/*
+ * Rebuild the target data columns from the given parity (both P and Q
+ * for two columns) and see whether the block checksums.
+ */
+static int
+vdev_raidz_combrec_try(zio_t *zio, raidz_map_t *rm, int *tgt, int ntgt,
+    int parity)
+{
+	RAIDZSTAT_BUMP(raidzstat_combrec_attempts);
+
+	if (ntgt == 2)
+		vdev_raidz_reconstruct_pq(rm, tgt[0], tgt[1]);
+	else if (parity == VDEV_RAIDZ_P)
+		vdev_raidz_reconstruct_p(rm, tgt[0]);
+	else
+		vdev_raidz_reconstruct_q(rm, tgt[0]);
+
+	return (zio_checksum_error(zio));
+}
+
+/*
+ * Combinatorial reconstruction, for when every column has been read and
+ * the data still doesn't checksum, so something returned bad data
+ * without saying so.  The candidate sets of data columns are tried in a
+ * fixed order: single columns before pairs and, within those, in column
+ * order, with every data column that reported an error in each set.  A
+ * single column is rebuilt from P and then from Q, a pair from both, so
+ * there are at most 2 * ndata + ndata * (ndata - 1) / 2 attempts, less
+ * the one vdev_raidz_io_done() has already made for the known errors.
+ * Only the columns in hand are used; nothing is read again.  Returns 0
+ * with the rebuilt columns marked ECKSUM, or ECKSUM with the data as it
+ * was.
+ */
+static int
+vdev_raidz_combrec(zio_t *zio, raidz_map_t *rm)
+{
+	raidz_col_t *rc;
+	void *orig[VDEV_RAIDZ_MAXPARITY];
+	int tgt[VDEV_RAIDZ_MAXPARITY];
+	int known = -1, nknown = 0, ngood = 0, used;
+	int c, c1, i, p, n;
+	uint64_t size = rm->rm_col[VDEV_RAIDZ_P].rc_size;
+
+	for (p = 0; p < rm->rm_firstdatacol; p++) {
+		ASSERT(rm->rm_col[p].rc_tried || rm->rm_col[p].rc_error);
+		if (rm->rm_col[p].rc_error == 0)
+			ngood++;
+	}
+	for (c = rm->rm_firstdatacol; c < rm->rm_cols; c++) {
+		if (rm->rm_col[c].rc_error != 0) {
+			known = c;
+			nknown++;
+		}
+	}
+
+	/*
+	 * vdev_raidz_io_done() only calls us when the known errors leave a
+	 * parity column to spare; otherwise there'd be nothing left to try.
+	 */
+	ASSERT(nknown < ngood);
+
+	/*
+	 * The parity vdev_raidz_io_done() used for a single known error.
+	 */
+	used = (rm->rm_col[VDEV_RAIDZ_P].rc_error == 0) ?
+	    VDEV_RAIDZ_P : VDEV_RAIDZ_Q;
+
+	for (i = 0; i < ngood; i++)
+		orig[i] = zio_buf_alloc(size);
+
+	/*
+	 * Single columns, from each good parity column in turn.
+	 */
+	n = 1;
+	for (c = rm->rm_firstdatacol; c < rm->rm_cols; c++) {
+		if (nknown != 0 && c != known)
+			continue;
+		tgt[0] = c;
+		vdev_raidz_cols_save(rm, tgt, n, orig);
+		for (p = 0; p < rm->rm_firstdatacol; p++) {
+			if (rm->rm_col[p].rc_error != 0 ||
+			    (nknown != 0 && p == used))
+				continue;
+			if (vdev_raidz_combrec_try(zio, rm, tgt, n, p) == 0)
+				goto found;
+			vdev_raidz_cols_restore(rm, tgt, n, orig);
+		}
+	}
+
+	/*
+	 * Pairs of columns, from P and Q together.
+	 */
+	n = 2;
+	p = VDEV_RAIDZ_Q;
+	if (ngood == 2) {
+		for (c = rm->rm_firstdatacol; c < rm->rm_cols - 1; c++) {
+			for (c1 = c + 1; c1 < rm->rm_cols; c1++) {
+				if (nknown != 0 && c != known && c1 != known)
+					continue;
+				tgt[0] = c;
+				tgt[1] = c1;
+				vdev_raidz_cols_save(rm, tgt, n, orig);
+				if (vdev_raidz_combrec_try(zio, rm, tgt, n,
+				    p) == 0)
+					goto found;
+				vdev_raidz_cols_restore(rm, tgt, n, orig);
+			}
+		}
+	}
+
+	for (i = 0; i < ngood; i++)
+		zio_buf_free(orig[i], size);
+	RAIDZSTAT_BUMP(raidzstat_combrec_failed);
+	return (ECKSUM);
+
+found:
+	for (i = 0; i < ngood; i++)
+		zio_buf_free(orig[i], size);
+
+	if (n == 2)
+		RAIDZSTAT_BUMP(raidzstat_combrec_pq);
+	else if (p == VDEV_RAIDZ_P)
+		RAIDZSTAT_BUMP(raidzstat_combrec_p);
+	else
+		RAIDZSTAT_BUMP(raidzstat_combrec_q);
+
+	/*
+	 * If these children didn't know they returned bad data, inform them.
+	 */
+	for (i = 0; i < n; i++) {
+		rc = &rm->rm_col[tgt[i]];
+		if (rc->rc_tried && rc->rc_error == 0)
+			raidz_checksum_error(zio, rc);
+		rc->rc_error = ECKSUM;
+	}
+
+	/*
+	 * The parity we didn't reconstruct from may be what was bad all
+	 * along; check it against the good data so that it gets repaired.
+	 */
+	(void) raidz_parity_verify(zio, rm);
+
+	return (0);
+}
 
 static void
 vdev_raidz_io_done(zio_t *zio)
@@ -789,7 +1023,7 @@ vdev_raidz_io_done(zio_t *zio)
 	vdev_t *vd = zio->io_vd;
 	vdev_t *cvd;
 	raidz_map_t *rm = zio->io_vsd;
-	raidz_col_t *rc, *rc1;
+	raidz_col_t *rc;
 	int unexpected_errors = 0;
 	int parity_errors = 0;
 	int parity_untried = 0;
@@ -848,7 +1082,7 @@ vdev_raidz_io_done(zio_t *zio)
 	/*
 	 * There are three potential phases for a read:
 	 *	1. produce valid data from the columns read
-	 *	2. read all disks and try again
+	 *	2. read the columns not yet read and try again
 	 *	3. perform combinatorial reconstruction
 	 *
 	 * Each phase is progressively both more expensive and less likely to
@@ -867,6 +1101,7 @@ vdev_raidz_io_done(zio_t *zio)
 		case 0:
 			if (zio_checksum_error(zio) == 0) {
 				zio->io_error = 0;
+				RAIDZSTAT_BUMP(raidzstat_normal);
 
 				/*
 				 * If we read parity information (unnecessarily
@@ -890,13 +1125,13 @@ vdev_raidz_io_done(zio_t *zio)
 
 		case 1:
 			/*
-			 * We either attempt to read all the parity columns or
-			 * none of them. If we didn't try to read parity, we
-			 * wouldn't be here in the correctable case. There must
-			 * also have been fewer parity errors than parity
-			 * columns or, again, we wouldn't be in this code path.
+			 * We read at least one parity column, P unless it's
+			 * missing, or we wouldn't be here in the correctable
+			 * case. There must also have been fewer parity errors
+			 * than parity columns or, again, we wouldn't be in
+			 * this code path.
 			 */
-			ASSERT(parity_untried == 0);
+			ASSERT(parity_untried < rm->rm_firstdatacol);
 			ASSERT(parity_errors < rm->rm_firstdatacol);
 
 			/*
@@ -912,18 +1147,20 @@ vdev_raidz_io_done(zio_t *zio)
 			    rc->rc_error == ESTALE);
 
 			if (rm->rm_col[VDEV_RAIDZ_P].rc_error == 0) {
+				ASSERT(rm->rm_col[VDEV_RAIDZ_P].rc_tried);
 				vdev_raidz_reconstruct_p(rm, c);
 			} else {
 				ASSERT(rm->rm_firstdatacol > 1);
+				ASSERT(rm->rm_col[VDEV_RAIDZ_Q].rc_tried);
 				vdev_raidz_reconstruct_q(rm, c);
 			}
 
 			if (zio_checksum_error(zio) == 0) {
 				zio->io_error = 0;
 				if (rm->rm_col[VDEV_RAIDZ_P].rc_error == 0)
-					atomic_inc_64(&raidz_corrected_p);
+					RAIDZSTAT_BUMP(raidzstat_reconstruct_p);
 				else
-					atomic_inc_64(&raidz_corrected_q);
+					RAIDZSTAT_BUMP(raidzstat_reconstruct_q);
 
 				/*
 				 * If there's more than one parity disk that
@@ -939,7 +1176,8 @@ vdev_raidz_io_done(zio_t *zio)
 				 * so we can write it out to the failed device
 				 * later.
 				 */
-				if (parity_errors < rm->rm_firstdatacol - 1 ||
+				if (parity_errors + parity_untried <
+				    rm->rm_firstdatacol - 1 ||
 				    (zio->io_flags & ZIO_FLAG_RESILVER)) {
 					n = raidz_parity_verify(zio, rm);
 					unexpected_errors += n;
@@ -982,7 +1220,7 @@ vdev_raidz_io_done(zio_t *zio)
 
 			if (zio_checksum_error(zio) == 0) {
 				zio->io_error = 0;
-				atomic_inc_64(&raidz_corrected_pq);
+				RAIDZSTAT_BUMP(raidzstat_reconstruct_pq);
 
 				goto done;
 			}
@@ -996,10 +1234,12 @@ vdev_raidz_io_done(zio_t *zio)
 
 	/*
 	 * This isn't a typical situation -- either we got a read error or
-	 * a child silently returned bad data. Read every block so we can
-	 * try again with as much data and parity as we can track down. If
-	 * we've already been through once before, all children will be marked
-	 * as tried so we'll proceed to combinatorial reconstruction.
+	 * a child silently returned bad data. Read the columns we haven't
+	 * read yet, usually the parity we skipped, so we can try again with
+	 * as much data and parity as we can track down; the columns already
+	 * in hand are kept, not read again. If we've already been through
+	 * once before, all children will be marked as tried so we'll proceed
+	 * to combinatorial reconstruction.
 	 */
 	unexpected_errors = 1;
 	rm->rm_missingdata = 0;
@@ -1015,6 +1255,7 @@ vdev_raidz_io_done(zio_t *zio)
 			rc = &rm->rm_col[c];
 			if (rc->rc_tried)
 				continue;
+			RAIDZSTAT_BUMP(raidzstat_extra_reads);
 			zio_nowait(zio_vdev_child_io(zio, NULL,
 			    vd->vdev_child[rc->rc_devidx],
 			    rc->rc_offset, rc->rc_data, rc->rc_size,
@@ -1039,119 +1280,9 @@ vdev_raidz_io_done(zio_t *zio)
 		goto done;
 	}
 
-	if (rm->rm_col[VDEV_RAIDZ_P].rc_error == 0) {
-		/*
-		 * Attempt to reconstruct the data from parity P.
-		 */
-		for (c = rm->rm_firstdatacol; c < rm->rm_cols; c++) {
-			void *orig;
-			rc = &rm->rm_col[c];
-
-			orig = zio_buf_alloc(rc->rc_size);
-			bcopy(rc->rc_data, orig, rc->rc_size);
-			vdev_raidz_reconstruct_p(rm, c);
-
-			if (zio_checksum_error(zio) == 0) {
-				zio_buf_free(orig, rc->rc_size);
-				zio->io_error = 0;
-				atomic_inc_64(&raidz_corrected_p);
-
-				/*
-				 * If this child didn't know that it returned
-				 * bad data, inform it.
-				 */
-				if (rc->rc_tried && rc->rc_error == 0)
-					raidz_checksum_error(zio, rc);
-				rc->rc_error = ECKSUM;
-				goto done;
-			}
-
-			bcopy(orig, rc->rc_data, rc->rc_size);
-			zio_buf_free(orig, rc->rc_size);
-		}
-	}
-
-	if (rm->rm_firstdatacol > 1 && rm->rm_col[VDEV_RAIDZ_Q].rc_error == 0) {
-		/*
-		 * Attempt to reconstruct the data from parity Q.
-		 */
-		for (c = rm->rm_firstdatacol; c < rm->rm_cols; c++) {
-			void *orig;
-			rc = &rm->rm_col[c];
-
-			orig = zio_buf_alloc(rc->rc_size);
-			bcopy(rc->rc_data, orig, rc->rc_size);
-			vdev_raidz_reconstruct_q(rm, c);
-
-			if (zio_checksum_error(zio) == 0) {
-				zio_buf_free(orig, rc->rc_size);
-				zio->io_error = 0;
-				atomic_inc_64(&raidz_corrected_q);
-
-				/*
-				 * If this child didn't know that it returned
-				 * bad data, inform it.
-				 */
-				if (rc->rc_tried && rc->rc_error == 0)
-					raidz_checksum_error(zio, rc);
-				rc->rc_error = ECKSUM;
-				goto done;
-			}
-
-			bcopy(orig, rc->rc_data, rc->rc_size);
-			zio_buf_free(orig, rc->rc_size);
-		}
-	}
-
-	if (rm->rm_firstdatacol > 1 &&
-	    rm->rm_col[VDEV_RAIDZ_P].rc_error == 0 &&
-	    rm->rm_col[VDEV_RAIDZ_Q].rc_error == 0) {
-		/*
-		 * Attempt to reconstruct the data from both P and Q.
-		 */
-		for (c = rm->rm_firstdatacol; c < rm->rm_cols - 1; c++) {
-			void *orig, *orig1;
-			rc = &rm->rm_col[c];
-
-			orig = zio_buf_alloc(rc->rc_size);
-			bcopy(rc->rc_data, orig, rc->rc_size);
-
-			for (c1 = c + 1; c1 < rm->rm_cols; c1++) {
-				rc1 = &rm->rm_col[c1];
-
-				orig1 = zio_buf_alloc(rc1->rc_size);
-				bcopy(rc1->rc_data, orig1, rc1->rc_size);
-
-				vdev_raidz_reconstruct_pq(rm, c, c1);
-
-				if (zio_checksum_error(zio) == 0) {
-					zio_buf_free(orig, rc->rc_size);
-					zio_buf_free(orig1, rc1->rc_size);
-					zio->io_error = 0;
-					atomic_inc_64(&raidz_corrected_pq);
-
-					/*
-					 * If these children didn't know they
-					 * returned bad data, inform them.
-					 */
-					if (rc->rc_tried && rc->rc_error == 0)
-						raidz_checksum_error(zio, rc);
-					if (rc1->rc_tried && rc1->rc_error == 0)
-						raidz_checksum_error(zio, rc1);
-
-					rc->rc_error = ECKSUM;
-					rc1->rc_error = ECKSUM;
-
-					goto done;
-				}
-
-				bcopy(orig1, rc1->rc_data, rc1->rc_size);
-				zio_buf_free(orig1, rc1->rc_size);
-			}
-
-			bcopy(orig, rc->rc_data, rc->rc_size);
-			zio_buf_free(orig, rc->rc_size);
-		}
+	if (vdev_raidz_combrec(zio, rm) == 0) {
+		zio->io_error = 0;
+		goto done;
 	}
 
 	/*
@@ -1171,6 +1302,14 @@ vdev_raidz_io_done(zio_t *zio)
 done:
 	zio_checksum_verified(zio);
 
+	if (zio->io_error == 0) {
+		for (c = 0; c < rm->rm_cols; c++) {
+			if (rm->rm_col[c].rc_error != 0)
+				atomic_add_64(&raidz_col_repairs[MIN(c,
+				    VDEV_RAIDZ_STAT_COLS - 1)], 1);
+		}
+	}
+
 	if (zio->io_error == 0 && (spa_mode & FWRITE) &&
 	    (unexpected_errors || (zio->io_flags & ZIO_FLAG_RESILVER))) {
 		zio_t *rio;
@@ -1235,3 +1374,49 @@ vdev_ops_t vdev_raidz_ops = {
 	VDEV_TYPE_RAIDZ,	/* name of this vdev type */
 	B_FALSE			/* not a leaf vdev */
 };
+
+void
+vdev_raidz_stat_init(void)
+{
+	raidz_ksp = kstat_create("zfs", 0, "raidzstats", "misc",
+	    KSTAT_TYPE_NAMED, sizeof (raidz_stats) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL);
+	if (raidz_ksp != NULL) {
+		raidz_ksp->ks_data = &raidz_stats;
+		kstat_install(raidz_ksp);
+	}
+
+	raidz_col_ksp = kstat_create("zfs", 0, "raidzcols", "misc",
+	    KSTAT_TYPE_RAW, 1, KSTAT_FLAG_VIRTUAL);
+	if (raidz_col_ksp != NULL) {
+		raidz_col_ksp->ks_data = raidz_col_repairs;
+		raidz_col_ksp->ks_data_size = sizeof (raidz_col_repairs);
+		kstat_install(raidz_col_ksp);
+	}
+}
+
+void
+vdev_raidz_stat_fini(void)
+{
+	if (raidz_ksp != NULL) {
+		kstat_delete(raidz_ksp);
+		raidz_ksp = NULL;
+	}
+	if (raidz_col_ksp != NULL) {
+		kstat_delete(raidz_col_ksp);
+		raidz_col_ksp = NULL;
+	}
+}
+
+/*
+ * Copy out the per-column repair counts; repairs must have room for
+ * VDEV_RAIDZ_STAT_COLS of them.
+ */
+void
+vdev_raidz_col_repairs(uint64_t *repairs)
+{
+	int c;
+
+	for (c = 0; c < VDEV_RAIDZ_STAT_COLS; c++)
+		repairs[c] = raidz_col_repairs[c];
+}
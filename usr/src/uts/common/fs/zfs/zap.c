@@ -391,6 +391,8 @@ zap_create_leaf(zap_t *zap, dmu_tx_t *tx)
 	l->l_blkid = zap_allocate_blocks(zap, 1);
 	l->l_dbuf = NULL;
 	l->l_phys = NULL;
+	l->l_index = NULL;
+	l->l_index_lookups = 0;
 
 	VERIFY(0 == dmu_buf_hold(zap->zap_objset, zap->zap_object,
 	    l->l_blkid << FZAP_BLOCK_SHIFT(zap), NULL, &l->l_dbuf));
@@ -432,6 +434,7 @@ zap_leaf_pageout(dmu_buf_t *db, void *vl)
 {
 	zap_leaf_t *l = vl;
 
+	zap_leaf_index_free(l);
 	rw_destroy(&l->l_rwlock);
 	kmem_free(l, sizeof (zap_leaf_t));
 }
@@ -450,6 +453,8 @@ zap_open_leaf(uint64_t blkid, dmu_buf_t *db)
 	l->l_bs = highbit(db->db_size)-1;
 	l->l_dbuf = db;
 	l->l_phys = NULL;
+	l->l_index = NULL;
+	l->l_index_lookups = 0;
 
 	winner = dmu_buf_set_user(db, l, &l->l_phys, zap_leaf_pageout);
 
@@ -739,7 +744,7 @@ fzap_lookup(zap_t *zap, const char *name,
 	err = zap_deref_leaf(zap, hash, NULL, RW_READER, &l);
 	if (err != 0)
 		return (err);
-	err = zap_leaf_lookup(l, name, hash, &zeh);
+	err = zap_leaf_lookup_index(l, name, hash, &zeh);
 	if (err == 0)
 		err = zap_entry_read(&zeh, integer_size, num_integers, buf);
 
@@ -896,6 +901,90 @@ fzap_remove(zap_t *zap, const char *name, dmu_tx_t *tx)
 	return (err);
 }
 
+/*
+ * Apply a batch of adds, updates or removes, sorted by hash.  Names
+ * that hash to the same leaf are contiguous in the batch, so each leaf
+ * is held (and dirtied) once rather than once per name.
+ */
+int
+fzap_batch(zap_t *zap, zap_batch_op_t op, zap_batch_ent_t *zbe, int count,
+    int integer_size, uint64_t num_integers, dmu_tx_t *tx)
+{
+	zap_leaf_t *l = NULL;
+	zap_entry_handle_t zeh;
+	int i, err, delta = 0, rv = 0;
+
+	ASSERT(RW_LOCK_HELD(&zap->zap_rwlock));
+	ASSERT(!zap->zap_ismicro);
+
+	for (i = 0; i < count; i++, zbe++) {
+		uint64_t hash = zbe->zbe_hash;
+
+		if (op != ZAP_BATCH_REMOVE) {
+			err = fzap_checksize(zbe->zbe_name,
+			    integer_size, num_integers);
+			if (err != 0) {
+				rv = err;
+				break;
+			}
+		}
+
+		if (l != NULL && ZAP_HASH_IDX(hash,
+		    l->l_phys->l_hdr.lh_prefix_len) !=
+		    l->l_phys->l_hdr.lh_prefix) {
+			zap_put_leaf_maybe_grow_ptrtbl(zap, l, tx);
+			l = NULL;
+		}
+		if (l == NULL) {
+			err = zap_deref_leaf(zap, hash, tx, RW_WRITER, &l);
+			if (err != 0) {
+				l = NULL;
+				rv = err;
+				break;
+			}
+		}
+retry:
+		err = zap_leaf_lookup(l, zbe->zbe_name, hash, &zeh);
+		if (op == ZAP_BATCH_REMOVE) {
+			if (err == 0) {
+				zap_entry_remove(&zeh);
+				delta--;
+			}
+		} else if (err == ENOENT) {
+			err = zap_entry_create(l, zbe->zbe_name, hash,
+			    ZAP_MAXCD, integer_size, num_integers,
+			    zbe->zbe_val, &zeh);
+			if (err == 0)
+				delta++;
+		} else if (err == 0 && op == ZAP_BATCH_UPDATE) {
+			err = zap_entry_update(&zeh,
+			    integer_size, num_integers, zbe->zbe_val);
+		} else if (err == 0) {
+			err = EEXIST;
+		}
+
+		if (err == EAGAIN) {
+			err = zap_expand_leaf(zap, l, hash, tx, &l);
+			if (err == 0)
+				goto retry;
+		}
+
+		if (err == EEXIST || err == ENOENT) {
+			if (rv == 0)
+				rv = err;
+		} else if (err != 0) {
+			rv = err;
+			break;
+		}
+	}
+
+	if (delta != 0)
+		zap_increment_num_entries(zap, delta, tx);
+	if (l != NULL)
+		zap_put_leaf_maybe_grow_ptrtbl(zap, l, tx);
+	return (rv);
+}
+
 int
 zap_value_search(objset_t *os, uint64_t zapobj, uint64_t value, uint64_t mask,
     char *name)
@@ -49,6 +49,14 @@
 
 #define	LEAF_HASH_ENTPTR(l, h) (&(l)->l_phys->l_hash[LEAF_HASH(l, h)])
 
+/*
+ * A leaf is given an in-core index (see zap_leaf_index_t) once it has
+ * been looked up this many times without its entries changing.  Leaves
+ * that are modified as often as they are read are never indexed.
+ */
+int zap_leaf_index_disable = 0;
+int zap_leaf_index_min_lookups = 8;
+
 
 static void
 zap_memset(void *a, int c, size_t n)
@@ -386,6 +394,148 @@ zap_leaf_lookup(zap_leaf_t *l,
 	return (ENOENT);
 }
 
+static int
+zap_leaf_index_compare(const void *a, const void *b)
+{
+	const zap_leaf_index_ent_t *zie1 = a;
+	const zap_leaf_index_ent_t *zie2 = b;
+
+	if (zie1->zie_hash < zie2->zie_hash)
+		return (-1);
+	if (zie1->zie_hash > zie2->zie_hash)
+		return (1);
+	return (0);
+}
+
+static zap_leaf_index_t *
+zap_leaf_index_build(zap_leaf_t *l)
+{
+	zap_leaf_index_t *zli;
+	struct zap_leaf_entry *le;
+	int nentries = l->l_phys->l_hdr.lh_nentries;
+	uint32_t namebytes = 0;
+	size_t size;
+	int i, n;
+
+	for (i = 0; i < ZAP_LEAF_NUMCHUNKS(l); i++) {
+		le = ZAP_LEAF_ENTRY(l, i);
+		if (le->le_type == ZAP_CHUNK_ENTRY)
+			namebytes += le->le_name_length;
+	}
+
+	size = sizeof (zap_leaf_index_t) +
+	    nentries * sizeof (zap_leaf_index_ent_t) + namebytes;
+	zli = kmem_alloc(size, KM_SLEEP);
+	zli->zli_size = size;
+	zli->zli_names = (char *)&zli->zli_ents[nentries];
+
+	namebytes = 0;
+	for (i = 0, n = 0; i < ZAP_LEAF_NUMCHUNKS(l); i++) {
+		zap_leaf_index_ent_t *zie;
+
+		le = ZAP_LEAF_ENTRY(l, i);
+		if (le->le_type != ZAP_CHUNK_ENTRY)
+			continue;
+
+		ASSERT3U(n, <, nentries);
+		zie = &zli->zli_ents[n++];
+		zie->zie_hash = le->le_hash;
+		zie->zie_chunk = i;
+		zie->zie_namelen = le->le_name_length;
+		zie->zie_nameoff = namebytes;
+		zap_leaf_array_read(l, le->le_name_chunk, 1,
+		    le->le_name_length, 1, le->le_name_length,
+		    zli->zli_names + namebytes);
+		namebytes += le->le_name_length;
+	}
+	ASSERT3U(n, ==, nentries);
+	zli->zli_nentries = n;
+
+	qsort(zli->zli_ents, n, sizeof (zap_leaf_index_ent_t),
+	    zap_leaf_index_compare);
+
+	return (zli);
+}
+
+/*
+ * Discard the leaf's index.  Must be called with the leaf held as
+ * writer whenever entries are added, removed, or moved between chunks.
+ */
+void
+zap_leaf_index_free(zap_leaf_t *l)
+{
+	if (l->l_index != NULL) {
+		kmem_free(l->l_index, l->l_index->zli_size);
+		l->l_index = NULL;
+	}
+	l->l_index_lookups = 0;
+}
+
+int
+zap_leaf_lookup_index(zap_leaf_t *l,
+    const char *name, uint64_t h, zap_entry_handle_t *zeh)
+{
+	zap_leaf_index_t *zli = l->l_index;
+	zap_leaf_index_ent_t *zie;
+	struct zap_leaf_entry *le;
+	int namelen, lo, hi;
+
+	ASSERT3U(l->l_phys->l_hdr.lh_magic, ==, ZAP_LEAF_MAGIC);
+
+	if (zli == NULL) {
+		/*
+		 * l_index_lookups is bumped by concurrent readers without
+		 * a lock; it is only a hint as to when to build the index.
+		 */
+		if (zap_leaf_index_disable ||
+		    ++l->l_index_lookups < zap_leaf_index_min_lookups)
+			return (zap_leaf_lookup(l, name, h, zeh));
+
+		zli = zap_leaf_index_build(l);
+		if (atomic_cas_ptr(&l->l_index, NULL, zli) != NULL) {
+			/* someone else built it first */
+			kmem_free(zli, zli->zli_size);
+			zli = l->l_index;
+		}
+	}
+
+	/* find the first entry with this hash */
+	lo = 0;
+	hi = zli->zli_nentries;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+
+		if (zli->zli_ents[mid].zie_hash < h)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	namelen = strlen(name) + 1;
+	for (zie = &zli->zli_ents[lo];
+	    zie < &zli->zli_ents[zli->zli_nentries] && zie->zie_hash == h;
+	    zie++) {
+		if (zie->zie_namelen != namelen ||
+		    bcmp(zli->zli_names + zie->zie_nameoff, name, namelen) != 0)
+			continue;
+
+		le = ZAP_LEAF_ENTRY(l, zie->zie_chunk);
+		ASSERT3U(le->le_type, ==, ZAP_CHUNK_ENTRY);
+		ASSERT3U(le->le_hash, ==, h);
+
+		zeh->zeh_num_integers = le->le_value_length;
+		zeh->zeh_integer_size = le->le_int_size;
+		zeh->zeh_cd = le->le_cd;
+		zeh->zeh_hash = le->le_hash;
+		zeh->zeh_fakechunk = zie->zie_chunk;
+		zeh->zeh_chunkp = &zeh->zeh_fakechunk;
+		zeh->zeh_leaf = l;
+		return (0);
+	}
+
+	return (ENOENT);
+}
+
 /* Return (h1,cd1 >= h2,cd2) */
 #define	HCD_GTEQ(h1, cd1, h2, cd2) \
 	((h1 > h2) ? TRUE : ((h1 == h2 && cd1 >= cd2) ? TRUE : FALSE))
@@ -509,6 +659,7 @@ zap_entry_remove(zap_entry_handle_t *zeh)
 	le = ZAP_LEAF_ENTRY(l, entry_chunk);
 	ASSERT3U(le->le_type, ==, ZAP_CHUNK_ENTRY);
 
+	zap_leaf_index_free(l);
 	zap_leaf_array_free(l, &le->le_name_chunk);
 	zap_leaf_array_free(l, &le->le_value_chunk);
 
@@ -560,6 +711,8 @@ zap_entry_create(zap_leaf_t *l, const char *name, uint64_t h, uint32_t cd,
 	if (l->l_phys->l_hdr.lh_nfree < numchunks)
 		return (EAGAIN);
 
+	zap_leaf_index_free(l);
+
 	/* make the entry */
 	chunk = zap_leaf_chunk_alloc(l);
 	le = ZAP_LEAF_ENTRY(l, chunk);
@@ -665,6 +818,9 @@ zap_leaf_split(zap_leaf_t *l, zap_leaf_t *nl)
 	int i;
 	int bit = 64 - 1 - l->l_phys->l_hdr.lh_prefix_len;
 
+	zap_leaf_index_free(l);
+	zap_leaf_index_free(nl);
+
 	/* set new prefix and prefix_len */
 	l->l_phys->l_hdr.lh_prefix <<= 1;
 	l->l_phys->l_hdr.lh_prefix_len++;
@@ -80,53 +80,103 @@ mze_compare(const void *arg1, const void *arg2)
 		return (+1);
 	if (mze1->mze_hash < mze2->mze_hash)
 		return (-1);
-	if (mze1->mze_phys.mze_cd > mze2->mze_phys.mze_cd)
+	if (mze1->mze_cd > mze2->mze_cd)
 		return (+1);
-	if (mze1->mze_phys.mze_cd < mze2->mze_phys.mze_cd)
+	if (mze1->mze_cd < mze2->mze_cd)
 		return (-1);
 	return (0);
 }
 
+/*
+ * Return the index of the first entry at or after (hash, cd).
+ */
+static int
+mze_search(zap_t *zap, uint64_t hash, uint32_t cd)
+{
+	mzap_ent_t *ents = zap->zap_m.zap_ents;
+	int lo = 0;
+	int hi = zap->zap_m.zap_num_entries;
+
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+
+		if (ents[mid].mze_hash < hash ||
+		    (ents[mid].mze_hash == hash && ents[mid].mze_cd < cd))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return (lo);
+}
+
+/*
+ * Make sure the index has a slot for every chunk, since the object's
+ * block (and so the number of chunks) may have grown.
+ */
+static void
+mze_reserve(zap_t *zap)
+{
+	int n = zap->zap_m.zap_num_chunks;
+	mzap_ent_t *ents;
+
+	if (zap->zap_m.zap_num_alloc >= n)
+		return;
+
+	ents = kmem_alloc(n * sizeof (mzap_ent_t), KM_SLEEP);
+	if (zap->zap_m.zap_ents != NULL) {
+		bcopy(zap->zap_m.zap_ents, ents,
+		    zap->zap_m.zap_num_entries * sizeof (mzap_ent_t));
+		kmem_free(zap->zap_m.zap_ents,
+		    zap->zap_m.zap_num_alloc * sizeof (mzap_ent_t));
+	}
+	zap->zap_m.zap_ents = ents;
+	zap->zap_m.zap_num_alloc = n;
+}
+
 static void
 mze_insert(zap_t *zap, int chunkid, uint64_t hash, mzap_ent_phys_t *mzep)
 {
 	mzap_ent_t *mze;
+	int idx;
 
 	ASSERT(zap->zap_ismicro);
 	ASSERT(RW_WRITE_HELD(&zap->zap_rwlock));
 	ASSERT(mzep->mze_cd < ZAP_MAXCD);
 	ASSERT3U(zap_hash(zap, mzep->mze_name), ==, hash);
 
-	mze = kmem_alloc(sizeof (mzap_ent_t), KM_SLEEP);
-	mze->mze_chunkid = chunkid;
+	mze_reserve(zap);
+	ASSERT3S(zap->zap_m.zap_num_entries, <, zap->zap_m.zap_num_alloc);
+
+	idx = mze_search(zap, hash, mzep->mze_cd);
+	mze = &zap->zap_m.zap_ents[idx];
+	if (idx < zap->zap_m.zap_num_entries) {
+		ASSERT(mze->mze_hash != hash || mze->mze_cd != mzep->mze_cd);
+		(void) memmove(mze + 1, mze,
+		    (zap->zap_m.zap_num_entries - idx) * sizeof (mzap_ent_t));
+	}
 	mze->mze_hash = hash;
-	mze->mze_phys = *mzep;
-	avl_add(&zap->zap_m.zap_avl, mze);
+	mze->mze_cd = mzep->mze_cd;
+	mze->mze_chunkid = chunkid;
+	mze->mze_pad = 0;
+	zap->zap_m.zap_num_entries++;
 }
 
 static mzap_ent_t *
 mze_find(zap_t *zap, const char *name, uint64_t hash)
 {
-	mzap_ent_t mze_tofind;
-	mzap_ent_t *mze;
-	avl_index_t idx;
-	avl_tree_t *avl = &zap->zap_m.zap_avl;
+	mzap_ent_t *mze, *end;
 
 	ASSERT(zap->zap_ismicro);
 	ASSERT(RW_LOCK_HELD(&zap->zap_rwlock));
 	ASSERT3U(zap_hash(zap, name), ==, hash);
 
-	if (strlen(name) >= sizeof (mze_tofind.mze_phys.mze_name))
+	if (strlen(name) >= MZAP_NAME_LEN)
 		return (NULL);
 
-	mze_tofind.mze_hash = hash;
-	mze_tofind.mze_phys.mze_cd = 0;
-
-	mze = avl_find(avl, &mze_tofind, &idx);
-	if (mze == NULL)
-		mze = avl_nearest(avl, idx, AVL_AFTER);
-	for (; mze && mze->mze_hash == hash; mze = AVL_NEXT(avl, mze)) {
-		if (strcmp(name, mze->mze_phys.mze_name) == 0)
+	end = zap->zap_m.zap_ents + zap->zap_m.zap_num_entries;
+	for (mze = zap->zap_m.zap_ents + mze_search(zap, hash, 0);
+	    mze < end && mze->mze_hash == hash; mze++) {
+		if (strcmp(name, MZE_PHYS(zap, mze)->mze_name) == 0)
 			return (mze);
 	}
 	return (NULL);
@@ -135,22 +185,17 @@ mze_find(zap_t *zap, const char *name, uint64_t hash)
 static uint32_t
 mze_find_unused_cd(zap_t *zap, uint64_t hash)
 {
-	mzap_ent_t mze_tofind;
-	mzap_ent_t *mze;
-	avl_index_t idx;
-	avl_tree_t *avl = &zap->zap_m.zap_avl;
+	mzap_ent_t *mze, *end;
 	uint32_t cd;
 
 	ASSERT(zap->zap_ismicro);
 	ASSERT(RW_LOCK_HELD(&zap->zap_rwlock));
 
-	mze_tofind.mze_hash = hash;
-	mze_tofind.mze_phys.mze_cd = 0;
-
 	cd = 0;
-	for (mze = avl_find(avl, &mze_tofind, &idx);
-	    mze && mze->mze_hash == hash; mze = AVL_NEXT(avl, mze)) {
-		if (mze->mze_phys.mze_cd != cd)
+	end = zap->zap_m.zap_ents + zap->zap_m.zap_num_entries;
+	for (mze = zap->zap_m.zap_ents + mze_search(zap, hash, 0);
+	    mze < end && mze->mze_hash == hash; mze++) {
+		if (mze->mze_cd != cd)
 			break;
 		cd++;
 	}
@@ -161,22 +206,26 @@ mze_find_unused_cd(zap_t *zap, uint64_t hash)
 static void
 mze_remove(zap_t *zap, mzap_ent_t *mze)
 {
+	mzap_ent_t *end = zap->zap_m.zap_ents + zap->zap_m.zap_num_entries;
+
 	ASSERT(zap->zap_ismicro);
 	ASSERT(RW_WRITE_HELD(&zap->zap_rwlock));
+	ASSERT(mze >= zap->zap_m.zap_ents && mze < end);
 
-	avl_remove(&zap->zap_m.zap_avl, mze);
-	kmem_free(mze, sizeof (mzap_ent_t));
+	(void) memmove(mze, mze + 1, (end - mze - 1) * sizeof (mzap_ent_t));
+	zap->zap_m.zap_num_entries--;
 }
 
 static void
 mze_destroy(zap_t *zap)
 {
-	mzap_ent_t *mze;
-	void *avlcookie = NULL;
-
-	while (mze = avl_destroy_nodes(&zap->zap_m.zap_avl, &avlcookie))
-		kmem_free(mze, sizeof (mzap_ent_t));
-	avl_destroy(&zap->zap_m.zap_avl);
+	if (zap->zap_m.zap_ents != NULL) {
+		kmem_free(zap->zap_m.zap_ents,
+		    zap->zap_m.zap_num_alloc * sizeof (mzap_ent_t));
+	}
+	zap->zap_m.zap_ents = NULL;
+	zap->zap_m.zap_num_alloc = 0;
+	zap->zap_m.zap_num_entries = 0;
 }
 
 static zap_t *
@@ -221,18 +270,29 @@ mzap_open(objset_t *os, uint64_t obj, dmu_buf_t *db)
 	if (zap->zap_ismicro) {
 		zap->zap_salt = zap->zap_m.zap_phys->mz_salt;
 		zap->zap_m.zap_num_chunks = db->db_size / MZAP_ENT_LEN - 1;
-		avl_create(&zap->zap_m.zap_avl, mze_compare,
-		    sizeof (mzap_ent_t), offsetof(mzap_ent_t, mze_node));
+		mze_reserve(zap);
 
+		/*
+		 * Build the whole index in one go and sort it once,
+		 * rather than inserting the entries one at a time.
+		 */
 		for (i = 0; i < zap->zap_m.zap_num_chunks; i++) {
-			mzap_ent_phys_t *mze =
+			mzap_ent_phys_t *mzep =
 			    &zap->zap_m.zap_phys->mz_chunk[i];
-			if (mze->mze_name[0]) {
-				zap->zap_m.zap_num_entries++;
-				mze_insert(zap, i,
-				    zap_hash(zap, mze->mze_name), mze);
-			}
+			mzap_ent_t *mze;
+
+			if (mzep->mze_name[0] == 0)
+				continue;
+			ASSERT(mzep->mze_cd < ZAP_MAXCD);
+			mze = &zap->zap_m.zap_ents[zap->zap_m.zap_num_entries];
+			zap->zap_m.zap_num_entries++;
+			mze->mze_hash = zap_hash(zap, mzep->mze_name);
+			mze->mze_cd = mzep->mze_cd;
+			mze->mze_chunkid = i;
+			mze->mze_pad = 0;
 		}
+		qsort(zap->zap_m.zap_ents, zap->zap_m.zap_num_entries,
+		    sizeof (mzap_ent_t), mze_compare);
 	} else {
 		zap->zap_salt = zap->zap_f.zap_phys->zap_salt;
 
@@ -381,14 +441,35 @@ mzap_upgrade(zap_t *zap, dmu_tx_t *tx)
 uint64_t
 zap_hash(zap_t *zap, const char *name)
 {
-	const uint8_t *cp;
-	uint8_t c;
+	const uint8_t *cp = (const uint8_t *)name;
+	size_t len = strlen(name);
 	uint64_t crc = zap->zap_salt;
 
 	ASSERT(crc != 0);
 	ASSERT(zfs_crc64_table[128] == ZFS_CRC64_POLY);
-	for (cp = (const uint8_t *)name; (c = *cp) != '\0'; cp++)
-		crc = (crc >> 8) ^ zfs_crc64_table[(crc ^ c) & 0xFFULL];
+
+	/*
+	 * This is the byte-at-a-time CRC64 below, eight bytes at a time.
+	 * The result is part of the on-disk format, so the two must agree
+	 * exactly; the bytes are assembled explicitly so that this holds
+	 * on either byte order.
+	 */
+	for (; len >= 8; len -= 8, cp += 8) {
+		crc ^= (uint64_t)cp[0] | ((uint64_t)cp[1] << 8) |
+		    ((uint64_t)cp[2] << 16) | ((uint64_t)cp[3] << 24) |
+		    ((uint64_t)cp[4] << 32) | ((uint64_t)cp[5] << 40) |
+		    ((uint64_t)cp[6] << 48) | ((uint64_t)cp[7] << 56);
+		crc = zfs_crc64_slice[7][crc & 0xFF] ^
+		    zfs_crc64_slice[6][(crc >> 8) & 0xFF] ^
+		    zfs_crc64_slice[5][(crc >> 16) & 0xFF] ^
+		    zfs_crc64_slice[4][(crc >> 24) & 0xFF] ^
+		    zfs_crc64_slice[3][(crc >> 32) & 0xFF] ^
+		    zfs_crc64_slice[2][(crc >> 40) & 0xFF] ^
+		    zfs_crc64_slice[1][(crc >> 48) & 0xFF] ^
+		    zfs_crc64_slice[0][crc >> 56];
+	}
+	for (; len > 0; len--, cp++)
+		crc = (crc >> 8) ^ zfs_crc64_table[(crc ^ *cp) & 0xFFULL];
 
 	/*
 	 * Only use 28 bits, since we need 4 bits in the cookie for the
@@ -523,7 +604,8 @@ zap_lookup(objset_t *os, uint64_t zapobj, const char *name,
 			else if (integer_size != 8)
 				err = EINVAL;
 			else
-				*(uint64_t *)buf = mze->mze_phys.mze_value;
+				*(uint64_t *)buf =
+				    MZE_PHYS(zap, mze)->mze_value;
 		}
 	}
 	zap_unlockdir(zap);
@@ -586,7 +668,6 @@ again:
 			mze->mze_value = value;
 			mze->mze_cd = cd;
 			(void) strcpy(mze->mze_name, name);
-			zap->zap_m.zap_num_entries++;
 			zap->zap_m.zap_alloc_next = i+1;
 			if (zap->zap_m.zap_alloc_next ==
 			    zap->zap_m.zap_num_chunks)
@@ -665,9 +746,7 @@ zap_update(objset_t *os, uint64_t zapobj, const char *name,
 		hash = zap_hash(zap, name);
 		mze = mze_find(zap, name, hash);
 		if (mze != NULL) {
-			mze->mze_phys.mze_value = *intval;
-			zap->zap_m.zap_phys->mz_chunk
-			    [mze->mze_chunkid].mze_value = *intval;
+			MZE_PHYS(zap, mze)->mze_value = *intval;
 		} else {
 			mzap_addent(zap, name, hash, *intval);
 		}
@@ -695,9 +774,7 @@ zap_remove(objset_t *os, uint64_t zapobj, const char *name, dmu_tx_t *tx)
 			err = ENOENT;
 		} else {
 			dprintf("success: %s\n", name);
-			zap->zap_m.zap_num_entries--;
-			bzero(&zap->zap_m.zap_phys->mz_chunk[mze->mze_chunkid],
-			    sizeof (mzap_ent_phys_t));
+			bzero(MZE_PHYS(zap, mze), sizeof (mzap_ent_phys_t));
 			mze_remove(zap, mze);
 		}
 	}
@@ -705,6 +782,141 @@ zap_remove(objset_t *os, uint64_t zapobj, const char *name, dmu_tx_t *tx)
 	return (err);
 }
 
+/*
+ * Grow a micro-zap so that count more entries fit, if they can.
+ */
+static boolean_t
+mzap_make_room(zap_t *zap, int count, dmu_tx_t *tx)
+{
+	uint64_t need = zap->zap_m.zap_num_entries + count;
+	uint64_t newsz;
+	int err;
+
+	if (need <= zap->zap_m.zap_num_chunks)
+		return (B_TRUE);
+
+	/* the first chunk's worth of the block is the mzap_phys_t header */
+	newsz = P2ROUNDUP((need + 1) * MZAP_ENT_LEN, SPA_MINBLOCKSIZE);
+	if (newsz > MZAP_MAX_BLKSZ)
+		return (B_FALSE);
+
+	err = dmu_object_set_blocksize(zap->zap_objset, zap->zap_object,
+	    newsz, 0, tx);
+	ASSERT3U(err, ==, 0);
+	zap->zap_m.zap_num_chunks = zap->zap_dbuf->db_size / MZAP_ENT_LEN - 1;
+	return (B_TRUE);
+}
+
+static int
+zap_batch_compare(const void *arg1, const void *arg2)
+{
+	const zap_batch_ent_t *zbe1 = arg1;
+	const zap_batch_ent_t *zbe2 = arg2;
+
+	if (zbe1->zbe_hash > zbe2->zbe_hash)
+		return (+1);
+	if (zbe1->zbe_hash < zbe2->zbe_hash)
+		return (-1);
+	return (0);
+}
+
+static int
+zap_batch(objset_t *os, uint64_t zapobj, zap_batch_op_t op, int count,
+    const char **names, int integer_size, uint64_t num_integers,
+    const void *val, dmu_tx_t *tx)
+{
+	zap_t *zap;
+	zap_batch_ent_t *zbe;
+	mzap_ent_t *mze;
+	size_t valsize = integer_size * num_integers;
+	boolean_t longname = B_FALSE;
+	int i, err, rv = 0;
+
+	if (count == 0)
+		return (0);
+
+	err = zap_lockdir(os, zapobj, tx, RW_WRITER, TRUE, &zap);
+	if (err)
+		return (err);
+
+	zbe = kmem_alloc(count * sizeof (zap_batch_ent_t), KM_SLEEP);
+	for (i = 0; i < count; i++) {
+		zbe[i].zbe_hash = zap_hash(zap, names[i]);
+		zbe[i].zbe_name = names[i];
+		zbe[i].zbe_val = (op == ZAP_BATCH_REMOVE) ? NULL :
+		    (const char *)val + i * valsize;
+		if (strlen(names[i]) >= MZAP_NAME_LEN)
+			longname = B_TRUE;
+	}
+	qsort(zbe, count, sizeof (zap_batch_ent_t), zap_batch_compare);
+
+	if (zap->zap_ismicro && op != ZAP_BATCH_REMOVE &&
+	    (integer_size != 8 || num_integers != 1 || longname ||
+	    !mzap_make_room(zap, count, tx))) {
+		dprintf("upgrading obj %llu: intsz=%u numint=%llu count=%d\n",
+		    zapobj, integer_size, num_integers, count);
+		mzap_upgrade(zap, tx);
+	}
+
+	if (!zap->zap_ismicro) {
+		rv = fzap_batch(zap, op, zbe, count,
+		    integer_size, num_integers, tx);
+	} else {
+		for (i = 0; i < count; i++) {
+			mze = mze_find(zap, zbe[i].zbe_name, zbe[i].zbe_hash);
+			err = 0;
+			if (op == ZAP_BATCH_REMOVE) {
+				if (mze == NULL) {
+					err = ENOENT;
+				} else {
+					bzero(MZE_PHYS(zap, mze),
+					    sizeof (mzap_ent_phys_t));
+					mze_remove(zap, mze);
+				}
+			} else if (mze == NULL) {
+				mzap_addent(zap, zbe[i].zbe_name,
+				    zbe[i].zbe_hash,
+				    *(const uint64_t *)zbe[i].zbe_val);
+			} else if (op == ZAP_BATCH_UPDATE) {
+				MZE_PHYS(zap, mze)->mze_value =
+				    *(const uint64_t *)zbe[i].zbe_val;
+			} else {
+				err = EEXIST;
+			}
+			if (err != 0 && rv == 0)
+				rv = err;
+		}
+	}
+
+	kmem_free(zbe, count * sizeof (zap_batch_ent_t));
+	zap_unlockdir(zap);
+	return (rv);
+}
+
+int
+zap_add_many(objset_t *os, uint64_t zapobj, int count, const char **names,
+    int integer_size, uint64_t num_integers, const void *val, dmu_tx_t *tx)
+{
+	return (zap_batch(os, zapobj, ZAP_BATCH_ADD, count, names,
+	    integer_size, num_integers, val, tx));
+}
+
+int
+zap_update_many(objset_t *os, uint64_t zapobj, int count, const char **names,
+    int integer_size, uint64_t num_integers, const void *val, dmu_tx_t *tx)
+{
+	return (zap_batch(os, zapobj, ZAP_BATCH_UPDATE, count, names,
+	    integer_size, num_integers, val, tx));
+}
+
+int
+zap_remove_many(objset_t *os, uint64_t zapobj, int count, const char **names,
+    dmu_tx_t *tx)
+{
+	return (zap_batch(os, zapobj, ZAP_BATCH_REMOVE, count, names,
+	    0, 0, NULL, tx));
+}
+
 
 /*
  * Routines for iterating over the attributes.
@@ -772,9 +984,7 @@ zap_cursor_serialize(zap_cursor_t *zc)
 int
 zap_cursor_retrieve(zap_cursor_t *zc, zap_attribute_t *za)
 {
-	int err;
-	avl_index_t idx;
-	mzap_ent_t mze_tofind;
+	int err, idx;
 	mzap_ent_t *mze;
 
 	if (zc->zc_hash == -1ULL)
@@ -791,26 +1001,21 @@ zap_cursor_retrieve(zap_cursor_t *zc, zap_attribute_t *za)
 	if (!zc->zc_zap->zap_ismicro) {
 		err = fzap_cursor_retrieve(zc->zc_zap, zc, za);
 	} else {
-		err = ENOENT;
+		zap_t *zap = zc->zc_zap;
 
-		mze_tofind.mze_hash = zc->zc_hash;
-		mze_tofind.mze_phys.mze_cd = zc->zc_cd;
+		err = ENOENT;
 
-		mze = avl_find(&zc->zc_zap->zap_m.zap_avl, &mze_tofind, &idx);
-		ASSERT(mze == NULL || 0 == bcmp(&mze->mze_phys,
-		    &zc->zc_zap->zap_m.zap_phys->mz_chunk[mze->mze_chunkid],
-		    sizeof (mze->mze_phys)));
-		if (mze == NULL) {
-			mze = avl_nearest(&zc->zc_zap->zap_m.zap_avl,
-			    idx, AVL_AFTER);
-		}
-		if (mze) {
+		idx = mze_search(zap, zc->zc_hash, zc->zc_cd);
+		if (idx < zap->zap_m.zap_num_entries) {
+			mze = &zap->zap_m.zap_ents[idx];
+			ASSERT3U(MZE_PHYS(zap, mze)->mze_cd, ==, mze->mze_cd);
 			za->za_integer_length = 8;
 			za->za_num_integers = 1;
-			za->za_first_integer = mze->mze_phys.mze_value;
-			(void) strcpy(za->za_name, mze->mze_phys.mze_name);
+			za->za_first_integer = MZE_PHYS(zap, mze)->mze_value;
+			(void) strcpy(za->za_name,
+			    MZE_PHYS(zap, mze)->mze_name);
 			zc->zc_hash = mze->mze_hash;
-			zc->zc_cd = mze->mze_phys.mze_cd;
+			zc->zc_cd = mze->mze_cd;
 			err = 0;
 		} else {
 			zc->zc_hash = -1ULL;
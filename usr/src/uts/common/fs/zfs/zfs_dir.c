@@ -52,6 +52,7 @@
 #include <sys/policy.h>
 #endif /*!__APPLE__*/
 #include <sys/zfs_dir.h>
+#include <sys/zfs_dircache.h>
 #include <sys/zfs_acl.h>
 #include <sys/fs/zfs.h>
 #ifndef __APPLE__
@@ -277,9 +278,16 @@ zfs_dirent_lock(zfs_dirlock_t **dlpp, znode_t *dzp, char *name, znode_t **zpp,
 			*zpp = VTOZ(vp);
 			return (0);
 		} else {
-			error = zap_lookup(zfsvfs->z_os, dzp->z_id, name,
-			    8, 1, &zoid);
-			zoid = ZFS_DIRENT_OBJ(zoid);
+			error = zfs_dircache_lookup(dzp->z_dircache, name,
+			    &zoid);
+			if (error == ESRCH) {
+				error = zap_lookup(zfsvfs->z_os, dzp->z_id,
+				    name, 8, 1, &zoid);
+				zoid = ZFS_DIRENT_OBJ(zoid);
+				if (error == 0 || error == ENOENT)
+					zfs_dircache_enter(&dzp->z_dircache,
+					    name, error ? 0 : zoid);
+			}
 			if (error == ENOENT)
 #ifdef __APPLE__
 				/*
@@ -759,6 +767,7 @@ zfs_link_create(zfs_dirlock_t *dl, znode_t *zp, dmu_tx_t *tx, int flag)
 	error = zap_add(zp->z_zfsvfs->z_os, dzp->z_id, dl->dl_name,
 	    8, 1, &value, tx);
 	ASSERT(error == 0);
+	zfs_dircache_remove(dzp->z_dircache, dl->dl_name);
 
 #ifndef __APPLE__
 	/* On Mac OS X, this is done up in VFS layer. */
@@ -851,6 +860,7 @@ zfs_link_destroy(zfs_dirlock_t *dl, znode_t *zp, dmu_tx_t *tx, int flag,
 
 	error = zap_remove(zp->z_zfsvfs->z_os, dzp->z_id, dl->dl_name, tx);
 	ASSERT(error == 0);
+	zfs_dircache_remove(dzp->z_dircache, dl->dl_name);
 
 	if (unlinkedp != NULL)
 		*unlinkedp = unlinked;
@@ -0,0 +1,225 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2008 Sun Microsystems, Inc.  All rights reserved.
+ * Use is subject to license terms.
+ */
+
+#pragma ident	"%Z%%M%	%I%	%E% SMI"
+
+/*
+ * Directory entry lookup cache; see sys/zfs_dircache.h.
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/zfs_dircache.h>
+
+/*
+ * Cap on the number of directories with a cache, each of which costs
+ * about 4K.
+ */
+int zfs_dircache_max = 4096;
+static uint32_t zfs_dircache_count;
+
+typedef struct zfs_dircache_stats {
+	kstat_named_t dcstat_hits;
+	kstat_named_t dcstat_neg_hits;
+	kstat_named_t dcstat_misses;
+	kstat_named_t dcstat_enters;
+	kstat_named_t dcstat_removes;
+	kstat_named_t dcstat_long_names;
+	kstat_named_t dcstat_over_max;
+	kstat_named_t dcstat_dirs;
+} zfs_dircache_stats_t;
+
+static zfs_dircache_stats_t zfs_dircache_stats = {
+	{ "hits",			KSTAT_DATA_UINT64 },
+	{ "negative_hits",		KSTAT_DATA_UINT64 },
+	{ "misses",			KSTAT_DATA_UINT64 },
+	{ "enters",			KSTAT_DATA_UINT64 },
+	{ "removes",			KSTAT_DATA_UINT64 },
+	{ "long_names",			KSTAT_DATA_UINT64 },
+	{ "over_max",			KSTAT_DATA_UINT64 },
+	{ "dirs",			KSTAT_DATA_UINT64 }
+};
+
+#define	DCSTAT_INCR(stat, val) \
+	atomic_add_64(&zfs_dircache_stats.stat.value.ui64, (val));
+
+#define	DCSTAT_BUMP(stat)	DCSTAT_INCR(stat, 1)
+
+static kstat_t *zfs_dircache_ksp;
+
+void
+zfs_dircache_init(void)
+{
+	zfs_dircache_ksp = kstat_create("zfs", 0, "dircachestats", "misc",
+	    KSTAT_TYPE_NAMED, sizeof (zfs_dircache_stats) /
+	    sizeof (kstat_named_t), KSTAT_FLAG_VIRTUAL);
+
+	if (zfs_dircache_ksp != NULL) {
+		zfs_dircache_ksp->ks_data = &zfs_dircache_stats;
+		kstat_install(zfs_dircache_ksp);
+	}
+}
+
+void
+zfs_dircache_fini(void)
+{
+	if (zfs_dircache_ksp != NULL) {
+		kstat_delete(zfs_dircache_ksp);
+		zfs_dircache_ksp = NULL;
+	}
+}
+
+/*
+ * FNV-1a, which also measures the name.  Returns 0 for names that are
+ * empty or too long to cache.
+ */
+static uint64_t
+zfs_dircache_hash(const char *name, int *lenp)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	const uint8_t *cp;
+
+	for (cp = (const uint8_t *)name; *cp != '\0'; cp++) {
+		if (cp - (const uint8_t *)name >= ZFS_DIRCACHE_NAMELEN - 1)
+			return (0);
+		h = (h ^ *cp) * 0x100000001b3ULL;
+	}
+	if (cp == (const uint8_t *)name)
+		return (0);
+	*lenp = cp - (const uint8_t *)name;
+	return (h);
+}
+
+static zfs_dircache_ent_t *
+zfs_dircache_slot(zfs_dircache_t *dc, uint64_t h)
+{
+	return (&dc->dc_ents[(h ^ (h >> 32)) & (ZFS_DIRCACHE_NENTS - 1)]);
+}
+
+int
+zfs_dircache_lookup(zfs_dircache_t *dc, const char *name, uint64_t *zoidp)
+{
+	zfs_dircache_ent_t *dce;
+	uint64_t h;
+	int len, error = ESRCH;
+
+	if (dc == NULL) {
+		DCSTAT_BUMP(dcstat_misses);
+		return (ESRCH);
+	}
+	if ((h = zfs_dircache_hash(name, &len)) == 0) {
+		DCSTAT_BUMP(dcstat_long_names);
+		return (ESRCH);
+	}
+
+	dce = zfs_dircache_slot(dc, h);
+	mutex_enter(&dc->dc_lock);
+	if (dce->dce_hash == h && dce->dce_namelen == len &&
+	    bcmp(dce->dce_name, name, len) == 0) {
+		*zoidp = dce->dce_zoid;
+		error = (dce->dce_zoid == 0) ? ENOENT : 0;
+	}
+	mutex_exit(&dc->dc_lock);
+
+	if (error == 0)
+		DCSTAT_BUMP(dcstat_hits);
+	else if (error == ENOENT)
+		DCSTAT_BUMP(dcstat_neg_hits);
+	else
+		DCSTAT_BUMP(dcstat_misses);
+	return (error);
+}
+
+void
+zfs_dircache_enter(zfs_dircache_t **dcp, const char *name, uint64_t zoid)
+{
+	zfs_dircache_t *dc = *dcp;
+	zfs_dircache_ent_t *dce;
+	uint64_t h;
+	int len;
+
+	if ((h = zfs_dircache_hash(name, &len)) == 0)
+		return;
+
+	if (dc == NULL) {
+		if (zfs_dircache_count >= zfs_dircache_max) {
+			DCSTAT_BUMP(dcstat_over_max);
+			return;
+		}
+		dc = kmem_zalloc(sizeof (zfs_dircache_t), KM_SLEEP);
+		mutex_init(&dc->dc_lock, NULL, MUTEX_DEFAULT, NULL);
+		if (atomic_cas_ptr(dcp, NULL, dc) != NULL) {
+			/* someone else allocated it first */
+			mutex_destroy(&dc->dc_lock);
+			kmem_free(dc, sizeof (zfs_dircache_t));
+			dc = *dcp;
+		} else {
+			atomic_add_32(&zfs_dircache_count, 1);
+			DCSTAT_BUMP(dcstat_dirs);
+		}
+	}
+
+	dce = zfs_dircache_slot(dc, h);
+	mutex_enter(&dc->dc_lock);
+	dce->dce_hash = h;
+	dce->dce_zoid = zoid;
+	dce->dce_namelen = len;
+	bcopy(name, dce->dce_name, len);
+	mutex_exit(&dc->dc_lock);
+	DCSTAT_BUMP(dcstat_enters);
+}
+
+void
+zfs_dircache_remove(zfs_dircache_t *dc, const char *name)
+{
+	zfs_dircache_ent_t *dce;
+	uint64_t h;
+	int len;
+
+	if (dc == NULL || (h = zfs_dircache_hash(name, &len)) == 0)
+		return;
+
+	dce = zfs_dircache_slot(dc, h);
+	mutex_enter(&dc->dc_lock);
+	if (dce->dce_hash == h && dce->dce_namelen == len &&
+	    bcmp(dce->dce_name, name, len) == 0) {
+		dce->dce_namelen = 0;
+		DCSTAT_BUMP(dcstat_removes);
+	}
+	mutex_exit(&dc->dc_lock);
+}
+
+void
+zfs_dircache_destroy(zfs_dircache_t **dcp)
+{
+	zfs_dircache_t *dc = *dcp;
+
+	if (dc == NULL)
+		return;
+	*dcp = NULL;
+	mutex_destroy(&dc->dc_lock);
+	kmem_free(dc, sizeof (zfs_dircache_t));
+	atomic_add_32(&zfs_dircache_count, -1);
+	DCSTAT_INCR(dcstat_dirs, -1);
+}
@@ -1332,6 +1332,23 @@ zfs_set_prop_nvlist(const char *name, nvlist_t *nvl)
 			}
 			break;
 		}
+
+		case ZFS_PROP_DEDUP:
+			if (nvpair_type(elem) == DATA_TYPE_UINT64 &&
+			    nvpair_value_uint64(elem, &intval) == 0 &&
+			    intval != 0) {
+				spa_t *spa;
+
+				if (spa_open(name, &spa, FTAG) == 0) {
+					if (spa_version(spa) <
+					    SPA_VERSION_DEDUP) {
+						spa_close(spa, FTAG);
+						return (ENOTSUP);
+					}
+					spa_close(spa, FTAG);
+				}
+			}
+			break;
 		}
 	}
 
@@ -1544,6 +1561,11 @@ zfs_ioc_pool_set_props(zfs_cmd_t *zc)
 			 */
 			error = EPERM;
 			break;
+
+		case ZPOOL_PROP_FREEING:
+			/* Read-only; reported by spa_get_props(). */
+			error = EINVAL;
+			break;
 		}
 
 		if (error)
@@ -2010,8 +2032,8 @@ zfs_ioc_recvbackup(zfs_cmd_t *zc)
 	       return (EBADF);	
 
 	error = dmu_recvbackup(zc->zc_value, &zc->zc_begin_record,
-	    &zc->zc_cookie, (boolean_t)zc->zc_guid, vp,
-	    zc->zc_history_offset);
+	    &zc->zc_cookie, (boolean_t)zc->zc_guid, (boolean_t)zc->zc_obj,
+	    vp, zc->zc_history_offset);
 
 	new_off = zc->zc_history_offset + zc->zc_cookie;
 	
@@ -2029,8 +2051,8 @@ zfs_ioc_recvbackup(zfs_cmd_t *zc)
 	if (fp == NULL)
 		return (EBADF);
 	error = dmu_recvbackup(zc->zc_value, &zc->zc_begin_record,
-	    &zc->zc_cookie, (boolean_t)zc->zc_guid, fp->f_vnode,
-	    fp->f_offset);
+	    &zc->zc_cookie, (boolean_t)zc->zc_guid, (boolean_t)zc->zc_obj,
+	    fp->f_vnode, fp->f_offset);
 
 	new_off = fp->f_offset + zc->zc_cookie;
 	if (VOP_SEEK(fp->f_vnode, fp->f_offset, &new_off) == 0)
@@ -2051,8 +2073,12 @@ zfs_ioc_sendbackup(zfs_cmd_t *zc)
 #else
 	file_t *fp;
 #endif /* __APPLE__ */
+	dmu_send_resume_t *resume = NULL;
 	int error;
 
+	if (zc->zc_obj & DMU_SEND_RESUME)
+		resume = &zc->zc_resume;
+
 	error = dmu_objset_open(zc->zc_name, DMU_OST_ANY,
 	    DS_MODE_STANDARD | DS_MODE_READONLY, &tosnap);
 	if (error)
@@ -2095,11 +2121,12 @@ zfs_ioc_sendbackup(zfs_cmd_t *zc)
 	}
 
 #ifdef __APPLE__
-	error = dmu_sendbackup(tosnap, fromsnap, vp);
+	error = dmu_sendbackup(tosnap, fromsnap, (int)zc->zc_obj, resume, vp);
 
 	file_drop(zc->zc_cookie);
 #else
-	error = dmu_sendbackup(tosnap, fromsnap, fp->f_vnode);
+	error = dmu_sendbackup(tosnap, fromsnap, (int)zc->zc_obj, resume,
+	    fp->f_vnode);
 
 	releasef(zc->zc_cookie);
 #endif /* __APPLE__ */
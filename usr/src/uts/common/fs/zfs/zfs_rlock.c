@@ -92,9 +92,126 @@
  * So if the block size needs to be grown then the whole file is
  * exclusively locked, then later the caller will reduce the lock
  * range to just the range to be written using zfs_reduce_range.
+ *
+ * Reader fast path
+ * ----------------
+ * Readers of a file nobody is writing never conflict with each other,
+ * yet each one would otherwise take z_range_lock twice and churn the
+ * tree. So while no writer holds or waits for a range, a reader just
+ * claims one of the z_range_fast slots with a compare-and-swap, leaving
+ * its rl_t there so the range can be seen, and never enters the tree.
+ * z_range_writers is the gate: a reader that finds it non-zero after
+ * claiming a slot gives the slot back and takes the slow path. A writer
+ * raises it under z_range_lock, locks its range in the tree, and then
+ * waits on z_range_cv only for the fast readers whose ranges overlap
+ * its own. Both sides publish with a compare-and-swap before looking
+ * at the other's side, so one of them always sees the other. Only
+ * 32-bit and pointer compare-and-swap are used, which every platform
+ * provides. Writers and appenders always use the tree, so append and
+ * grow block handling are unchanged.
  */
 
 #include <sys/zfs_rlock.h>
+#include <sys/atomic.h>
+
+int zfs_range_fast_disable = 0;
+
+/*
+ * Give back the slot held by fast reader 'rl', waking any writer that
+ * may be waiting for it.  A writer looks at the rl_t in the slot with
+ * z_range_lock held, so once a writer is about the caller must pass
+ * through z_range_lock before the rl_t is freed or reused.
+ */
+static void
+zfs_range_unlock_fast(znode_t *zp, rl_t *rl)
+{
+	int i;
+
+	for (i = 0; i < ZFS_RANGE_FAST_SLOTS; i++) {
+		if (zp->z_range_fast[i] == rl)
+			break;
+	}
+	VERIFY(i < ZFS_RANGE_FAST_SLOTS);
+	VERIFY(atomic_cas_ptr(&zp->z_range_fast[i], rl, NULL) == rl);
+
+	if (zp->z_range_writers != 0) {
+		mutex_enter(&zp->z_range_lock);
+		cv_broadcast(&zp->z_range_cv);
+		mutex_exit(&zp->z_range_lock);
+	}
+}
+
+/*
+ * Try to take reader lock 'new' without z_range_lock.  Fails if a
+ * writer holds or is waiting for any range of the file, or if all the
+ * slots are taken.
+ */
+static boolean_t
+zfs_range_lock_fast(znode_t *zp, rl_t *new)
+{
+	int i;
+
+	if (zp->z_range_writers != 0)
+		return (B_FALSE);
+
+	for (i = 0; i < ZFS_RANGE_FAST_SLOTS; i++) {
+		if (zp->z_range_fast[i] != NULL ||
+		    atomic_cas_ptr(&zp->z_range_fast[i], NULL, new) != NULL)
+			continue;
+		if (zp->z_range_writers == 0)
+			return (B_TRUE);
+		zfs_range_unlock_fast(zp, new);
+		return (B_FALSE);
+	}
+	return (B_FALSE);
+}
+
+/*
+ * Close the reader fast path.  Called with z_range_lock held, before
+ * the writer looks at the tree; undone by zfs_range_open_fast().
+ */
+static void
+zfs_range_close_fast(znode_t *zp)
+{
+	uint32_t cnt;
+
+	ASSERT(MUTEX_HELD(&zp->z_range_lock));
+	do {
+		cnt = zp->z_range_writers;
+	} while (atomic_cas_32(&zp->z_range_writers, cnt, cnt + 1) != cnt);
+}
+
+/*
+ * Wait for the fast readers that overlap writer lock 'new', which is
+ * already in the tree, to go away.  Readers of other ranges carry on.
+ */
+static void
+zfs_range_wait_fast(znode_t *zp, rl_t *new)
+{
+	rl_t *rl;
+	int i;
+
+	ASSERT(MUTEX_HELD(&zp->z_range_lock));
+	ASSERT(zp->z_range_writers != 0);
+	for (i = 0; i < ZFS_RANGE_FAST_SLOTS; i++) {
+		while ((rl = zp->z_range_fast[i]) != NULL &&
+		    rl->r_off < new->r_off + new->r_len &&
+		    new->r_off < rl->r_off + rl->r_len)
+			cv_wait(&zp->z_range_cv, &zp->z_range_lock);
+	}
+}
+
+static void
+zfs_range_open_fast(znode_t *zp)
+{
+	uint32_t cnt;
+
+	ASSERT(MUTEX_HELD(&zp->z_range_lock));
+	do {
+		cnt = zp->z_range_writers;
+		ASSERT(cnt != 0);
+	} while (atomic_cas_32(&zp->z_range_writers, cnt, cnt - 1) != cnt);
+}
 
 /*
  * Check if a write lock can be grabbed, or wait and recheck until available.
@@ -105,7 +222,9 @@ zfs_range_lock_writer(znode_t *zp, rl_t *new)
 	avl_tree_t *tree = &zp->z_range_avl;
 	rl_t *rl;
 	avl_index_t where;
+#ifdef _KERNEL
 	uint64_t end_size;
+#endif
 	uint64_t off = new->r_off;
 	uint64_t len = new->r_len;
 
@@ -119,8 +238,10 @@ zfs_range_lock_writer(znode_t *zp, rl_t *new)
 		 * Yes, this is ugly, and would be solved by not handling
 		 * grow or append in range lock code. If that was done then
 		 * we could make the range locking code generically available
-		 * to other non-zfs consumers.
+		 * to other non-zfs consumers. libzpool has no ZPL at all,
+		 * so there it is compiled out.
 		 */
+#ifdef _KERNEL
 		if (zp->z_vnode) { /* caller is ZPL */
 			/*
 			 * If in append mode pick up the current end of file.
@@ -141,6 +262,7 @@ zfs_range_lock_writer(znode_t *zp, rl_t *new)
 				new->r_len = UINT64_MAX;
 			}
 		}
+#endif
 
 		/*
 		 * First check for the usual case of no locks
@@ -438,6 +560,14 @@ zfs_range_lock(znode_t *zp, uint64_t off, uint64_t len, rl_type_t type)
 	new->r_proxy = B_FALSE;
 	new->r_write_wanted = B_FALSE;
 	new->r_read_wanted = B_FALSE;
+	new->r_fast = B_FALSE;
+
+	if (type == RL_READER && !zfs_range_fast_disable &&
+	    zfs_range_lock_fast(zp, new)) {
+		new->r_cnt = 0;
+		new->r_fast = B_TRUE;
+		return (new);
+	}
 
 	mutex_enter(&zp->z_range_lock);
 	if (type == RL_READER) {
@@ -448,8 +578,11 @@ zfs_range_lock(znode_t *zp, uint64_t off, uint64_t len, rl_type_t type)
 			avl_add(&zp->z_range_avl, new);
 		else
 			zfs_range_lock_reader(zp, new);
-	} else
+	} else {
+		zfs_range_close_fast(zp);
 		zfs_range_lock_writer(zp, new); /* RL_WRITER or RL_APPEND */
+		zfs_range_wait_fast(zp, new);
+	}
 	mutex_exit(&zp->z_range_lock);
 	return (new);
 }
@@ -533,10 +666,18 @@ zfs_range_unlock(rl_t *rl)
 	ASSERT(rl->r_cnt == 1 || rl->r_cnt == 0);
 	ASSERT(!rl->r_proxy);
 
+	if (rl->r_fast) {
+		ASSERT(rl->r_type == RL_READER);
+		zfs_range_unlock_fast(zp, rl);
+		kmem_free(rl, sizeof (rl_t));
+		return;
+	}
+
 	mutex_enter(&zp->z_range_lock);
 	if (rl->r_type == RL_WRITER) {
 		/* writer locks can't be shared or split */
 		avl_remove(&zp->z_range_avl, rl);
+		zfs_range_open_fast(zp);
 		mutex_exit(&zp->z_range_lock);
 		if (rl->r_write_wanted) {
 			cv_broadcast(&rl->r_wr_cv);
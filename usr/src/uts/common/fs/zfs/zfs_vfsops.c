@@ -2144,6 +2144,8 @@ zfs_vfs_start(__unused struct mount *mp, __unused int flags, __unused vfs_contex
 
 SYSCTL_NODE(_debug, OID_AUTO, maczfs, CTLFLAG_RW, 0, "maczfs specific tuning flags");
 SYSCTL_INT(_debug_maczfs, OID_AUTO, stalk, (CTLTYPE_INT | CTLFLAG_RW | CTLFLAG_ANYBODY ), &k_maczfs_debug_stalk, 0, "enable stalk-printf logging");
+SYSCTL_INT(_debug_maczfs, OID_AUTO, latency_stats, (CTLTYPE_INT | CTLFLAG_RW),
+    &zio_latency_stats, 0, "collect zio latency histograms");
 
 int
 zfs_module_start(__unused kmod_info_t *ki, __unused void *data)
@@ -2157,6 +2159,7 @@ zfs_module_start(__unused kmod_info_t *ki, __unused void *data)
 
 	sysctl_register_oid(&sysctl__debug_maczfs);
 	sysctl_register_oid(&sysctl__debug_maczfs_stalk);
+	sysctl_register_oid(&sysctl__debug_maczfs_latency_stats);
 		
 	vfe.vfe_vfsops = &zfs_vfsops_template;
 	vfe.vfe_vopcnt = ZFS_VNOP_TBL_CNT;
@@ -2195,6 +2198,7 @@ zfs_module_stop(__unused kmod_info_t *ki, __unused void *data)
 	}
 	zfs_fini();
 	
+	sysctl_unregister_oid(&sysctl__debug_maczfs_latency_stats);
 	sysctl_unregister_oid(&sysctl__debug_maczfs_stalk);
 	sysctl_unregister_oid(&sysctl__debug_maczfs);
 	
@@ -1206,7 +1206,7 @@ zfs_get_data(void *arg, lr_write_t *lr, char *buf, zio_t *zio)
 			error = ENOENT;
 			goto out;
 		}
-		VERIFY(0 == dmu_read(os, lr->lr_foid, off, dlen, buf));
+		error = dmu_read(os, lr->lr_foid, off, dlen, buf);
 	} else { /* indirect write */
 		uint64_t boff; /* block starting offset */
 
@@ -1238,9 +1238,17 @@ zfs_get_data(void *arg, lr_write_t *lr, char *buf, zio_t *zio)
 		zgd->zgd_rl = rl;
 		zgd->zgd_zilog = zfsvfs->z_log;
 		zgd->zgd_bp = &lr->lr_blkptr;
-		VERIFY(0 == dmu_buf_hold(os, lr->lr_foid, boff, zgd, &db));
+		error = dmu_buf_hold(os, lr->lr_foid, boff, zgd, &db);
+		if (error) {
+			kmem_free(zgd, sizeof (zgd_t));
+			goto out;
+		}
 		ASSERT(boff == db->db_offset);
 		lr->lr_blkoff = off - boff;
+		/*
+		 * dmu_buf_hold() has read the block in, merging a deferred
+		 * partial fill, so dmu_sync() can write it out now.
+		 */
 		error = dmu_sync(zio, db, &lr->lr_blkptr,
 		    lr->lr_common.lrc_txg, zfs_get_done, zgd);
 		ASSERT((error && error != EINPROGRESS) ||
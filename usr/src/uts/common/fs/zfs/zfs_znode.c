@@ -61,6 +61,7 @@
 #include <sys/zfs_acl.h>
 #include <sys/zfs_ioctl.h>
 #include <sys/zfs_rlock.h>
+#include <sys/zfs_dircache.h>
 #include <sys/fs/zfs.h>
 #ifdef __APPLE__
 #include <maczfs/kernel/maczfs_kernel.h>
@@ -139,11 +140,15 @@ zfs_znode_cache_constructor(void *buf, void *cdrarg, int kmflags)
 	mutex_init(&zp->z_acl_lock, NULL, MUTEX_DEFAULT, NULL);
 
 	mutex_init(&zp->z_range_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&zp->z_range_cv, NULL, CV_DEFAULT, NULL);
 	avl_create(&zp->z_range_avl, zfs_range_compare,
 	    sizeof (rl_t), offsetof(rl_t, r_node));
+	bzero((void *)zp->z_range_fast, sizeof (zp->z_range_fast));
+	zp->z_range_writers = 0;
 
 	zp->z_dbuf_held = 0;
 	zp->z_dirlocks = 0;
+	zp->z_dircache = NULL;
 	return (0);
 }
 
@@ -152,14 +157,20 @@ static void
 zfs_znode_cache_destructor(void *buf, void *cdarg)
 {
 	znode_t *zp = buf;
+	int i;
 
 	ASSERT(zp->z_dirlocks == 0);
+	ASSERT(zp->z_dircache == NULL);
 	mutex_destroy(&zp->z_lock);
 	rw_destroy(&zp->z_map_lock);
 	rw_destroy(&zp->z_parent_lock);
 	rw_destroy(&zp->z_name_lock);
 	mutex_destroy(&zp->z_acl_lock);
+	for (i = 0; i < ZFS_RANGE_FAST_SLOTS; i++)
+		ASSERT(zp->z_range_fast[i] == NULL);
+	ASSERT(zp->z_range_writers == 0);
 	avl_destroy(&zp->z_range_avl);
+	cv_destroy(&zp->z_range_cv);
 	mutex_destroy(&zp->z_range_lock);
 
 	ASSERT(zp->z_dbuf_held == 0);
@@ -181,6 +192,8 @@ zfs_znode_init(void)
 	znode_cache = kmem_cache_create("zfs_znode_cache",
 	    sizeof (znode_t), 0, zfs_znode_cache_constructor,
 	    zfs_znode_cache_destructor, NULL, NULL, NULL, 0);
+
+	zfs_dircache_init();
 }
 
 void
@@ -198,6 +211,8 @@ zfs_znode_fini(void)
 	if (znode_cache)
 		kmem_cache_destroy(znode_cache);
 	znode_cache = NULL;
+
+	zfs_dircache_fini();
 }
 
 #ifdef __APPLE__
@@ -1125,6 +1140,7 @@ zfs_znode_free(znode_t *zp)
 
 #endif __APPLE__
 
+	zfs_dircache_destroy(&zp->z_dircache);
 	kmem_cache_free(znode_cache, zp);
 
 #ifdef __APPLE__
@@ -36,6 +36,7 @@
 #include <sys/zio_impl.h>
 #include <sys/zio_compress.h>
 #include <sys/zio_checksum.h>
+#include <sys/ddt.h>
 
 /*
  * ==========================================================================
@@ -69,6 +70,13 @@ uint64_t zio_gang_bang = SPA_MAXBLOCKSIZE + 1;
 /* Force an allocation failure when non-zero */
 uint16_t zio_zil_fail_shift = 0;
 
+/*
+ * Collect per-stage and per-vdev latency histograms (spa_lat_stat_t,
+ * vdev_lat_stat_t).  Off by default: when clear, a zio takes no
+ * timestamps at all, so the only cost is a test of io_stage_ts.
+ */
+int zio_latency_stats = 0;
+
 typedef struct zio_sync_pass {
 	int	zp_defer_free;		/* defer frees after this pass */
 	int	zp_dontcompress;	/* don't compress after this pass */
@@ -155,6 +163,9 @@ zio_init(void)
 			zio_data_buf_cache[c - 1] = zio_data_buf_cache[c];
 	}
 
+	ASSERT3U(ZIO_LAT_STAGES, ==, ZIO_STAGE_DONE + 1);
+
+	zio_compress_init();
 	zio_inject_init();
 }
 
@@ -181,6 +192,7 @@ zio_fini(void)
 
 	kmem_cache_destroy(zio_cache);
 
+	zio_compress_fini();
 	zio_inject_fini();
 }
 
@@ -296,6 +308,47 @@ zio_clear_transform_stack(zio_t *zio)
 	}
 }
 
+/*
+ * ==========================================================================
+ * Latency histograms
+ * ==========================================================================
+ */
+
+/*
+ * Count 'delta' in a log2 histogram of ZIO_LAT_BUCKETS
+ * microsecond buckets.
+ */
+static void
+zio_latency_bucket(uint64_t *buckets, hrtime_t delta)
+{
+	uint64_t us = delta / (NANOSEC / MICROSEC);
+	int b = (us == 0) ? 0 : highbit((ulong_t)us) - 1;
+
+	atomic_add_64(&buckets[MIN(b, ZIO_LAT_BUCKETS - 1)], 1);
+}
+
+void
+zio_latency_add(uint64_t *buckets, hrtime_t start)
+{
+	zio_latency_bucket(buckets, gethrtime() - start);
+}
+
+/*
+ * Charge the time spent getting through the current stage, including
+ * any wait for a taskq thread or for children, to that stage.
+ */
+static void
+zio_latency_stage(zio_t *zio)
+{
+	spa_lat_stat_t *sl = zio->io_spa->spa_lat;
+	hrtime_t now = gethrtime();
+
+	if (sl != NULL)
+		zio_latency_bucket(sl->sl_stage[zio->io_type][zio->io_stage],
+		    now - zio->io_stage_ts);
+	zio->io_stage_ts = now;
+}
+
 /*
  * ==========================================================================
  * Create the various types of I/O (read, write, free)
@@ -333,6 +386,8 @@ zio_create(zio_t *pio, spa_t *spa, uint64_t txg, blkptr_t *bp,
 	zio->io_pipeline = pipeline;
 	zio->io_async_stages = ZIO_ASYNC_PIPELINE_STAGES;
 	zio->io_timestamp = lbolt64;
+	if (zio_latency_stats)
+		zio->io_start_ts = zio->io_stage_ts = gethrtime();
 	if (pio != NULL)
 		zio->io_flags |= (pio->io_flags & ZIO_FLAG_METADATA);
 	mutex_init(&zio->io_lock, NULL, MUTEX_DEFAULT, NULL);
@@ -417,7 +472,14 @@ zio_read(zio_t *pio, spa_t *spa, blkptr_t *bp, void *data,
 {
 	zio_t *zio;
 
-	ASSERT3U(size, ==, BP_GET_LSIZE(bp));
+	/*
+	 * A raw read returns the block exactly as stored (compressed),
+	 * so the caller's buffer is sized to the physical size.
+	 */
+	if (flags & ZIO_FLAG_RAW)
+		ASSERT3U(size, ==, BP_GET_PSIZE(bp));
+	else
+		ASSERT3U(size, ==, BP_GET_LSIZE(bp));
 
 	zio = zio_create(pio, spa, bp->blk_birth, bp, data, size, done, private,
 	    ZIO_TYPE_READ, priority, flags | ZIO_FLAG_USER,
@@ -431,7 +493,8 @@ zio_read(zio_t *pio, spa_t *spa, blkptr_t *bp, void *data,
 	 */
 	zio->io_bp = &zio->io_bp_copy;
 
-	if (BP_GET_COMPRESS(bp) != ZIO_COMPRESS_OFF) {
+	if (BP_GET_COMPRESS(bp) != ZIO_COMPRESS_OFF &&
+	    !(flags & ZIO_FLAG_RAW)) {
 		uint64_t csize = BP_GET_PSIZE(bp);
 		void *cbuf = zio_buf_alloc(csize);
 
@@ -478,8 +541,15 @@ zio_write(zio_t *pio, spa_t *spa, int checksum, int compress, int ncopies,
 	zio->io_compress = compress;
 	zio->io_ndvas = ncopies;
 
-	if (compress != ZIO_COMPRESS_OFF)
-		zio->io_async_stages |= 1U << ZIO_STAGE_WRITE_COMPRESS;
+	/*
+	 * Only spa_sync()'s writes come in numbers worth spreading over
+	 * the CPU taskq, and only compressing them costs enough to pay for
+	 * the extra hand-off.  dmu_sync() and the intent log have a thread
+	 * waiting on the write, so they keep it on the issue taskq.
+	 */
+	if (compress != ZIO_COMPRESS_OFF &&
+	    priority == ZIO_PRIORITY_ASYNC_WRITE)
+		zio->io_cpu_stages = ZIO_CPU_STAGES;
 
 	if (bp->blk_birth != txg) {
 		/* XXX the bp usually (always?) gets re-zeroed later */
@@ -495,6 +565,31 @@ zio_write(zio_t *pio, spa_t *spa, int checksum, int compress, int ncopies,
 	return (zio);
 }
 
+/*
+ * Supply a precompressed image of a write zio's data.  If the block is
+ * still eligible for compression when the write reaches the compress
+ * stage, cdata is written as-is instead of compressing io_data again.
+ * The zio takes ownership of cdata, which must come from
+ * zio_buf_alloc(csize).
+ */
+void
+zio_write_set_compressed(zio_t *zio, void *cdata, uint64_t csize,
+    uint8_t compress)
+{
+	ASSERT(zio->io_type == ZIO_TYPE_WRITE);
+	ASSERT(zio->io_stage == ZIO_STAGE_OPEN);
+	ASSERT(zio->io_cdata == NULL);
+	ASSERT(compress > ZIO_COMPRESS_OFF &&
+	    compress < ZIO_COMPRESS_FUNCTIONS);
+	ASSERT(csize != 0 && csize < zio->io_size);
+	ASSERT(P2PHASE(csize, SPA_MINBLOCKSIZE) == 0);
+
+	zio->io_cdata = cdata;
+	zio->io_csize = csize;
+	zio->io_ccompress = compress;
+	zio->io_async_stages |= 1U << ZIO_STAGE_WRITE_COMPRESS;
+}
+
 zio_t *
 zio_rewrite(zio_t *pio, spa_t *spa, int checksum,
     uint64_t txg, blkptr_t *bp, void *data, uint64_t size,
@@ -553,6 +648,13 @@ zio_free(zio_t *pio, spa_t *spa, uint64_t txg, blkptr_t *bp,
 		return (zio_null(pio, spa, NULL, NULL, 0));
 	}
 
+	/*
+	 * A deduplicated block is only freed when the last block
+	 * pointer that refers to it goes away.
+	 */
+	if (BP_GET_DEDUP(bp) && ddt_free(spa, bp))
+		return (zio_null(pio, spa, done, private, 0));
+
 	zio = zio_create(pio, spa, txg, bp, NULL, 0, done, private,
 	    ZIO_TYPE_FREE, ZIO_PRIORITY_FREE, ZIO_FLAG_USER,
 	    ZIO_STAGE_OPEN, ZIO_FREE_PIPELINE);
@@ -873,6 +975,11 @@ zio_done(zio_t *zio)
 	if (vd != NULL)
 		vdev_stat_update(zio);
 
+	if (zio->io_start_ts != 0 && spa->spa_lat != NULL)
+		zio_latency_add(spa->spa_lat->sl_total[zio->io_type]
+		    [MIN(zio->io_priority, ZIO_LAT_PRIORITIES - 1)],
+		    zio->io_start_ts);
+
 	if (zio->io_error) {
 		/*
 		 * If this I/O is attached to a particular vdev,
@@ -920,6 +1027,19 @@ zio_done(zio_t *zio)
 	}
 	zio_clear_transform_stack(zio);
 
+	/*
+	 * Only enter a new dedup block in the table once it is safely
+	 * on disk; until then nobody else may share it.
+	 */
+	if ((zio->io_flags & ZIO_FLAG_DEDUP) && zio->io_error == 0 &&
+	    !BP_IS_HOLE(bp) && !BP_IS_GANG(bp) && BP_GET_DEDUP(bp))
+		ddt_add(spa, bp);
+
+	if (zio->io_cdata != NULL) {
+		zio_buf_free(zio->io_cdata, zio->io_csize);
+		zio->io_cdata = NULL;
+	}
+
 	if (zio->io_done)
 		zio->io_done(zio);
 
@@ -998,10 +1118,37 @@ zio_write_compress(zio_t *zio)
 		pass = 1;
 	}
 
-	if (compress != ZIO_COMPRESS_OFF)
-		if (!zio_compress_data(compress, zio->io_data, zio->io_size,
-		    &cbuf, &csize, &cbufsize))
+	if (zio->io_cdata != NULL) {
+		/*
+		 * The caller handed us this block already compressed.
+		 * Use it unless we've given up on compression for this
+		 * sync pass; either way the write now owns the buffer.
+		 */
+		if (pass <= zio_sync_pass.zp_dontcompress) {
+			compress = zio->io_ccompress;
+			cbuf = zio->io_cdata;
+			csize = cbufsize = zio->io_csize;
+		} else {
+			zio_buf_free(zio->io_cdata, zio->io_csize);
+		}
+		zio->io_cdata = NULL;
+	} else if (compress != ZIO_COMPRESS_OFF) {
+		/*
+		 * If this object's blocks have stopped compressing, only
+		 * look for an all-zero block (ZIO_COMPRESS_EMPTY).
+		 */
+		int cpfunc = zio_compress_backoff(zio) ?
+		    ZIO_COMPRESS_EMPTY : compress;
+
+		if (!zio_compress_data(cpfunc, zio->io_data, zio->io_size,
+		    &cbuf, &csize, &cbufsize)) {
 			compress = ZIO_COMPRESS_OFF;
+			if (cpfunc != ZIO_COMPRESS_EMPTY)
+				zio_compress_feedback(zio, B_FALSE);
+		} else if (csize != 0) {
+			zio_compress_feedback(zio, B_TRUE);
+		}
+	}
 
 	if (compress != ZIO_COMPRESS_OFF && csize != 0)
 		zio_push_transform(zio, cbuf, csize, cbufsize);
@@ -1015,7 +1162,7 @@ zio_write_compress(zio_t *zio)
 	 * There should only be a handful of blocks after pass 1 in any case.
 	 */
 	if (bp->blk_birth == zio->io_txg && BP_GET_PSIZE(bp) == csize &&
-	    pass > zio_sync_pass.zp_rewrite) {
+	    pass > zio_sync_pass.zp_rewrite && !BP_GET_DEDUP(bp)) {
 		ASSERT(csize != 0);
 		BP_SET_LSIZE(bp, lsize);
 		BP_SET_COMPRESS(bp, compress);
@@ -1267,10 +1414,11 @@ zio_write_allocate_gang_members(zio_t *zio, metaslab_class_t *mc)
 	gbps_left = SPA_GBH_NBLKPTRS;
 
 	error = metaslab_alloc(spa, mc, gsize, bp, gbh_ndvas, txg, NULL,
-	    B_FALSE);
+	    B_FALSE, B_FALSE);
 	if (error == ENOSPC)
 		panic("can't allocate gang block header");
 	ASSERT(error == 0);
+	SPA_GANGSTAT_BUMP(spa, sgs_gang_blocks);
 
 	for (d = 0; d < gbh_ndvas; d++)
 		DVA_SET_GANG(&dva[d], 1);
@@ -1291,10 +1439,11 @@ zio_write_allocate_gang_members(zio_t *zio, metaslab_class_t *mc)
 
 		ASSERT(gbps_left != 0);
 		maxalloc = MIN(maxalloc, resid);
+		SPA_GANGSTAT_BUMP(spa, sgs_gang_members);
 
 		while (resid <= maxalloc * gbps_left) {
 			error = metaslab_alloc(spa, mc, maxalloc, gbp, ndvas,
-			    txg, bp, B_FALSE);
+			    txg, bp, B_FALSE, B_FALSE);
 			if (error == 0)
 				break;
 			ASSERT3U(error, ==, ENOSPC);
@@ -1360,6 +1509,7 @@ zio_dva_allocate(zio_t *zio)
 
 	/* For testing, make some blocks above a certain size be gang blocks */
 	if (zio->io_size >= zio_gang_bang && (lbolt & 0x3ULL) == 0) {
+		SPA_GANGSTAT_BUMP(spa, sgs_gang_forced);
 		zio_write_allocate_gang_members(zio, mc);
 		return;
 	}
@@ -1367,7 +1517,7 @@ zio_dva_allocate(zio_t *zio)
 	ASSERT3U(zio->io_size, ==, BP_GET_PSIZE(bp));
 
 	error = metaslab_alloc(spa, mc, zio->io_size, bp, zio->io_ndvas,
-	    zio->io_txg, NULL, B_FALSE);
+	    zio->io_txg, NULL, B_FALSE, B_TRUE);
 
 	if (error == 0) {
 		bp->blk_birth = zio->io_txg;
@@ -1460,6 +1610,14 @@ zio_vdev_io_start(zio_t *zio)
 static void
 zio_vdev_io_done(zio_t *zio)
 {
+	/*
+	 * An injected delay or bandwidth limit holds a leaf I/O here, before
+	 * it leaves the vdev queue, so the scheduler sees a slow device.
+	 */
+	if (zio_injection_enabled && zio->io_vd != NULL &&
+	    zio->io_vd->vdev_ops->vdev_op_leaf && zio_handle_io_delay(zio))
+		return;
+
 	if (zio->io_vd == NULL)
 		/* The mirror_ops handle multiple DVAs in a single BP */
 		vdev_mirror_ops.vdev_op_io_done(zio);
@@ -1603,7 +1761,15 @@ zio_checksum_generate(zio_t *zio)
 
 	zio_checksum(checksum, &bp->blk_cksum, zio->io_data, zio->io_size);
 
-	zio_next_stage(zio);
+	/*
+	 * The dedup table lookup can block on a read of the table, so
+	 * don't do it in whatever thread got us here (spa_sync(), or a
+	 * child finishing); let the issue taskq take it.
+	 */
+	if (zio->io_flags & ZIO_FLAG_DEDUP)
+		zio_next_stage_async(zio);
+	else
+		zio_next_stage(zio);
 }
 
 static void
@@ -1658,6 +1824,30 @@ zio_set_gang_verifier(zio_t *zio, zio_cksum_t *zcp)
 	zcp->zc_word[3] = 0;
 }
 
+/*
+ * ==========================================================================
+ * Deduplication
+ * ==========================================================================
+ */
+static void
+zio_ddt_write(zio_t *zio)
+{
+	blkptr_t *bp = zio->io_bp;
+
+	/*
+	 * If an identical block is already on disk, share it and skip
+	 * straight to completion: there is nothing to allocate or write.
+	 */
+	if ((zio->io_flags & ZIO_FLAG_DEDUP) &&
+	    BP_GET_CHECKSUM(bp) == ZIO_CHECKSUM_SHA256 &&
+	    ddt_write(zio->io_spa, bp, zio->io_ndvas, zio->io_txg)) {
+		zio->io_flags &= ~ZIO_FLAG_DEDUP;
+		zio->io_pipeline = ZIO_WAIT_FOR_CHILDREN_PIPELINE;
+	}
+
+	zio_next_stage(zio);
+}
+
 /*
  * ==========================================================================
  * Define the pipeline
@@ -1676,6 +1866,7 @@ zio_pipe_stage_t *zio_pipeline[ZIO_STAGE_DONE + 2] = {
 	zio_wait_children_ready,
 	zio_write_compress,
 	zio_checksum_generate,
+	zio_ddt_write,
 	zio_gang_pipeline,
 	zio_get_gang_header,
 	zio_rewrite_gang_members,
@@ -1697,6 +1888,40 @@ zio_pipe_stage_t *zio_pipeline[ZIO_STAGE_DONE + 2] = {
 	zio_badop
 };
 
+/*
+ * A logical write runs its compress and checksum stages on the pool's
+ * CPU taskq, whichever thread advanced it there: the spa_sync() thread
+ * issuing it, or the last child to become ready.  The stages run back
+ * to back in one taskq thread, and the first stage after them, which
+ * may block on allocation, is handed to the issue taskq so that the
+ * CPU threads only ever compute.  Each zio still passes its stages in
+ * order and only becomes ready (dbuf_write_ready()) after its children
+ * have, so parents still see their children's block pointers.
+ *
+ * Returns B_TRUE if the current stage was dispatched.
+ */
+static boolean_t
+zio_cpu_dispatch(zio_t *zio)
+{
+	uint32_t stage = 1U << zio->io_stage;
+	taskq_t *tq;
+
+	if (stage & zio->io_cpu_stages) {
+		zio->io_cpu_stages = 0;
+		zio->io_cpu_taskq = B_TRUE;
+		tq = zio->io_spa->spa_zio_cpu_taskq;
+	} else if (zio->io_cpu_taskq && !(stage & ZIO_CPU_STAGES)) {
+		zio->io_cpu_taskq = B_FALSE;
+		tq = zio->io_spa->spa_zio_issue_taskq[zio->io_type];
+	} else {
+		return (B_FALSE);
+	}
+
+	(void) taskq_dispatch(tq, (task_func_t *)zio_pipeline[zio->io_stage],
+	    zio, TQ_SLEEP);
+	return (B_TRUE);
+}
+
 /*
  * Move an I/O to the next stage of the pipeline and execute that stage.
  * There's no locking on io_stage because there's no legitimate way for
@@ -1717,24 +1942,17 @@ zio_next_stage(zio_t *zio)
 			pipeline &= ZIO_ERROR_PIPELINE_MASK;
 	}
 
+	if (zio->io_stage_ts != 0)
+		zio_latency_stage(zio);
+
 	while (((1U << ++zio->io_stage) & pipeline) == 0)
 		continue;
 
 	ASSERT(zio->io_stage <= ZIO_STAGE_DONE);
 	ASSERT(zio->io_stalled == 0);
 
-	/*
-	 * See the comment in zio_next_stage_async() about per-CPU taskqs.
-	 */
-	if (((1U << zio->io_stage) & zio->io_async_stages) &&
-	    (zio->io_stage == ZIO_STAGE_WRITE_COMPRESS) &&
-	    !(zio->io_flags & ZIO_FLAG_METADATA)) {
-		taskq_t *tq = zio->io_spa->spa_zio_issue_taskq[zio->io_type];
-		(void) taskq_dispatch(tq,
-		    (task_func_t *)zio_pipeline[zio->io_stage], zio, TQ_SLEEP);
-	} else {
+	if (!zio_cpu_dispatch(zio))
 		zio_pipeline[zio->io_stage](zio);
-	}
 }
 
 void
@@ -1753,6 +1971,9 @@ zio_next_stage_async(zio_t *zio)
 			pipeline &= ZIO_ERROR_PIPELINE_MASK;
 	}
 
+	if (zio->io_stage_ts != 0)
+		zio_latency_stage(zio);
+
 	while (((1U << ++zio->io_stage) & pipeline) == 0)
 		continue;
 
@@ -1774,6 +1995,9 @@ zio_next_stage_async(zio_t *zio)
 	 * there won't be any threads available to service I/O completion
 	 * interrupts.
 	 */
+	if (zio_cpu_dispatch(zio))
+		return;
+
 	if ((1U << zio->io_stage) & zio->io_async_stages) {
 		if (zio->io_stage < ZIO_STAGE_VDEV_IO_DONE)
 			tq = zio->io_spa->spa_zio_issue_taskq[zio->io_type];
@@ -1815,11 +2039,11 @@ zio_alloc_blk(spa_t *spa, uint64_t size, blkptr_t *new_bp, blkptr_t *old_bp,
 	 * We use that as a hint for which vdev to allocate from next.
 	 */
 	error = metaslab_alloc(spa, spa->spa_log_class, size,
-	    new_bp, 1, txg, old_bp, B_TRUE);
+	    new_bp, 1, txg, old_bp, B_TRUE, B_FALSE);
 
 	if (error)
 		error = metaslab_alloc(spa, spa->spa_normal_class, size,
-		    new_bp, 1, txg, old_bp, B_TRUE);
+		    new_bp, 1, txg, old_bp, B_TRUE, B_FALSE);
 
 	if (error == 0) {
 		BP_SET_LSIZE(new_bp, size);
@@ -31,6 +31,7 @@
 #include <sys/spa.h>
 #include <sys/zio.h>
 #include <sys/zio_compress.h>
+#include <sys/kstat.h>
 
 /*
  * Compression vectors.
@@ -53,6 +54,217 @@ zio_compress_info_t zio_compress_table[ZIO_COMPRESS_FUNCTIONS] = {
 	{gzip_compress,		gzip_decompress,	9,	"gzip-9"},
 };
 
+/*
+ * Early abort.  Before running the real compressor on a block of at
+ * least zio_compress_probe_min bytes, a ZIO_COMPRESS_PROBE_SIZE sample
+ * from the middle of it is checked two ways.  Its byte histogram must
+ * look close to uniform (an effective alphabet of more than
+ * ZIO_COMPRESS_PROBE_ALPHABET symbols, so gzip's Huffman stage has
+ * nothing to work with), and lzjb must fail to save 1/16th of it (so
+ * there are no repeats for the LZ stage either).  If both hold, the
+ * block is taken to be incompressible (media, archives, encrypted
+ * backups) and is written as-is without paying for the compressor,
+ * gzip in particular.
+ *
+ * On top of that, an object whose blocks fail to compress
+ * zio_compress_backoff_failures times in a row has its next
+ * zio_compress_backoff_blocks blocks written uncompressed without even
+ * a probe.  The failures are remembered in a small hash table keyed by
+ * pool, objset and object; collisions just cost an extra probe.
+ */
+#define	ZIO_COMPRESS_PROBE_SIZE		4096
+#define	ZIO_COMPRESS_PROBE_ALPHABET	200
+#define	ZIO_COMPRESS_BACKOFF_BUCKETS	256
+
+int zio_compress_probe = 1;
+uint64_t zio_compress_probe_min = 16384;
+int zio_compress_backoff_failures = 4;
+int zio_compress_backoff_blocks = 64;
+
+typedef struct zio_compress_backoff {
+	spa_t		*zcb_spa;
+	uint64_t	zcb_objset;
+	uint64_t	zcb_object;
+	int		zcb_failures;	/* in a row */
+	int		zcb_skip;	/* blocks left to write as-is */
+} zio_compress_backoff_t;
+
+static zio_compress_backoff_t zio_compress_backoff_table[
+    ZIO_COMPRESS_BACKOFF_BUCKETS];
+static kmutex_t zio_compress_backoff_lock;
+
+typedef struct zio_compress_stats {
+	kstat_named_t zcstat_probes;
+	kstat_named_t zcstat_probe_aborts;
+	kstat_named_t zcstat_backoff_skips;
+	kstat_named_t zcstat_failures;
+	kstat_named_t zcstat_skipped_bytes;
+	kstat_named_t zcstat_saved_bytes;
+} zio_compress_stats_t;
+
+static zio_compress_stats_t zio_compress_stats = {
+	{ "probes",			KSTAT_DATA_UINT64 },
+	{ "probe_aborts",		KSTAT_DATA_UINT64 },
+	{ "backoff_skips",		KSTAT_DATA_UINT64 },
+	{ "failures",			KSTAT_DATA_UINT64 },
+	{ "skipped_bytes",		KSTAT_DATA_UINT64 },
+	{ "saved_bytes",		KSTAT_DATA_UINT64 }
+};
+
+#define	ZCSTAT(stat)		(zio_compress_stats.stat.value.ui64)
+#define	ZCSTAT_INCR(stat, val) \
+	atomic_add_64(&zio_compress_stats.stat.value.ui64, (val));
+#define	ZCSTAT_BUMP(stat)	ZCSTAT_INCR(stat, 1)
+
+static kstat_t *zio_compress_ksp;
+
+void
+zio_compress_init(void)
+{
+	mutex_init(&zio_compress_backoff_lock, NULL, MUTEX_DEFAULT, NULL);
+
+	zio_compress_ksp = kstat_create("zfs", 0, "zcompstats", "misc",
+	    KSTAT_TYPE_NAMED, sizeof (zio_compress_stats) /
+	    sizeof (kstat_named_t), KSTAT_FLAG_VIRTUAL);
+	if (zio_compress_ksp != NULL) {
+		zio_compress_ksp->ks_data = &zio_compress_stats;
+		kstat_install(zio_compress_ksp);
+	}
+}
+
+void
+zio_compress_fini(void)
+{
+	if (zio_compress_ksp != NULL) {
+		kstat_delete(zio_compress_ksp);
+		zio_compress_ksp = NULL;
+	}
+
+	mutex_destroy(&zio_compress_backoff_lock);
+}
+
+static zio_compress_backoff_t *
+zio_compress_backoff_bucket(zio_t *zio)
+{
+	uint64_t h = (uintptr_t)zio->io_spa ^ zio->io_bookmark.zb_objset ^
+	    (zio->io_bookmark.zb_object * 0x9e3779b97f4a7c15ULL);
+
+	return (&zio_compress_backoff_table[(h >> 32) &
+	    (ZIO_COMPRESS_BACKOFF_BUCKETS - 1)]);
+}
+
+/*
+ * Returns B_TRUE if the block zio is writing should be stored without
+ * trying to compress it, because its object's recent blocks didn't
+ * compress.
+ */
+boolean_t
+zio_compress_backoff(zio_t *zio)
+{
+	zio_compress_backoff_t *zcb;
+	boolean_t skip = B_FALSE;
+
+	if (zio_compress_backoff_blocks == 0)
+		return (B_FALSE);
+
+	zcb = zio_compress_backoff_bucket(zio);
+	mutex_enter(&zio_compress_backoff_lock);
+	if (zcb->zcb_spa == zio->io_spa &&
+	    zcb->zcb_objset == zio->io_bookmark.zb_objset &&
+	    zcb->zcb_object == zio->io_bookmark.zb_object &&
+	    zcb->zcb_skip != 0) {
+		zcb->zcb_skip--;
+		skip = B_TRUE;
+	}
+	mutex_exit(&zio_compress_backoff_lock);
+
+	if (skip) {
+		ZCSTAT_BUMP(zcstat_backoff_skips);
+		ZCSTAT_INCR(zcstat_skipped_bytes, zio->io_size);
+	}
+	return (skip);
+}
+
+/*
+ * Record whether the block zio is writing compressed.
+ */
+void
+zio_compress_feedback(zio_t *zio, boolean_t compressed)
+{
+	zio_compress_backoff_t *zcb = zio_compress_backoff_bucket(zio);
+
+	mutex_enter(&zio_compress_backoff_lock);
+	if (zcb->zcb_spa != zio->io_spa ||
+	    zcb->zcb_objset != zio->io_bookmark.zb_objset ||
+	    zcb->zcb_object != zio->io_bookmark.zb_object) {
+		if (compressed) {
+			mutex_exit(&zio_compress_backoff_lock);
+			return;
+		}
+		zcb->zcb_spa = zio->io_spa;
+		zcb->zcb_objset = zio->io_bookmark.zb_objset;
+		zcb->zcb_object = zio->io_bookmark.zb_object;
+		zcb->zcb_failures = 0;
+		zcb->zcb_skip = 0;
+	}
+	if (compressed) {
+		zcb->zcb_failures = 0;
+	} else if (++zcb->zcb_failures >= zio_compress_backoff_failures) {
+		zcb->zcb_failures = 0;
+		zcb->zcb_skip = zio_compress_backoff_blocks;
+	}
+	mutex_exit(&zio_compress_backoff_lock);
+}
+
+/*
+ * Returns B_FALSE if a sample of the block shows it isn't worth
+ * compressing.
+ */
+static boolean_t
+zio_compress_probe_data(void *src, uint64_t srcsize)
+{
+	uint64_t len = ZIO_COMPRESS_PROBE_SIZE;
+	uint64_t dlen = len - (len >> 4);
+	uchar_t *sample = (uchar_t *)src + P2ALIGN((srcsize - len) / 2, 8);
+	uint16_t count[256];
+	uint64_t sumsq = 0;
+	void *dest;
+	size_t clen;
+	int i;
+
+	ZCSTAT_BUMP(zcstat_probes);
+
+	/*
+	 * len^2 / sum(count^2) is the number of equally likely symbols
+	 * that would give the same chance of two bytes matching.
+	 */
+	bzero(count, sizeof (count));
+	for (i = 0; i < len; i++)
+		count[sample[i]]++;
+	for (i = 0; i < 256; i++)
+		sumsq += count[i] * count[i];
+	if (sumsq * ZIO_COMPRESS_PROBE_ALPHABET >= len * len)
+		return (B_TRUE);
+
+	dest = zio_buf_alloc(len);
+	clen = lzjb_compress(sample, dest, len, dlen, 0);
+	zio_buf_free(dest, len);
+
+	if (clen > dlen) {
+		ZCSTAT_BUMP(zcstat_probe_aborts);
+		ZCSTAT_INCR(zcstat_skipped_bytes, srcsize);
+		return (B_FALSE);
+	}
+	return (B_TRUE);
+}
+
+void
+zio_compress_get_stats(uint64_t *skipped, uint64_t *saved)
+{
+	*skipped = ZCSTAT(zcstat_skipped_bytes);
+	*saved = ZCSTAT(zcstat_saved_bytes);
+}
+
 uint8_t
 zio_compress_select(uint8_t child, uint8_t parent)
 {
@@ -109,12 +321,19 @@ zio_compress_data(int cpfunc, void *src, uint64_t srcsize, void **destp,
 	destbufsize = P2ALIGN(srcsize - (srcsize >> 3), SPA_MINBLOCKSIZE);
 	if (destbufsize == 0)
 		return (0);
+
+	if (zio_compress_probe && srcsize >= zio_compress_probe_min &&
+	    srcsize >= ZIO_COMPRESS_PROBE_SIZE &&
+	    !zio_compress_probe_data(src, srcsize))
+		return (0);
+
 	dest = zio_buf_alloc(destbufsize);
 
 	ciosize = ci->ci_compress(src, dest, (size_t)srcsize,
 	    (size_t)destbufsize, ci->ci_level);
 	if (ciosize > destbufsize) {
 		zio_buf_free(dest, destbufsize);
+		ZCSTAT_BUMP(zcstat_failures);
 		return (0);
 	}
 
@@ -129,6 +348,7 @@ zio_compress_data(int cpfunc, void *src, uint64_t srcsize, void **destp,
 
 	ASSERT3U(ciosize, <=, destbufsize);
 	ASSERT(P2PHASE(ciosize, SPA_MINBLOCKSIZE) == 0);
+	ZCSTAT_INCR(zcstat_saved_bytes, srcsize - ciosize);
 	*destp = dest;
 	*destsizep = ciosize;
 	*destbufsizep = destbufsize;
@@ -38,6 +38,13 @@
  * means that the error is destined for a particular device, not a piece of
  * data.
  *
+ * Besides errors, a device can be given extra latency or a bandwidth limit
+ * (zi_cmd).  Leaf I/O to it is then held in zio_vdev_io_done(), before it
+ * leaves the vdev queue, until its injected completion time: the I/O sits
+ * on inject_delay_list and the delay thread hands it back to the interrupt
+ * taskq, so no taskq thread sleeps on behalf of the sick device.  Waits are
+ * rounded up to clock ticks.
+ *
  * This is a rather poor data structure and algorithm, but we don't expect more
  * than a few faults at any one time, so it should be sufficient for our needs.
  */
@@ -55,12 +62,20 @@ typedef struct inject_handler {
 	spa_t			*zi_spa;
 	zinject_record_t	zi_record;
 	list_node_t		zi_link;
+	kmutex_t		zi_lock;	/* protects zi_busy_until */
+	hrtime_t		zi_busy_until;	/* BANDWIDTH: device busy */
 } inject_handler_t;
 
 static list_t inject_handlers;
 static krwlock_t inject_lock;
 static int inject_next_id = 1;
 
+static list_t inject_delay_list;	/* delayed zios, by io_delay_target */
+static kmutex_t inject_delay_lock;
+static kcondvar_t inject_delay_cv;
+static kthread_t *inject_delay_thread;
+static boolean_t inject_delay_exit;
+
 /*
  * Returns true if the given record matches the I/O in progress.
  */
@@ -127,8 +142,9 @@ zio_handle_fault_injection(zio_t *zio, int error)
 		if (zio->io_spa != handler->zi_spa)
 			continue;
 
-		/* Ignore device errors */
-		if (handler->zi_record.zi_guid != 0)
+		/* Ignore device errors, delays and bandwidth limits */
+		if (handler->zi_record.zi_guid != 0 ||
+		    handler->zi_record.zi_cmd != ZINJECT_CMD_ERROR)
 			continue;
 
 		/* If this handler matches, return EIO */
@@ -156,6 +172,9 @@ zio_handle_device_injection(vdev_t *vd, int error)
 	for (handler = list_head(&inject_handlers); handler != NULL;
 	    handler = list_next(&inject_handlers, handler)) {
 
+		if (handler->zi_record.zi_cmd != ZINJECT_CMD_ERROR)
+			continue;
+
 		if (vd->vdev_guid == handler->zi_record.zi_guid) {
 			if (handler->zi_record.zi_error == error) {
 				/*
@@ -180,6 +199,151 @@ zio_handle_device_injection(vdev_t *vd, int error)
 	return (ret);
 }
 
+/*
+ * Draw the latency to add to one I/O.  The exponential draw is
+ * -ln(u) * mean for u uniform on (0, 1], with log2(1/u) taken from the
+ * position of the leading one bit of a 31-bit draw and a linear fraction
+ * below it, which is within 9% of the true logarithm.
+ */
+static uint64_t
+zio_inject_delay_sample(zinject_record_t *record)
+{
+	uint64_t spread = record->zi_timer_spread;
+	uint64_t r, log2inv;
+	int h;
+
+	if (spread == 0)
+		return (record->zi_timer);
+
+	switch (record->zi_dist) {
+	case ZINJECT_DIST_UNIFORM:
+		return (record->zi_timer + spa_get_random(spread));
+
+	case ZINJECT_DIST_EXPONENTIAL:
+		r = spa_get_random(1ULL << 31) + 1;
+		h = highbit((ulong_t)r) - 1;
+		/* log2(2^31 / r) in 1/1024ths */
+		log2inv = ((31 - h) << 10) -
+		    (((r - (1ULL << h)) << 10) >> h);
+		/* ln 2 is 710/1024 */
+		return (record->zi_timer +
+		    spread * log2inv / 1024 * 710 / 1024);
+
+	default:
+		return (record->zi_timer);
+	}
+}
+
+/*
+ * If the device under a leaf I/O has an injected delay or bandwidth limit,
+ * park the I/O on the delay list until its time comes and return B_TRUE;
+ * the delay thread then finishes it with vdev_io_done().  The longest of
+ * several matching records wins.
+ */
+boolean_t
+zio_handle_io_delay(zio_t *zio)
+{
+	vdev_t *vd = zio->io_vd;
+	inject_handler_t *handler;
+	zinject_record_t *record;
+	hrtime_t now, start, target = 0;
+	zio_t *prev;
+
+	if (zio->io_type != ZIO_TYPE_READ && zio->io_type != ZIO_TYPE_WRITE)
+		return (B_FALSE);
+
+	now = gethrtime();
+
+	rw_enter(&inject_lock, RW_READER);
+
+	for (handler = list_head(&inject_handlers); handler != NULL;
+	    handler = list_next(&inject_handlers, handler)) {
+		record = &handler->zi_record;
+
+		if (record->zi_cmd == ZINJECT_CMD_ERROR ||
+		    record->zi_guid != vd->vdev_guid)
+			continue;
+
+		if (record->zi_freq != 0 &&
+		    spa_get_random(100) >= record->zi_freq)
+			continue;
+
+		if (record->zi_cmd == ZINJECT_CMD_DELAY_IO) {
+			target = MAX(target,
+			    now + zio_inject_delay_sample(record));
+		} else {
+			/*
+			 * The device serves one I/O at a time at the given
+			 * rate, so a burst queues up behind the last one.
+			 */
+			mutex_enter(&handler->zi_lock);
+			start = MAX(now, handler->zi_busy_until);
+			handler->zi_busy_until = start +
+			    zio->io_size * NANOSEC / record->zi_bandwidth;
+			target = MAX(target, handler->zi_busy_until);
+			mutex_exit(&handler->zi_lock);
+		}
+	}
+
+	rw_exit(&inject_lock);
+
+	if (target <= now)
+		return (B_FALSE);
+
+	zio->io_delay_target = target;
+
+	mutex_enter(&inject_delay_lock);
+	for (prev = list_tail(&inject_delay_list); prev != NULL;
+	    prev = list_prev(&inject_delay_list, prev))
+		if (prev->io_delay_target <= target)
+			break;
+	if (prev == NULL) {
+		list_insert_head(&inject_delay_list, zio);
+		cv_signal(&inject_delay_cv);
+	} else {
+		list_insert_after(&inject_delay_list, prev, zio);
+	}
+	mutex_exit(&inject_delay_lock);
+
+	return (B_TRUE);
+}
+
+/* ARGSUSED */
+static void
+zio_inject_delay_thread(void *arg)
+{
+	zio_t *zio;
+	hrtime_t now;
+
+	mutex_enter(&inject_delay_lock);
+	while (!inject_delay_exit) {
+		if ((zio = list_head(&inject_delay_list)) == NULL) {
+			cv_wait(&inject_delay_cv, &inject_delay_lock);
+			continue;
+		}
+
+		now = gethrtime();
+		if (zio->io_delay_target > now) {
+			(void) cv_timedwait(&inject_delay_cv,
+			    &inject_delay_lock, lbolt +
+			    (zio->io_delay_target - now) * hz / NANOSEC + 1);
+			continue;
+		}
+
+		list_remove(&inject_delay_list, zio);
+		mutex_exit(&inject_delay_lock);
+		(void) taskq_dispatch(zio->io_spa->spa_zio_intr_taskq[
+		    zio->io_type], (task_func_t *)vdev_io_done, zio, TQ_SLEEP);
+		mutex_enter(&inject_delay_lock);
+	}
+
+	ASSERT(list_is_empty(&inject_delay_list));
+	inject_delay_thread = NULL;
+	cv_broadcast(&inject_delay_cv);
+	mutex_exit(&inject_delay_lock);
+	thread_exit();
+}
+
 /*
  * Create a new handler for the given record.  We add it to the list, adding
  * a reference to the spa_t in the process.  We increment zio_injection_enabled,
@@ -201,6 +365,22 @@ zio_inject_fault(char *name, int flags, int *id, zinject_record_t *record)
 		if ((error = spa_reset(name)) != 0)
 			return (error);
 
+	switch (record->zi_cmd) {
+	case ZINJECT_CMD_ERROR:
+		break;
+	case ZINJECT_CMD_DELAY_IO:
+		if (record->zi_guid == 0 ||
+		    record->zi_dist > ZINJECT_DIST_EXPONENTIAL)
+			return (EINVAL);
+		break;
+	case ZINJECT_CMD_BANDWIDTH:
+		if (record->zi_guid == 0 || record->zi_bandwidth == 0)
+			return (EINVAL);
+		break;
+	default:
+		return (EINVAL);
+	}
+
 	if (!(flags & ZINJECT_NULL)) {
 		/*
 		 * spa_inject_ref() will add an injection reference, which will
@@ -217,6 +397,8 @@ zio_inject_fault(char *name, int flags, int *id, zinject_record_t *record)
 		*id = handler->zi_id = inject_next_id++;
 		handler->zi_spa = spa;
 		handler->zi_record = *record;
+		mutex_init(&handler->zi_lock, NULL, MUTEX_DEFAULT, NULL);
+		handler->zi_busy_until = 0;
 		list_insert_tail(&inject_handlers, handler);
 		atomic_add_32(&zio_injection_enabled, 1);
 
@@ -291,6 +473,7 @@ zio_clear_fault(int id)
 	} else {
 		list_remove(&inject_handlers, handler);
 		spa_inject_delref(handler->zi_spa);
+		mutex_destroy(&handler->zi_lock);
 		kmem_free(handler, sizeof (inject_handler_t));
 		atomic_add_32(&zio_injection_enabled, -1);
 		ret = 0;
@@ -306,10 +489,29 @@ zio_inject_init(void)
 {
 	list_create(&inject_handlers, sizeof (inject_handler_t),
 	    offsetof(inject_handler_t, zi_link));
+
+	list_create(&inject_delay_list, sizeof (zio_t),
+	    offsetof(zio_t, io_delay_node));
+	mutex_init(&inject_delay_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&inject_delay_cv, NULL, CV_DEFAULT, NULL);
+	inject_delay_exit = B_FALSE;
+	inject_delay_thread = thread_create(NULL, 0, zio_inject_delay_thread,
+	    NULL, 0, &p0, TS_RUN, maxclsyspri);
 }
 
 void
 zio_inject_fini(void)
 {
+	mutex_enter(&inject_delay_lock);
+	inject_delay_exit = B_TRUE;
+	cv_broadcast(&inject_delay_cv);
+	while (inject_delay_thread != NULL)
+		cv_wait(&inject_delay_cv, &inject_delay_lock);
+	mutex_exit(&inject_delay_lock);
+
+	cv_destroy(&inject_delay_cv);
+	mutex_destroy(&inject_delay_lock);
+	list_destroy(&inject_delay_list);
+
 	list_destroy(&inject_handlers);
 }
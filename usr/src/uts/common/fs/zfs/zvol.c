@@ -74,12 +74,10 @@
 #include <sys/refcount.h>
 #include <sys/zfs_znode.h>
 #include <sys/zfs_rlock.h>
+#include <sys/zvol.h>
 
 #include "zfs_namecheck.h"
 
-#define	ZVOL_OBJ		1ULL
-#define	ZVOL_ZAP_OBJ		2ULL
-
 static void *zvol_state;
 
 /*
@@ -462,8 +460,12 @@ zvol_create_minor(const char *name, major_t maj)
 	zv->zv_mode = ds_mode;
 	zv->zv_zilog = zil_open(os, zvol_get_data);
 	mutex_init(&zv->zv_znode.z_range_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&zv->zv_znode.z_range_cv, NULL, CV_DEFAULT, NULL);
 	avl_create(&zv->zv_znode.z_range_avl, zfs_range_compare,
 	    sizeof (rl_t), offsetof(rl_t, r_node));
+	bzero((void *)zv->zv_znode.z_range_fast,
+	    sizeof (zv->zv_znode.z_range_fast));
+	zv->zv_znode.z_range_writers = 0;
 
 
 	/* get and cache the blocksize */
@@ -524,6 +526,7 @@ zvol_remove_minor(const char *name)
 	dmu_objset_close(zv->zv_objset);
 	zv->zv_objset = NULL;
 	avl_destroy(&zv->zv_znode.z_range_avl);
+	cv_destroy(&zv->zv_znode.z_range_cv);
 	mutex_destroy(&zv->zv_znode.z_range_lock);
 
 #ifndef __APPLE__
@@ -772,7 +775,13 @@ zvol_get_data(void *arg, lr_write_t *lr, char *buf, zio_t *zio)
 	    RL_READER);
 	zgd->zgd_rl = rl;
 
-	VERIFY(0 == dmu_buf_hold(os, ZVOL_OBJ, lr->lr_offset, zgd, &db));
+	error = dmu_buf_hold(os, ZVOL_OBJ, lr->lr_offset, zgd, &db);
+	if (error) {
+		zfs_range_unlock(rl);
+		kmem_free(zgd, sizeof (zgd_t));
+		return (error);
+	}
+	/* the hold merged any deferred partial fill; see dmu_sync() */
 	error = dmu_sync(zio, db, &lr->lr_blkptr,
 	    lr->lr_common.lrc_txg, zvol_get_done, zgd);
 	if (error == 0)
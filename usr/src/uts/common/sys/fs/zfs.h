@@ -107,6 +107,9 @@ typedef enum {
 	ZFS_PROP_VERSION,
 	ZPOOL_PROP_NAME,
 	ZPOOL_PROP_ASHIFT,
+	ZFS_PROP_RECEIVE_RESUME_TOKEN,
+	ZPOOL_PROP_FREEING,
+	ZFS_PROP_DEDUP,
 	ZFS_NUM_PROPS
 } zfs_prop_t;
 
@@ -190,13 +193,15 @@ extern zpool_prop_t zpool_prop_iter(zpool_prop_f, void *);
 #define	SPA_VERSION_6			6ULL
 #define	SPA_VERSION_7			7ULL
 #define	SPA_VERSION_8			8ULL
+#define	SPA_VERSION_9			9ULL
+#define	SPA_VERSION_10			10ULL
 /*
  * When bumping up SPA_VERSION, make sure GRUB ZFS understand the on-disk
  * format change. Go to usr/src/grub/grub-0.95/stage2/{zfs-include/, fsys_zfs*},
  * and do the appropriate changes.
  */
-#define	SPA_VERSION			SPA_VERSION_8
-#define	SPA_VERSION_STRING		"8"
+#define	SPA_VERSION			SPA_VERSION_10
+#define	SPA_VERSION_STRING		"10"
 
 /*
  * Symbolic names for the changes that caused a SPA_VERSION switch.
@@ -221,6 +226,8 @@ extern zpool_prop_t zpool_prop_iter(zpool_prop_f, void *);
 #define	SPA_VERSION_BOOTFS		SPA_VERSION_6
 #define	ZFS_VERSION_SLOGS		SPA_VERSION_7
 #define	ZFS_VERSION_DELEGATED_PERMS	SPA_VERSION_8
+#define	SPA_VERSION_FREE_PENDING	SPA_VERSION_9
+#define	SPA_VERSION_DEDUP		SPA_VERSION_10
 
 /*
  * ZPL version - rev'd whenever an incompatible on-disk format change
@@ -274,6 +281,9 @@ extern zpool_prop_t zpool_prop_iter(zpool_prop_f, void *);
 #define	ZPOOL_CONFIG_UNSPARE		"unspare"
 #define	ZPOOL_CONFIG_PHYS_PATH		"phys_path"
 #define	ZPOOL_CONFIG_IS_LOG		"is_log"
+/* Latency histograms, not stored on disk */
+#define	ZPOOL_CONFIG_VDEV_LATENCY	"vdev_latency"
+#define	ZPOOL_CONFIG_POOL_LATENCY	"pool_latency"
 /*
  * The persistent vdev state is stored as separate values rather than a single
  * 'vdev_state' entry.  This is because a device can be in multiple states, such
@@ -414,6 +424,26 @@ typedef struct vdev_stat {
 	uint64_t	vs_scrub_end;		/* UTC scrub end time	*/
 } vdev_stat_t;
 
+/*
+ * Latency histograms, kept only while zio_latency_stats is set.  Bucket n
+ * counts I/Os that took [2^n, 2^(n+1)) microseconds; the last bucket
+ * also takes everything slower.  Stages are indexed by zio_stage_t, and
+ * the total time from creation to zio_done() by zio priority.
+ */
+#define	ZIO_LAT_BUCKETS		24
+#define	ZIO_LAT_STAGES		23
+#define	ZIO_LAT_PRIORITIES	32
+
+typedef struct vdev_lat_stat {
+	uint64_t	vl_queue[ZIO_TYPES][ZIO_LAT_BUCKETS];	/* queued */
+	uint64_t	vl_disk[ZIO_TYPES][ZIO_LAT_BUCKETS];	/* issued */
+} vdev_lat_stat_t;
+
+typedef struct spa_lat_stat {
+	uint64_t sl_stage[ZIO_TYPES][ZIO_LAT_STAGES][ZIO_LAT_BUCKETS];
+	uint64_t sl_total[ZIO_TYPES][ZIO_LAT_PRIORITIES][ZIO_LAT_BUCKETS];
+} spa_lat_stat_t;
+
 #define	ZFS_DRIVER	"zfs"
 #define	ZFS_DEV		"/dev/zfs"
 